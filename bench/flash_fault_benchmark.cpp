@@ -0,0 +1,152 @@
+#include "Schmi/binary_file_std.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/fault_injecting_serial.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/parse_number.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Flashes an image into the bootloader emulator through a FaultInjectingSerial for a range of
+// fault rates and reports what the noise costs. Time is simulated, so the whole sweep runs in
+// seconds while reporting wire time at 115200 baud.
+//
+// Recovery is what Schmi does today: any failure aborts the session and the board is reset and
+// flashed again from scratch, up to MAX_ATTEMPTS times.
+//
+// usage: flash_fault_benchmark [binary_file] [seed]
+
+namespace {
+
+const uint32_t MAX_ATTEMPTS = 20;
+const uint32_t SESSIONS_PER_RATE = 10;
+
+// Per byte rate on the wire. Per call faults (NACK, partial read, stalled write) use the same rate
+// scaled by CALL_RATE_FACTOR, roughly the size of an average protocol message.
+const double FAULT_RATES[] = {0.0, 1e-6, 3e-6, 1e-5, 3e-5, 1e-4};
+const double CALL_RATE_FACTOR = 10.0;
+
+struct RateResult {
+  uint32_t sessions_ok;
+  uint32_t attempts;
+  uint64_t flash_time_us;
+  uint64_t injected_delay_us;
+  uint32_t faults;
+};
+
+Schmi::FaultConfig MakeFaultConfig(const double& rate, const uint32_t& seed) {
+  Schmi::FaultConfig config;
+  config.seed = seed;
+  config.latency_jitter_us = 200;
+  config.drop_byte_rate = rate;
+  config.corrupt_byte_rate = rate;
+  config.spurious_nack_rate = rate * CALL_RATE_FACTOR;
+  config.partial_read_rate = rate * CALL_RATE_FACTOR;
+  config.stall_write_rate = rate * CALL_RATE_FACTOR;
+
+  return config;
+}
+
+bool FlashMatchesImage(Schmi::Stm32Emulator& emulator, Schmi::BinaryFileStd& bin) {
+  uint64_t size = bin.GetBinaryFileSize();
+  uint8_t buffer[256];
+  for (uint64_t pos = 0; pos < size; pos += sizeof(buffer)) {
+    uint32_t num_bytes = size - pos < sizeof(buffer) ? size - pos : sizeof(buffer);
+    bin.GetBytesArray(buffer, {num_bytes, (uint32_t)pos});
+    if (memcmp(buffer, emulator.GetFlash() + pos, num_bytes) != 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+RateResult RunRate(const double& rate, const uint32_t& seed, Schmi::BinaryFileStd& bin) {
+  RateResult result = {0, 0, 0, 0, 0};
+
+  for (uint32_t session = 0; session < SESSIONS_PER_RATE; session++) {
+    Schmi::SimClock clock;
+    Schmi::Stm32Emulator emulator(clock);
+    Schmi::FaultInjectingSerial ser(emulator, clock, MakeFaultConfig(rate, seed + session));
+    Schmi::ErrorHandlerCapture error;
+    Schmi::LoadingBarNull bar;
+    Schmi::FlashLoader fl(&ser, &bin, &error, &bar);
+
+    // Boards come with some other firmware on them
+    emulator.FillFlash(0x00);
+    fl.Init();
+
+    for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+      result.attempts++;
+      emulator.Reset();
+      error.Reset();
+
+      if (fl.Flash(true, false) && FlashMatchesImage(emulator, bin)) {
+        result.sessions_ok++;
+        break;
+      }
+    }
+
+    const Schmi::FaultStats& faults = ser.GetStats();
+    result.flash_time_us += clock.NowUs();
+    result.injected_delay_us += faults.injected_delay_us;
+    result.faults += faults.dropped_bytes + faults.corrupted_bytes + faults.spurious_nacks +
+                     faults.partial_reads + faults.stalled_writes;
+  }
+
+  return result;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string binary_file = "../test_files/1048583_V6-3.bin";
+  uint32_t seed = 1;
+  if (argc > 1) binary_file = argv[1];
+  uint64_t seed_arg = seed;
+  if (argc > 2 && !Schmi::ParseNumber(argv[2], seed_arg, UINT32_MAX)) {
+    std::cerr << "usage: flash_fault_benchmark [binary_file] [seed]\n";
+    return 1;
+  }
+  seed = seed_arg;
+
+  Schmi::BinaryFileStd bin(binary_file);
+  bin.Init();
+  uint64_t image_size = bin.GetBinaryFileSize();
+
+  std::cout << "Image: " << binary_file << " (" << image_size << " bytes), ";
+  std::cout << SESSIONS_PER_RATE << " sessions per rate, max " << MAX_ATTEMPTS << " attempts\n\n";
+
+  std::cout << std::setw(10) << "rate" << std::setw(10) << "ok" << std::setw(12) << "attempts";
+  std::cout << std::setw(14) << "flash_s" << std::setw(14) << "bytes/s" << std::setw(12) << "faults";
+  std::cout << std::setw(14) << "delay_s" << "\n";
+
+  double baseline_bytes_per_s = 0;
+  for (const double& rate : FAULT_RATES) {
+    RateResult result = RunRate(rate, seed, bin);
+
+    double flash_s = result.flash_time_us / 1e6 / SESSIONS_PER_RATE;
+    double bytes_per_s = result.sessions_ok ? image_size * result.sessions_ok / (result.flash_time_us / 1e6) : 0;
+    if (rate == 0.0) baseline_bytes_per_s = bytes_per_s;
+
+    std::cout << std::setw(10) << rate;
+    std::cout << std::setw(7) << result.sessions_ok << "/" << std::setw(2) << SESSIONS_PER_RATE;
+    std::cout << std::setw(12) << std::fixed << std::setprecision(2)
+              << (double)result.attempts / SESSIONS_PER_RATE;
+    std::cout << std::setw(14) << std::setprecision(3) << flash_s;
+    std::cout << std::setw(14) << std::setprecision(0) << bytes_per_s;
+    std::cout << std::setw(12) << result.faults / SESSIONS_PER_RATE;
+    std::cout << std::setw(14) << std::setprecision(3) << result.injected_delay_us / 1e6 / SESSIONS_PER_RATE;
+    if (baseline_bytes_per_s > 0) {
+      std::cout << "  (" << std::setprecision(1) << 100.0 * bytes_per_s / baseline_bytes_per_s << "%)";
+    }
+    std::cout << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+
+  return EXIT_SUCCESS;
+}
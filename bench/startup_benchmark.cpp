@@ -0,0 +1,143 @@
+#include "Schmi/binary_file_std.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/parse_number.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Time from FlashLoader::Init to the first WRITE_MEMORY, with the image loaded up front by
+// BinaryFileStd::Init or in the background while the port syncs and the chip is erased.
+//
+// This one runs in real time: the emulator sleeps on a ClockStd and the image is a real file, its
+// pages are dropped from the page cache before every run (no effect on tmpfs). The session is
+// stopped at the first WRITE_MEMORY, the rest of it doesn't depend on how the file was loaded.
+//
+// usage: startup_benchmark [image_size_mb] [runs]
+
+namespace {
+
+const std::string IMAGE_FILE = "startup_benchmark.bin";
+
+// Passes everything through to the emulator until the first WRITE_MEMORY command, which fails
+// and ends the session
+class StopAtFirstWrite : public Schmi::SerialInterface {
+ public:
+  StopAtFirstWrite(Schmi::SerialInterface& ser) : ser_(ser){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    if (buffer_length == 2 && buffer[0] == Schmi::CMD::WRITE_MEMORY[0] &&
+        buffer[1] == Schmi::CMD::WRITE_MEMORY[1]) {
+      return -1;
+    }
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms = 500) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+
+ private:
+  Schmi::SerialInterface& ser_;
+};
+
+void WriteImage(const uint64_t& size) {
+  std::vector<char> image(size);
+  uint32_t state = 1;
+  for (uint64_t ii = 0; ii < size; ii++) {
+    state = state * 1103515245 + 12345;
+    image[ii] = state >> 24;
+  }
+
+  std::ofstream file(IMAGE_FILE, std::ios::binary);
+  file.write(image.data(), image.size());
+
+  return;
+}
+
+void DropFromPageCache() {
+  int fd = open(IMAGE_FILE.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+
+  return;
+}
+
+Schmi::FlashTiming RunSession(const bool& load_in_background, const uint32_t& flash_size) {
+  Schmi::ClockStd clock;
+  Schmi::EmulatorConfig config;
+  config.flash_size = flash_size;
+  Schmi::Stm32Emulator emulator(clock, config);
+  StopAtFirstWrite ser(emulator);
+  Schmi::BinaryFileStd bin(IMAGE_FILE, load_in_background);
+  Schmi::ErrorHandlerCapture error;
+  Schmi::LoadingBarNull bar;
+
+  Schmi::FlashLoader fl(&ser, &bin, &error, &bar);
+  Schmi::ChipTiming chip = Schmi::FindChipTiming(config.product_id);
+  chip.flash_size = flash_size;
+  fl.SetChipTiming(chip);
+  fl.SetClock(&clock);
+
+  DropFromPageCache();
+  fl.Init();
+  fl.Flash(true, false);
+
+  return fl.GetTiming();
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t image_size_mb = 8;
+  uint32_t runs = 5;
+  uint64_t image_size_arg = image_size_mb;
+  uint64_t runs_arg = runs;
+  if ((argc > 1 && !Schmi::ParseNumber(argv[1], image_size_arg, 4096)) ||
+      (argc > 2 && !Schmi::ParseNumber(argv[2], runs_arg, UINT32_MAX))) {
+    std::cerr << "usage: startup_benchmark [image_size_mb] [runs]\n";
+    return 1;
+  }
+  image_size_mb = image_size_arg;
+  runs = runs_arg;
+
+  uint32_t flash_size = image_size_mb * 1024 * 1024;
+  WriteImage(flash_size);
+
+  std::cout << "Image: " << image_size_mb << " MB, mass erased, " << runs << " runs per mode\n\n";
+  std::cout << std::setw(12) << "loading" << std::setw(12) << "init_ms" << std::setw(12) << "sync_ms";
+  std::cout << std::setw(12) << "erase_ms" << std::setw(16) << "first_write_ms" << "\n";
+
+  for (const bool& load_in_background : {false, true}) {
+    Schmi::FlashTiming sum = {};
+    for (uint32_t run = 0; run < runs; run++) {
+      Schmi::FlashTiming timing = RunSession(load_in_background, flash_size);
+      sum.init_done_us += timing.init_done_us;
+      sum.sync_done_us += timing.sync_done_us;
+      sum.erase_done_us += timing.erase_done_us;
+      sum.first_write_us += timing.first_write_us;
+    }
+
+    std::cout << std::setw(12) << (load_in_background ? "background" : "in Init") << std::fixed
+              << std::setprecision(1);
+    std::cout << std::setw(12) << sum.init_done_us / 1e3 / runs;
+    std::cout << std::setw(12) << sum.sync_done_us / 1e3 / runs;
+    std::cout << std::setw(12) << sum.erase_done_us / 1e3 / runs;
+    std::cout << std::setw(16) << sum.first_write_us / 1e3 / runs << "\n";
+  }
+
+  remove(IMAGE_FILE.c_str());
+
+  return EXIT_SUCCESS;
+}
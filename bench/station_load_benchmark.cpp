@@ -0,0 +1,374 @@
+#include "Schmi/clock_std.hpp"
+#include "Schmi/emulator_pty_server.hpp"
+#include "Schmi/fault_injecting_serial.hpp"
+#include "Schmi/flash_daemon.hpp"
+#include "Schmi/parse_number.hpp"
+#include "Schmi/serial_posix.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Load test of a whole station: N emulated bootloaders on ptys, all flashed through one FlashDaemon
+// the way station software drives it, for every N given. Tells how boards per minute, host CPU and
+// context switches per board, and memory per session go as N grows, to find where the host stops
+// scaling before buying more hubs.
+//
+// The boards are served by a child process, so the CPU, context switches and memory reported are
+// the host side only: daemon, port workers and the serial ports. Every port flashes boards_per_port
+// boards, a board that is started is swapped for a new one right away.
+//
+// Timing profiles of the boards:
+//   sim    no time spent in the bootloader or on the wire, only the host cost is left
+//   g431   the default EmulatorConfig, 115200 baud, in real time
+//   slow   a slow adapter and a slow flash, in real time
+// Fault profiles, added on the host side of every port (FaultInjectingSerial):
+//   none, noisy (1e-6 per byte), bad (1e-5 per byte)
+//
+// usage: station_load_benchmark [image_size_kb] [boards_per_port] [timing] [faults] [num_ports...]
+
+namespace {
+
+const uint32_t DONE_TIMEOUT_MS = 120000;
+
+struct StationResult {
+  bool ok;
+  uint32_t boards;
+  uint32_t boards_ok;
+  uint64_t wall_us;
+  uint64_t session_us;  // sum over the boards flashed fine
+  uint64_t cpu_us;
+  uint64_t context_switches;
+  int64_t rss_kb;  // growth from the daemon, its ports and its sessions
+};
+
+bool MakeBoardConfig(const std::string& timing, Schmi::EmulatorConfig& config) {
+  if (timing == "sim" || timing == "g431") {
+    return 1;
+  }
+  if (timing == "slow") {
+    config.ack_latency_us = 4000;
+    config.page_erase_us = 40000;
+    config.program_us_per_byte = 25;
+    return 1;
+  }
+
+  return 0;
+}
+
+bool MakeFaultConfig(const std::string& faults, const uint32_t& seed, Schmi::FaultConfig& config) {
+  double rate = 0.0;
+  if (faults == "noisy") {
+    rate = 1e-6;
+  } else if (faults == "bad") {
+    rate = 1e-5;
+  } else if (faults != "none") {
+    return 0;
+  }
+
+  config.seed = seed;
+  config.latency_jitter_us = rate > 0.0 ? 200 : 0;
+  config.drop_byte_rate = rate;
+  config.corrupt_byte_rate = rate;
+  config.spurious_nack_rate = rate * 10;
+  config.partial_read_rate = rate * 10;
+  config.stall_write_rate = rate * 10;
+
+  return 1;
+}
+
+// Runs in the child: one pty server per board, the paths go to path_fd one per line. Serves until
+// the parent closes the other end of stop_fd.
+void ServeBoards(const uint32_t& num_ports, const std::string& timing, const int& path_fd, const int& stop_fd) {
+  Schmi::EmulatorConfig config;
+  MakeBoardConfig(timing, config);
+
+  std::vector<std::unique_ptr<Schmi::ClockInterface>> clocks;
+  std::vector<std::unique_ptr<Schmi::Stm32Emulator>> boards;
+  std::vector<std::unique_ptr<Schmi::EmulatorPtyServer>> servers;
+  std::string paths;
+  for (uint32_t ii = 0; ii < num_ports; ii++) {
+    if (timing == "sim") {
+      clocks.emplace_back(new Schmi::SimClock());
+    } else {
+      clocks.emplace_back(new Schmi::ClockStd());
+    }
+    boards.emplace_back(new Schmi::Stm32Emulator(*clocks.back(), config));
+    servers.emplace_back(new Schmi::EmulatorPtyServer(*boards.back(), true));
+    if (!servers.back()->Start()) {
+      break;
+    }
+    paths += servers.back()->GetPortPath() + "\n";
+  }
+  if (write(path_fd, paths.data(), paths.size()) != (ssize_t)paths.size()) {
+    return;
+  }
+  close(path_fd);
+
+  char byte;
+  while (read(stop_fd, &byte, 1) > 0) {
+  }
+
+  return;
+}
+
+// Resident set of this process
+int64_t ReadRssKb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0) {
+      return std::stoll(line.substr(6));
+    }
+  }
+
+  return 0;
+}
+
+// Station side of the daemon socket
+class StationClient {
+ public:
+  StationClient(const std::string& socket_path) {
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    socket_path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    connected_ = connect(fd_, (sockaddr*)&address, sizeof(address)) == 0;
+  };
+  ~StationClient() { close(fd_); };
+
+  bool IsConnected() const { return connected_; };
+
+  bool Send(const std::string& line) {
+    std::string out = line + "\n";
+    return write(fd_, out.data(), out.size()) == (ssize_t)out.size();
+  };
+
+  // Next line that isn't a PROGRESS event, empty after timeout_ms without one
+  std::string ReadAnswer(const int& timeout_ms) {
+    while (true) {
+      size_t end;
+      while ((end = input_.find('\n')) == std::string::npos) {
+        pollfd fd = {fd_, POLLIN, 0};
+        char buffer[4096];
+        ssize_t num_bytes;
+        if (poll(&fd, 1, timeout_ms) <= 0 || (num_bytes = read(fd_, buffer, sizeof(buffer))) <= 0) {
+          return "";
+        }
+        input_.append(buffer, num_bytes);
+      }
+
+      std::string line = input_.substr(0, end);
+      input_.erase(0, end + 1);
+      if (line.compare(0, 9, "PROGRESS ") != 0) {
+        return line;
+      }
+    }
+  };
+
+ private:
+  int fd_;
+  bool connected_;
+  std::string input_;
+};
+
+uint64_t TimevalUs(const timeval& time) { return (uint64_t)time.tv_sec * 1000000 + time.tv_usec; }
+
+// Flashes boards_per_port boards on each of num_ports emulated ports through a fresh daemon
+StationResult RunStation(const uint32_t& num_ports, const uint32_t& boards_per_port, const std::string& timing,
+                         const std::string& faults, const std::string& image_path) {
+  StationResult result = {0, num_ports * boards_per_port, 0, 0, 0, 0, 0, 0};
+
+  // Forked before the daemon has any threads
+  int path_pipe[2];
+  int stop_pipe[2];
+  if (pipe(path_pipe) != 0 || pipe(stop_pipe) != 0) {
+    return result;
+  }
+  pid_t child = fork();
+  if (child < 0) {
+    return result;
+  }
+  if (child == 0) {
+    close(path_pipe[0]);
+    close(stop_pipe[1]);
+    ServeBoards(num_ports, timing, path_pipe[1], stop_pipe[0]);
+    _exit(0);
+  }
+  close(path_pipe[1]);
+  close(stop_pipe[0]);
+
+  std::string paths;
+  char buffer[4096];
+  ssize_t num_bytes;
+  while ((num_bytes = read(path_pipe[0], buffer, sizeof(buffer))) > 0) {
+    paths.append(buffer, num_bytes);
+  }
+  close(path_pipe[0]);
+
+  int64_t rss_before_kb = ReadRssKb();
+  rusage usage_before;
+  getrusage(RUSAGE_SELF, &usage_before);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  {
+    Schmi::ClockStd clock;
+    std::vector<std::unique_ptr<Schmi::SerialPosix>> ports;
+    std::vector<std::unique_ptr<Schmi::FaultInjectingSerial>> noisy_ports;
+    Schmi::FlashDaemon daemon("/tmp/schmi_station_load_" + std::to_string(getpid()) + ".sock");
+    std::istringstream path_lines(paths);
+    std::string path;
+    while (std::getline(path_lines, path)) {
+      ports.emplace_back(new Schmi::SerialPosix(path));
+      Schmi::SerialInterface* ser = ports.back().get();
+      if (faults != "none") {
+        Schmi::FaultConfig config;
+        MakeFaultConfig(faults, ports.size(), config);
+        noisy_ports.emplace_back(new Schmi::FaultInjectingSerial(*ser, clock, config));
+        ser = noisy_ports.back().get();
+      }
+      daemon.AddPort(path, ser);
+    }
+
+    std::string image_id;
+    if (ports.size() == num_ports && daemon.Start()) {
+      StationClient station(daemon.GetSocketPath());
+      std::string answer;
+      if (station.IsConnected() && station.Send("LOAD " + image_path) &&
+          (answer = station.ReadAnswer(5000)).compare(0, 6, "IMAGE ") == 0) {
+        std::istringstream image(answer.substr(6));
+        image >> image_id;
+        for (uint32_t ii = 0; ii < result.boards; ii++) {
+          station.Send("FLASH " + image_id);
+        }
+
+        uint32_t num_done = 0;
+        while (num_done < result.boards) {
+          answer = station.ReadAnswer(DONE_TIMEOUT_MS);
+          if (answer.empty()) {
+            break;
+          }
+          if (answer.compare(0, 5, "DONE ") != 0) {
+            continue;
+          }
+          num_done++;
+          // DONE <job_id> <port> OK <total_us>
+          std::istringstream done(answer.substr(5));
+          std::string job_id, port, status;
+          uint64_t total_us = 0;
+          done >> job_id >> port >> status >> total_us;
+          if (status == "OK") {
+            result.boards_ok++;
+            result.session_us += total_us;
+          }
+        }
+        result.ok = num_done == result.boards;
+      }
+
+      result.rss_kb = ReadRssKb() - rss_before_kb;
+    }
+    result.wall_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    daemon.Stop();
+  }
+
+  rusage usage_after;
+  getrusage(RUSAGE_SELF, &usage_after);
+  result.cpu_us = TimevalUs(usage_after.ru_utime) + TimevalUs(usage_after.ru_stime) -
+                  TimevalUs(usage_before.ru_utime) - TimevalUs(usage_before.ru_stime);
+  result.context_switches = usage_after.ru_nvcsw + usage_after.ru_nivcsw - usage_before.ru_nvcsw -
+                            usage_before.ru_nivcsw;
+
+  close(stop_pipe[1]);
+  waitpid(child, nullptr, 0);
+
+  return result;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t image_size_kb = 8;
+  uint32_t boards_per_port = 2;
+  std::string timing = "g431";
+  std::string faults = "none";
+  std::vector<uint32_t> station_sizes;
+  uint64_t image_size_arg = image_size_kb;
+  uint64_t boards_per_port_arg = boards_per_port;
+  bool args_ok = (argc <= 1 || Schmi::ParseNumber(argv[1], image_size_arg, UINT32_MAX)) &&
+                 (argc <= 2 || Schmi::ParseNumber(argv[2], boards_per_port_arg, UINT32_MAX));
+  if (argc > 3) timing = argv[3];
+  if (argc > 4) faults = argv[4];
+  for (int ii = 5; ii < argc && args_ok; ii++) {
+    uint64_t num_ports = 0;
+    args_ok = Schmi::ParseNumber(argv[ii], num_ports, UINT32_MAX) && num_ports;
+    station_sizes.push_back(num_ports);
+  }
+  if (!args_ok) {
+    std::cerr << "usage: station_load_benchmark [image_size_kb] [boards_per_port] [timing] [faults] [num_ports...]\n";
+    return 1;
+  }
+  image_size_kb = image_size_arg;
+  boards_per_port = boards_per_port_arg;
+  if (station_sizes.empty()) {
+    station_sizes = {1, 2, 4, 8, 16, 32};
+  }
+
+  Schmi::EmulatorConfig board_config;
+  Schmi::FaultConfig fault_config;
+  if (!MakeBoardConfig(timing, board_config) || !MakeFaultConfig(faults, 1, fault_config)) {
+    std::cerr << "ERROR: timing is sim, g431 or slow, faults none, noisy or bad\n";
+    return EXIT_FAILURE;
+  }
+
+  std::string image_path = "/tmp/schmi_station_load_" + std::to_string(getpid()) + ".bin";
+  {
+    std::vector<char> image(image_size_kb * 1024);
+    for (uint32_t ii = 0; ii < image.size(); ii++) {
+      image[ii] = ii * 13 + (ii >> 10);
+    }
+    std::ofstream(image_path, std::ios::binary).write(image.data(), image.size());
+  }
+  // Ports of a child that went away shouldn't end the run
+  signal(SIGPIPE, SIG_IGN);
+
+  std::cout << "Image: " << image_size_kb << " KB, " << boards_per_port << " boards per port, timing " << timing
+            << ", faults " << faults << "\n\n";
+  std::cout << std::setw(6) << "ports" << std::setw(8) << "boards" << std::setw(8) << "ok" << std::setw(10)
+            << "wall_s" << std::setw(12) << "boards/min" << std::setw(12) << "session_s" << std::setw(14)
+            << "cpu_ms/board" << std::setw(14) << "ctxsw/board" << std::setw(14) << "rss_kb/port" << "\n";
+
+  for (uint32_t num_ports : station_sizes) {
+    StationResult result = RunStation(num_ports, boards_per_port, timing, faults, image_path);
+    std::cout << std::setw(6) << num_ports << std::setw(8) << result.boards << std::setw(8) << result.boards_ok;
+    if (!result.ok) {
+      std::cout << "  station failed to start or jobs went missing\n";
+      continue;
+    }
+
+    std::cout << std::fixed << std::setprecision(2) << std::setw(10) << result.wall_us / 1e6 << std::setw(12)
+              << std::setprecision(1) << result.boards_ok * 60e6 / result.wall_us << std::setw(12)
+              << std::setprecision(2) << (result.boards_ok ? result.session_us / 1e6 / result.boards_ok : 0.0)
+              << std::setw(14) << result.cpu_us / 1e3 / result.boards << std::setw(14) << std::setprecision(0)
+              << (double)result.context_switches / result.boards << std::setw(14) << result.rss_kb / (int64_t)num_ports
+              << "\n";
+  }
+
+  unlink(image_path.c_str());
+
+  return EXIT_SUCCESS;
+}
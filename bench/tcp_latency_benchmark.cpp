@@ -0,0 +1,108 @@
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/emulator_tcp_server.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/latency_histogram.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/parse_number.hpp"
+#include "Schmi/serial_tcp.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ACK round trips of whole sessions through SerialTcp and a loopback EmulatorTcpServer, for each
+// socket setting. The emulator runs on a SimClock on the server thread, so what is measured is the
+// host and TCP side of a round trip, not the bootloader. Timed on the steady clock.
+//
+// usage: tcp_latency_benchmark [image_size_kb] [runs]
+
+namespace {
+
+struct Setting {
+  const char* name;
+  bool no_delay;
+  bool quick_ack;
+  bool rfc2217;
+};
+
+bool RunSession(const Setting& setting, const std::vector<uint8_t>& image, Schmi::LatencyHistogram& latency) {
+  Schmi::SimClock board_clock;
+  Schmi::Stm32Emulator board(board_clock);
+  Schmi::EmulatorTcpServer server(board, setting.rfc2217);
+  if (!server.Start()) {
+    return 0;
+  }
+
+  Schmi::SerialTcpOptions options;
+  options.no_delay = setting.no_delay;
+  options.quick_ack = setting.quick_ack;
+  options.rfc2217 = setting.rfc2217;
+  Schmi::SerialTcp ser("127.0.0.1", server.GetPort(), options);
+  if (!ser.Open()) {
+    return 0;
+  }
+
+  Schmi::ClockStd clock;
+  Schmi::BinaryFileMemory bin(image);
+  Schmi::ErrorHandlerCapture error;
+  Schmi::LoadingBarNull bar;
+  Schmi::FlashLoader fl(&ser, &bin, &error, &bar);
+  fl.SetClock(&clock);
+  fl.SetLatencyHistogram(&latency);
+  fl.Init();
+
+  return fl.Flash(true, false);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t image_size_kb = 64;
+  uint32_t runs = 5;
+  uint64_t image_size_arg = image_size_kb;
+  uint64_t runs_arg = runs;
+  if ((argc > 1 && !Schmi::ParseNumber(argv[1], image_size_arg, UINT32_MAX)) ||
+      (argc > 2 && !Schmi::ParseNumber(argv[2], runs_arg, UINT32_MAX))) {
+    std::cerr << "usage: tcp_latency_benchmark [image_size_kb] [runs]\n";
+    return 1;
+  }
+  image_size_kb = image_size_arg;
+  runs = runs_arg;
+
+  std::vector<uint8_t> image(image_size_kb * 1024);
+  for (uint32_t ii = 0; ii < image.size(); ii++) {
+    image[ii] = ii * 31 + (ii >> 10);
+  }
+
+  const Setting settings[] = {{"raw", true, true, false},
+                              {"raw, no quick-ack", true, false, false},
+                              {"raw, Nagle", false, false, false},
+                              {"rfc2217", true, true, true}};
+
+  std::cout << "Image: " << image_size_kb << " KB, " << runs << " runs per setting\n\n";
+  std::cout << std::setw(20) << "socket" << std::setw(10) << "acks" << std::setw(10) << "p50_us" << std::setw(10)
+            << "p99_us" << std::setw(10) << "p999_us" << std::setw(10) << "max_us" << "\n";
+
+  for (const Setting& setting : settings) {
+    Schmi::LatencyHistogram latency;
+    bool ok = true;
+    for (uint32_t run = 0; run < runs && ok; run++) {
+      ok = RunSession(setting, image, latency);
+    }
+
+    std::cout << std::setw(20) << setting.name;
+    if (!ok) {
+      std::cout << "  session failed\n";
+      continue;
+    }
+    std::cout << std::setw(10) << latency.GetCount() << std::setw(10) << latency.GetPercentileUs(50)
+              << std::setw(10) << latency.GetPercentileUs(99) << std::setw(10) << latency.GetPercentileUs(99.9)
+              << std::setw(10) << latency.GetMaxUs() << "\n";
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+#ifndef SCHMI_AUTO_FLASHER_HPP
+#define SCHMI_AUTO_FLASHER_HPP
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/clock_interface.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/port_watcher.hpp"
+#include "Schmi/serial_interface.hpp"
+
+#include <stdint.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Schmi {
+
+struct AutoFlashResult {
+  SerialDeviceInfo device;
+  bool ok;
+  uint64_t start_delay_us;  // from the board showing up to its port being open
+  uint64_t total_us;        // from the board showing up to the firmware running
+  FlashTiming timing;       // of the session, once the port is open
+  std::string error;        // where: message, when it failed
+};
+
+// Flashes every board it is handed on its own thread, as soon as it is handed. Hooked to a
+// PortWatcher, a board starts flashing the moment its node appears, whatever the others are doing.
+// The node can show up before udev has set its permissions, so a port that can't be opened is
+// tried again, with growing waits, until the open window runs out.
+class AutoFlasher {
+ public:
+  static const uint32_t DEFAULT_OPEN_WINDOW_MS = 1000;
+  static const uint32_t FIRST_OPEN_RETRY_MS = 5;
+  static const uint32_t MAX_OPEN_RETRY_MS = 200;
+
+  // Opens the port of a board, nullptr if it can't
+  using SerialFactory = std::function<std::unique_ptr<SerialInterface>(const SerialDeviceInfo&)>;
+  // Called on the session thread once a board is done
+  using ResultCallback = std::function<void(const AutoFlashResult&)>;
+
+  AutoFlasher(const std::vector<uint8_t>& image, const SerialFactory& open_port, const ResultCallback& on_done,
+              ClockInterface* clock = nullptr)
+      : image_(image), open_port_(open_port), on_done_(on_done), clock_(clock ? clock : &clock_std_){};
+  ~AutoFlasher() { Wait(); };
+
+  // How long a port that can't be opened is tried again, 0 to give up on the first try
+  void SetOpenWindow(const uint32_t& window_ms) { open_window_ms_ = window_ms; };
+
+  // Starts a session for the board, the PortWatcher callback
+  void Flash(const SerialDeviceInfo& device);
+
+  // Waits for every session started so far
+  void Wait();
+
+  uint32_t GetNumRunning();
+
+ private:
+  struct Session {
+    std::thread thread;
+    bool done;
+  };
+
+  BinaryFileMemory image_;  // only read, shared by the sessions
+  SerialFactory open_port_;
+  ResultCallback on_done_;
+  ClockStd clock_std_;
+  ClockInterface* clock_;
+  uint32_t open_window_ms_ = DEFAULT_OPEN_WINDOW_MS;
+
+  std::mutex mutex_;
+  std::list<Session> sessions_;
+
+  AutoFlashResult RunSession(const SerialDeviceInfo& device, const uint64_t& seen_us);
+  std::unique_ptr<SerialInterface> OpenPort(const SerialDeviceInfo& device, const uint64_t& seen_us);
+  // Joins the sessions that are done, so a station running all day doesn't pile up threads
+  void JoinFinished();
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_AUTO_FLASHER_HPP
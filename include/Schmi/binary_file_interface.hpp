@@ -7,7 +7,7 @@ namespace Schmi {
 
 struct BytesData {
   uint32_t num_bytes;
-  uint32_t starting_byte;
+  uint64_t starting_byte;
 };
 
 class BinaryFileInterface {
@@ -17,6 +17,13 @@ class BinaryFileInterface {
   virtual void Init() = 0;
   virtual uint64_t GetBinaryFileSize() = 0;
   virtual void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) = 0;
+
+  // False for sources that can only be read once, front to back
+  virtual bool IsRereadable() { return true; };
+
+  // The WRITE_MEMORY data frame of these bytes if the source has it built already (see
+  // PreparedImage), nullptr to have it built from GetBytesArray
+  virtual const uint8_t* GetWriteFrame(const BytesData&, uint16_t&) { return nullptr; };
 };
 }  // namespace Schmi
 
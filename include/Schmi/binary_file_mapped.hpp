@@ -0,0 +1,36 @@
+#ifndef SCHMI_BINARY_FILE_MAPPED_HPP
+#define SCHMI_BINARY_FILE_MAPPED_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace Schmi {
+
+// Image mapped read only from a file that doesn't change, like an ImageStore object. Nothing is
+// copied until a chunk is asked for and the pages are shared with every other mapping of the
+// file, so one instance can be read by any number of sessions at once.
+class BinaryFileMapped : public BinaryFileInterface {
+ public:
+  BinaryFileMapped(const std::string& file_name) : file_name_(file_name){};
+  ~BinaryFileMapped();
+
+  // Maps the file if Map wasn't called, exits if it can't like BinaryFileStd
+  void Init() override;
+  uint64_t GetBinaryFileSize() override { return size_; };
+  void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) override;
+
+  // False if the file can't be opened or mapped, or is empty
+  bool Map();
+
+  const uint8_t* GetBytes() const { return bytes_; };
+
+ private:
+  std::string file_name_;
+  const uint8_t* bytes_ = nullptr;
+  uint64_t size_ = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_BINARY_FILE_MAPPED_HPP
@@ -0,0 +1,29 @@
+#ifndef SCHMI_BINARY_FILE_MEMORY_HPP
+#define SCHMI_BINARY_FILE_MEMORY_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Schmi {
+
+// Image that is already in memory, like one generated by a tool or received over the network
+class BinaryFileMemory : public BinaryFileInterface {
+ public:
+  BinaryFileMemory(const std::vector<uint8_t>& bytes) : bytes_(bytes){};
+  BinaryFileMemory(const uint8_t* bytes, const uint64_t& num_bytes) : bytes_(bytes, bytes + num_bytes){};
+  ~BinaryFileMemory(){};
+
+  void Init() override{};
+  uint64_t GetBinaryFileSize() override { return bytes_.size(); };
+  void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) override;
+
+  const std::vector<uint8_t>& GetBytes() const { return bytes_; };
+
+ private:
+  std::vector<uint8_t> bytes_;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_BINARY_FILE_MEMORY_HPP
@@ -3,33 +3,56 @@
 
 #include "iq_flasher/include/Schmi/binary_file_interface.hpp"
 
+#include "iq_flasher/include/Schmi/crc32.hpp"
 #include "iq_flasher/include/Schmi/std_exception.hpp"
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstdint>
 #include <fstream>
 #include <iterator>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace Schmi {
 
+// Init only opens the file and reads its size, the content is loaded (and its CRC computed) by a
+// background thread. The erase can be planned and started right away, GetBytesArray blocks until
+// the bytes it needs are in. Pass load_in_background = false to load everything in Init.
 class BinaryFileStd : public BinaryFileInterface {
  public:
-  BinaryFileStd(std::string binary_file_name) : binary_file_name_(binary_file_name){};
-  ~BinaryFileStd(){};
+  static const uint32_t LOAD_CHUNK_SIZE = 64 * 1024;
+
+  BinaryFileStd(std::string binary_file_name, bool load_in_background = true)
+      : binary_file_name_(binary_file_name), load_in_background_(load_in_background){};
+  ~BinaryFileStd();
 
   void Init() override;
   uint64_t GetBinaryFileSize() override { return binary_file_size_; };
   void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) override;
 
+  // Blocks until the whole file is in memory, returns the CRC-32 of its content
+  uint32_t WaitUntilLoaded();
+
  private:
   std::string binary_file_name_;
+  bool load_in_background_;
   uint64_t binary_file_size_ = 0;
   std::vector<uint8_t> bytes_;
 
+  std::ifstream input_file_;
+  std::thread loader_;
+  std::mutex mutex_;
+  std::condition_variable loaded_cv_;
+  uint64_t num_bytes_loaded_ = 0;
+  bool load_failed_ = false;
+  Crc32 crc_;
+
   uint64_t FindFileSize(std::ifstream& file);
-  std::vector<uint8_t> ReadFile(std::ifstream& file);
+  void LoadFile();
+  void WaitForBytes(const uint64_t& end);
 };
 }  // namespace Schmi
 #endif  // SCHMI_BINARY_FILE_STD
@@ -0,0 +1,56 @@
+#ifndef SCHMI_BINARY_FILE_STREAM_HPP
+#define SCHMI_BINARY_FILE_STREAM_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+#include "Schmi/std_exception.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Schmi {
+
+// Image read from a pipe, a FIFO or stdin, for firmware coming straight out of the build or
+// signing tool. The size has to be known up front since the erase is planned before the first
+// byte is written.
+//
+// Only a ring of buffer_size bytes is kept in memory, so the image has to be read front to back
+// (FlashLoader does). Bytes that already left the ring can only be read again if a spill file was
+// given, every byte read from the stream is also appended to it. Without one IsRereadable() is
+// false and FlashLoader verifies the flash against a CRC of what it wrote instead.
+class BinaryFileStream : public BinaryFileInterface {
+ public:
+  static const uint32_t DEFAULT_BUFFER_SIZE = 8 * 1024;
+
+  BinaryFileStream(const int& fd, const uint64_t& image_size, const uint32_t& buffer_size = DEFAULT_BUFFER_SIZE,
+                   const std::string& spill_file_name = "")
+      : fd_(fd), image_size_(image_size), buffer_size_(buffer_size), spill_file_name_(spill_file_name){};
+  ~BinaryFileStream();
+
+  void Init() override;
+  uint64_t GetBinaryFileSize() override { return image_size_; };
+  void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) override;
+  bool IsRereadable() override { return !spill_file_name_.empty(); };
+
+  // Bytes pulled from the stream so far
+  uint64_t GetBytesReceived() const { return window_end_; };
+
+ private:
+  int fd_;
+  uint64_t image_size_;
+  uint32_t buffer_size_;
+  std::string spill_file_name_;
+  int spill_fd_ = -1;
+
+  // The ring holds the stream bytes [window_start_, window_end_)
+  std::vector<uint8_t> ring_;
+  uint64_t window_start_ = 0;
+  uint64_t window_end_ = 0;
+
+  void FillUntil(const uint64_t& end, const uint64_t& keep_from);
+  void CopyFromRing(uint8_t* bytes, const uint64_t& pos, const uint32_t& num_bytes);
+  void ReadFromSpill(uint8_t* bytes, const uint64_t& pos, const uint32_t& num_bytes);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_BINARY_FILE_STREAM_HPP
@@ -0,0 +1,81 @@
+#ifndef SCHMI_BOARD_CLONER_HPP
+#define SCHMI_BOARD_CLONER_HPP
+
+#include "Schmi/clock_interface.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/clone_stream.hpp"
+#include "Schmi/serial_interface.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Schmi {
+
+struct CloneTargetResult {
+  std::string name;
+  bool ok;             // flashed, verified, and what it was given hashes like what was read
+  uint32_t crc;        // CRC-32 of what it was given
+  uint64_t total_us;   // from the start of the clone
+  std::string error;   // where: message, when it failed
+};
+
+struct CloneReport {
+  bool source_ok;
+  std::string source_error;
+  uint64_t num_bytes;
+  uint32_t source_crc;         // CRC-32 of everything read from the source
+  uint64_t read_us;            // reading the source, waits for the targets included
+  uint64_t producer_wait_us;   // of which waiting for the slowest target
+  std::vector<CloneTargetResult> targets;
+};
+
+// Copies the flash of a known good board onto any number of others, without a dump file: the
+// source is read with READ_MEMORY into a CloneStream and every target writes from it as the bytes
+// come, each in its own session on its own thread. The targets erase while the first bytes are
+// read, and the slowest one sets the pace once the ring is full. Every target's flash is verified
+// against what it wrote (FlashLoader), and what it wrote against the CRC of the source read.
+class BoardCloner {
+ public:
+  static const uint16_t READ_SIZE = 256;
+
+  /**
+   * @param start_address Where the copy starts, on the source and on the targets
+   * @param num_bytes How much of the flash to copy, the targets are erased for this much
+   */
+  BoardCloner(SerialInterface* source, const uint32_t& start_address, const uint64_t& num_bytes,
+              ClockInterface* clock = nullptr, const uint32_t& capacity = CloneStream::DEFAULT_CAPACITY)
+      : source_(source),
+        start_address_(start_address),
+        num_bytes_(num_bytes),
+        clock_(clock ? clock : &clock_std_),
+        capacity_(capacity){};
+  ~BoardCloner(){};
+
+  // A board to copy onto, before Run. The clock times its session, the steady clock by default.
+  void AddTarget(const std::string& name, SerialInterface* ser, ClockInterface* clock = nullptr);
+
+  // Reads the source on the calling thread while the targets are flashed, returns once all are done
+  CloneReport Run();
+
+ private:
+  struct Target {
+    std::string name;
+    SerialInterface* ser;
+    ClockInterface* clock;
+  };
+
+  SerialInterface* source_;
+  uint32_t start_address_;
+  uint64_t num_bytes_;
+  ClockStd clock_std_;
+  ClockInterface* clock_;
+  uint32_t capacity_;
+  std::vector<Target> targets_;
+
+  bool ReadSource(CloneStream& stream, CloneReport& report);
+  CloneTargetResult RunTarget(const uint32_t& index, CloneStream& stream, const uint64_t& start_us);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_BOARD_CLONER_HPP
@@ -0,0 +1,47 @@
+#ifndef SCHMI_BOOTLOADER_CAPABILITIES_HPP
+#define SCHMI_BOOTLOADER_CAPABILITIES_HPP
+
+#include "Schmi/stm32.hpp"
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// What the system bootloader of a chip can do. The command list only depends on the product and
+// on the bootloader version, so it's asked for with GET once per pair and reused for every board
+// of the same kind.
+struct BootloaderCapabilities {
+  uint16_t product_id;
+  uint8_t bootloader_version;
+  uint32_t commands[8];  // one bit per opcode
+
+  bool Supports(const uint8_t* cmd) const { return (commands[cmd[0] >> 5] >> (cmd[0] & 0x1F)) & 1; };
+};
+
+BootloaderCapabilities MakeBootloaderCapabilities(const uint16_t& product_id, const BootloaderCommands& commands);
+
+// Capabilities already seen, by product ID and bootloader version. Once full the oldest entry is
+// replaced. No heap and no lock: it can be shared by the FlashLoaders of one thread only
+// (FlashLoader::SetCapabilityCache), sessions on other threads each need their own.
+class CapabilityCache {
+ public:
+  static const uint8_t MAX_ENTRIES = 16;
+
+  CapabilityCache(){};
+  ~CapabilityCache(){};
+
+  // nullptr if the pair was never stored
+  const BootloaderCapabilities* Find(const uint16_t& product_id, const uint8_t& bootloader_version) const;
+
+  void Store(const BootloaderCapabilities& capabilities);
+
+  uint8_t GetNumEntries() const { return num_entries_; };
+
+ private:
+  BootloaderCapabilities entries_[MAX_ENTRIES];
+  uint8_t num_entries_ = 0;
+  uint8_t next_entry_ = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_BOOTLOADER_CAPABILITIES_HPP
@@ -0,0 +1,18 @@
+#ifndef SCHMI_CLOCK_INTERFACE_HPP
+#define SCHMI_CLOCK_INTERFACE_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+class ClockInterface {
+ public:
+  virtual ~ClockInterface(){};
+
+  // Monotonic time in microseconds, the origin is implementation defined
+  virtual uint64_t NowUs() = 0;
+  virtual void SleepUs(const uint64_t& duration_us) = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_CLOCK_INTERFACE_HPP
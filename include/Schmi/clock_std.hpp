@@ -0,0 +1,21 @@
+#ifndef SCHMI_CLOCK_STD_HPP
+#define SCHMI_CLOCK_STD_HPP
+
+#include "Schmi/clock_interface.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace Schmi {
+
+class ClockStd : public ClockInterface {
+ public:
+  ClockStd(){};
+  ~ClockStd(){};
+
+  uint64_t NowUs() override;
+  void SleepUs(const uint64_t& duration_us) override;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_CLOCK_STD_HPP
@@ -0,0 +1,87 @@
+#ifndef SCHMI_CLONE_STREAM_HPP
+#define SCHMI_CLONE_STREAM_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+#include "Schmi/crc32.hpp"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace Schmi {
+
+// Bytes of one producer going to several readers through a ring of capacity bytes. Each reader
+// goes front to back at its own pace, the producer waits while the slowest one is a full ring
+// behind. A reader that stops early has to Detach, or the producer waits for it forever.
+class CloneStream {
+ public:
+  static const uint32_t DEFAULT_CAPACITY = 64 * 1024;
+
+  CloneStream(const uint64_t& num_bytes, const uint32_t& num_readers, const uint32_t& capacity = DEFAULT_CAPACITY)
+      : num_bytes_(num_bytes), ring_(capacity), cursors_(num_readers, 0), detached_(num_readers, false){};
+
+  // Blocks until every reader has room for the bytes, false once aborted
+  bool Write(const uint8_t* bytes, const uint32_t& num_bytes);
+  // Wakes everyone up, the reads that aren't satisfied yet fail
+  void Abort();
+
+  /**
+   * @brief Read Blocks until the producer got that far
+   * @param pos Not before the end of the last read of this reader
+   * @param num_bytes At most the capacity
+   * @return false if the stream was aborted before the bytes came
+   */
+  bool Read(const uint32_t& reader, uint8_t* bytes, const uint64_t& pos, const uint32_t& num_bytes);
+  void Detach(const uint32_t& reader);
+
+  uint64_t GetNumBytes() const { return num_bytes_; };
+  bool IsAborted();
+  // How long the producer waited for the readers, in us
+  uint64_t GetProducerWaitUs();
+
+ private:
+  uint64_t num_bytes_;
+  std::vector<uint8_t> ring_;
+  std::vector<uint64_t> cursors_;
+  std::vector<bool> detached_;
+  uint64_t written_ = 0;
+  bool aborted_ = false;
+  uint64_t producer_wait_us_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable written_cv_;
+  std::condition_variable read_cv_;
+
+  // With mutex_ held, the end of the bytes every attached reader is done with
+  uint64_t GetSlowestCursor() const;
+};
+
+// One reader of a CloneStream as the image of a FlashLoader. It can only be read once, front to
+// back, so FlashLoader verifies against the CRC of what it wrote. Bytes that never came (the stream
+// was aborted) read as 0xFF and IsComplete turns false.
+class CloneStreamReader : public BinaryFileInterface {
+ public:
+  CloneStreamReader(CloneStream& stream, const uint32_t& reader) : stream_(stream), reader_(reader){};
+  ~CloneStreamReader(){};
+
+  void Init() override{};
+  uint64_t GetBinaryFileSize() override { return stream_.GetNumBytes(); };
+  void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) override;
+  bool IsRereadable() override { return 0; };
+
+  bool IsComplete() const { return complete_; };
+  // CRC-32 of every byte handed out, in order
+  uint32_t GetCrc() const { return crc_.Get(); };
+  uint64_t GetNumBytesRead() const { return num_bytes_read_; };
+
+ private:
+  CloneStream& stream_;
+  uint32_t reader_;
+  bool complete_ = true;
+  Crc32 crc_;
+  uint64_t num_bytes_read_ = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_CLONE_STREAM_HPP
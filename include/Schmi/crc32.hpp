@@ -0,0 +1,44 @@
+#ifndef SCHMI_CRC32_HPP
+#define SCHMI_CRC32_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// CRC-32 (IEEE 802.3, same as zlib and `crc32` on the command line), fed in pieces
+class Crc32 {
+ public:
+  Crc32() { Reset(); };
+  ~Crc32(){};
+
+  void Reset() { crc_ = 0xFFFFFFFF; };
+  void Update(const uint8_t* bytes, const uint32_t& num_bytes);
+  uint32_t Get() const { return ~crc_; };
+
+ private:
+  uint32_t crc_;
+};
+
+// CRC-32 as the STM32 CRC unit computes it out of reset, the one GET_CHECKSUM answers with:
+// polynomial 0x04C11DB7, initial value 0xFFFFFFFF, no reflection and no final XOR, fed one
+// little endian 32 bit word at a time. A last partial word is padded with 0xFF, like the padding
+// WRITE_MEMORY adds.
+class Crc32Stm32 {
+ public:
+  Crc32Stm32() { Reset(); };
+  ~Crc32Stm32(){};
+
+  void Reset();
+  void Update(const uint8_t* bytes, const uint32_t& num_bytes);
+  uint32_t Get() const;
+
+ private:
+  uint32_t crc_;
+  uint32_t word_;
+  uint8_t num_word_bytes_;
+
+  static uint32_t UpdateWord(uint32_t crc, const uint32_t& word);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_CRC32_HPP
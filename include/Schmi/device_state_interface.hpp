@@ -0,0 +1,50 @@
+#ifndef SCHMI_DEVICE_STATE_INTERFACE_HPP
+#define SCHMI_DEVICE_STATE_INTERFACE_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+const uint8_t UNIQUE_ID_SIZE = 12;
+
+// 96 bit unique device ID of an STM32, as read from its flash interface registers
+struct UniqueId {
+  uint8_t bytes[UNIQUE_ID_SIZE];
+};
+
+// What a board was last flashed with: a range of whole pages, each with the CRC-32 of its content
+// (the image, 0xFF around it)
+struct DeviceRecord {
+  uint32_t page_size;
+  uint32_t first_page;
+  uint32_t num_pages;
+  uint32_t image_crc;
+  uint64_t image_size;
+  uint32_t range_checksum;  // Crc32Stm32 of the pages, what GET_CHECKSUM answers for the range
+};
+
+// Flash content per board, kept from one session to the next so a board that comes back only gets
+// the pages that changed (FlashLoader::SetDeviceState)
+class DeviceStateInterface {
+ public:
+  virtual ~DeviceStateInterface(){};
+
+  virtual void Init() = 0;
+
+  // Looks up a board, GetPageCrc then reads its pages
+  virtual bool Find(const UniqueId& uid, DeviceRecord& record) = 0;
+
+  // Page index of the record found last, 0 to num_pages - 1. Still valid after Forget.
+  virtual uint32_t GetPageCrc(const uint32_t& index) = 0;
+
+  // The board is about to be written, its record can't be trusted anymore
+  virtual void Forget(const UniqueId& uid) = 0;
+
+  // Replaces the record of a board: every page is set with SetPageCrc, then Commit makes it last
+  virtual void StartRecord(const UniqueId& uid) = 0;
+  virtual void SetPageCrc(const uint32_t& index, const uint32_t& crc) = 0;
+  virtual bool Commit(const DeviceRecord& record) = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_DEVICE_STATE_INTERFACE_HPP
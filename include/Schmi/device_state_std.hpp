@@ -0,0 +1,51 @@
+#ifndef SCHMI_DEVICE_STATE_STD_HPP
+#define SCHMI_DEVICE_STATE_STD_HPP
+
+#include "Schmi/device_state_interface.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Schmi {
+
+// Device states in a text file, one board per line:
+//   <unique id> <page size> <first page> <num pages> <image crc> <image size> <range checksum> <page crcs...>
+// The whole file is written again, through a temporary file and a rename, on every change.
+class DeviceStateStd : public DeviceStateInterface {
+ public:
+  DeviceStateStd(const std::string& file_name) : file_name_(file_name){};
+  ~DeviceStateStd(){};
+
+  // Reads the file, a missing file is an empty cache
+  void Init() override;
+
+  bool Find(const UniqueId& uid, DeviceRecord& record) override;
+  uint32_t GetPageCrc(const uint32_t& index) override;
+  void Forget(const UniqueId& uid) override;
+
+  void StartRecord(const UniqueId& uid) override;
+  void SetPageCrc(const uint32_t& index, const uint32_t& crc) override;
+  bool Commit(const DeviceRecord& record) override;
+
+  size_t GetNumDevices() const { return devices_.size(); };
+
+ private:
+  struct Entry {
+    DeviceRecord record;
+    std::vector<uint32_t> page_crcs;
+  };
+
+  std::string file_name_;
+  std::map<std::string, Entry> devices_;
+  Entry found_ = {};
+  std::string pending_key_;
+  Entry pending_ = {};
+
+  static std::string ToKey(const UniqueId& uid);
+  bool Save();
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_DEVICE_STATE_STD_HPP
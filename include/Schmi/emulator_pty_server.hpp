@@ -0,0 +1,49 @@
+#ifndef SCHMI_EMULATOR_PTY_SERVER_HPP
+#define SCHMI_EMULATOR_PTY_SERVER_HPP
+
+#include "Schmi/stm32_emulator.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace Schmi {
+
+// An Stm32Emulator behind a pseudo terminal, so a SerialPosix opened on GetPortPath talks to it like
+// to a board on a USB-serial adapter. The emulator is only used from the server thread, with a
+// steady clock its timings are paid in real time.
+//
+// With swap_boards, a board that was started is reset right away, like the next board put on the
+// fixture, so one port can be flashed again and again.
+class EmulatorPtyServer {
+ public:
+  EmulatorPtyServer(Stm32Emulator& board, const bool& swap_boards = false)
+      : board_(board), swap_boards_(swap_boards){};
+  ~EmulatorPtyServer() { Stop(); };
+
+  // Opens the pty and starts serving. False if there is no pty to be had.
+  bool Start();
+  void Stop();
+
+  // The slave side, like /dev/pts/3
+  const std::string& GetPortPath() const { return port_path_; };
+  // Boards started so far
+  uint32_t GetNumBoards() const { return num_boards_; };
+
+ private:
+  Stm32Emulator& board_;
+  bool swap_boards_;
+  std::string port_path_;
+  int master_fd_ = -1;
+  int slave_fd_ = -1;  // held so the master doesn't hang up between two hosts
+  int stop_pipe_[2] = {-1, -1};
+  std::thread thread_;
+  std::atomic<uint32_t> num_boards_{0};
+
+  void Serve();
+  bool Send(const uint8_t* bytes, const size_t& num_bytes);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_EMULATOR_PTY_SERVER_HPP
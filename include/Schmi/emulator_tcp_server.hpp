@@ -0,0 +1,44 @@
+#ifndef SCHMI_EMULATOR_TCP_SERVER_HPP
+#define SCHMI_EMULATOR_TCP_SERVER_HPP
+
+#include "Schmi/stm32_emulator.hpp"
+#include "Schmi/telnet.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+namespace Schmi {
+
+// A serial server on the loopback interface with an Stm32Emulator behind it, standing in for a
+// ser2net box with a board on its UART. Raw, or telnet with RFC 2217 where SET-BAUDRATE goes to
+// Stm32Emulator::SetBaudRate. One connection at a time, the emulator is only used from the server
+// thread: give it a SimClock of its own to take the bootloader out of the round trip.
+class EmulatorTcpServer {
+ public:
+  EmulatorTcpServer(Stm32Emulator& board, const bool& rfc2217 = false) : board_(board), rfc2217_(rfc2217){};
+  ~EmulatorTcpServer() { Stop(); };
+
+  // Listens on 127.0.0.1, on port if it isn't 0. False if it can't.
+  bool Start(const uint16_t& port = 0);
+  void Stop();
+
+  uint16_t GetPort() const { return port_; };
+  uint32_t GetBaudRate() const { return baud_rate_; };
+
+ private:
+  Stm32Emulator& board_;
+  bool rfc2217_;
+  uint16_t port_ = 0;
+  int listen_fd_ = -1;
+  int stop_pipe_[2] = {-1, -1};
+  std::thread thread_;
+  std::atomic<uint32_t> baud_rate_{0};
+
+  void Serve();
+  // Until the client goes away or Stop
+  void ServeClient(const int& fd);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_EMULATOR_TCP_SERVER_HPP
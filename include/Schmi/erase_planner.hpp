@@ -0,0 +1,100 @@
+#ifndef SCHMI_ERASE_PLANNER_HPP
+#define SCHMI_ERASE_PLANNER_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// Flash layout and erase times of a chip, the times come from the datasheets (tERASE typ/max).
+// A flash_size of 0 means we don't know the chip, then only page erase or a mass erase the caller
+// explicitly allowed can be planned.
+struct ChipTiming {
+  uint16_t product_id;
+  uint32_t page_size;
+  uint32_t flash_size;
+  uint8_t num_banks;  // bank erase (0xFFFE / 0xFFFD) needs 2 banks
+  uint16_t page_erase_ms;
+  uint16_t page_erase_max_ms;
+  uint16_t mass_erase_ms;  // also used for a bank erase
+  uint16_t mass_erase_max_ms;
+};
+
+// What a round trip to the bootloader costs on this link
+struct LinkTiming {
+  uint32_t baud_rate;
+  uint32_t round_trip_us;
+};
+
+const ChipTiming DEFAULT_CHIP_TIMING = {0x0000, 2048, 0, 1, 25, 40, 25, 40};
+const LinkTiming DEFAULT_LINK_TIMING = {115200, 1000};
+
+enum class EraseType { kPages, kBank, kMass };
+
+// One erase operation: either a special code, or a page range sent as consecutive EXTEND_ERASE
+// messages of at most pages_per_message pages, each with its own ACK timeout
+struct EraseStep {
+  EraseType type;
+  uint16_t special_code;
+  uint32_t first_page;
+  uint32_t num_pages;
+  uint16_t pages_per_message;
+  uint16_t timeout_ms;
+  uint32_t estimated_us;
+};
+
+const uint8_t MAX_ERASE_STEPS = 2;  // one per bank
+
+struct ErasePlan {
+  EraseStep steps[MAX_ERASE_STEPS];
+  uint8_t num_steps;
+  uint32_t estimated_us;
+};
+
+// Looks up the timing of a known product ID, DEFAULT_CHIP_TIMING otherwise
+const ChipTiming& FindChipTiming(const uint16_t& product_id);
+
+// Address of the 96 bit unique device ID of a known product ID, 0 otherwise
+uint32_t FindUniqueIdAddress(const uint16_t& product_id);
+
+class ErasePlanner {
+ public:
+  // Pages per EXTEND_ERASE message allowed by a 512 byte message: (512 / 2) - 3
+  static const uint16_t MAX_PAGES_PER_MESSAGE = 254;
+
+  ErasePlanner(const ChipTiming& chip = DEFAULT_CHIP_TIMING, const LinkTiming& link = DEFAULT_LINK_TIMING,
+               const uint32_t& max_message_ms = 8000)
+      : chip_(chip), link_(link), max_message_ms_(max_message_ms){};
+  ~ErasePlanner(){};
+
+  /**
+   * @brief Plan Picks the fastest way to erase pages [first_page, first_page + num_pages)
+   * @param allow_erase_outside_range If false, bank and mass erase are only used when the range
+   * covers the whole bank or flash, so nothing outside the range is lost
+   * @return the plan, with per message batch sizes and timeouts
+   */
+  ErasePlan Plan(const uint32_t& first_page, const uint32_t& num_pages,
+                 const bool& allow_erase_outside_range) const;
+
+  // A 0xFFFF global erase step, for callers that ask for it explicitly
+  EraseStep PlanMassErase() const;
+
+  uint32_t EstimatePagesUs(const uint32_t& num_pages) const;
+  uint32_t EstimateSpecialUs() const;
+
+ private:
+  ChipTiming chip_;
+  LinkTiming link_;
+  uint32_t max_message_ms_;
+
+  EraseStep PlanPages(const uint32_t& first_page, const uint32_t& num_pages) const;
+  EraseStep PlanBank(const uint8_t& bank) const;
+
+  bool IsWorthWiping(const uint32_t& special_us, const uint32_t& pages_us) const;
+  uint16_t PagesPerMessage(const uint32_t& num_pages) const;
+  uint16_t PagesTimeoutMs(const uint16_t& pages_per_message) const;
+  uint16_t SpecialTimeoutMs() const;
+  uint32_t WireTimeUs(const uint32_t& num_bytes) const;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_ERASE_PLANNER_HPP
@@ -0,0 +1,35 @@
+#ifndef SCHMI_ERROR_HANDLER_CAPTURE_HPP
+#define SCHMI_ERROR_HANDLER_CAPTURE_HPP
+
+#include "Schmi/error_handler_interface.hpp"
+
+#include <iostream>
+
+namespace Schmi {
+
+// Error handler that never exits the process. Every caller of DisplayAndDie already returns 0
+// afterwards, so the failure propagates up to FlashLoader and the session can be retried.
+class ErrorHandlerCapture : public ErrorHandlerInterface {
+ public:
+  ErrorHandlerCapture(bool verbose = false) : verbose_(verbose){};
+  ~ErrorHandlerCapture(){};
+
+  void Init(const Schmi::Error& error) override;
+  void Display() override;
+  void DisplayAndDie() override;
+
+  const Error& GetLastError() const { return error_; };
+  uint32_t GetNumErrors() const { return num_errors_; };
+  bool HasDied() const { return died_; };
+
+  void Reset();
+
+ private:
+  bool verbose_;
+  Error error_ = {"", "", 0};
+  uint32_t num_errors_ = 0;
+  bool died_ = false;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_ERROR_HANDLER_CAPTURE_HPP
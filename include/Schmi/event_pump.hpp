@@ -0,0 +1,44 @@
+#ifndef SCHMI_EVENT_PUMP_HPP
+#define SCHMI_EVENT_PUMP_HPP
+
+#include "Schmi/event_ring.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+namespace Schmi {
+
+// Drains an event ring on its own thread and hands every event to a sink, so printing, logging
+// or updating widgets never runs on the I/O thread. The ring is polled, the producer doesn't
+// have to wake anyone up.
+class EventPump {
+ public:
+  using Sink = std::function<void(const SessionEvent&)>;
+
+  EventPump(EventRing& ring, const Sink& sink, const uint32_t& poll_us = 2000)
+      : ring_(ring), sink_(sink), poll_us_(poll_us){};
+  ~EventPump() { Stop(); };
+
+  void Start();
+
+  // Stops polling once the events already queued are handed over
+  void Stop();
+
+  // Hands over what is queued now, on the calling thread. For owners with a loop of their own,
+  // like a GUI timer, instead of Start.
+  uint32_t Drain();
+
+ private:
+  EventRing& ring_;
+  Sink sink_;
+  uint32_t poll_us_;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+
+  void Run();
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_EVENT_PUMP_HPP
@@ -0,0 +1,54 @@
+#ifndef SCHMI_EVENT_RING_HPP
+#define SCHMI_EVENT_RING_HPP
+
+#include <stdint.h>
+#include <atomic>
+
+namespace Schmi {
+
+enum class EventKind : uint8_t { kWriteStart, kVerifyStart, kProgress, kEnd, kWarning, kError };
+
+// What a session has to tell the console, a GUI or a log, small enough to copy around
+struct SessionEvent {
+  static const uint8_t TEXT_SIZE = 64;
+
+  EventKind kind;
+  int32_t num;          // percent for progress, the error number for warnings and errors
+  uint64_t value;       // total bytes for the starts, bytes left for progress
+  char text[TEXT_SIZE];  // where and what for warnings and errors, cut short, always terminated
+};
+
+/**
+ * Fixed size single-producer, single-consumer queue of session events. The I/O thread pushes and
+ * never waits: when the consumer falls behind, the event is dropped and counted instead. No lock
+ * and no allocation, the consumer drains it on its own thread (see EventPump). The last slot is
+ * kept for errors, so the one that ends a session still gets through a ring full of progress.
+ */
+class EventRing {
+ public:
+  static const uint32_t CAPACITY = 256;  // a power of two
+
+  EventRing(){};
+  ~EventRing(){};
+
+  // Producer thread only, false when the ring is full and the event was dropped. Other kinds than
+  // kError can only fill CAPACITY - 1 slots
+  bool Push(const SessionEvent& event);
+  bool Push(const EventKind& kind, const int32_t& num, const uint64_t& value, const char* text = "");
+
+  // Consumer thread only, false when there is nothing to take
+  bool Pop(SessionEvent& event);
+
+  uint32_t GetNumDropped() const { return num_dropped_.load(std::memory_order_relaxed); };
+
+ private:
+  SessionEvent events_[CAPACITY];
+
+  // Apart so the two threads don't fight over a cache line
+  alignas(64) std::atomic<uint32_t> head_{0};  // next to pop, moved by the consumer
+  alignas(64) std::atomic<uint32_t> tail_{0};  // next to push, moved by the producer
+  std::atomic<uint32_t> num_dropped_{0};
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_EVENT_RING_HPP
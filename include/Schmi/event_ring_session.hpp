@@ -0,0 +1,53 @@
+#ifndef SCHMI_EVENT_RING_SESSION_HPP
+#define SCHMI_EVENT_RING_SESSION_HPP
+
+#include "Schmi/error_handler_interface.hpp"
+#include "Schmi/event_ring.hpp"
+#include "Schmi/loading_bar_interface.hpp"
+
+namespace Schmi {
+
+// The event of an error: "location: message", as much of it as fits
+SessionEvent MakeErrorEvent(const EventKind& kind, const Error& error);
+
+// Loading bar of a session that only queues events, one per percent at most
+class RingLoadingBar : public LoadingBarInterface {
+ public:
+  RingLoadingBar(EventRing& ring) : ring_(ring){};
+  ~RingLoadingBar(){};
+
+  void StartLoadingBar(const uint64_t& total_num_bytes) override;
+  void StartCheckingLoadingBar(const uint64_t& total_num_bytes) override;
+  void UpdateLoadingBar(const uint64_t& bytes_left) override;
+  void EndLoadingBar() override;
+
+ private:
+  EventRing& ring_;
+  uint64_t total_num_bytes_ = 0;
+  int32_t last_percent_ = -1;
+};
+
+// Error handler of a session that queues its errors and, like ErrorHandlerCapture, never exits
+// the process: the session fails and whoever drains the ring tells about it
+class RingErrorHandler : public ErrorHandlerInterface {
+ public:
+  RingErrorHandler(EventRing& ring) : ring_(ring){};
+  ~RingErrorHandler(){};
+
+  void Init(const Schmi::Error& error) override { error_ = error; };
+  void Display() override { Queue(EventKind::kWarning); };
+  void DisplayAndDie() override;
+
+  const Error& GetLastError() const { return error_; };
+  bool HasDied() const { return died_; };
+
+ private:
+  EventRing& ring_;
+  Error error_ = {"", "", 0};
+  bool died_ = false;
+
+  void Queue(const EventKind& kind);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_EVENT_RING_SESSION_HPP
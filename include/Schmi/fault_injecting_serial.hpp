@@ -0,0 +1,75 @@
+#ifndef SCHMI_FAULT_INJECTING_SERIAL_HPP
+#define SCHMI_FAULT_INJECTING_SERIAL_HPP
+
+#include "Schmi/clock_interface.hpp"
+#include "Schmi/serial_interface.hpp"
+#include "Schmi/stm32.hpp"
+
+#include <stdint.h>
+#include <random>
+
+namespace Schmi {
+
+// Byte rates are per byte on the wire, the other rates are per Read/Write call
+struct FaultConfig {
+  uint32_t seed = 1;
+
+  uint32_t latency_us = 0;         // added to every Read and Write
+  uint32_t latency_jitter_us = 0;  // uniform extra latency in [0, jitter]
+
+  double drop_byte_rate = 0.0;
+  double corrupt_byte_rate = 0.0;   // one random bit flipped
+  double spurious_nack_rate = 0.0;  // a single byte read (ACK) comes back as NACK
+  double partial_read_rate = 0.0;   // read stops halfway and times out, the rest stays in the port
+  double stall_write_rate = 0.0;
+  uint32_t stall_write_us = 50000;
+};
+
+struct FaultStats {
+  uint32_t dropped_bytes;
+  uint32_t corrupted_bytes;
+  uint32_t spurious_nacks;
+  uint32_t partial_reads;
+  uint32_t stalled_writes;
+  uint64_t injected_delay_us;
+};
+
+// Wraps another SerialInterface and degrades the line between it and Stm32. All the delays go
+// through the clock so the same faults can be replayed in real time or against a SimClock.
+class FaultInjectingSerial : public SerialInterface {
+ public:
+  FaultInjectingSerial(SerialInterface& ser, ClockInterface& clock, const FaultConfig& config)
+      : ser_(ser), clock_(clock), config_(config), rng_(config.seed){};
+  ~FaultInjectingSerial(){};
+
+  void Init() override;
+  bool Open() override { return ser_.Open(); };
+  void Close() override { ser_.Close(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override;
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms = 500) override;
+  bool SetBaudRate(const uint32_t& baud_rate) override { return ser_.SetBaudRate(baud_rate); };
+  void FlushInput() override { ser_.FlushInput(); };
+
+  // Reseeds the generator and clears the stats so a run can be replayed exactly
+  void Reset();
+  void SetConfig(const FaultConfig& config);
+
+  const FaultStats& GetStats() const { return stats_; };
+
+ private:
+  SerialInterface& ser_;
+  ClockInterface& clock_;
+  FaultConfig config_;
+  std::mt19937 rng_;
+  FaultStats stats_ = {0, 0, 0, 0, 0, 0};
+
+  uint8_t write_buffer_[MAX_MESSAGE_SIZE];
+
+  bool Chance(const double& rate);
+  void AddLatency();
+  void Delay(const uint64_t& duration_us);
+  uint8_t CorruptByte(const uint8_t& byte);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_FAULT_INJECTING_SERIAL_HPP
@@ -0,0 +1,171 @@
+#ifndef SCHMI_FLASH_DAEMON_HPP
+#define SCHMI_FLASH_DAEMON_HPP
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/bootloader_capabilities.hpp"
+#include "Schmi/clock_interface.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/io_thread.hpp"
+#include "Schmi/latency_histogram.hpp"
+#include "Schmi/link_scheduler.hpp"
+#include "Schmi/serial_interface.hpp"
+#include "Schmi/timeout_model.hpp"
+#include "Schmi/tracer.hpp"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Schmi {
+
+// Long running flashing service. The ports are opened and configured once and stay open, images
+// are loaded once and kept by content hash, so a board only costs the work on the wire. Station
+// software talks to it over a Unix domain socket, one request per line, answers are lines too:
+//
+//   LOAD <path>                 IMAGE <image_id> <size>
+//   FLASH <image_id> [port]     QUEUED <job_id>, then PROGRESS <job_id> write|verify <percent>
+//                               and DONE <job_id> <port> OK <total_us>
+//                                or DONE <job_id> <port> FAIL <where>: <message>
+//                                or DONE <job_id> <port> FAIL <where>: <message> REJECTED <reject_us>
+//                                when flash that doesn't match gave the board up, see FlashTiming
+//                                or DONE <job_id> <port> FAIL open if the port can't be opened
+//   STATUS                      PORT <name> IDLE|BUSY <boards_done> for every port, then QUEUE <num_jobs>
+//   LATENCY                     LATENCY <name> <acks> <p50_us> <p99_us> <p999_us> <max_us> for every
+//                               port, the ACK round trips of its finished jobs
+//   LINKS                       LINK <name> hub|chip <ports> <busy_percent> <max_transfers> <wait_ms>
+//                               for every USB link, with a link scheduler
+//
+// A port that can't be opened only fails its own jobs, and after a failed job it is closed and
+// opened again for the next one, in case the adapter went away with the board.
+// A job without a port goes to the first idle one. Anything else is answered with ERROR <message>.
+// Events of a job go to the connection that queued it, the job still runs if it goes away.
+// Answers and events are queued and written by the server thread when the socket takes them, so
+// a station that stops reading never holds up a port. One that falls MAX_OUTPUT_BYTES behind is
+// dropped.
+class FlashDaemon {
+ public:
+  static const uint32_t MAX_LINE_LENGTH = 4096;
+  static const uint8_t MAX_CLIENTS = 32;
+  static const uint32_t MAX_OUTPUT_BYTES = 1 << 20;
+
+  FlashDaemon(const std::string& socket_path) : socket_path_(socket_path){};
+  ~FlashDaemon() { Stop(); };
+
+  /**
+   * @brief AddPort Adds a port jobs can be scheduled on, before Start. The daemon doesn't own it.
+   * @param clock Time source of the session timings, the steady clock by default
+   */
+  void AddPort(const std::string& name, SerialInterface* ser, ClockInterface* clock = nullptr);
+
+  // How the worker thread of a port is scheduled, before Start. False for an unknown port.
+  bool SetIoThreadOptions(const std::string& port_name, const IoThreadOptions& options);
+
+  // Every job verifies page by page as it writes, see FlashLoader::SetInlineVerify. Before Start.
+  void SetInlineVerify(const bool& inline_verify) { inline_verify_ = inline_verify; };
+
+  // Records every job on the row of its port, see FlashLoader::SetTracer. Before Start.
+  void SetTracer(Tracer* tracer) { tracer_ = tracer; };
+
+  // Jobs ask the scheduler before every erase and transfer, the ports have to be added to it by
+  // their names here. Before Start.
+  void SetLinkScheduler(LinkScheduler* link_scheduler) { link_scheduler_ = link_scheduler; };
+
+  // Binds the socket, opens the ports and starts serving. False if the socket can't be bound.
+  bool Start();
+
+  // Stops taking requests, lets the running jobs finish and drops the queued ones
+  void Stop();
+
+  /**
+   * @brief LoadImage Same as a LOAD request
+   * @param image_id The content hash the image is kept by
+   * @param error Why it failed
+   * @return true if the image is loaded
+   */
+  bool LoadImage(const std::string& path, std::string& image_id, std::string& error);
+
+  const std::string& GetSocketPath() const { return socket_path_; };
+
+ private:
+  struct Client {
+    int fd;
+    bool open;         // false once it should be closed, the server thread closes it
+    std::mutex mutex;  // events come from the port workers
+    std::string input;
+    std::string output;  // not sent yet, guarded by mutex
+  };
+
+  struct Job {
+    uint32_t id;
+    std::shared_ptr<BinaryFileMemory> image;
+    std::string port;  // empty for any port
+    std::shared_ptr<Client> client;
+  };
+
+  class JobBar;  // streams the loading bar of a job as PROGRESS events
+
+  struct Port {
+    std::string name;
+    SerialInterface* ser;
+    ClockInterface* clock;
+    CapabilityCache capability_cache;  // one per worker, the cache isn't thread safe
+    IoThreadOptions io_options;
+    LatencyHistogram latency;  // guarded by mutex_, a job merges its own in when done
+    TimeoutModel timeouts;     // worker only, learned from board to board
+    uint32_t trace_port;
+    bool busy;
+    uint32_t boards_done;
+    std::thread worker;
+  };
+
+  std::string socket_path_;
+  int listen_fd_ = -1;
+  int stop_pipe_[2] = {-1, -1};
+  int wake_pipe_[2] = {-1, -1};  // output was queued for a client
+  bool running_ = false;
+  bool inline_verify_ = false;
+  Tracer* tracer_ = nullptr;
+  LinkScheduler* link_scheduler_ = nullptr;
+  std::thread server_;
+
+  ClockStd clock_;
+  std::vector<std::unique_ptr<Port>> ports_;
+  std::vector<std::shared_ptr<Client>> clients_;  // server thread only
+  std::map<std::string, std::shared_ptr<BinaryFileMemory>> images_;
+
+  // Guards the queue and the port states
+  std::mutex mutex_;
+  std::condition_variable job_cv_;
+  std::deque<std::shared_ptr<Job>> queue_;
+  uint32_t next_job_id_ = 1;
+  bool stopping_ = false;
+
+  void Serve();
+  void AcceptClient();
+  bool ReadClient(Client& client);
+  void HandleRequest(const std::shared_ptr<Client>& client, const std::string& line);
+  void HandleFlash(const std::shared_ptr<Client>& client, std::istream& request);
+  void HandleStatus(const std::shared_ptr<Client>& client);
+  void HandleLatency(const std::shared_ptr<Client>& client);
+  void HandleLinks(const std::shared_ptr<Client>& client);
+
+  void PortWorker(Port& port);
+  std::shared_ptr<Job> NextJob(Port& port);
+  // Flashes one board, returns the DONE line
+  std::string RunJob(Port& port, Job& job, LatencyHistogram& latency);
+
+  // Queues a line for the server thread to write, never blocks
+  void Send(Client& client, const std::string& line);
+  // Writes what the socket takes now, false if the client should be closed
+  static bool FlushClient(Client& client);
+  static void CloseClient(Client& client);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_FLASH_DAEMON_HPP
@@ -0,0 +1,98 @@
+#ifndef SCHMI_FLASH_ESTIMATOR_HPP
+#define SCHMI_FLASH_ESTIMATOR_HPP
+
+#include "Schmi/erase_planner.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// What the link and the chip cost. round_trip_us is paid for every ACK or answer the host waits
+// for, the wire time comes from the baud rate at 11 bits per byte (8E1).
+struct CostModel {
+  LinkTiming link;
+  uint32_t page_erase_us;
+  uint32_t special_erase_us;  // bank or mass erase
+  uint32_t program_ns_per_byte;
+  uint32_t checksum_us_per_kb;  // GET_CHECKSUM going through the flash
+};
+
+// Erase times from the chip's typical datasheet values, programming from the G4 (about 10 us
+// per byte through the bootloader)
+CostModel MakeCostModel(const ChipTiming& chip, const LinkTiming& link = DEFAULT_LINK_TIMING);
+
+enum class VerifyStrategy { kReadBack, kChecksum };
+
+// The arguments and settings of the FlashLoader the dry run drives
+struct DryRunOptions {
+  bool init_usart = true;
+  bool global_erase = false;
+  bool allow_erase_outside_image = false;
+  bool capabilities_cached = false;  // GET is skipped, see CapabilityCache
+  VerifyStrategy verify = VerifyStrategy::kReadBack;  // kChecksum gives the chip GET_CHECKSUM
+  uint32_t starting_flash = 0x08000000;
+  uint32_t start_address = 0x08000000;
+};
+
+struct PhaseEstimate {
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+  uint32_t round_trips;
+  uint64_t chip_us;  // erasing, programming or computing a checksum
+  uint64_t estimated_us;
+};
+
+// The phases line up with FlashTiming, except that FlashTiming counts discover as part of erase
+struct FlashEstimate {
+  bool completed;  // the session got to GO, error says why not otherwise
+  Error error;
+
+  PhaseEstimate connect;
+  PhaseEstimate discover;
+  PhaseEstimate erase;
+  PhaseEstimate write;
+  PhaseEstimate verify;
+  PhaseEstimate go;
+
+  ErasePlan erase_plan;
+  uint32_t pages_erased;  // by page list
+  uint8_t special_erases;
+  uint64_t bytes_programmed;  // padded to whole words like WRITE_MEMORY does
+  uint64_t bytes_checksummed;
+  uint64_t total_us;
+};
+
+// Dry run of FlashLoader::Flash: runs a FlashLoader against a Stm32Emulator of the chip on a
+// SimClock, counts the bytes and round trips of every phase, then prices them with a cost model.
+// Useful to know what a new image or baud rate will cost before a line changeover.
+class FlashEstimator {
+ public:
+  FlashEstimator(const ChipTiming& chip, const CostModel& model) : chip_(chip), model_(model){};
+  ~FlashEstimator(){};
+
+  FlashEstimate Estimate(const uint64_t& image_size, const DryRunOptions& options = DryRunOptions()) const;
+
+  // Prices the counts of an estimate with another model, the plan stays the same
+  void Price(FlashEstimate& estimate) const;
+
+ private:
+  ChipTiming chip_;
+  CostModel model_;
+
+  EmulatorConfig MakeEmulatorConfig(const uint64_t& image_size, const DryRunOptions& options) const;
+  void PricePhase(PhaseEstimate& phase, const uint64_t& chip_us) const;
+};
+
+/**
+ * @brief CalibrateCostModel Fits the round trip, programming and erase costs to a real session
+ * @param model The model the estimate was made with, the baud rate is kept
+ * @param estimate Dry run of the same image and options as the measured session
+ * @param measured FlashLoader::GetTiming() of that session
+ * @return the fitted model
+ */
+CostModel CalibrateCostModel(const CostModel& model, const FlashEstimate& estimate, const FlashTiming& measured);
+}  // namespace Schmi
+
+#endif  // SCHMI_FLASH_ESTIMATOR_HPP
@@ -2,31 +2,68 @@
 #define SCHMI_FLASH_LOADER_HPP
 
 #include "iq_flasher/include/Schmi/binary_file_interface.hpp"
+#include "iq_flasher/include/Schmi/bootloader_capabilities.hpp"
+#include "iq_flasher/include/Schmi/clock_interface.hpp"
+#include "iq_flasher/include/Schmi/crc32.hpp"
+#include "iq_flasher/include/Schmi/device_state_interface.hpp"
+#include "iq_flasher/include/Schmi/erase_planner.hpp"
 #include "iq_flasher/include/Schmi/error_handler_interface.hpp"
 #include "iq_flasher/include/Schmi/loading_bar_interface.hpp"
+#include "iq_flasher/include/Schmi/phase_gate_interface.hpp"
 #include "iq_flasher/include/Schmi/serial_interface.hpp"
 #include "iq_flasher/include/Schmi/stm32.hpp"
+#include "iq_flasher/include/Schmi/stub_client.hpp"
+#include "iq_flasher/include/Schmi/tracer.hpp"
 
 namespace Schmi {
 
 struct BinaryBytesData {
-  uint32_t current_byte_pos;
+  uint64_t current_byte_pos;
   uint32_t current_memory_address;
-  uint32_t bytes_left;
+  uint64_t bytes_left;
 };
 
-const uint16_t MAX_NUM_PAGES_TO_ERASE = 512;
+// When each phase of a session ended, in us since the session started: the call to Init, or to
+// Flash if Init wasn't called again since the last Flash. Only filled in when a clock is set.
+struct FlashTiming {
+  uint64_t init_done_us;
+  uint64_t sync_done_us;
+  uint64_t erase_done_us;
+  uint64_t first_write_us;  // first WRITE_MEMORY sent
+  uint64_t write_done_us;
+  uint64_t verify_done_us;
+  uint64_t total_us;
+  uint64_t reject_us;  // when a page that doesn't match gave the board up, 0 if none did
+};
+
+// Pages the verify of the last Flash found bad, and what the repair did about them
+struct RepairResult {
+  uint16_t pages_found;
+  uint16_t pages_repaired;
+  uint8_t passes;
+};
+
+// What the device state did for the last Flash
+struct DiffFlashResult {
+  bool used_record;  // the board was known and its flash matched the record
+  uint32_t pages_in_image;
+  uint32_t pages_written;
+};
 
 class FlashLoader {
  public:
   const uint32_t MAX_WRITE_SIZE = 256;
+  static const uint16_t MAX_REPAIR_PAGES = 64;
 
   FlashLoader(SerialInterface* ser, BinaryFileInterface* bin, ErrorHandlerInterface* err,
               LoadingBarInterface* bar)
       : ser_(ser), bin_(bin), err_(err), bar_(bar) {
     stm32_ = new Stm32(*ser_, *err_);
   };
-  ~FlashLoader() { delete stm32_; };
+  ~FlashLoader() {
+    delete stm32_;
+    delete stub_;
+  };
 
   void Init();
 
@@ -38,33 +75,192 @@ class FlashLoader {
   // For erasing only certain pages
   bool Flash(uint16_t* page_codes, const uint16_t& num_of_pages, bool init_usart = true);
 
+  // By default the chip is identified with GET_ID at the start of every Flash and its erase
+  // timings are looked up with FindChipTiming, this skips the lookup for all of them
+  void SetChipTiming(const ChipTiming& chip_timing);
+
+  // Every Flash asks the chip for its product ID and bootloader version, and with GET for its
+  // commands the first time that pair is seen. A cache shared between loaders of one thread
+  // saves the GET for every board after the first of its kind.
+  void SetCapabilityCache(CapabilityCache* cache) { capability_cache_ = cache; };
+  const BootloaderCapabilities& GetCapabilities() const { return capabilities_; };
+
+  // Lets the erase planner use a bank or mass erase even if it wipes pages the image doesn't cover
+  void SetAllowEraseOutsideImage(const bool& allow) { allow_erase_outside_image_ = allow; };
+
+  const ErasePlan& GetErasePlan() const { return erase_plan_; };
+
+  // CRC-32 of the image as it was written by the last Flash
+  uint32_t GetImageCrc32() const { return image_crc_.Get(); };
+
+  // Address of page 0, where the firmware is started once flashed. 0x08000000 on every STM32
+  void SetStartAddress(const uint32_t& start_address) { start_address_ = start_address; };
+
+  void SetClock(ClockInterface* clock);
+
+  // Round trip of every command to its ACK, for the jitter of the link (see Stm32::SetLatencyHistogram)
+  void SetLatencyHistogram(LatencyHistogram* histogram) { stm32_->SetLatencyHistogram(histogram); };
+
+  // Deadlines learned per chip and kind of wait instead of the fixed timeouts, a hung board is
+  // given up in ms (see TimeoutModel, and LoadTimeoutModel to keep it between runs). Needs a clock.
+  void SetTimeoutModel(TimeoutModel* timeout_model) { stm32_->SetTimeoutModel(timeout_model); };
+
+  /**
+   * @brief SetTracer Records the phases of every session (init, discover, erase, write, verify...)
+   * and, through Stm32, every bootloader command and wait inside them
+   * @param port From Tracer::AddPort, the row the spans go to
+   */
+  void SetTracer(Tracer* tracer, const uint32_t& port = 0);
+
+  // Asks the gate before every erase and every block written or read, see LinkScheduler
+  void SetPhaseGate(PhaseGateInterface* phase_gate) { phase_gate_ = phase_gate; };
+
+  /**
+   * @brief SetRepairBudget Lets the verify go on past a mismatch: every bad page is collected, then
+   * only those are erased, written again and verified again. Needs an image that can be read twice.
+   * @param max_pages More bad pages than this and the board is given up, at most MAX_REPAIR_PAGES.
+   * 0, the default, stops at the first mismatch.
+   * @param max_passes Erase, write and verify rounds before giving up on pages that stay bad
+   */
+  void SetRepairBudget(const uint16_t& max_pages, const uint8_t& max_passes = 2);
+  const RepairResult& GetRepairResult() const { return repair_result_; };
+
+  /**
+   * @brief SetInlineVerify Verifies every page right after it is written, with GET_CHECKSUM or by
+   * reading it back, instead of the whole image once it is all written. A bad page gives the board
+   * up, or is repaired within the repair budget, before the rest of the image is sent, see
+   * FlashTiming::reject_us. Costs a round trip per page on good boards. Stub sessions verify on
+   * the chip and don't use it.
+   */
+  void SetInlineVerify(const bool& inline_verify) { inline_verify_ = inline_verify; };
+
+  /**
+   * @brief SetDeviceState Remembers what each board was flashed with, by its 96 bit unique ID. When
+   * a known board comes back, its flash is checked against the record first. This costs one
+   * GET_CHECKSUM, or reading back its first and last pages. Then only the pages whose content
+   * changes are erased, written and verified. Needs an image that can be read twice and a chip
+   * whose unique ID address is known (FindUniqueIdAddress), other sessions flash in full.
+   */
+  void SetDeviceState(DeviceStateInterface* device_state) { device_state_ = device_state; };
+  const DiffFlashResult& GetDiffFlashResult() const { return diff_result_; };
+
+  /**
+   * @brief SetStub Flash through a loader stub: the chip is erased with the bootloader, then the
+   * stub is written to SRAM and started, and it does the writing and the verify (see StubClient)
+   * @param stub_image The stub, starting with the header from stub_protocol.hpp
+   * @param baud_rate Speed to switch to once the stub runs, 0 to stay at the bootloader speed
+   * @param load_address Where the stub goes in SRAM
+   */
+  void SetStub(BinaryFileInterface* stub_image, const uint32_t& baud_rate = 0,
+               const uint32_t& load_address = StubProtocol::DEFAULT_LOAD_ADDRESS);
+  const FlashTiming& GetTiming() const { return timing_; };
+
+  // Attempts and latency of the last sync with the bootloader (Stm32::Connect)
+  const ConnectResult& GetConnectResult() const { return connect_result_; };
+
  private:
-  const uint32_t START_ADDRESS_ = 0x08000000;
-  const uint32_t PAGE_SIZE_ = 2048;
-  
   SerialInterface* ser_;
   BinaryFileInterface* bin_;
   ErrorHandlerInterface* err_;
   LoadingBarInterface* bar_;
   Stm32* stm32_;
+  ClockInterface* clock_ = nullptr;
+  Tracer* tracer_ = nullptr;
+  uint32_t trace_port_ = 0;
+  PhaseGateInterface* phase_gate_ = nullptr;
+
+  // The port goes back to this speed after a stub session so the bootloader can be synced again
+  const uint32_t BOOTLOADER_BAUD_RATE = 115200;
+
+  StubClient* stub_ = nullptr;
+  BinaryFileInterface* stub_image_ = nullptr;
+  uint32_t stub_baud_rate_ = 0;
+  uint32_t stub_load_address_ = 0;
+  uint8_t stub_block_[StubProtocol::MAX_BLOCK_SIZE];
+
+  uint64_t total_num_bytes_ = 0;
+  uint32_t start_address_ = 0x08000000;
+
+  ChipTiming chip_timing_ = DEFAULT_CHIP_TIMING;
+  bool chip_timing_set_ = false;  // by SetChipTiming
+  bool allow_erase_outside_image_ = false;
+  ErasePlan erase_plan_ = {};
+  Crc32 image_crc_;
+  Crc32Stm32 image_checksum_;  // what GET_CHECKSUM should answer for the image
+
+  CapabilityCache own_capability_cache_;
+  CapabilityCache* capability_cache_ = &own_capability_cache_;
+  BootloaderCapabilities capabilities_ = {};
+
+  uint16_t repair_max_pages_ = 0;
+  uint8_t repair_max_passes_ = 0;
+  uint32_t bad_pages_[MAX_REPAIR_PAGES];
+  uint16_t num_bad_pages_ = 0;
+  RepairResult repair_result_ = {};
+  bool inline_verify_ = false;
+
+  DeviceStateInterface* device_state_ = nullptr;
+  UniqueId unique_id_ = {};
+  bool unique_id_known_ = false;
+  DeviceRecord device_record_ = {};
+  DiffFlashResult diff_result_ = {};
+
+  FlashTiming timing_ = {};
+  ConnectResult connect_result_ = {};
+  uint64_t session_start_us_ = 0;
+  bool session_started_ = false;
+
+  // Page codes of a single EXTEND_ERASE message, the list is generated as the erase goes
+  uint16_t pages_codes_buffer_[ErasePlanner::MAX_PAGES_PER_MESSAGE];
+
+  void StartSession();
+  uint64_t SessionUs();
+
+  /**
+   * @brief DiscoverCapabilities Reads the product ID and bootloader version, then the command list
+   * from the cache or with GET. Looks up the flash layout and erase timings too unless they were set.
+   * @return true if successful
+   */
+  bool DiscoverCapabilities();
 
-  uint32_t total_num_bytes_ = 0;
+  /**
+   * @brief CheckFlashRange Makes sure the image fits between the start address and the end of the
+   * 32 bit address space, with every page addressable by a 16 bit EXTEND_ERASE page code
+   * @param starting_flash Where the image will be written
+   * @return true if the image fits
+   */
+  bool CheckFlashRange(const uint32_t& starting_flash);
 
-  uint16_t pages_codes_buffer[MAX_NUM_PAGES_TO_ERASE];
+  /**
+   * @brief Erase Runs every step of an erase plan, page lists are generated one message at a time
+   * @param plan The plan from ErasePlanner
+   * @return true if successful
+   */
+  bool Erase(const ErasePlan& plan);
 
   /**
-   * @brief GetPagesCodesFromBinary Based on the starting page, returns an array of the pages that we will flash
-   * @param page_offset The starting flash
-   * @return the array
+   * @brief GetNumPagesFromBinary Counts the pages the binary touches when written at starting_flash
+   * @param starting_flash The starting flash location, doesn't have to be page aligned
+   * @return the number of pages
    */
-  uint16_t GetPagesCodesFromBinary(uint16_t page_offset);
+  uint32_t GetNumPagesFromBinary(const uint32_t& starting_flash);
 
   /**
    * @brief CalculatePageOffset Based on where the flash starts (from the metadata) calculate how many pages to skip
    * @param memoryLocation The starting flash location
    * @return The number of pages to skip
    */
-  uint16_t CalculatePageOffset(uint16_t memoryLocation);
+  uint32_t CalculatePageOffset(uint32_t memoryLocation);
+
+  /**
+   * @brief FlashWithStub Uploads and starts the loader stub, then writes, verifies and starts the
+   * firmware through it
+   * @param curAddress Where the image goes
+   * @return true if successful
+   */
+  bool FlashWithStub(uint32_t curAddress);
+  bool StubFlashBytes(uint32_t curAddress);
+  bool StubCheckMemory(uint32_t curAddress);
 
   /**
    * @brief FlashBytes Flash the memory starting at a given adress
@@ -73,16 +269,106 @@ class FlashLoader {
    */
   bool FlashBytes(uint32_t curAddress);
 
+  /**
+   * @brief WriteChunk Writes num_bytes of the image with the frame the image has built, or one
+   * built from its bytes (see BinaryFileInterface::GetWriteFrame)
+   * @param buffer At least num_bytes long, for the bytes when the image has no frame
+   * @return the bytes that were written, nullptr if the write failed
+   */
+  const uint8_t* WriteChunk(const uint64_t& byte_pos, const uint16_t& num_bytes, const uint32_t& address,
+                            uint8_t* buffer);
+
+  // ReadMemory of one chunk, a transfer for the phase gate like a WriteChunk
+  bool ReadChunk(uint8_t* buffer, const uint16_t& num_bytes, const uint32_t& address);
+
+  /**
+   * @brief FlashAndVerifyPages FlashBytes and CheckMemory interleaved, page by page. The CRC a page
+   * should have is computed while it is written, so streams can be verified this way too, only
+   * the repair needs to read the image again.
+   * @param curAddress the current adress you want to flash
+   * @return true if every page matches
+   */
+  bool FlashAndVerifyPages(uint32_t curAddress);
+  bool SpanMatches(const uint32_t& address, const uint32_t& num_bytes, const bool& use_checksum,
+                   const uint32_t& expected, bool& matches);
+
+  // Stops the session on flash that doesn't match the image, and notes when for FlashTiming::reject_us
+  void RejectBoard(const Error& err);
+
   /**
    * @brief CheckMemory Verify that what you flashed is the same as the data in the binary file
    * @param curAddress The starting adress for verification
    * @return True if successful
    */
   bool CheckMemory(uint32_t curAddress);
+
+  /**
+   * @brief CheckMemoryCrc Verify for images that can't be read twice: reads the flash back and
+   * compares its CRC to the one computed while flashing
+   * @param curAddress The starting adress for verification
+   * @return True if successful
+   */
+  bool CheckMemoryCrc(uint32_t curAddress);
+
+  /**
+   * @brief CheckMemoryChecksum Verify with GET_CHECKSUM: the chip computes the CRC of the flash
+   * itself, only 5 bytes come back instead of the whole image
+   * @param curAddress The starting adress for verification, must be a multiple of 4
+   * @return True if successful
+   */
+  bool CheckMemoryChecksum(uint32_t curAddress);
+  bool GetMemoryChecksum(const uint32_t& address, const uint64_t& num_bytes, uint32_t& checksum);
+
+  /**
+   * @brief CheckAndRepairMemory Verify that collects the bad pages instead of stopping at the first,
+   * then rewrites them within the repair budget
+   * @param curAddress The starting adress for verification
+   * @return True if every page matches in the end
+   */
+  bool CheckAndRepairMemory(uint32_t curAddress);
+
+  /**
+   * @brief FindBadPages Verifies page by page and keeps the list of those that don't match
+   * @param all_pages Every page of the image, or only those of the current list
+   * @return false on a bootloader error or when there are more bad pages than the budget
+   */
+  bool FindBadPages(uint32_t curAddress, const bool& all_pages);
+  bool PageMatches(uint32_t curAddress, const uint32_t& page, bool& matches);
+  bool RewritePages(uint32_t curAddress);
+
+  // Writes the part of the image in pages [first_page, first_page + num_pages)
+  bool WritePages(uint32_t curAddress, const uint32_t& first_page, const uint32_t& num_pages);
+
+  /**
+   * @brief CheckDeviceRecord Compares the flash of a known board to its record
+   * @param consistent False if the board was flashed by something else since, or is another layout
+   * @return false on a bootloader error
+   */
+  bool CheckDeviceRecord(bool& consistent);
+  bool ReadUniqueId();
+  bool ReadPageCrc(const uint32_t& page, uint32_t& crc);
+
+  /**
+   * @brief FlashChangedPages Erases, writes and verifies only the pages whose content differs from
+   * the record of the board, then records the new content and starts the firmware
+   * @param curAddress Where the image goes
+   * @return true if successful
+   */
+  bool FlashChangedPages(uint32_t curAddress);
+  bool IsPageUnchanged(const uint32_t& curAddress, const uint32_t& page);
+  bool FlashPageRun(uint32_t curAddress, const uint32_t& first_page, const uint32_t& num_pages);
+  void RecordDeviceState(uint32_t curAddress);
+
+  // CRC-32 of a page once the image is written: the image bytes with 0xFF around them
+  uint32_t ComputePageCrc(const uint32_t& curAddress, const uint32_t& page, Crc32Stm32* range_checksum = nullptr,
+                          Crc32* image_crc = nullptr);
+
+  // The part of a page the image covers, the first and last pages may be partial
+  void GetPageSpan(const uint32_t& curAddress, const uint32_t& page, uint32_t& address, uint32_t& num_bytes);
   bool CompareBinaryAndMemory(uint8_t* memory_buffer, uint8_t* binary_buffer,
                               const uint16_t& num_bytes);
 
-  uint16_t CheckNumBytesToWrite(const uint32_t& bytes_left);
+  uint16_t CheckNumBytesToWrite(const uint64_t& bytes_left);
 
   void UpdateBinaryBytesData(BinaryBytesData& binary_bytes_data, const uint16_t& num_bytes);
 };
@@ -0,0 +1,152 @@
+#ifndef SCHMI_FLASH_LOADER_STATIC_HPP
+#define SCHMI_FLASH_LOADER_STATIC_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+#include "Schmi/error_handler_interface.hpp"
+#include "Schmi/stm32_static.hpp"
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// Static dispatch version of FlashLoader, see Stm32Static. The backends are template parameters
+// and the chip layout and buffer sizes are compile time constants. There is no heap allocation,
+// the Stm32Static lives inside the loader and the page list is generated while erasing, so the
+// whole loader is sizeof(FlashLoaderStatic) on the stack or in .bss.
+//
+//   Schmi::FlashLoaderStatic<UartSerial, SpiFlashImage, LedErrors, NoBar> fl(&ser, &bin, &err, &bar);
+template <typename Serial, typename BinaryFile, typename ErrorHandler, typename LoadingBar,
+          uint32_t StartAddress = 0x08000000, uint32_t PageSize = 2048,
+          uint16_t MaxMessageSize = MAX_MESSAGE_SIZE>
+class FlashLoaderStatic {
+ public:
+  static constexpr uint16_t MAX_WRITE_SIZE = 256;
+
+  static_assert(PageSize % MAX_WRITE_SIZE == 0, "Pages must hold a whole number of writes");
+
+  FlashLoaderStatic(Serial* ser, BinaryFile* bin, ErrorHandler* err, LoadingBar* bar)
+      : ser_(ser), bin_(bin), err_(err), bar_(bar), stm32_(*ser, *err){};
+  ~FlashLoaderStatic(){};
+
+  void Init() {
+    ser_->Init();
+    bin_->Init();
+    total_num_bytes_ = bin_->GetBinaryFileSize();
+
+    return;
+  };
+
+  bool InitUsart() { return stm32_.InitUsart(); };
+
+  bool Flash(bool init_usart = true, bool global_erase = false, uint32_t starting_flash = StartAddress) {
+    if (init_usart) {
+      if (!stm32_.InitUsart()) {
+        return 0;
+      }
+    }
+
+    if (global_erase) {
+      if (!stm32_.SpecialExtendedErase(0xFFFF)) {
+        return 0;
+      }
+    } else {
+      // The image doesn't have to start on a page boundary, it may spill into one more page
+      uint32_t first_page = (starting_flash - StartAddress) / PageSize;
+      uint32_t page_offset = (starting_flash - StartAddress) % PageSize;
+      uint32_t num_of_pages = total_num_bytes_ ? (page_offset + total_num_bytes_ + PageSize - 1) / PageSize : 0;
+      if (!stm32_.ExtendedErase(first_page, num_of_pages)) {
+        return 0;
+      }
+    }
+
+    if (!FlashBytes(starting_flash)) {
+      return 0;
+    }
+
+    if (!CheckMemory(starting_flash)) {
+      return 0;
+    }
+
+    if (!stm32_.GoToAddress(StartAddress)) {
+      return 0;
+    }
+
+    return 1;
+  };
+
+  Stm32Static<Serial, ErrorHandler, MaxMessageSize>& GetStm32() { return stm32_; };
+
+ private:
+  Serial* ser_;
+  BinaryFile* bin_;
+  ErrorHandler* err_;
+  LoadingBar* bar_;
+  Stm32Static<Serial, ErrorHandler, MaxMessageSize> stm32_;
+
+  uint32_t total_num_bytes_ = 0;
+
+  uint8_t binary_buffer_[MAX_WRITE_SIZE];
+  uint8_t memory_buffer_[MAX_WRITE_SIZE];
+
+  bool FlashBytes(uint32_t address) {
+    bar_->StartLoadingBar(total_num_bytes_);
+
+    uint32_t bytes_left = total_num_bytes_;
+    uint32_t byte_pos = 0;
+    while (bytes_left) {
+      uint16_t num_bytes = bytes_left < MAX_WRITE_SIZE ? bytes_left : MAX_WRITE_SIZE;
+      bin_->GetBytesArray(binary_buffer_, {num_bytes, byte_pos});
+
+      if (!stm32_.WriteMemory(binary_buffer_, num_bytes, address + byte_pos)) {
+        return 0;
+      }
+
+      byte_pos += num_bytes;
+      bytes_left -= num_bytes;
+      bar_->UpdateLoadingBar(bytes_left);
+    }
+
+    bar_->EndLoadingBar();
+
+    return 1;
+  };
+
+  bool CheckMemory(uint32_t address) {
+    bar_->StartCheckingLoadingBar(total_num_bytes_);
+
+    uint32_t bytes_left = total_num_bytes_;
+    uint32_t byte_pos = 0;
+    while (bytes_left) {
+      uint16_t num_bytes = bytes_left < MAX_WRITE_SIZE ? bytes_left : MAX_WRITE_SIZE;
+      bin_->GetBytesArray(binary_buffer_, {num_bytes, byte_pos});
+
+      if (!stm32_.ReadMemory(memory_buffer_, num_bytes, address + byte_pos)) {
+        return 0;
+      }
+      for (uint16_t ii = 0; ii < num_bytes; ii++) {
+        if (memory_buffer_[ii] != binary_buffer_[ii]) {
+          Schmi::Error err = {"CheckBytes", "Bytes do not match", (int)(byte_pos + ii)};
+          err_->Init(err);
+          err_->DisplayAndDie();
+          return 0;
+        }
+      }
+
+      byte_pos += num_bytes;
+      bytes_left -= num_bytes;
+      bar_->UpdateLoadingBar(bytes_left);
+    }
+
+    bar_->EndLoadingBar();
+
+    return 1;
+  };
+};
+
+template <typename Serial, typename BinaryFile, typename ErrorHandler, typename LoadingBar,
+          uint32_t StartAddress, uint32_t PageSize, uint16_t MaxMessageSize>
+constexpr uint16_t FlashLoaderStatic<Serial, BinaryFile, ErrorHandler, LoadingBar, StartAddress,
+                                     PageSize, MaxMessageSize>::MAX_WRITE_SIZE;
+}  // namespace Schmi
+
+#endif  // SCHMI_FLASH_LOADER_STATIC_HPP
@@ -0,0 +1,99 @@
+#ifndef SCHMI_IMAGE_STORE_HPP
+#define SCHMI_IMAGE_STORE_HPP
+
+#include "Schmi/binary_file_mapped.hpp"
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Schmi {
+
+// A part of an image that isn't blank (all 0xFF), in SEGMENT_GRANULE steps
+struct ImageSegment {
+  uint64_t offset;
+  uint64_t length;
+};
+
+struct ImageInfo {
+  std::string hash;     // 16 hex digits, the name of the object
+  uint32_t product_id;  // 0 when the file name doesn't tell
+  uint8_t version;
+  uint64_t size;
+  std::vector<ImageSegment> segments;
+};
+
+// Images kept by content in a directory:
+//   <root>/objects/<hash>   the bytes, never changed once written
+//   <root>/index.txt        one image per line:
+//                           <hash> <product id> <version> <size> <num segments> <offset>:<length>...
+// Images are ingested from files named like 0x100016_iq2306_2200kv.bin, the hex prefix is the
+// product ID followed by a version byte (product 0x1000, version 0x16 there). Looking an image up
+// by hash or product ID is a hash map lookup, the image comes back mapped from its object and is
+// shared with every other session flashing it. Safe to use from several threads.
+class ImageStore {
+ public:
+  static const uint32_t SEGMENT_GRANULE = 256;
+
+  ImageStore(const std::string& root_dir) : root_dir_(root_dir){};
+  ~ImageStore(){};
+
+  // Creates the directories if needed and reads the index, false if neither works
+  bool Init();
+
+  /**
+   * @brief Ingest Copies the images into the store, hashing them on num_threads threads at once
+   * @param paths Image files, the ones already in the store only cost the read, the hash and a
+   * comparison with the stored bytes
+   * @param errors Why a file was left out, one line each
+   * @param num_threads 0 for one per core
+   * @return How many images the store didn't have yet
+   */
+  size_t Ingest(const std::vector<std::string>& paths, std::vector<std::string>& errors,
+                const uint32_t& num_threads = 0);
+
+  // The .bin files of a directory, sorted, to hand to Ingest
+  static std::vector<std::string> ListImages(const std::string& dir);
+
+  // nullptr if there is no such image. Pointers stay valid until the store goes away.
+  const ImageInfo* FindByHash(const std::string& hash) const;
+  // The highest version of the product
+  const ImageInfo* FindByProduct(const uint32_t& product_id) const;
+
+  // The image mapped from its object, nullptr if it isn't in the store or can't be mapped
+  std::shared_ptr<BinaryFileMapped> Open(const std::string& hash);
+  std::shared_ptr<BinaryFileMapped> OpenProduct(const uint32_t& product_id);
+
+  size_t GetNumImages() const;
+
+  // Product ID and version from a file name, false if it doesn't start with 0x<hex>
+  static bool ParseImageName(const std::string& file_name, uint32_t& product_id, uint8_t& version);
+  // 64 bit FNV-1a of the bytes, as 16 hex digits
+  static std::string HashBytes(const uint8_t* bytes, const uint64_t& num_bytes);
+  static std::vector<ImageSegment> FindSegments(const uint8_t* bytes, const uint64_t& num_bytes);
+
+ private:
+  std::string root_dir_;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<ImageInfo>> images_;  // by hash, the index is written in this order
+  std::unordered_map<std::string, const ImageInfo*> by_hash_;
+  std::unordered_map<uint32_t, const ImageInfo*> by_product_;
+  std::unordered_map<std::string, std::weak_ptr<BinaryFileMapped>> open_;
+
+  std::string GetObjectPath(const std::string& hash) const { return root_dir_ + "/objects/" + hash; };
+  // Reads, hashes and stores one file, on an ingest thread
+  bool IngestFile(const std::string& path, ImageInfo& info, std::string& error);
+  // False with the error if the object isn't these bytes
+  static bool ObjectMatches(const std::string& object_path, const std::vector<uint8_t>& bytes, std::string& error);
+  // With mutex_ held, true if the index has to be written again
+  bool AddImage(const ImageInfo& info);
+  bool SaveIndex();
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_IMAGE_STORE_HPP
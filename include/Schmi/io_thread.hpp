@@ -0,0 +1,33 @@
+#ifndef SCHMI_IO_THREAD_HPP
+#define SCHMI_IO_THREAD_HPP
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+namespace Schmi {
+
+// How the thread running a port's protocol loop is scheduled. Each ACK round trip waits on the
+// scheduler twice, on a loaded station that jitter adds up over hundreds of writes.
+struct IoThreadOptions {
+  int cpu = -1;              // core to pin the thread to, -1 to let it run anywhere
+  int rt_priority = 0;       // SCHED_FIFO priority, 1 to 99, 0 to stay SCHED_OTHER
+  bool lock_memory = false;  // mlockall, so a page fault never stalls a round trip
+};
+
+// What could be applied. Missing privileges aren't an error: the thread just runs as it would have.
+struct IoThreadStatus {
+  bool pinned;
+  bool realtime;
+  bool memory_locked;
+  std::string warnings;  // one line per option that couldn't be applied
+};
+
+// Applies the options to the calling thread. Memory locking is process wide.
+IoThreadStatus ApplyIoThreadOptions(const IoThreadOptions& options);
+
+// Runs work on a new thread set up with the options and waits for it
+IoThreadStatus RunOnIoThread(const IoThreadOptions& options, const std::function<void()>& work);
+}  // namespace Schmi
+
+#endif  // SCHMI_IO_THREAD_HPP
@@ -0,0 +1,54 @@
+#ifndef SCHMI_LATENCY_HISTOGRAM_HPP
+#define SCHMI_LATENCY_HISTOGRAM_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// Durations in us, kept in buckets eight to a power of two: a percentile is off by at most 12.5%
+// whatever the scale, and recording costs no allocation, so it can sit in the ACK path
+class LatencyHistogram {
+ public:
+  static const uint8_t SUB_BUCKETS = 8;
+  static const uint16_t NUM_BUCKETS = 30 * SUB_BUCKETS;  // up to 2^32 us, over an hour
+
+  LatencyHistogram() { Reset(); };
+  ~LatencyHistogram(){};
+
+  void Reset();
+  void Record(const uint64_t& duration_us);
+
+  // Adds the samples of another histogram, to sum up several ports
+  void Merge(const LatencyHistogram& other);
+
+  uint64_t GetCount() const { return count_; };
+  uint64_t GetMaxUs() const { return max_us_; };
+  uint64_t GetMeanUs() const { return count_ ? total_us_ / count_ : 0; };
+
+  /**
+   * @brief GetPercentileUs Smallest duration at least the given share of the samples stay under
+   * @param percentile 0 to 100, 99.9 for the one in a thousand tail
+   * @return the upper edge of the bucket, never more than the max, 0 without samples
+   */
+  uint64_t GetPercentileUs(const double& percentile) const;
+
+  // Halves every bucket, so older samples weigh less than new ones once enough are in
+  void Decay();
+
+  // Raw buckets, to store a histogram and load it again. A loaded sample counts as the upper edge
+  // of its bucket.
+  uint64_t GetBucketCount(const uint16_t& bucket) const { return buckets_[bucket]; };
+  void AddToBucket(const uint16_t& bucket, const uint64_t& count);
+
+ private:
+  uint64_t buckets_[NUM_BUCKETS];
+  uint64_t count_;
+  uint64_t total_us_;
+  uint64_t max_us_;
+
+  static uint16_t BucketOf(const uint64_t& duration_us);
+  static uint64_t BucketUpperUs(const uint16_t& bucket);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,105 @@
+#ifndef SCHMI_LINK_SCHEDULER_HPP
+#define SCHMI_LINK_SCHEDULER_HPP
+
+#include "Schmi/clock_interface.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/phase_gate_interface.hpp"
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Schmi {
+
+// Where a tty sits on the USB tree, as sysfs directory names: the interface of a multi-channel
+// chip, the chip, and the hub the chip is plugged into (a root hub like usb1 for a chip on a host
+// port). Ports without a USB device get their own name for all three.
+struct UsbTopology {
+  std::string name;       // ttyUSB0
+  std::string interface;  // 1-1.2:1.0
+  std::string chip;       // 1-1.2
+  std::string hub;        // 1-1
+};
+
+// Resolves <sysfs_tty_dir>/<name>/device like PortWatcher::ReadUsbInfo. False if it isn't a USB
+// device, the topology is then the name alone.
+bool ReadUsbTopology(const std::string& sysfs_tty_dir, const std::string& name, UsbTopology& topology);
+
+// Transfers at once on one link, 0 for no cap. Off by default: a block at bootloader baud rates
+// is far below what a chip or a USB 2.0 hub carries, so a cap is for links measured to be short,
+// with LINKS showing transfers waiting on the board side.
+struct LinkLimits {
+  uint8_t max_transfers_per_chip = 0;  // channels of one chip share its USB endpoint and its buffers
+  uint8_t max_transfers_per_hub = 0;   // a USB 2.0 hub link shared by every chip behind it
+};
+
+// How a chip or hub link was used since the scheduler was made
+struct LinkStats {
+  std::string name;
+  bool is_hub;
+  uint32_t num_ports;
+  uint32_t transfers;        // running now
+  uint32_t max_transfers;    // most at once
+  uint64_t busy_us;          // with at least one transfer running
+  uint64_t transfer_us;      // of all transfers together
+  uint64_t wait_us;          // transfers waited for the link
+  uint64_t elapsed_us;       // since the scheduler was made
+};
+
+// Schedules the sessions of a multi-port station on the USB links their ports share: each session
+// asks its port's gate (FlashLoader::SetPhaseGate) before an erase and before every block it
+// writes or reads. Erases never wait, they leave the link idle. A block waits until its chip and
+// its hub are under their limits, in the order they asked, so the blocks of sibling ports take
+// turns instead of fighting over the link. Without limits it only measures the links.
+class LinkScheduler {
+ public:
+  LinkScheduler(const LinkLimits& limits = LinkLimits(), ClockInterface* clock = nullptr);
+  ~LinkScheduler();
+
+  // Adds a port, before any session of it runs
+  void AddPort(const UsbTopology& topology);
+  // ReadUsbTopology then AddPort, false if the port isn't on USB (it is added on its own link)
+  bool AddPort(const std::string& name, const std::string& sysfs_tty_dir = "/sys/class/tty");
+
+  // The gate of a port for its FlashLoader, nullptr for an unknown port. One session at a time.
+  PhaseGateInterface* GetGate(const std::string& port_name);
+
+  // Hubs first, then chips, by name
+  std::vector<LinkStats> GetLinkStats();
+
+ private:
+  struct Link {
+    LinkStats stats;
+    uint8_t limit;
+    uint64_t busy_since_us;
+  };
+
+  class PortGate;
+
+  LinkLimits limits_;
+  ClockStd default_clock_;
+  ClockInterface* clock_;
+  uint64_t created_us_;
+
+  std::mutex mutex_;
+  std::condition_variable link_cv_;
+  std::map<std::string, Link> chips_;
+  std::map<std::string, Link> hubs_;
+  std::map<std::string, std::unique_ptr<PortGate>> gates_;
+  std::deque<PortGate*> waiting_;  // transfers in the order they asked
+
+  Link& GetLink(std::map<std::string, Link>& links, const std::string& name, const bool& is_hub);
+  // With mutex_ held
+  bool CanStart(const PortGate& gate) const;
+  void StartTransfer(PortGate& gate, const uint64_t& now_us);
+  void EndTransfer(PortGate& gate, const uint64_t& now_us);
+  static void AddBusyTime(Link& link, const uint64_t& now_us);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_LINK_SCHEDULER_HPP
@@ -0,0 +1,21 @@
+#ifndef SCHMI_LOADING_BAR_NULL_HPP
+#define SCHMI_LOADING_BAR_NULL_HPP
+
+#include "Schmi/loading_bar_interface.hpp"
+
+namespace Schmi {
+
+// Shows nothing, for sessions nobody watches: side by side sessions, dry runs, tests and benchmarks
+class LoadingBarNull : public LoadingBarInterface {
+ public:
+  LoadingBarNull(){};
+  ~LoadingBarNull(){};
+
+  void StartLoadingBar(const uint64_t&) override{};
+  void StartCheckingLoadingBar(const uint64_t&) override{};
+  void UpdateLoadingBar(const uint64_t&) override{};
+  void EndLoadingBar() override{};
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_LOADING_BAR_NULL_HPP
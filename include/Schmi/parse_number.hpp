@@ -0,0 +1,36 @@
+#ifndef SCHMI_PARSE_NUMBER_HPP
+#define SCHMI_PARSE_NUMBER_HPP
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+namespace Schmi {
+
+/**
+ * @brief ParseNumber Reads a whole command line argument as an unsigned number. Unlike std::stoul
+ * it doesn't throw: an empty string, a sign, trailing characters or a value over max are refused.
+ * @param base 10, 16, or 0 for the 0x and 0 prefixes of strtoul
+ * @return false if text isn't such a number, value is left alone then
+ */
+inline bool ParseNumber(const std::string& text, uint64_t& value, const uint64_t& max = UINT64_MAX,
+                        const int& base = 10) {
+  if (text.empty() || !isalnum((unsigned char)text[0])) {
+    return 0;
+  }
+
+  char* end;
+  errno = 0;
+  unsigned long long parsed = strtoull(text.c_str(), &end, base);
+  if (errno || *end != '\0' || parsed > max) {
+    return 0;
+  }
+  value = parsed;
+
+  return 1;
+}
+}  // namespace Schmi
+
+#endif  // SCHMI_PARSE_NUMBER_HPP
@@ -0,0 +1,43 @@
+#ifndef SCHMI_PHASE_GATE_INTERFACE_HPP
+#define SCHMI_PHASE_GATE_INTERFACE_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// What a session is busy with, as far as the link to its board is concerned: an erase keeps the
+// chip busy and the link idle, a transfer (one block written or read) keeps the link busy. The
+// waits for the board between blocks are left out so other sessions can use the link then.
+enum class SessionPhase : uint8_t { kErase, kTransfer };
+
+// Lets the owner of several sessions decide when each may start a phase, see LinkScheduler. Enter
+// may block until the phase can start. Phases can nest, only the outermost one has to count.
+class PhaseGateInterface {
+ public:
+  virtual ~PhaseGateInterface(){};
+
+  virtual void Enter(const SessionPhase& phase) = 0;
+  virtual void Leave(const SessionPhase& phase) = 0;
+};
+
+// Enter for the lifetime of the scope, nothing without a gate
+class PhaseScope {
+ public:
+  PhaseScope(PhaseGateInterface* gate, const SessionPhase& phase) : gate_(gate), phase_(phase) {
+    if (gate_) {
+      gate_->Enter(phase_);
+    }
+  };
+  ~PhaseScope() {
+    if (gate_) {
+      gate_->Leave(phase_);
+    }
+  };
+
+ private:
+  PhaseGateInterface* gate_;
+  SessionPhase phase_;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_PHASE_GATE_INTERFACE_HPP
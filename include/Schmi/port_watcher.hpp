@@ -0,0 +1,81 @@
+#ifndef SCHMI_PORT_WATCHER_HPP
+#define SCHMI_PORT_WATCHER_HPP
+
+#include <stdint.h>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Schmi {
+
+// A serial device node and the USB device behind it, as far as sysfs tells
+struct SerialDeviceInfo {
+  std::string path;  // the node, like /dev/ttyUSB0
+  std::string name;  // ttyUSB0
+  uint16_t vid;      // 0 when sysfs has no USB device for it
+  uint16_t pid;
+  std::string serial;
+};
+
+// Which devices to take. Empty fields and 0 IDs match anything.
+struct PortFilter {
+  std::string name_pattern;  // glob on the node name, like ttyUSB*
+  uint16_t vid;
+  uint16_t pid;
+  std::string serial;
+};
+
+bool MatchesFilter(const SerialDeviceInfo& device, const PortFilter& filter);
+
+// Watches a device directory with inotify and calls back for every node that appears and matches
+// one of the filters. The USB IDs come from sysfs: <sysfs_tty_dir>/<name>/device links into the
+// USB interface, and the first parent directory with an idVendor file is the USB device.
+// Both directories can be scratch ones, with ptys or symlinks standing in for the boards.
+class PortWatcher {
+ public:
+  using DeviceCallback = std::function<void(const SerialDeviceInfo&)>;
+
+  PortWatcher(const std::string& dev_dir = "/dev", const std::string& sysfs_tty_dir = "/sys/class/tty")
+      : dev_dir_(dev_dir), sysfs_tty_dir_(sysfs_tty_dir){};
+  ~PortWatcher() { Stop(); };
+
+  // Without filters every ttyUSB* and ttyACM* is taken
+  void AddFilter(const PortFilter& filter) { filters_.push_back(filter); };
+
+  /**
+   * @brief Start Starts watching. The callbacks run on the watcher thread and should return quickly.
+   * @param on_added For a matching node, once until it goes away again
+   * @param on_removed For a node on_added was called for, may be empty
+   * @param include_present Also report the matching nodes already there
+   * @return false if the directory can't be watched
+   */
+  bool Start(const DeviceCallback& on_added, const DeviceCallback& on_removed = nullptr,
+             const bool& include_present = true);
+  void Stop();
+
+  // Reads what sysfs knows about a node name, false if it isn't a USB device
+  bool ReadUsbInfo(const std::string& name, SerialDeviceInfo& device) const;
+
+ private:
+  std::string dev_dir_;
+  std::string sysfs_tty_dir_;
+  std::vector<PortFilter> filters_;
+
+  DeviceCallback on_added_;
+  DeviceCallback on_removed_;
+  int inotify_fd_ = -1;
+  int stop_pipe_[2] = {-1, -1};
+  bool running_ = false;
+  std::thread thread_;
+  std::set<std::string> present_;  // names on_added was called for, watcher thread only
+
+  void Watch();
+  void NodeAdded(const std::string& name);
+  void NodeRemoved(const std::string& name);
+  bool Matches(const SerialDeviceInfo& device) const;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_PORT_WATCHER_HPP
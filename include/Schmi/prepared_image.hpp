@@ -0,0 +1,80 @@
+#ifndef SCHMI_PREPARED_IMAGE_HPP
+#define SCHMI_PREPARED_IMAGE_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+#include "Schmi/stm32.hpp"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace Schmi {
+
+// An image read once and cut into the WRITE_MEMORY data frames FlashLoader sends, 256 bytes each
+// from the start of the image. Nothing changes it once built, so it can be shared by every board
+// it goes to, on any number of ports at once. Boards get it through a PatchedImage.
+class PreparedImage {
+ public:
+  static const uint16_t CHUNK_SIZE = 256;
+
+  // Reads the whole image, it doesn't have to be rereadable
+  explicit PreparedImage(BinaryFileInterface& bin);
+  explicit PreparedImage(const std::vector<uint8_t>& bytes);
+  ~PreparedImage(){};
+
+  uint64_t GetSize() const { return bytes_.size(); };
+  const uint8_t* GetBytes() const { return bytes_.data(); };
+
+  uint32_t GetNumChunks() const { return frame_lengths_.size(); };
+  const uint8_t* GetFrame(const uint32_t& chunk) const { return &frames_[chunk * Stm32::MAX_WRITE_FRAME_SIZE]; };
+  uint16_t GetFrameLength(const uint32_t& chunk) const { return frame_lengths_[chunk]; };
+
+ private:
+  std::vector<uint8_t> bytes_;
+  std::vector<uint8_t> frames_;  // MAX_WRITE_FRAME_SIZE apart
+  std::vector<uint16_t> frame_lengths_;
+
+  void BuildFrames();
+};
+
+// A prepared image with a few bytes changed for one board, like its serial number and calibration
+// block. Only the chunks the patches touch are copied and get their frames built again, every
+// other frame is the one of the shared image.
+class PatchedImage : public BinaryFileInterface {
+ public:
+  PatchedImage(const std::shared_ptr<const PreparedImage>& image) : image_(image){};
+  ~PatchedImage(){};
+
+  /**
+   * @brief AddPatch Overwrites bytes of the image for this board only. Patches can overlap, the
+   * last one wins.
+   * @param offset Into the image, the address minus where the image is written
+   * @return false if the patch goes past the end of the image
+   */
+  bool AddPatch(const uint64_t& offset, const uint8_t* bytes, const uint32_t& num_bytes);
+
+  // Back to the prepared image, for the next board
+  void ClearPatches() { chunks_.clear(); };
+
+  // Chunks whose frame was built for this board
+  uint32_t GetNumPatchedChunks() const { return chunks_.size(); };
+
+  void Init() override{};
+  uint64_t GetBinaryFileSize() override { return image_->GetSize(); };
+  void GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) override;
+  const uint8_t* GetWriteFrame(const BytesData& bytes_data, uint16_t& frame_length) override;
+
+ private:
+  std::shared_ptr<const PreparedImage> image_;
+
+  // The patched chunks by index, their frame holds their bytes after the length byte
+  struct Chunk {
+    uint8_t frame[Stm32::MAX_WRITE_FRAME_SIZE];
+    uint16_t frame_length;
+  };
+  std::map<uint32_t, Chunk> chunks_;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_PREPARED_IMAGE_HPP
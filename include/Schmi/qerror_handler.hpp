@@ -4,6 +4,7 @@
 #include <QString>
 
 #include "iq_flasher/include/Schmi/error_handler_interface.hpp"
+#include "iq_flasher/include/Schmi/event_ring.hpp"
 #include "main.h"
 
 #include <iostream>
@@ -20,8 +21,17 @@ class ErrorHandlerStd : public ErrorHandlerInterface {
   void Display() override;
   void DisplayAndDie() override;
 
+  // With a ring, errors are queued instead of touching the widgets from the I/O thread
+  void SetEventRing(EventRing* events) { events_ = events; };
+
+  // Sink for EventPump::Drain, on the GUI thread: puts warnings and errors in the widgets
+  static void ShowEvent(const SessionEvent& event);
+
  private:
   Error error_;
+  EventRing* events_ = nullptr;
+
+  QString GetText() const;
 };
 }  // namespace Schmi
 
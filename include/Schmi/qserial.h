@@ -3,6 +3,7 @@
 
 #include "QSerialPort"
 
+#include "iq_flasher/include/Schmi/event_ring.hpp"
 #include "iq_flasher/include/Schmi/serial_interface.hpp"
 #include "iq_flasher/include/Schmi/std_exception.hpp"
 
@@ -26,14 +27,19 @@ class QSerial : public SerialInterface {
   int Write(uint8_t* buffer, const uint16_t& buffer_length) override;
   int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms = 500) override;
   void Init() override;
+  void FlushInput() override { qser_port_->clear(QSerialPort::Input); };
 
   void LinkSerialPort(QSerialPort* ser);
+
+  // Read and write errors are queued as warnings instead of shown from the I/O path, see
+  // EventPump::Drain for taking them on the GUI thread
+  void SetEventRing(EventRing* events) { events_ = events; };
  private:
   QString usb_handle_;
   QSerialPort* qser_port_;
+  EventRing* events_ = nullptr;
 
-  void CheckNumBytesWritten(const qint64& num_bytes_written, const uint16_t& buffer_length);
-  void CheckNumBytesRead(const qint64& num_bytes_read);
+  void Report(const char* message, const qint64& num);
   void UpdateSerialReadData(SerialReadData& read_data, const qint64& num_bytes_read);
 };
 }  // namespace Schmi
@@ -11,8 +11,24 @@ class SerialInterface {
   virtual ~SerialInterface(){};
 
   virtual void Init() = 0;
+
+  // Like Init, but a port that can't be opened is reported instead of ending the process. For
+  // owners of several ports, where one bad port shouldn't stop the others.
+  virtual bool Open() {
+    Init();
+    return 1;
+  };
+
+  // Closes the port so the next Open starts over, like after an adapter re-enumerated
+  virtual void Close(){};
   virtual int Write(uint8_t* buffer, const uint16_t& buffer_length) = 0;
   virtual int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) = 0;
+
+  // Changes the line speed of the host side, returns false if the port can't do it
+  virtual bool SetBaudRate(const uint32_t&) { return 0; };
+
+  // Drops whatever was received but not read yet
+  virtual void FlushInput(){};
 };
 }  // namespace Schmi
 
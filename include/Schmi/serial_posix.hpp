@@ -1,6 +1,7 @@
 #ifndef SCHMI_SERIAL_POSIX_HPP
 #define SCHMI_SERIAL_POSIX_HPP
 
+#include "Schmi/event_ring.hpp"
 #include "Schmi/serial_interface.hpp"
 #include "Schmi/std_exception.hpp"
 
@@ -41,20 +42,31 @@ class SerialPosix : public SerialInterface {
 
   void Init() override;
 
+  bool Open() override;
+  void Close() override;
+
+  // 115200 to 3000000 baud, the speeds a USB-serial adapter and the loader stub can both do
+  bool SetBaudRate(const uint32_t& baud_rate) override;
+
+  void FlushInput() override { tcflush(usb_flag_, TCIFLUSH); };
+
+  // Read and write errors are queued as warnings instead of written to std::cerr. Only from the
+  // thread that does the I/O, it is the producer of the ring.
+  void SetEventRing(EventRing* events) { events_ = events; };
+
  private:
   std::string usb_handle_;
   int usb_flag_ = -1;
+  EventRing* events_ = nullptr;
 
-  void CheckNumBytesWritten(const int& num_bytes_written, const uint16_t& buffer_length);
-
-  void CheckNumBytesRead(const int& num_bytes_read);
+  void Report(const char* message, const int& num);
   void UpdateSerialReadData(SerialReadData& read_data, const int& num_bytes_read);
 
   int OpenPort();
 
   void SetAttributes(const int& usb_flag);
   void GetTerminalAttributes(const int& usb_flag, struct termios& tty);
-  void SetBaudRate(struct termios& tty);
+  void SetBaudRate(struct termios& tty, const speed_t& speed);
   void SetTerminalAttributes(const int& usb_flag, struct termios& tty);
 
   //Private internal debugging function
@@ -0,0 +1,76 @@
+#ifndef SCHMI_SERIAL_TCP_HPP
+#define SCHMI_SERIAL_TCP_HPP
+
+#include "Schmi/event_ring.hpp"
+#include "Schmi/serial_interface.hpp"
+#include "Schmi/telnet.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Schmi {
+
+struct SerialTcpOptions {
+  bool no_delay = true;    // TCP_NODELAY, a frame isn't held back waiting for the ACK of the last one
+  bool quick_ack = true;   // TCP_QUICKACK after every receive, the server isn't kept waiting for our ACK
+  bool rfc2217 = false;    // telnet with COM-PORT-OPTION, the server sets up its UART from here
+  uint32_t baud_rate = 115200;  // rfc2217 only, the raw server is set up on its side
+};
+
+// A serial port served over TCP, like ser2net or a terminal server gives access to a fixture on
+// another machine. Raw by default: the bytes on the socket are the bytes on the wire. Each Write
+// goes out as one send, so a protocol frame is one segment and no Nagle delay sits between the
+// host and the ACK it waits for.
+class SerialTcp : public SerialInterface {
+ public:
+  static const uint32_t RECEIVE_SIZE = 4096;
+
+  SerialTcp(const std::string& host, const uint16_t& port, const SerialTcpOptions& options = SerialTcpOptions())
+      : host_(host), port_(port), options_(options){};
+  ~SerialTcp();
+
+  // Exits if the server can't be reached, like SerialPosix::Init
+  void Init() override;
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override;
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms = 500) override;
+
+  // rfc2217 only, true once the server confirmed the new speed
+  bool SetBaudRate(const uint32_t& baud_rate) override;
+
+  void FlushInput() override;
+
+  // Connects, and with rfc2217 sets the line up. False if the server can't be reached.
+  bool Open() override;
+  void Close() override;
+
+  void SetEventRing(EventRing* events) { events_ = events; };
+
+  // tcp:host:port or rfc2217:host:port, the names the runner takes instead of a device node
+  static bool ParseAddress(const std::string& name, std::string& host, uint16_t& port, bool& rfc2217);
+
+ private:
+  std::string host_;
+  uint16_t port_;
+  SerialTcpOptions options_;
+  int fd_ = -1;
+  EventRing* events_ = nullptr;
+
+  std::vector<uint8_t> input_;  // received, not read yet
+  size_t input_pos_ = 0;
+  std::vector<uint8_t> output_;  // one frame with its IACs doubled
+  Telnet::Decoder decoder_;
+  std::vector<Telnet::Command> commands_;
+  uint32_t confirmed_baud_rate_ = 0;
+
+  // Waits up to timeout_ms for bytes and takes in what came, false on timeout or a closed
+  // connection, which is closed here too
+  bool Receive(const int& timeout_ms);
+  bool Send(const uint8_t* bytes, const size_t& num_bytes);
+  void HandleCommands();
+  bool SendComPortOption(const uint8_t& command, const std::vector<uint8_t>& value);
+  void Report(const char* message, const int& num);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_SERIAL_TCP_HPP
@@ -0,0 +1,25 @@
+#ifndef SCHMI_SIM_CLOCK_HPP
+#define SCHMI_SIM_CLOCK_HPP
+
+#include "Schmi/clock_interface.hpp"
+
+namespace Schmi {
+
+// Virtual clock for simulations: sleeping only advances the time, so a whole flash session against
+// the emulator runs in a few milliseconds while still reporting what it would have cost on the wire
+class SimClock : public ClockInterface {
+ public:
+  SimClock(){};
+  ~SimClock(){};
+
+  uint64_t NowUs() override { return now_us_; };
+  void SleepUs(const uint64_t& duration_us) override { now_us_ += duration_us; };
+
+  void Reset() { now_us_ = 0; };
+
+ private:
+  uint64_t now_us_ = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_SIM_CLOCK_HPP
@@ -1,7 +1,11 @@
 #ifndef SCHMI_STM32_HPP
 #define SCHMI_STM32_HPP
 
+#include "iq_flasher/include/Schmi/clock_interface.hpp"
 #include "iq_flasher/include/Schmi/error_handler_interface.hpp"
+#include "iq_flasher/include/Schmi/latency_histogram.hpp"
+#include "iq_flasher/include/Schmi/timeout_model.hpp"
+#include "iq_flasher/include/Schmi/tracer.hpp"
 #include "iq_flasher/include/Schmi/serial_interface.hpp"
 
 #include <math.h> /* floor */
@@ -13,21 +17,22 @@ namespace Schmi {
 
 // All these values are from the AN3155 file
 namespace CMD {
-const uint8_t USART_INIT[2] = {0x7F, 0x00};  // added dummy 0x00 byte so all commands are 2 bytes long
-const uint8_t ACK = 0x79;
-const uint8_t NACK = 0x1F;
-const uint8_t GET[2] = {0x01, 0xFE};
-const uint8_t GET_VER_PROTECT_STATUS[2] = {0x01, 0xFE};
-const uint8_t GET_ID[2] = {0x02, 0xFD};
-const uint8_t READ_MEMORY[2] = {0x11, 0xEE};
-const uint8_t GO[2] = {0x21, 0xDE};
-const uint8_t WRITE_MEMORY[2] = {0x31, 0xCE};
-const uint8_t ERASE[2] = {0x43, 0xBC};
-const uint8_t EXTEND_ERASE[2] = {0x44, 0xBB};
-const uint8_t WRITE_PROTECT[2] = {0x63, 0x9C};
-const uint8_t WRITE_UNPROTECT[2] = {0x73, 0x8C};
-const uint8_t READOUT_PROTECT[2] = {0x82, 0x7D};
-const uint8_t READOUT_UNPROTECT[2] = {0x92, 0x6D};
+constexpr uint8_t USART_INIT[2] = {0x7F, 0x00};  // added dummy 0x00 byte so all commands are 2 bytes long
+constexpr uint8_t ACK = 0x79;
+constexpr uint8_t NACK = 0x1F;
+constexpr uint8_t GET[2] = {0x00, 0xFF};
+constexpr uint8_t GET_VER_PROTECT_STATUS[2] = {0x01, 0xFE};
+constexpr uint8_t GET_ID[2] = {0x02, 0xFD};
+constexpr uint8_t READ_MEMORY[2] = {0x11, 0xEE};
+constexpr uint8_t GO[2] = {0x21, 0xDE};
+constexpr uint8_t WRITE_MEMORY[2] = {0x31, 0xCE};
+constexpr uint8_t ERASE[2] = {0x43, 0xBC};
+constexpr uint8_t EXTEND_ERASE[2] = {0x44, 0xBB};
+constexpr uint8_t WRITE_PROTECT[2] = {0x63, 0x9C};
+constexpr uint8_t WRITE_UNPROTECT[2] = {0x73, 0x8C};
+constexpr uint8_t READOUT_PROTECT[2] = {0x82, 0x7D};
+constexpr uint8_t READOUT_UNPROTECT[2] = {0x92, 0x6D};
+constexpr uint8_t GET_CHECKSUM[2] = {0xA1, 0x5E};  // newer bootloaders only, check GET first
 }  // namespace CMD
 
 struct VersionAndReadProtectionData {
@@ -36,8 +41,23 @@ struct VersionAndReadProtectionData {
   uint8_t option2;
 };
 
+// Answer of GET: the bootloader version and the opcodes of every command it supports
+const uint8_t MAX_BOOTLOADER_COMMANDS = 32;
+
+struct BootloaderCommands {
+  uint8_t version;
+  uint8_t num_commands;
+  uint8_t commands[MAX_BOOTLOADER_COMMANDS];
+};
+
 const uint16_t MAX_MESSAGE_SIZE = 512;
 
+struct ConnectResult {
+  uint8_t attempts;
+  bool was_synced;      // the bootloader answered NACK, it was synced by an earlier session
+  uint64_t latency_us;  // from the first sync byte to the answer, 0 without a clock
+};
+
 class Stm32 {
  public:
   // const uint16_t MAX_MESSAGE_LENGTH = 512;
@@ -45,9 +65,43 @@ class Stm32 {
   Stm32(SerialInterface& ser, ErrorHandlerInterface& error) : ser_(ser), error_handler_(error){};
   ~Stm32(){};
 
+  // Single sync attempt with the full ACK timeout
   bool InitUsart();
 
-  // bool Get();
+  /**
+   * @brief Connect Syncs with the bootloader, or finds it already synced. Stale input is dropped,
+   * then the sync is retried with a timeout that starts short and doubles on every miss, so a chip
+   * that is still booting or a sync byte lost on the line costs a few ms instead of 500.
+   * With a clock, the first timeout of the next Connect follows the round trip measured by this one.
+   * @return true if successful
+   */
+  bool Connect(ConnectResult& result);
+
+  void SetClock(ClockInterface* clock) { clock_ = clock; };
+
+  // Every ACK is recorded with the time since its command was handed to the port, needs a clock
+  void SetLatencyHistogram(LatencyHistogram* histogram) { latency_ = histogram; };
+
+  // Waits use the deadlines of the model instead of the fixed timeouts, and every completed wait
+  // teaches it. A wait past its deadline gets one extension (see TimeoutModel::GetExtensionMs)
+  // before the chip is given up. GetID selects the chip. Needs a clock, Connect keeps its own
+  // retry timeouts.
+  void SetTimeoutModel(TimeoutModel* timeout_model) { timeout_model_ = timeout_model; };
+  uint16_t GetConnectTimeoutMs() const { return connect_timeout_ms_; };
+
+  // Every command is recorded as a span on the row of the port, and so is every wait for an ACK
+  // or an answer inside it
+  void SetTracer(Tracer* tracer, const uint32_t& port) {
+    tracer_ = tracer;
+    trace_port_ = port;
+  };
+
+  static const uint8_t CONNECT_MAX_ATTEMPTS = 8;
+  static const uint16_t CONNECT_MIN_TIMEOUT_MS = 10;
+  static const uint16_t CONNECT_MAX_TIMEOUT_MS = 500;
+
+  // Opcodes past MAX_BOOTLOADER_COMMANDS are read and dropped
+  bool Get(BootloaderCommands& commands);
 
   bool GetVersionAndReadProtection(VersionAndReadProtectionData& vrpd);
 
@@ -61,10 +115,32 @@ class Stm32 {
 
   bool WriteMemory(uint8_t* bytes, const uint16_t& num_bytes, const uint32_t& start_address);
 
-  // Multiple ExtendedErase commands will be sent if num_of_pages > 254
-  bool ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages);
+  // WRITE_MEMORY data frame: N, up to 256 bytes padded with 0xFF to a multiple of 4, the checksum
+  static const uint16_t MAX_WRITE_FRAME_SIZE = 258;
+
+  // Builds the data frame WriteMemory sends for num_bytes, at most 256, returns its length
+  static uint16_t BuildWriteFrame(const uint8_t* bytes, const uint16_t& num_bytes, uint8_t* frame);
 
-  bool SpecialExtendedErase(const uint16_t& special_extended_erase_code);
+  // WriteMemory with a data frame built ahead of time, like the ones of a PreparedImage
+  bool WriteMemoryFrame(const uint8_t* frame, const uint16_t& frame_length, const uint32_t& start_address);
+
+  // Multiple ExtendedErase commands will be sent if num_of_pages > 254,
+  // the timeout applies to each of them (see ErasePlanner for sizing it)
+  bool ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages,
+                     const uint16_t& ack_read_timeout_ms = 8000);
+
+  bool SpecialExtendedErase(const uint16_t& special_extended_erase_code,
+                            const uint16_t& ack_read_timeout_ms = 500);
+
+  /**
+   * @brief GetChecksum CRC of a flash range computed by the chip (see Crc32Stm32 for the algorithm)
+   * @param address Must be a multiple of 4
+   * @param num_bytes Must be a multiple of 4
+   * @param ack_read_timeout_ms How long the chip gets to go through the range
+   * @return true if successful
+   */
+  bool GetChecksum(const uint32_t& address, const uint32_t& num_bytes, uint32_t& crc,
+                   const uint16_t& ack_read_timeout_ms = 500);
 
   // bool  WriteProtect();
 
@@ -77,6 +153,14 @@ class Stm32 {
  private:
   SerialInterface& ser_;
   ErrorHandlerInterface& error_handler_;
+  ClockInterface* clock_ = nullptr;
+  LatencyHistogram* latency_ = nullptr;
+  TimeoutModel* timeout_model_ = nullptr;
+  Tracer* tracer_ = nullptr;
+  uint32_t trace_port_ = 0;
+  uint64_t ack_wait_start_us_ = 0;  // 0 once the ACK of the last message is recorded
+
+  uint16_t connect_timeout_ms_ = 50;
 
   // We are blocking it to 512, for extended erase it will send multiple messages in a row
   uint8_t message_buffer[MAX_MESSAGE_SIZE];
@@ -86,12 +170,26 @@ class Stm32 {
 
   bool SendCmd(const uint8_t* cmd);
 
-  bool SendMessage(uint8_t* message, const size_t& message_length,
-                   const uint16_t& ack_read_timeout_ms = 500);
+  // units: pages for an erase, KB for a checksum, 1 otherwise (see TimeoutModel)
+  bool SendMessage(uint8_t* message, const size_t& message_length, const WaitKind& kind = WaitKind::kAck,
+                   const uint32_t& units = 1, const uint16_t& ack_read_timeout_ms = 500);
   bool SendBytes(uint8_t* buffer, const size_t& buffer_length);
-  bool CheckForAck(const uint16_t& ack_read_timeout_ms = 500);
+  bool CheckForAck(const WaitKind& kind = WaitKind::kAck, const uint32_t& units = 1, const size_t& num_bytes = 0,
+                   const uint16_t& ack_read_timeout_ms = 500);
 
   bool ReadBytes(uint8_t* buffer, const size_t& num_bytes, const uint16_t& timeout_ms = 500);
+  // An answer of the chip, timed like the ACKs
+  bool ReadData(uint8_t* buffer, const size_t& num_bytes);
+
+  // The deadline of the model if there is one, the fixed timeout otherwise
+  uint16_t GetDeadlineMs(const WaitKind& kind, const uint32_t& units, const size_t& num_bytes,
+                         const uint16_t& fixed_timeout_ms);
+  // Bytes by the deadline, the first one gets the extension after it if the deadline is a learned one
+  bool WaitForBytes(uint8_t* buffer, const size_t& num_bytes, const uint16_t& deadline_ms,
+                    const uint16_t& fixed_timeout_ms);
+  // Gives a completed wait to the model, as a miss if it took longer than the deadline
+  void RecordWait(const WaitKind& kind, const uint32_t& units, const size_t& num_bytes,
+                  const uint16_t& deadline_ms, const uint64_t& latency_us);
 
   void AddCheckSum(uint8_t* message, const size_t& num_bytes);
   uint8_t CalculateCheckSum(uint8_t* buffer, const size_t& num_bytes);
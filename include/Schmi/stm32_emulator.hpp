@@ -0,0 +1,189 @@
+#ifndef SCHMI_STM32_EMULATOR_HPP
+#define SCHMI_STM32_EMULATOR_HPP
+
+#include "Schmi/clock_interface.hpp"
+#include "Schmi/serial_interface.hpp"
+#include "Schmi/stm32.hpp"
+#include "Schmi/stub_protocol.hpp"
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace Schmi {
+
+// Description of the emulated chip and of how long its bootloader takes to do things.
+// The defaults are close to an STM32G431 behind a USB-serial adapter at 115200 baud.
+struct EmulatorConfig {
+  uint16_t product_id = 0x0468;
+  uint8_t bootloader_version = 0x31;
+
+  uint32_t flash_start = 0x08000000;
+  uint32_t flash_size = 128 * 1024;
+  uint32_t page_size = 2048;
+  uint8_t num_banks = 1;
+
+  uint32_t sram_start = 0x20000000;
+  uint32_t sram_size = 32 * 1024;
+
+  uint32_t unique_id_address = 0x1FFF7590;  // read only
+  uint8_t unique_id[12] = {0x2F, 0x00, 0x3A, 0x00, 0x12, 0x51, 0x4B, 0x4E, 0x35, 0x33, 0x30, 0x20};
+
+  uint32_t baud_rate = 115200;
+  uint32_t boot_us = 0;                // after power up or Reset, bytes sent before that are lost
+  uint32_t ack_latency_us = 1000;      // bootloader turnaround plus USB adapter latency
+  uint32_t page_erase_us = 22000;      // per page of an EXTEND_ERASE page list
+  uint32_t bank_erase_us = 30000;      // 0xFFFE / 0xFFFD
+  uint32_t mass_erase_us = 30000;      // 0xFFFF
+  uint32_t program_us_per_byte = 10;   // flash programming time of WRITE_MEMORY
+
+  bool checksum_command = false;       // GET_CHECKSUM, not on the G431 bootloader
+  uint32_t checksum_us_per_kb = 10;    // CRC unit going through the flash
+
+  uint32_t stub_max_baud_rate = 3000000;  // fastest SET_BAUD the loader stub accepts
+};
+
+struct EmulatorStats {
+  uint64_t bytes_received;
+  uint64_t bytes_sent;
+  uint32_t commands;
+  uint32_t nacks;
+  uint32_t pages_erased;
+  uint32_t special_erases;  // bank or mass erases, their pages are in pages_erased too
+  uint64_t bytes_programmed;
+  uint64_t bytes_checksummed;
+  uint32_t stub_requests;
+};
+
+// Host side model of the AN3155 system bootloader. It is a SerialInterface so Stm32 and FlashLoader
+// can run unmodified against it: every byte written is fed to the bootloader state machine and the
+// answers are queued for the next Read. Time spent on the wire and inside the chip is charged to the
+// clock, use a SimClock to get the cost of a session without waiting for it.
+//
+// A GO to an image with a stub header in SRAM (stub_protocol.hpp) starts a model of the loader stub
+// instead: it answers the stub framing, pays the link latency once per batch of requests rather
+// than once per answer, and can switch baud rate. Bytes sent at a speed other than the one the
+// chip listens at are lost.
+class Stm32Emulator : public SerialInterface {
+ public:
+  Stm32Emulator(ClockInterface& clock, const EmulatorConfig& config = EmulatorConfig());
+  ~Stm32Emulator(){};
+
+  void Init() override{};
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override;
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms = 500) override;
+  bool SetBaudRate(const uint32_t& baud_rate) override;
+  void FlushInput() override { output_.clear(); };
+
+  // Same as pulling NRST with BOOT0 high: the protocol state is lost, the memory is kept
+  void Reset();
+
+  // An image the emulator accepts as a loader stub: the header, then code_size bytes standing in for
+  // the code
+  static std::vector<uint8_t> MakeStubImage(const uint16_t& max_block_size = StubProtocol::MAX_BLOCK_SIZE,
+                                            const uint32_t& code_size = 1024);
+
+  // Fill the whole flash with a value, 0xFF is the erased state
+  void FillFlash(const uint8_t& value);
+
+  // A marginal page: the next num_bad_programs times it is programmed, between two erases, the first
+  // byte written into it stays erased. The writes are still acknowledged.
+  void SetWeakPage(const uint32_t& page, const uint8_t& num_bad_programs) { weak_pages_[page] = {num_bad_programs, false}; };
+
+  const EmulatorConfig& GetConfig() const { return config_; };
+  const EmulatorStats& GetStats() const { return stats_; };
+  const uint8_t* GetFlash() const { return flash_.data(); };
+  const uint8_t* GetSram() const { return sram_.data(); };
+
+  bool IsRunning() const { return state_ == State::kRunning; };
+  bool IsStubRunning() const { return state_ == State::kStub; };
+  uint32_t GetDeviceBaudRate() const { return device_baud_rate_; };
+  uint32_t GetGoAddress() const { return go_address_; };
+  // Answer bytes queued for the next Read
+  size_t GetNumPending() const { return output_.size(); };
+
+ private:
+  enum class State {
+    kWaitSync,
+    kSyncPad,
+    kCommand,
+    kAddress,
+    kReadLength,
+    kWriteData,
+    kEraseCount,
+    kEraseData,
+    kChecksumLength,
+    kRunning,
+    kStub
+  };
+
+  ClockInterface& clock_;
+  EmulatorConfig config_;
+  EmulatorStats stats_ = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+  std::vector<uint8_t> flash_;
+  std::vector<uint8_t> sram_;
+  std::deque<uint8_t> output_;
+  struct WeakPage {
+    uint8_t bad_programs_left;
+    bool corrupted;  // since the last erase
+  };
+  std::map<uint32_t, WeakPage> weak_pages_;
+
+  State state_ = State::kWaitSync;
+  uint8_t current_cmd_ = 0;
+  uint32_t address_ = 0;
+  uint32_t go_address_ = 0;
+  std::vector<uint8_t> frame_;
+  size_t frame_length_ = 0;
+
+  uint64_t booted_at_us_;
+  uint32_t host_baud_rate_;
+  uint32_t device_baud_rate_;
+  uint16_t stub_max_block_size_ = 0;
+  bool turnaround_pending_ = false;
+  struct StubWriteAnswer {
+    uint8_t seq;
+    uint8_t status;
+  };
+  StubWriteAnswer stub_writes_[StubProtocol::WRITE_HISTORY_SIZE];
+  uint32_t num_stub_writes_ = 0;  // by the stub now running, the history keeps the last ones
+
+  void ProcessByte(const uint8_t& byte);
+  void ProcessCommand();
+  void ProcessAddress();
+  void ProcessReadLength();
+  void ProcessWriteData();
+  void ProcessEraseCount();
+  void ProcessEraseData();
+  void ProcessChecksumLength();
+
+  void StartFrame(const State& state, const size_t& frame_length);
+
+  bool FindStub(const uint32_t& go_address);
+  void ProcessStubByte(const uint8_t& byte);
+  void ProcessStubRequest();
+  uint8_t StubErase(const uint32_t& address, const uint32_t& num_bytes);
+  uint8_t StubWrite(const uint32_t& address, const uint8_t* bytes, const uint32_t& num_bytes);
+  // The status a write with this seq was answered with, false if it wasn't one of the last ones
+  bool FindStubWrite(const uint8_t& seq, uint8_t& status) const;
+  void SendStubResponse(const uint8_t& seq, const uint8_t& status, const uint8_t* payload = nullptr,
+                        const uint16_t& length = 0);
+
+  void SendAck();
+  void SendNack();
+  void SendByte(const uint8_t& byte);
+
+  uint8_t NumSupportedOps();
+  bool IsCommandSupported(const uint8_t& cmd);
+  uint8_t* MapAddress(const uint32_t& address, const uint32_t& num_bytes);
+  bool ErasePage(const uint32_t& page);
+  bool SpecialErase(const uint16_t& code);
+
+  uint64_t WireTimeUs(const uint64_t& num_bytes);
+  uint8_t XorBytes(const uint8_t* bytes, const size_t& num_bytes);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_STM32_EMULATOR_HPP
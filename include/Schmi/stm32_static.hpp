@@ -0,0 +1,241 @@
+#ifndef SCHMI_STM32_STATIC_HPP
+#define SCHMI_STM32_STATIC_HPP
+
+#include "Schmi/error_handler_interface.hpp"
+#include "Schmi/stm32.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace Schmi {
+
+// Static dispatch version of Stm32 for hosts where the virtual calls and the heap matter, like a
+// microcontroller flashing another one. Serial and ErrorHandler only need the member functions of
+// SerialInterface and ErrorHandlerInterface, they don't have to derive from them (if they do, mark
+// them final so the calls get devirtualized). Everything lives in the object, sized at compile time.
+//
+// It covers the commands FlashLoaderStatic needs: sync, get ID, read, write, erase and go.
+template <typename Serial, typename ErrorHandler, uint16_t MaxMessageSize = MAX_MESSAGE_SIZE>
+class Stm32Static {
+ public:
+  static_assert(MaxMessageSize >= 258, "WRITE_MEMORY needs 256 data bytes + N + checksum");
+
+  // Each page code is 2 bytes, plus 2 bytes for N and 1 for the checksum
+  static constexpr uint16_t MAX_PAGES_PER_ERASE = (MaxMessageSize - 3) / 2;
+  static constexpr uint16_t ACK_TIMEOUT_MS = 500;
+  static constexpr uint16_t ERASE_TIMEOUT_MS = 8000;
+
+  Stm32Static(Serial& ser, ErrorHandler& error) : ser_(ser), error_handler_(error){};
+  ~Stm32Static(){};
+
+  bool InitUsart() { return SendCmd(CMD::USART_INIT); };
+
+  bool GetID(uint16_t& id) {
+    if (!SendCmd(CMD::GET_ID)) {
+      return 0;
+    }
+
+    uint8_t incoming_bytes[4];
+    if (!ReadBytes(incoming_bytes, 4, ACK_TIMEOUT_MS)) {
+      return 0;
+    }
+    id = (incoming_bytes[1] << 8) | incoming_bytes[2];
+
+    return 1;
+  };
+
+  // The max value of num_bytes_to_read = 256
+  bool ReadMemory(uint8_t* bytes_read_buffer, const uint16_t& num_bytes_to_read,
+                  const uint32_t& address) {
+    if (num_bytes_to_read == 0 || num_bytes_to_read > 256) {
+      Die({"ReadMemory", "num_bytes_to_read > 256", num_bytes_to_read});
+      return 0;
+    }
+
+    if (!SendCmd(CMD::READ_MEMORY) || !SendAddressMessage(address)) {
+      return 0;
+    }
+
+    uint8_t message[2];
+    message[0] = num_bytes_to_read - 1;
+    message[1] = ~message[0];
+    if (!SendMessage(message, 2, ACK_TIMEOUT_MS)) {
+      return 0;
+    }
+
+    return ReadBytes(bytes_read_buffer, num_bytes_to_read, ACK_TIMEOUT_MS);
+  };
+
+  bool GoToAddress(const uint32_t& address) {
+    return SendCmd(CMD::GO) && SendAddressMessage(address);
+  };
+
+  bool WriteMemory(const uint8_t* bytes, const uint16_t& num_bytes, const uint32_t& start_address) {
+    // Data is padded with 0xFF to a multiple of 4 bytes (check datasheet)
+    const uint16_t padded_num_bytes = (num_bytes + 3) & ~3;
+    if (num_bytes == 0 || padded_num_bytes > 256) {
+      Die({"WriteMemory", "num_byte > 256", num_bytes});
+      return 0;
+    }
+
+    if (!SendCmd(CMD::WRITE_MEMORY) || !SendAddressMessage(start_address)) {
+      return 0;
+    }
+
+    message_buffer_[0] = padded_num_bytes - 1;
+    memcpy(message_buffer_ + 1, bytes, num_bytes);
+    memset(message_buffer_ + 1 + num_bytes, 0xFF, padded_num_bytes - num_bytes);
+    const uint16_t message_length = padded_num_bytes + 2;
+    AddCheckSum(message_buffer_, message_length);
+
+    return SendMessage(message_buffer_, message_length, ACK_TIMEOUT_MS);
+  };
+
+  // Erases the contiguous pages [first_page, first_page + num_of_pages), one EXTEND_ERASE
+  // command per MAX_PAGES_PER_ERASE pages. The page codes are generated straight into the
+  // message buffer so no page list has to be kept around. Page codes are 16 bits, a range past
+  // them is refused before anything is sent.
+  bool ExtendedErase(const uint32_t& first_page, const uint32_t& num_of_pages) {
+    if ((uint64_t)first_page + num_of_pages > 0x10000) {
+      Die({"ExtendedErase", "Pages past the 16 bit page codes", (int)(first_page + num_of_pages)});
+      return 0;
+    }
+
+    uint32_t page = first_page;
+    uint32_t num_pages_left = num_of_pages;
+
+    while (num_pages_left > 0) {
+      uint16_t num_pages_ready_to_erase =
+          num_pages_left > MAX_PAGES_PER_ERASE ? MAX_PAGES_PER_ERASE : num_pages_left;
+
+      if (!SendCmd(CMD::EXTEND_ERASE)) {
+        return 0;
+      }
+
+      // 2 bytes for N+1 pages | 2 bytes per page number | checksum
+      message_buffer_[0] = (num_pages_ready_to_erase - 1) >> 8;
+      message_buffer_[1] = (num_pages_ready_to_erase - 1) & 0xFF;
+      for (uint16_t ii = 0; ii < num_pages_ready_to_erase; ii++) {
+        message_buffer_[ii * 2 + 2] = (page + ii) >> 8;
+        message_buffer_[ii * 2 + 3] = (page + ii) & 0xFF;
+      }
+      const uint16_t message_length = 2 + 2 * num_pages_ready_to_erase + 1;
+      AddCheckSum(message_buffer_, message_length);
+
+      if (!SendMessage(message_buffer_, message_length, ERASE_TIMEOUT_MS)) {
+        return 0;
+      }
+
+      page += num_pages_ready_to_erase;
+      num_pages_left -= num_pages_ready_to_erase;
+    }
+
+    return 1;
+  };
+
+  // 0xFFFF global erase, 0xFFFE bank 1, 0xFFFD bank 2
+  bool SpecialExtendedErase(const uint16_t& special_extended_erase_code) {
+    if (special_extended_erase_code < 0xFFFD) {
+      Die({"SpecialExtendedErase", "Code not recognized", special_extended_erase_code});
+      return 0;
+    }
+
+    if (!SendCmd(CMD::EXTEND_ERASE)) {
+      return 0;
+    }
+
+    uint8_t message[3];
+    message[0] = special_extended_erase_code >> 8;
+    message[1] = special_extended_erase_code & 0xFF;
+    AddCheckSum(message, 3);
+
+    return SendMessage(message, 3, ERASE_TIMEOUT_MS);
+  };
+
+ private:
+  Serial& ser_;
+  ErrorHandler& error_handler_;
+
+  uint8_t message_buffer_[MaxMessageSize];
+
+  bool SendAddressMessage(const uint32_t& address) {
+    // Check AN3155.pdf for message structure
+    uint8_t message[5];
+    message[0] = (address >> 24) & 0xFF;
+    message[1] = (address >> 16) & 0xFF;
+    message[2] = (address >> 8) & 0xFF;
+    message[3] = address & 0xFF;
+    AddCheckSum(message, 5);
+
+    return SendMessage(message, 5, ACK_TIMEOUT_MS);
+  };
+
+  bool SendCmd(const uint8_t* cmd) {
+    uint8_t message[2] = {cmd[0], cmd[1]};
+
+    return SendMessage(message, 2, ACK_TIMEOUT_MS);
+  };
+
+  bool SendMessage(uint8_t* message, const uint16_t& message_length, const uint16_t& ack_read_timeout_ms) {
+    if (ser_.Write(message, message_length) != 0) {
+      Display({"SendBytes", "Failed to send Bytes", -1});
+      return 0;
+    }
+
+    uint8_t ack;
+    if (!ReadBytes(&ack, 1, ack_read_timeout_ms)) {
+      return 0;
+    }
+    if (ack != CMD::ACK) {
+      Die({"CheckForAck", "Not ACK", ack});
+      return 0;
+    }
+
+    return 1;
+  };
+
+  bool ReadBytes(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) {
+    int result = ser_.Read(buffer, num_bytes, timeout_ms);
+    if (result != 0) {
+      Display({"ReadBytes", "Failed to read Bytes", result});
+      return 0;
+    }
+
+    return 1;
+  };
+
+  void AddCheckSum(uint8_t* message, const uint16_t& message_length) {
+    uint8_t checksum = 0;
+    for (uint16_t ii = 0; ii < message_length - 1; ii++) {
+      checksum ^= message[ii];
+    }
+    message[message_length - 1] = checksum;
+
+    return;
+  };
+
+  void Display(const Schmi::Error& err) {
+    error_handler_.Init(err);
+    error_handler_.Display();
+
+    return;
+  };
+
+  void Die(const Schmi::Error& err) {
+    error_handler_.Init(err);
+    error_handler_.DisplayAndDie();
+
+    return;
+  };
+};
+
+// C++14 still needs these definitions when the constants are bound to a reference
+template <typename Serial, typename ErrorHandler, uint16_t MaxMessageSize>
+constexpr uint16_t Stm32Static<Serial, ErrorHandler, MaxMessageSize>::MAX_PAGES_PER_ERASE;
+template <typename Serial, typename ErrorHandler, uint16_t MaxMessageSize>
+constexpr uint16_t Stm32Static<Serial, ErrorHandler, MaxMessageSize>::ACK_TIMEOUT_MS;
+template <typename Serial, typename ErrorHandler, uint16_t MaxMessageSize>
+constexpr uint16_t Stm32Static<Serial, ErrorHandler, MaxMessageSize>::ERASE_TIMEOUT_MS;
+}  // namespace Schmi
+
+#endif  // SCHMI_STM32_STATIC_HPP
@@ -0,0 +1,114 @@
+#ifndef SCHMI_STUB_CLIENT_HPP
+#define SCHMI_STUB_CLIENT_HPP
+
+#include "Schmi/binary_file_interface.hpp"
+#include "Schmi/error_handler_interface.hpp"
+#include "Schmi/serial_interface.hpp"
+#include "Schmi/stm32.hpp"
+#include "Schmi/stub_protocol.hpp"
+
+#include <stdint.h>
+
+namespace Schmi {
+
+struct StubInfo {
+  uint8_t version;
+  uint16_t max_block_size;
+};
+
+struct StubStats {
+  uint32_t requests;
+  uint32_t retransmits;
+  uint32_t bad_responses;
+};
+
+// Host side of the RAM loader stub protocol (stub_protocol.hpp). The stub is uploaded with the
+// system bootloader, after that every command goes through this class.
+//
+// Writes are pipelined: QueueWrite sends the block right away and only waits for answers once
+// WINDOW_SIZE blocks are in flight, so the link latency is paid once per window instead of three
+// times per 256 bytes. A block answered with a CRC error is sent again. When no answer comes, the
+// oldest block in flight is sent again with its seq, the stub doesn't write it twice.
+class StubClient {
+ public:
+  static const uint8_t WINDOW_SIZE = 8;
+  static const uint8_t MAX_RETRIES = 3;
+  static const uint16_t RESPONSE_TIMEOUT_MS = 500;
+  static const uint32_t MAX_STUB_SIZE = 16 * 1024;
+
+  StubClient(SerialInterface& ser, ErrorHandlerInterface& error) : ser_(ser), error_handler_(error){};
+  ~StubClient(){};
+
+  /**
+   * @brief Upload Writes the stub image into SRAM through the system bootloader and starts it
+   * @param load_address Where the image goes, the stub is started at load_address + its entry offset
+   * @return true if successful
+   */
+  bool Upload(Stm32& stm32, BinaryFileInterface& stub_image, const uint32_t& load_address);
+
+  bool Ping(StubInfo& info);
+
+  // The stub answers at the current speed then switches, the host port follows
+  bool SetBaudRate(const uint32_t& baud_rate);
+
+  bool Erase(const uint32_t& address, const uint32_t& num_bytes, const uint16_t& timeout_ms);
+
+  // num_bytes can't be more than GetMaxBlockSize()
+  bool QueueWrite(const uint8_t* bytes, const uint16_t& num_bytes, const uint32_t& address);
+
+  // Waits until every queued write is acknowledged
+  bool Flush();
+
+  // CRC-32 of the flash computed by the stub
+  bool Crc(const uint32_t& address, const uint32_t& num_bytes, uint32_t& crc, const uint16_t& timeout_ms);
+
+  bool Run(const uint32_t& address);
+
+  uint16_t GetMaxBlockSize() const { return max_block_size_; };
+  const StubStats& GetStats() const { return stats_; };
+
+ private:
+  struct Slot {
+    bool in_use;
+    uint8_t seq;
+    uint8_t retries;
+    uint16_t length;
+    uint8_t frame[StubProtocol::MAX_REQUEST_SIZE];
+  };
+
+  struct Response {
+    uint8_t seq;
+    uint8_t status;
+    uint16_t length;
+    uint8_t payload[StubProtocol::MAX_RESPONSE_PAYLOAD];
+  };
+
+  SerialInterface& ser_;
+  ErrorHandlerInterface& error_handler_;
+
+  uint16_t max_block_size_ = StubProtocol::MAX_BLOCK_SIZE;
+  uint8_t next_seq_ = 0;
+  StubStats stats_ = {0, 0, 0};
+
+  Slot window_[WINDOW_SIZE] = {};
+  Slot request_ = {};
+  Response response_ = {};
+
+  bool Transact(const uint8_t& command, const uint32_t& address, const uint8_t* payload,
+                const uint16_t& payload_length, const uint16_t& timeout_ms);
+  bool CollectResponse();
+  // The block in flight the longest, nullptr if there is none
+  Slot* FindOldestSlot();
+  bool SendSlot(Slot& slot);
+  bool Resend(Slot& slot);
+
+  void BuildRequest(Slot& slot, const uint8_t& command, const uint32_t& address, const uint8_t* payload,
+                    const uint16_t& payload_length);
+  bool ReadResponse(const uint16_t& timeout_ms);
+  bool CheckStatus();
+
+  void Die(const Schmi::Error& err);
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_STUB_CLIENT_HPP
@@ -0,0 +1,78 @@
+#ifndef SCHMI_STUB_PROTOCOL_HPP
+#define SCHMI_STUB_PROTOCOL_HPP
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// Framing spoken by the RAM loader stub, see StubClient for the host side and Stm32Emulator for a
+// model of the device side. Multi byte fields are little endian, like the Cortex-M on the other end.
+//
+// Request:  0xA5 | seq | command | length (2) | address (4) | payload (length) | CRC-32 (4)
+// Response: 0x5A | seq | status  | length (2) | payload (length) | CRC-32 (4)
+//
+// The CRC covers everything between the sync byte and the CRC. Each request is answered with the
+// seq it came with, so the host can keep a window of requests in flight and resend only the ones
+// that came back with an error or never came back. A request whose answer was lost reaches the
+// stub twice: the stub remembers the seqs of its last WRITE_HISTORY_SIZE writes and answers a
+// repeated one with the same status, without programming the flash a second time.
+namespace StubProtocol {
+
+const uint8_t REQUEST_SYNC = 0xA5;
+const uint8_t RESPONSE_SYNC = 0x5A;
+
+const uint16_t REQUEST_HEADER_SIZE = 9;
+const uint16_t RESPONSE_HEADER_SIZE = 5;
+const uint16_t CRC_SIZE = 4;
+
+const uint16_t MAX_BLOCK_SIZE = 4096;
+const uint8_t WRITE_HISTORY_SIZE = 16;  // twice the host's window
+const uint16_t MAX_REQUEST_SIZE = REQUEST_HEADER_SIZE + MAX_BLOCK_SIZE + CRC_SIZE;
+const uint16_t MAX_RESPONSE_PAYLOAD = 16;
+const uint16_t MAX_RESPONSE_SIZE = RESPONSE_HEADER_SIZE + MAX_RESPONSE_PAYLOAD + CRC_SIZE;
+
+enum Command : uint8_t {
+  kPing = 0x01,     // answers version (1), reserved (1), max block size (2)
+  kSetBaud = 0x02,  // payload: baud rate (4), answered at the old speed then switches
+  kErase = 0x03,    // payload: number of bytes (4), erases every page that overlaps the range
+  kWrite = 0x04,    // payload: the data, up to max block size
+  kCrc = 0x05,      // payload: number of bytes (4), answers the CRC-32 of the range (4)
+  kRun = 0x06,      // answered, then jumps to address
+};
+
+enum Status : uint8_t {
+  kOk = 0x00,
+  kBadCrc = 0x01,
+  kBadCommand = 0x02,
+  kBadAddress = 0x03,
+  kFlashError = 0x04,
+  kBadBaudRate = 0x05,
+};
+
+// The stub image starts with this header, the code follows. The host reads it to know where to
+// jump, the GO address is load address + entry_offset.
+//
+//   magic (4) | version (1) | reserved (1) | max block size (2) | entry offset (4) | reserved (4)
+const uint32_t IMAGE_MAGIC = 0x42555453;  // "STUB"
+const uint8_t VERSION = 1;
+const uint16_t IMAGE_HEADER_SIZE = 16;
+
+// Right after the RAM used by the system bootloader on the parts we ship (AN2606)
+const uint32_t DEFAULT_LOAD_ADDRESS = 0x20004000;
+
+inline uint32_t ReadLe32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+inline void WriteLe32(uint8_t* bytes, const uint32_t& value) {
+  bytes[0] = value & 0xFF;
+  bytes[1] = (value >> 8) & 0xFF;
+  bytes[2] = (value >> 16) & 0xFF;
+  bytes[3] = (value >> 24) & 0xFF;
+
+  return;
+}
+}  // namespace StubProtocol
+}  // namespace Schmi
+
+#endif  // SCHMI_STUB_PROTOCOL_HPP
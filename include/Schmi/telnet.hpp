@@ -0,0 +1,62 @@
+#ifndef SCHMI_TELNET_HPP
+#define SCHMI_TELNET_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace Schmi {
+
+// The part of telnet serial servers speak: 0xFF escaping, option negotiation and the RFC 2217
+// COM-PORT-OPTION sub-negotiations
+namespace Telnet {
+const uint8_t IAC = 255;
+const uint8_t DONT = 254;
+const uint8_t DO = 253;
+const uint8_t WONT = 252;
+const uint8_t WILL = 251;
+const uint8_t SB = 250;
+const uint8_t SE = 240;
+
+const uint8_t BINARY = 0;
+const uint8_t COM_PORT_OPTION = 44;
+
+// COM-PORT-OPTION commands, the server answers with the command + SERVER_OFFSET
+const uint8_t SET_BAUDRATE = 1;
+const uint8_t SET_DATASIZE = 2;
+const uint8_t SET_PARITY = 3;
+const uint8_t SET_STOPSIZE = 4;
+const uint8_t SERVER_OFFSET = 100;
+
+const uint8_t PARITY_EVEN = 3;
+
+struct Command {
+  uint8_t verb;  // WILL, WONT, DO, DONT or SB
+  uint8_t option;
+  std::vector<uint8_t> payload;  // SB only, unescaped
+};
+
+// Doubles the IACs of bytes into out
+void AppendEscaped(const uint8_t* bytes, const size_t& num_bytes, std::vector<uint8_t>& out);
+void AppendNegotiation(const uint8_t& verb, const uint8_t& option, std::vector<uint8_t>& out);
+void AppendSubnegotiation(const uint8_t& option, const std::vector<uint8_t>& payload, std::vector<uint8_t>& out);
+
+// Splits a stream into its data bytes and commands. Keeps its state between calls, a command can
+// be cut anywhere by the TCP segments.
+class Decoder {
+ public:
+  void Decode(const uint8_t* bytes, const size_t& num_bytes, std::vector<uint8_t>& data,
+              std::vector<Command>& commands);
+
+  void Reset() { state_ = State::kData; };
+
+ private:
+  enum class State { kData, kIac, kOption, kSubOption, kSub, kSubIac };
+
+  State state_ = State::kData;
+  Command command_ = {};
+};
+}  // namespace Telnet
+}  // namespace Schmi
+
+#endif  // SCHMI_TELNET_HPP
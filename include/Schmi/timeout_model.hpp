@@ -0,0 +1,95 @@
+#ifndef SCHMI_TIMEOUT_MODEL_HPP
+#define SCHMI_TIMEOUT_MODEL_HPP
+
+#include "Schmi/latency_histogram.hpp"
+
+#include <stdint.h>
+
+namespace Schmi {
+
+// What Stm32 waits for, each kind has its own latency distribution
+enum class WaitKind : uint8_t {
+  kAck,        // ACK of a command, an address or a count
+  kWrite,      // ACK of a WRITE_MEMORY data frame, once the chip programmed it
+  kRead,       // data the chip sends back
+  kErase,      // ACK of an EXTEND_ERASE message, per page erased
+  kMassErase,  // ACK of a special erase code
+  kChecksum,   // ACK of GET_CHECKSUM, per KB checked
+  kNumKinds
+};
+
+/**
+ * Deadlines learned from the waits of earlier transactions, per chip and kind of wait.
+ * Every completed wait is recorded as its latency less the time its bytes spend on the wire,
+ * divided by its units (pages for an erase, KB for a checksum). The deadline of the next wait is
+ *   MARGIN * (99.9th percentile * units + wire time of its bytes) + MIN_MARGIN_US
+ * at least MIN_DEADLINE_MS and at most the fixed timeout Stm32 would use without a model.
+ * Until a kind has MIN_SAMPLES samples its fixed timeout is used. No heap, like CapabilityCache.
+ *
+ * Stm32 doesn't give up on a chip at the deadline: one late answer, like a USB latency timer
+ * spike, would fail a good board. It waits once more, for the extension, and records a late
+ * answer as a miss, which widens the deadlines of the next waits. A silent chip is given up
+ * after the deadline and the extension, never the fixed timeout.
+ */
+class TimeoutModel {
+ public:
+  static const uint8_t MAX_CHIPS = 4;
+  static const uint16_t MIN_SAMPLES = 32;
+  static const uint32_t MAX_SAMPLES = 4096;  // past this the samples are halved, old ones fade out
+  static const uint8_t MARGIN = 2;
+  static const uint16_t MIN_MARGIN_US = 2000;
+  static const uint16_t MIN_DEADLINE_MS = 5;
+  static const uint16_t MIN_EXTENSION_MS = 20;  // past a 16 ms FTDI latency timer
+  static const uint8_t NUM_KINDS = (uint8_t)WaitKind::kNumKinds;
+
+  // 8E1, 11 bits on the wire per byte
+  TimeoutModel(const uint32_t& baud_rate = 115200) { SetBaudRate(baud_rate); };
+  ~TimeoutModel(){};
+
+  void SetBaudRate(const uint32_t& baud_rate) { byte_ns_ = 11000000000ULL / baud_rate; };
+
+  // Samples and deadlines are for this chip from now on. Once full the oldest chip is replaced.
+  void SetChip(const uint16_t& product_id);
+  uint16_t GetChip() const { return chips_[current_].product_id; };
+
+  void Record(const WaitKind& kind, const uint32_t& units, const uint32_t& num_bytes, const uint64_t& latency_us);
+  // A wait that took longer than its deadline, recorded like any other and counted
+  void RecordMiss(const WaitKind& kind, const uint32_t& units, const uint32_t& num_bytes,
+                  const uint64_t& latency_us) {
+    num_misses_++;
+    Record(kind, units, num_bytes, latency_us);
+  };
+  uint32_t GetNumMisses() const { return num_misses_; };
+
+  uint16_t GetDeadlineMs(const WaitKind& kind, const uint32_t& units, const uint32_t& num_bytes,
+                         const uint16_t& fixed_timeout_ms) const;
+  // How much longer a wait that missed its deadline goes on: the deadline again, at least
+  // MIN_EXTENSION_MS, and never past the fixed timeout
+  static uint16_t GetExtensionMs(const uint16_t& deadline_ms, const uint16_t& fixed_timeout_ms);
+
+  // Per unit latency of a kind of the current chip, to look at or to store
+  const LatencyHistogram& GetLatency(const WaitKind& kind) const { return chips_[current_].latency[(uint8_t)kind]; };
+  LatencyHistogram& GetLatency(const WaitKind& kind) { return chips_[current_].latency[(uint8_t)kind]; };
+
+  uint8_t GetNumChips() const { return num_chips_; };
+  uint16_t GetChipAt(const uint8_t& index) const { return chips_[index].product_id; };
+  const LatencyHistogram& GetLatencyAt(const uint8_t& index, const WaitKind& kind) const {
+    return chips_[index].latency[(uint8_t)kind];
+  };
+
+ private:
+  struct Chip {
+    uint16_t product_id = 0;
+    LatencyHistogram latency[NUM_KINDS];
+  };
+
+  Chip chips_[MAX_CHIPS];
+  uint8_t num_chips_ = 1;  // entry 0 starts as the unknown chip, 0
+  uint8_t current_ = 0;
+  uint8_t next_chip_ = 1;
+  uint64_t byte_ns_;
+  uint32_t num_misses_ = 0;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_TIMEOUT_MODEL_HPP
@@ -0,0 +1,18 @@
+#ifndef SCHMI_TIMEOUT_MODEL_STD_HPP
+#define SCHMI_TIMEOUT_MODEL_STD_HPP
+
+#include "Schmi/timeout_model.hpp"
+
+#include <string>
+
+namespace Schmi {
+
+// A TimeoutModel in a text file, so what one run learned is there for the next. One line per chip
+// and kind of wait with samples:
+//   <product id> <kind> <bucket>:<count>...
+// Saved through a temporary file and a rename. A missing file loads as an empty model.
+bool LoadTimeoutModel(const std::string& file_name, TimeoutModel& model);
+bool SaveTimeoutModel(const std::string& file_name, const TimeoutModel& model);
+}  // namespace Schmi
+
+#endif  // SCHMI_TIMEOUT_MODEL_STD_HPP
@@ -0,0 +1,97 @@
+#ifndef SCHMI_TRACER_HPP
+#define SCHMI_TRACER_HPP
+
+#include "Schmi/clock_interface.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Schmi {
+
+// A span as a Chrome "complete" event: recorded once it ends, with its start and duration, so a
+// trace never holds a begin without its end
+struct TraceEvent {
+  const char* name;  // string literals only, they are kept by pointer
+  const char* category;
+  uint32_t port;
+  uint32_t thread;
+  uint64_t ts_us;  // start
+  uint64_t duration_us;
+};
+
+/**
+ * Records spans on a timeline, per port and thread, to be looked at in a trace viewer
+ * (chrome://tracing, Perfetto). FlashLoader records its phases and Stm32 every bootloader
+ * transaction and wait, see FlashLoader::SetTracer. One tracer can be shared by the sessions of
+ * several ports, each gets its own row. Every thread records into a buffer of its own, so the
+ * sessions don't take turns on a lock for each ACK.
+ */
+class Tracer {
+ public:
+  // Past this the spans are dropped and counted, about 40 MB
+  static const uint32_t MAX_EVENTS = 1 << 20;
+
+  Tracer(ClockInterface& clock);
+  ~Tracer(){};
+
+  // Names a row of the trace, returns the port ID to record with
+  uint32_t AddPort(const std::string& name);
+
+  // Start of a span
+  uint64_t NowUs() { return clock_.NowUs(); };
+  // A span that started at start_us and ends now
+  void Record(const uint32_t& port, const char* name, const char* category, const uint64_t& start_us);
+
+  size_t GetNumEvents();
+  uint32_t GetNumDropped() { return num_dropped_.load(std::memory_order_relaxed); };
+  // The spans of every thread in the order they started, a span before the ones inside it
+  std::vector<TraceEvent> GetEvents();
+
+  // The Chrome trace event JSON format, timestamps in us. Dropped spans are counted in otherData.
+  std::string ToChromeTrace();
+  bool WriteChromeTrace(const std::string& path);
+
+ private:
+  // Only its own thread appends, the lock is only contended while the trace is read
+  struct ThreadBuffer {
+    uint32_t thread;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+  };
+
+  ClockInterface& clock_;
+  uint64_t id_;  // tells tracers apart in the buffer cache of a thread
+  std::mutex mutex_;
+  std::vector<std::string> ports_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  std::atomic<uint32_t> num_events_{0};
+  std::atomic<uint32_t> num_dropped_{0};
+
+  ThreadBuffer& GetThreadBuffer();
+};
+
+// Starts now, recorded when it goes out of scope. Does nothing without a tracer.
+class TraceSpan {
+ public:
+  TraceSpan(Tracer* tracer, const uint32_t& port, const char* name, const char* category)
+      : tracer_(tracer), port_(port), name_(name), category_(category), start_us_(tracer ? tracer->NowUs() : 0){};
+  ~TraceSpan() {
+    if (tracer_) {
+      tracer_->Record(port_, name_, category_, start_us_);
+    }
+  };
+
+ private:
+  Tracer* tracer_;
+  uint32_t port_;
+  const char* name_;
+  const char* category_;
+  uint64_t start_us_;
+};
+}  // namespace Schmi
+
+#endif  // SCHMI_TRACER_HPP
@@ -0,0 +1,104 @@
+#include "Schmi/auto_flasher.hpp"
+
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/loading_bar_null.hpp"
+
+namespace Schmi {
+
+const uint32_t AutoFlasher::DEFAULT_OPEN_WINDOW_MS;
+const uint32_t AutoFlasher::FIRST_OPEN_RETRY_MS;
+const uint32_t AutoFlasher::MAX_OPEN_RETRY_MS;
+
+void AutoFlasher::Flash(const SerialDeviceInfo& device) {
+  uint64_t seen_us = clock_->NowUs();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  JoinFinished();
+  sessions_.push_back({std::thread(), false});
+  Session& session = sessions_.back();
+  session.thread = std::thread([this, device, seen_us, &session] {
+    AutoFlashResult result = RunSession(device, seen_us);
+    on_done_(result);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    session.done = true;
+  });
+
+  return;
+}
+
+void AutoFlasher::Wait() {
+  std::list<Session> sessions;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions.swap(sessions_);
+  }
+  for (auto& session : sessions) {
+    session.thread.join();
+  }
+
+  return;
+}
+
+uint32_t AutoFlasher::GetNumRunning() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t num_running = 0;
+  for (auto& session : sessions_) {
+    num_running += !session.done;
+  }
+
+  return num_running;
+}
+
+AutoFlashResult AutoFlasher::RunSession(const SerialDeviceInfo& device, const uint64_t& seen_us) {
+  AutoFlashResult result = {device, false, 0, 0, {}, ""};
+
+  std::unique_ptr<SerialInterface> ser = OpenPort(device, seen_us);
+  if (!ser) {
+    result.error = "open: cannot open " + device.path;
+    return result;
+  }
+  result.start_delay_us = clock_->NowUs() - seen_us;
+
+  ErrorHandlerCapture error;
+  LoadingBarNull bar;
+  FlashLoader fl(ser.get(), &image_, &error, &bar);
+  fl.SetClock(clock_);
+  fl.Init();
+  result.ok = fl.Flash(true, false);
+  result.total_us = clock_->NowUs() - seen_us;
+  result.timing = fl.GetTiming();
+  if (!result.ok) {
+    result.error = std::string(error.GetLastError().error_location) + ": " + error.GetLastError().error_string;
+  }
+
+  return result;
+}
+
+std::unique_ptr<SerialInterface> AutoFlasher::OpenPort(const SerialDeviceInfo& device, const uint64_t& seen_us) {
+  uint32_t retry_ms = FIRST_OPEN_RETRY_MS;
+  while (true) {
+    std::unique_ptr<SerialInterface> ser = open_port_(device);
+    uint64_t waited_us = clock_->NowUs() - seen_us;
+    if (ser || waited_us + retry_ms * 1000 > (uint64_t)open_window_ms_ * 1000) {
+      return ser;
+    }
+
+    clock_->SleepUs(retry_ms * 1000);
+    retry_ms = retry_ms * 2 < MAX_OPEN_RETRY_MS ? retry_ms * 2 : MAX_OPEN_RETRY_MS;
+  }
+}
+
+void AutoFlasher::JoinFinished() {
+  for (auto it = sessions_.begin(); it != sessions_.end();) {
+    if (it->done) {
+      it->thread.join();
+      it = sessions_.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+  return;
+}
+}  // namespace Schmi
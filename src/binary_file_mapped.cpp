@@ -0,0 +1,57 @@
+#include "Schmi/binary_file_mapped.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace Schmi {
+
+BinaryFileMapped::~BinaryFileMapped() {
+  if (bytes_) {
+    munmap(const_cast<uint8_t*>(bytes_), size_);
+  }
+}
+
+void BinaryFileMapped::Init() {
+  if (!bytes_ && !Map()) {
+    std::cerr << "ERROR: Fail mapping " << file_name_ << ", check file name/path\n";
+    exit(EXIT_FAILURE);
+  }
+  return;
+}
+
+void BinaryFileMapped::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
+  memcpy(bytes, bytes_ + bytes_data.starting_byte, bytes_data.num_bytes);
+
+  return;
+}
+
+bool BinaryFileMapped::Map() {
+  int fd = open(file_name_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  // The mapping keeps the file alive, the descriptor isn't needed anymore
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return 0;
+  }
+
+  bytes_ = static_cast<const uint8_t*>(mapped);
+  size_ = st.st_size;
+
+  return 1;
+}
+}  // namespace Schmi
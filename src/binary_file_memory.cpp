@@ -0,0 +1,15 @@
+#include "Schmi/binary_file_memory.hpp"
+
+#include <algorithm>
+
+namespace Schmi {
+
+void BinaryFileMemory::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
+  std::vector<uint8_t>::const_iterator first = bytes_.begin() + bytes_data.starting_byte;
+  std::vector<uint8_t>::const_iterator last = first + bytes_data.num_bytes;
+
+  std::copy(first, last, bytes);
+
+  return;
+}
+}  // namespace Schmi
@@ -2,26 +2,49 @@
 
 namespace Schmi {
 
+const uint32_t BinaryFileStd::LOAD_CHUNK_SIZE;
+
+BinaryFileStd::~BinaryFileStd() {
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+}
+
 void BinaryFileStd::Init() {
-  std::ifstream input_file;
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+
   try {
-    input_file.open(binary_file_name_, std::ios::binary | std::ios::ate);
-    if (input_file.fail()) {
+    input_file_.close();
+    input_file_.open(binary_file_name_, std::ios::binary | std::ios::ate);
+    if (input_file_.fail()) {
       throw StdException("Fail opening file, check file name/path");
     }
 
-    binary_file_size_ = FindFileSize(input_file);
-
-    bytes_ = ReadFile(input_file);
+    binary_file_size_ = FindFileSize(input_file_);
 
   } catch (const StdException& e) {
     std::cerr << "ERROR: " << e.what() << "\n";
     exit(EXIT_FAILURE);
   }
+
+  bytes_.resize(binary_file_size_);
+  num_bytes_loaded_ = 0;
+  load_failed_ = false;
+  crc_.Reset();
+
+  if (load_in_background_) {
+    loader_ = std::thread(&BinaryFileStd::LoadFile, this);
+  } else {
+    LoadFile();
+  }
   return;
 }
 
 void BinaryFileStd::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
+  WaitForBytes(bytes_data.starting_byte + bytes_data.num_bytes);
+
   std::vector<uint8_t>::const_iterator first = bytes_.begin() + bytes_data.starting_byte;
   std::vector<uint8_t>::const_iterator last = first + bytes_data.num_bytes;
 
@@ -30,6 +53,12 @@ void BinaryFileStd::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
   return;
 }
 
+uint32_t BinaryFileStd::WaitUntilLoaded() {
+  WaitForBytes(binary_file_size_);
+
+  return crc_.Get();
+}
+
 uint64_t BinaryFileStd::FindFileSize(std::ifstream& file) {
   file.seekg(0, file.end);
   uint64_t file_size = file.tellg();
@@ -38,12 +67,43 @@ uint64_t BinaryFileStd::FindFileSize(std::ifstream& file) {
   return file_size;
 }
 
-std::vector<uint8_t> BinaryFileStd::ReadFile(std::ifstream& file) {
-  char raw_data[binary_file_size_];
+void BinaryFileStd::LoadFile() {
+  uint64_t pos = 0;
+  while (pos < binary_file_size_) {
+    uint64_t num_bytes = std::min<uint64_t>(LOAD_CHUNK_SIZE, binary_file_size_ - pos);
 
-  file.read(raw_data, binary_file_size_);
-  std::vector<uint8_t> bytes(raw_data, raw_data + binary_file_size_);
+    // Straight into the vector, multi megabyte images don't fit on the stack
+    input_file_.read(reinterpret_cast<char*>(bytes_.data() + pos), num_bytes);
+    if ((uint64_t)input_file_.gcount() != num_bytes) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      load_failed_ = true;
+      loaded_cv_.notify_all();
+      return;
+    }
+    crc_.Update(bytes_.data() + pos, num_bytes);
+    pos += num_bytes;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_bytes_loaded_ = pos;
+    loaded_cv_.notify_all();
+  }
+
+  input_file_.close();
+  return;
+}
+
+void BinaryFileStd::WaitForBytes(const uint64_t& end) {
+  try {
+    std::unique_lock<std::mutex> lock(mutex_);
+    loaded_cv_.wait(lock, [this, &end]() { return load_failed_ || num_bytes_loaded_ >= end; });
+    if (num_bytes_loaded_ < end) {
+      throw StdException("Fail reading file, it was truncated while loading");
+    }
 
-  return bytes;
+  } catch (const StdException& e) {
+    std::cerr << "ERROR: " << e.what() << "\n";
+    exit(EXIT_FAILURE);
+  }
+  return;
 }
 }  // namespace Schmi
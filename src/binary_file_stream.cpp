@@ -0,0 +1,129 @@
+#include "Schmi/binary_file_stream.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace Schmi {
+
+const uint32_t BinaryFileStream::DEFAULT_BUFFER_SIZE;
+
+BinaryFileStream::~BinaryFileStream() {
+  if (spill_fd_ >= 0) {
+    close(spill_fd_);
+  }
+}
+
+void BinaryFileStream::Init() {
+  try {
+    if (buffer_size_ == 0) {
+      throw StdException("Stream buffer size can't be 0");
+    }
+    ring_.assign(buffer_size_, 0);
+    window_start_ = 0;
+    window_end_ = 0;
+
+    if (!spill_file_name_.empty()) {
+      spill_fd_ = open(spill_file_name_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+      if (spill_fd_ < 0) {
+        throw StdException("Fail opening spill file, check file name/path");
+      }
+    }
+
+  } catch (const StdException& e) {
+    std::cerr << "ERROR: " << e.what() << "\n";
+    exit(EXIT_FAILURE);
+  }
+  return;
+}
+
+void BinaryFileStream::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
+  const uint64_t pos = bytes_data.starting_byte;
+  const uint64_t end = pos + bytes_data.num_bytes;
+
+  try {
+    if (end > image_size_) {
+      throw StdException("Read past the end of the image");
+    }
+    if (bytes_data.num_bytes > buffer_size_) {
+      throw StdException("Read larger than the stream buffer");
+    }
+
+    if (pos < window_start_) {
+      ReadFromSpill(bytes, pos, bytes_data.num_bytes);
+      return;
+    }
+
+    FillUntil(end, pos);
+    CopyFromRing(bytes, pos, bytes_data.num_bytes);
+
+  } catch (const StdException& e) {
+    std::cerr << "ERROR: " << e.what() << "\n";
+    exit(EXIT_FAILURE);
+  }
+  return;
+}
+
+void BinaryFileStream::FillUntil(const uint64_t& end, const uint64_t& keep_from) {
+  while (window_end_ < end) {
+    // Never overwrite what the current request needs
+    uint64_t keep = keep_from < window_start_ ? window_start_ : keep_from;
+    if (keep > window_end_) keep = window_end_;
+
+    uint64_t num_bytes = buffer_size_ - (window_end_ - keep);
+    uint32_t offset = window_end_ % buffer_size_;
+    if (num_bytes > buffer_size_ - offset) num_bytes = buffer_size_ - offset;
+    if (num_bytes > image_size_ - window_end_) num_bytes = image_size_ - window_end_;
+
+    ssize_t num_bytes_read = read(fd_, ring_.data() + offset, num_bytes);
+    if (num_bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_bytes_read <= 0) {
+      std::stringstream err_message;
+      err_message << "Stream ended after " << window_end_ << " / " << image_size_ << " bytes";
+      throw StdException(err_message.str());
+    }
+
+    if (spill_fd_ >= 0) {
+      if (pwrite(spill_fd_, ring_.data() + offset, num_bytes_read, window_end_) != num_bytes_read) {
+        throw StdException("Fail writing spill file");
+      }
+    }
+
+    window_end_ += num_bytes_read;
+    if (window_end_ - window_start_ > buffer_size_) {
+      window_start_ = window_end_ - buffer_size_;
+    }
+  }
+
+  return;
+}
+
+void BinaryFileStream::CopyFromRing(uint8_t* bytes, const uint64_t& pos, const uint32_t& num_bytes) {
+  uint32_t offset = pos % buffer_size_;
+  uint32_t first_part = buffer_size_ - offset < num_bytes ? buffer_size_ - offset : num_bytes;
+
+  memcpy(bytes, ring_.data() + offset, first_part);
+  memcpy(bytes + first_part, ring_.data(), num_bytes - first_part);
+
+  return;
+}
+
+void BinaryFileStream::ReadFromSpill(uint8_t* bytes, const uint64_t& pos, const uint32_t& num_bytes) {
+  if (spill_fd_ < 0) {
+    throw StdException("Bytes already left the stream buffer and there is no spill file");
+  }
+
+  // The part still in the ring is also in the spill file, one read covers both
+  if (pos + num_bytes > window_end_) {
+    FillUntil(pos + num_bytes, window_start_);
+  }
+  if (pread(spill_fd_, bytes, num_bytes, pos) != (ssize_t)num_bytes) {
+    throw StdException("Fail reading spill file");
+  }
+
+  return;
+}
+}  // namespace Schmi
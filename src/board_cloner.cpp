@@ -0,0 +1,154 @@
+#include "Schmi/board_cloner.hpp"
+
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/stm32.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace Schmi {
+
+namespace {
+
+// A target port that stops taking writes once the source is lost, so its session ends at the next
+// frame instead of writing the rest of the image as 0xFF
+class CloneTargetSerial : public SerialInterface {
+ public:
+  CloneTargetSerial(SerialInterface& ser, CloneStream& stream) : ser_(ser), stream_(stream){};
+
+  void Init() override { ser_.Init(); };
+  bool Open() override { return ser_.Open(); };
+  void Close() override { ser_.Close(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    if (stream_.IsAborted()) {
+      return -1;
+    }
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+  bool SetBaudRate(const uint32_t& baud_rate) override { return ser_.SetBaudRate(baud_rate); };
+  void FlushInput() override { ser_.FlushInput(); };
+
+ private:
+  SerialInterface& ser_;
+  CloneStream& stream_;
+};
+
+std::string FormatError(const ErrorHandlerCapture& error) {
+  return std::string(error.GetLastError().error_location) + ": " + error.GetLastError().error_string;
+}
+}  // namespace
+
+const uint16_t BoardCloner::READ_SIZE;
+
+void BoardCloner::AddTarget(const std::string& name, SerialInterface* ser, ClockInterface* clock) {
+  targets_.push_back({name, ser, clock ? clock : &clock_std_});
+
+  return;
+}
+
+CloneReport BoardCloner::Run() {
+  CloneReport report = {false, "", num_bytes_, 0, 0, 0, {}};
+  report.targets.resize(targets_.size());
+  CloneStream stream(num_bytes_, targets_.size(), capacity_);
+  uint64_t start_us = clock_->NowUs();
+
+  std::vector<std::thread> sessions;
+  for (uint32_t ii = 0; ii < targets_.size(); ii++) {
+    sessions.emplace_back([&, ii] { report.targets[ii] = RunTarget(ii, stream, start_us); });
+  }
+
+  report.source_ok = ReadSource(stream, report);
+  if (!report.source_ok) {
+    stream.Abort();
+  }
+  report.read_us = clock_->NowUs() - start_us;
+  report.producer_wait_us = stream.GetProducerWaitUs();
+
+  for (auto& session : sessions) {
+    session.join();
+  }
+
+  // End to end: a target that wrote and verified something else than the source gave isn't a clone
+  for (CloneTargetResult& target : report.targets) {
+    if (target.ok && (!report.source_ok || target.crc != report.source_crc)) {
+      target.ok = false;
+      target.error = "clone: hash differs from the source";
+    }
+  }
+
+  return report;
+}
+
+bool BoardCloner::ReadSource(CloneStream& stream, CloneReport& report) {
+  ErrorHandlerCapture error;
+  Stm32 stm32(*source_, error);
+  stm32.SetClock(clock_);
+  if (!source_->Open()) {
+    report.source_error = "clone: could not open the source";
+    return 0;
+  }
+
+  ConnectResult connect_result;
+  if (!stm32.Connect(connect_result)) {
+    report.source_error = FormatError(error);
+    return 0;
+  }
+
+  Crc32 crc;
+  uint8_t bytes[READ_SIZE];
+  for (uint64_t pos = 0; pos < num_bytes_; pos += READ_SIZE) {
+    uint16_t num_bytes = std::min<uint64_t>(READ_SIZE, num_bytes_ - pos);
+    if (!stm32.ReadMemory(bytes, num_bytes, start_address_ + pos)) {
+      report.source_error = FormatError(error);
+      return 0;
+    }
+    crc.Update(bytes, num_bytes);
+    if (!stream.Write(bytes, num_bytes)) {
+      report.source_error = "clone: stream aborted";
+      return 0;
+    }
+  }
+  report.source_crc = crc.Get();
+
+  return 1;
+}
+
+CloneTargetResult BoardCloner::RunTarget(const uint32_t& index, CloneStream& stream, const uint64_t& start_us) {
+  const Target& target = targets_[index];
+  CloneTargetResult result = {target.name, false, 0, 0, ""};
+
+  CloneTargetSerial ser(*target.ser, stream);
+  CloneStreamReader bin(stream, index);
+  ErrorHandlerCapture error;
+  LoadingBarNull bar;
+  FlashLoader fl(&ser, &bin, &error, &bar);
+  fl.SetClock(target.clock);
+  // A port that can't be opened fails this target only, Init of the open port does nothing then
+  if (!ser.Open()) {
+    stream.Detach(index);
+    result.total_us = clock_->NowUs() - start_us;
+    result.error = "clone: could not open the port";
+    return result;
+  }
+  fl.Init();
+  result.ok = fl.Flash(true, false, start_address_);
+  // Done with the stream either way, the others mustn't wait for this one
+  stream.Detach(index);
+
+  result.total_us = clock_->NowUs() - start_us;
+  result.crc = bin.GetCrc();
+  if (!bin.IsComplete()) {
+    result.ok = false;
+    result.error = "clone: source lost";
+  } else if (!result.ok) {
+    result.error = FormatError(error);
+  }
+
+  return result;
+}
+}  // namespace Schmi
@@ -0,0 +1,47 @@
+#include "Schmi/bootloader_capabilities.hpp"
+
+namespace Schmi {
+
+const uint8_t CapabilityCache::MAX_ENTRIES;
+
+BootloaderCapabilities MakeBootloaderCapabilities(const uint16_t& product_id, const BootloaderCommands& commands) {
+  BootloaderCapabilities capabilities = {};
+  capabilities.product_id = product_id;
+  capabilities.bootloader_version = commands.version;
+  for (uint8_t ii = 0; ii < commands.num_commands; ii++) {
+    uint8_t opcode = commands.commands[ii];
+    capabilities.commands[opcode >> 5] |= (uint32_t)1 << (opcode & 0x1F);
+  }
+
+  return capabilities;
+}
+
+const BootloaderCapabilities* CapabilityCache::Find(const uint16_t& product_id,
+                                                    const uint8_t& bootloader_version) const {
+  for (uint8_t ii = 0; ii < num_entries_; ii++) {
+    if (entries_[ii].product_id == product_id && entries_[ii].bootloader_version == bootloader_version) {
+      return &entries_[ii];
+    }
+  }
+
+  return nullptr;
+}
+
+void CapabilityCache::Store(const BootloaderCapabilities& capabilities) {
+  for (uint8_t ii = 0; ii < num_entries_; ii++) {
+    if (entries_[ii].product_id == capabilities.product_id &&
+        entries_[ii].bootloader_version == capabilities.bootloader_version) {
+      entries_[ii] = capabilities;
+      return;
+    }
+  }
+
+  entries_[next_entry_] = capabilities;
+  next_entry_ = (next_entry_ + 1) % MAX_ENTRIES;
+  if (num_entries_ < MAX_ENTRIES) {
+    num_entries_++;
+  }
+
+  return;
+}
+}  // namespace Schmi
@@ -0,0 +1,15 @@
+#include "Schmi/clock_std.hpp"
+
+namespace Schmi {
+
+uint64_t ClockStd::NowUs() {
+  std::chrono::steady_clock::duration now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+void ClockStd::SleepUs(const uint64_t& duration_us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(duration_us));
+
+  return;
+}
+}  // namespace Schmi
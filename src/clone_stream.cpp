@@ -0,0 +1,112 @@
+#include "Schmi/clone_stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Schmi {
+
+const uint32_t CloneStream::DEFAULT_CAPACITY;
+
+bool CloneStream::Write(const uint8_t* bytes, const uint32_t& num_bytes) {
+  uint32_t done = 0;
+  while (done < num_bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint32_t capacity = ring_.size();
+    if (written_ - GetSlowestCursor() >= capacity) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      read_cv_.wait(lock, [&] { return aborted_ || written_ - GetSlowestCursor() < capacity; });
+      producer_wait_us_ +=
+          std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (aborted_) {
+      return 0;
+    }
+
+    // Up to the room left and the end of the ring, the rest on the next round
+    uint32_t offset = written_ % capacity;
+    uint64_t room = capacity - (written_ - GetSlowestCursor());
+    uint32_t chunk = std::min<uint64_t>({num_bytes - done, room, capacity - offset});
+    memcpy(ring_.data() + offset, bytes + done, chunk);
+    written_ += chunk;
+    done += chunk;
+    written_cv_.notify_all();
+  }
+
+  return 1;
+}
+
+void CloneStream::Abort() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  aborted_ = true;
+  written_cv_.notify_all();
+  read_cv_.notify_all();
+
+  return;
+}
+
+bool CloneStream::Read(const uint32_t& reader, uint8_t* bytes, const uint64_t& pos, const uint32_t& num_bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_cv_.wait(lock, [&] { return aborted_ || written_ >= pos + num_bytes; });
+  if (written_ < pos + num_bytes) {
+    return 0;
+  }
+
+  uint32_t capacity = ring_.size();
+  for (uint32_t done = 0; done < num_bytes;) {
+    uint32_t offset = (pos + done) % capacity;
+    uint32_t chunk = std::min<uint32_t>(num_bytes - done, capacity - offset);
+    memcpy(bytes + done, ring_.data() + offset, chunk);
+    done += chunk;
+  }
+  cursors_[reader] = std::max(cursors_[reader], pos + num_bytes);
+  read_cv_.notify_all();
+
+  return 1;
+}
+
+void CloneStream::Detach(const uint32_t& reader) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  detached_[reader] = true;
+  read_cv_.notify_all();
+
+  return;
+}
+
+bool CloneStream::IsAborted() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return aborted_;
+}
+
+uint64_t CloneStream::GetProducerWaitUs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return producer_wait_us_;
+}
+
+uint64_t CloneStream::GetSlowestCursor() const {
+  // Nobody left to wait for
+  uint64_t slowest = written_;
+  for (size_t ii = 0; ii < cursors_.size(); ii++) {
+    if (!detached_[ii]) {
+      slowest = std::min(slowest, cursors_[ii]);
+    }
+  }
+
+  return slowest;
+}
+
+void CloneStreamReader::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
+  if (!complete_ || !stream_.Read(reader_, bytes, bytes_data.starting_byte, bytes_data.num_bytes)) {
+    complete_ = false;
+    memset(bytes, 0xFF, bytes_data.num_bytes);
+    return;
+  }
+
+  crc_.Update(bytes, bytes_data.num_bytes);
+  num_bytes_read_ += bytes_data.num_bytes;
+
+  return;
+}
+}  // namespace Schmi
@@ -0,0 +1,124 @@
+#include "Schmi/device_state_std.hpp"
+
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace Schmi {
+
+void DeviceStateStd::Init() {
+  devices_.clear();
+
+  std::ifstream file(file_name_);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    Entry entry = {};
+    DeviceRecord& record = entry.record;
+    fields >> key >> std::dec >> record.page_size >> record.first_page >> record.num_pages >> std::hex >>
+        record.image_crc >> std::dec >> record.image_size >> std::hex >> record.range_checksum;
+
+    entry.page_crcs.resize(record.num_pages);
+    for (uint32_t ii = 0; ii < record.num_pages; ii++) {
+      fields >> entry.page_crcs[ii];
+    }
+
+    // A line cut short by a crash is dropped, that board is flashed in full next time
+    if (fields.fail() || key.size() != 2 * UNIQUE_ID_SIZE) {
+      continue;
+    }
+    devices_[key] = entry;
+  }
+
+  return;
+}
+
+bool DeviceStateStd::Find(const UniqueId& uid, DeviceRecord& record) {
+  auto device = devices_.find(ToKey(uid));
+  if (device == devices_.end()) {
+    return 0;
+  }
+
+  found_ = device->second;
+  record = found_.record;
+
+  return 1;
+}
+
+uint32_t DeviceStateStd::GetPageCrc(const uint32_t& index) {
+  return index < found_.page_crcs.size() ? found_.page_crcs[index] : 0;
+}
+
+void DeviceStateStd::Forget(const UniqueId& uid) {
+  if (devices_.erase(ToKey(uid))) {
+    Save();
+  }
+
+  return;
+}
+
+void DeviceStateStd::StartRecord(const UniqueId& uid) {
+  pending_key_ = ToKey(uid);
+  pending_ = {};
+
+  return;
+}
+
+void DeviceStateStd::SetPageCrc(const uint32_t& index, const uint32_t& crc) {
+  if (index >= pending_.page_crcs.size()) {
+    pending_.page_crcs.resize(index + 1, 0);
+  }
+  pending_.page_crcs[index] = crc;
+
+  return;
+}
+
+bool DeviceStateStd::Commit(const DeviceRecord& record) {
+  pending_.record = record;
+  pending_.page_crcs.resize(record.num_pages, 0);
+  devices_[pending_key_] = pending_;
+
+  return Save();
+}
+
+std::string DeviceStateStd::ToKey(const UniqueId& uid) {
+  char key[2 * UNIQUE_ID_SIZE + 1];
+  for (uint8_t ii = 0; ii < UNIQUE_ID_SIZE; ii++) {
+    snprintf(key + 2 * ii, 3, "%02x", uid.bytes[ii]);
+  }
+
+  return key;
+}
+
+bool DeviceStateStd::Save() {
+  // The old file stays whole until the new one is complete
+  std::string temp_name = file_name_ + ".tmp";
+  {
+    std::ofstream file(temp_name, std::ios::trunc);
+    for (auto& device : devices_) {
+      const DeviceRecord& record = device.second.record;
+      file << device.first << std::dec << " " << record.page_size << " " << record.first_page << " "
+           << record.num_pages << std::hex << " " << record.image_crc << std::dec << " " << record.image_size
+           << std::hex << " " << record.range_checksum;
+      for (uint32_t crc : device.second.page_crcs) {
+        file << " " << crc;
+      }
+      file << "\n";
+    }
+
+    if (!file.good()) {
+      std::cerr << "ERROR: could not write " << temp_name << "\n";
+      return 0;
+    }
+  }
+
+  if (rename(temp_name.c_str(), file_name_.c_str()) != 0) {
+    std::cerr << "ERROR: could not replace " << file_name_ << "\n";
+    return 0;
+  }
+
+  return 1;
+}
+}  // namespace Schmi
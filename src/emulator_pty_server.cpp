@@ -0,0 +1,113 @@
+#include "Schmi/emulator_pty_server.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+namespace Schmi {
+
+bool EmulatorPtyServer::Start() {
+  master_fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (master_fd_ < 0) {
+    return 0;
+  }
+
+  char name[128];
+  if (grantpt(master_fd_) != 0 || unlockpt(master_fd_) != 0 || ptsname_r(master_fd_, name, sizeof(name)) != 0 ||
+      (slave_fd_ = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0 || pipe(stop_pipe_) != 0) {
+    close(master_fd_);
+    if (slave_fd_ >= 0) {
+      close(slave_fd_);
+    }
+    master_fd_ = -1;
+    slave_fd_ = -1;
+    return 0;
+  }
+  port_path_ = name;
+
+  // No echo or line editing before the host sets the port up
+  termios tty;
+  if (tcgetattr(slave_fd_, &tty) == 0) {
+    cfmakeraw(&tty);
+    tcsetattr(slave_fd_, TCSANOW, &tty);
+  }
+
+  thread_ = std::thread(&EmulatorPtyServer::Serve, this);
+
+  return 1;
+}
+
+void EmulatorPtyServer::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  if (write(stop_pipe_[1], "x", 1) != 1) {
+    // Nothing else wakes the thread, but the pipe is empty and can't be full
+  }
+  thread_.join();
+  close(master_fd_);
+  close(slave_fd_);
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+  master_fd_ = -1;
+  slave_fd_ = -1;
+
+  return;
+}
+
+void EmulatorPtyServer::Serve() {
+  uint8_t bytes[4096];
+  std::vector<uint8_t> answer;
+  bool was_running = board_.IsRunning();
+
+  while (true) {
+    pollfd fds[2] = {{stop_pipe_[0], POLLIN, 0}, {master_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents) {
+      return;
+    }
+    ssize_t num_bytes = read(master_fd_, bytes, sizeof(bytes));
+    if (num_bytes <= 0) {
+      continue;
+    }
+
+    board_.Write(bytes, num_bytes);
+    answer.resize(board_.GetNumPending());
+    if (!answer.empty()) {
+      board_.Read(answer.data(), answer.size(), 0);
+    }
+
+    // Counted before the answer goes out, the host may look as soon as it has the ACK of the GO
+    if (board_.IsRunning() && !was_running) {
+      num_boards_++;
+      if (swap_boards_) {
+        board_.Reset();
+      }
+    }
+    was_running = board_.IsRunning();
+
+    if (!answer.empty() && !Send(answer.data(), answer.size())) {
+      return;
+    }
+  }
+}
+
+bool EmulatorPtyServer::Send(const uint8_t* bytes, const size_t& num_bytes) {
+  size_t num_sent = 0;
+  while (num_sent < num_bytes) {
+    ssize_t sent = write(master_fd_, bytes + num_sent, num_bytes - num_sent);
+    if (sent <= 0) {
+      return 0;
+    }
+    num_sent += sent;
+  }
+
+  return 1;
+}
+}  // namespace Schmi
@@ -0,0 +1,147 @@
+#include "Schmi/emulator_tcp_server.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace Schmi {
+
+bool EmulatorTcpServer::Start(const uint16_t& port) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return 0;
+  }
+  int on = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  socklen_t length = sizeof(address);
+  if (bind(listen_fd_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd_, 1) != 0 ||
+      getsockname(listen_fd_, (sockaddr*)&address, &length) != 0 || pipe(stop_pipe_) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return 0;
+  }
+  port_ = ntohs(address.sin_port);
+
+  thread_ = std::thread(&EmulatorTcpServer::Serve, this);
+
+  return 1;
+}
+
+void EmulatorTcpServer::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  if (write(stop_pipe_[1], "x", 1) != 1) {
+    // The thread is still woken up by the socket closing below
+  }
+  thread_.join();
+  close(listen_fd_);
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+  listen_fd_ = -1;
+
+  return;
+}
+
+void EmulatorTcpServer::Serve() {
+  while (true) {
+    pollfd fds[2] = {{stop_pipe_[0], POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents) {
+      return;
+    }
+
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    ServeClient(fd);
+    close(fd);
+  }
+}
+
+void EmulatorTcpServer::ServeClient(const int& fd) {
+  Telnet::Decoder decoder;
+  std::vector<uint8_t> data;
+  std::vector<Telnet::Command> commands;
+  std::vector<uint8_t> answer;
+  uint8_t bytes[4096];
+
+  while (true) {
+    pollfd fds[2] = {{stop_pipe_[0], POLLIN, 0}, {fd, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents) {
+      return;
+    }
+    ssize_t num_bytes = recv(fd, bytes, sizeof(bytes), 0);
+    if (num_bytes <= 0) {
+      return;
+    }
+
+    data.clear();
+    commands.clear();
+    answer.clear();
+    if (rfc2217_) {
+      decoder.Decode(bytes, num_bytes, data, commands);
+    } else {
+      data.assign(bytes, bytes + num_bytes);
+    }
+
+    for (const Telnet::Command& command : commands) {
+      if (command.verb != Telnet::SB || command.option != Telnet::COM_PORT_OPTION || command.payload.empty()) {
+        continue;
+      }
+      // Every setting is taken and echoed back, only the speed means anything to the emulator
+      std::vector<uint8_t> reply = command.payload;
+      reply[0] += Telnet::SERVER_OFFSET;
+      if (command.payload[0] == Telnet::SET_BAUDRATE && command.payload.size() == 5) {
+        uint32_t baud_rate = (command.payload[1] << 24) | (command.payload[2] << 16) | (command.payload[3] << 8) |
+                             command.payload[4];
+        if (board_.SetBaudRate(baud_rate)) {
+          baud_rate_ = baud_rate;
+        }
+      }
+      Telnet::AppendSubnegotiation(Telnet::COM_PORT_OPTION, reply, answer);
+    }
+
+    if (!data.empty()) {
+      board_.Write(data.data(), data.size());
+    }
+    size_t num_pending = board_.GetNumPending();
+    if (num_pending) {
+      std::vector<uint8_t> output(num_pending);
+      board_.Read(output.data(), num_pending, 0);
+      if (rfc2217_) {
+        Telnet::AppendEscaped(output.data(), output.size(), answer);
+      } else {
+        answer.insert(answer.end(), output.begin(), output.end());
+      }
+    }
+
+    size_t num_sent = 0;
+    while (num_sent < answer.size()) {
+      ssize_t sent = send(fd, answer.data() + num_sent, answer.size() - num_sent, MSG_NOSIGNAL);
+      if (sent <= 0) {
+        return;
+      }
+      num_sent += sent;
+    }
+  }
+}
+}  // namespace Schmi
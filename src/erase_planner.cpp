@@ -0,0 +1,193 @@
+#include "Schmi/erase_planner.hpp"
+
+namespace Schmi {
+
+namespace {
+// Datasheet values, bank erase takes as long as a mass erase on these parts
+const ChipTiming KNOWN_CHIPS[] = {
+    // id,   page,  flash,        banks, page typ/max, mass typ/max
+    {0x0422, 2048, 256 * 1024, 1, 20, 40, 20, 40},   // STM32F302xB/C, F303xB/C
+    {0x0438, 2048, 64 * 1024, 1, 20, 40, 20, 40},    // STM32F303x6/8, F334
+    {0x0439, 2048, 64 * 1024, 1, 20, 40, 20, 40},    // STM32F301x6/8, F302x6/8
+    {0x0468, 2048, 128 * 1024, 1, 22, 25, 22, 25},   // STM32G431/441
+    {0x0469, 2048, 512 * 1024, 2, 22, 25, 22, 25},   // STM32G47x/48x, dual bank mode
+    {0x0415, 2048, 1024 * 1024, 2, 22, 25, 22, 25},  // STM32L47x/48x
+};
+
+struct UniqueIdAddress {
+  uint16_t product_id;
+  uint32_t address;
+};
+
+// "Unique device ID register (96 bits)" of the reference manuals, readable by the bootloader
+const UniqueIdAddress UNIQUE_ID_ADDRESSES[] = {
+    {0x0422, 0x1FFFF7AC},
+    {0x0438, 0x1FFFF7AC},
+    {0x0439, 0x1FFFF7AC},
+    {0x0468, 0x1FFF7590},
+    {0x0469, 0x1FFF7590},
+    {0x0415, 0x1FFF7590},
+};
+
+// Room left in every timeout for the bootloader and the link on top of the erase itself
+const uint16_t TIMEOUT_MARGIN_MS = 500;
+const uint8_t BITS_PER_BYTE = 11;  // start + 8 data + even parity + stop
+}  // namespace
+
+const uint16_t ErasePlanner::MAX_PAGES_PER_MESSAGE;
+
+const ChipTiming& FindChipTiming(const uint16_t& product_id) {
+  for (const ChipTiming& chip : KNOWN_CHIPS) {
+    if (chip.product_id == product_id) {
+      return chip;
+    }
+  }
+
+  return DEFAULT_CHIP_TIMING;
+}
+
+uint32_t FindUniqueIdAddress(const uint16_t& product_id) {
+  for (const UniqueIdAddress& uid : UNIQUE_ID_ADDRESSES) {
+    if (uid.product_id == product_id) {
+      return uid.address;
+    }
+  }
+
+  return 0;
+}
+
+ErasePlan ErasePlanner::Plan(const uint32_t& first_page, const uint32_t& num_pages,
+                             const bool& allow_erase_outside_range) const {
+  ErasePlan plan = {};
+  if (num_pages == 0) {
+    return plan;
+  }
+
+  // Page list, always valid
+  plan.steps[0] = PlanPages(first_page, num_pages);
+  plan.num_steps = 1;
+  plan.estimated_us = plan.steps[0].estimated_us;
+
+  uint32_t total_pages = chip_.flash_size / chip_.page_size;
+  bool covers_flash = total_pages && first_page == 0 && num_pages >= total_pages;
+
+  // Bank by bank, each part of the range is either a bank erase or a page list
+  if (chip_.num_banks == 2 && total_pages) {
+    uint32_t bank_pages = total_pages / 2;
+    ErasePlan bank_plan = {};
+
+    for (uint8_t bank = 0; bank < 2; bank++) {
+      uint32_t bank_start = bank * bank_pages;
+      uint32_t bank_end = bank_start + bank_pages;
+      uint32_t part_start = first_page > bank_start ? first_page : bank_start;
+      uint32_t part_end = first_page + num_pages < bank_end ? first_page + num_pages : bank_end;
+      if (part_start >= part_end) {
+        continue;
+      }
+
+      EraseStep step = PlanPages(part_start, part_end - part_start);
+      bool covers_bank = part_start == bank_start && part_end == bank_end;
+      if (allow_erase_outside_range || covers_bank) {
+        EraseStep bank_step = PlanBank(bank);
+        if (IsWorthWiping(bank_step.estimated_us, step.estimated_us)) {
+          step = bank_step;
+        }
+      }
+
+      bank_plan.steps[bank_plan.num_steps++] = step;
+      bank_plan.estimated_us += step.estimated_us;
+    }
+
+    if (bank_plan.num_steps && bank_plan.estimated_us < plan.estimated_us) {
+      plan = bank_plan;
+    }
+  }
+
+  if (allow_erase_outside_range || covers_flash) {
+    EraseStep mass_step = PlanMassErase();
+    if (IsWorthWiping(mass_step.estimated_us, plan.estimated_us)) {
+      plan.steps[0] = mass_step;
+      plan.num_steps = 1;
+      plan.estimated_us = mass_step.estimated_us;
+    }
+  }
+
+  return plan;
+}
+
+EraseStep ErasePlanner::PlanMassErase() const {
+  EraseStep step = {EraseType::kMass, 0xFFFF, 0, chip_.flash_size / chip_.page_size, 0,
+                    SpecialTimeoutMs(), EstimateSpecialUs()};
+
+  return step;
+}
+
+EraseStep ErasePlanner::PlanPages(const uint32_t& first_page, const uint32_t& num_pages) const {
+  uint16_t pages_per_message = PagesPerMessage(num_pages);
+  EraseStep step = {EraseType::kPages, 0, first_page, num_pages, pages_per_message,
+                    PagesTimeoutMs(pages_per_message), EstimatePagesUs(num_pages)};
+
+  return step;
+}
+
+EraseStep ErasePlanner::PlanBank(const uint8_t& bank) const {
+  uint32_t bank_pages = chip_.flash_size / chip_.page_size / 2;
+  EraseStep step = {EraseType::kBank, (uint16_t)(0xFFFE - bank), bank * bank_pages, bank_pages, 0,
+                    SpecialTimeoutMs(), EstimateSpecialUs()};
+
+  return step;
+}
+
+uint32_t ErasePlanner::EstimatePagesUs(const uint32_t& num_pages) const {
+  if (num_pages == 0) {
+    return 0;
+  }
+  uint32_t num_messages = (num_pages + PagesPerMessage(num_pages) - 1) / PagesPerMessage(num_pages);
+
+  // Per message: EXTEND_ERASE + ACK, then N, the page codes and the checksum + ACK
+  uint32_t link_us = num_messages * (2 * link_.round_trip_us + WireTimeUs(2 + 2 + 1 + 2));
+  link_us += WireTimeUs(2 * num_pages);
+
+  return link_us + num_pages * chip_.page_erase_ms * 1000;
+}
+
+uint32_t ErasePlanner::EstimateSpecialUs() const {
+  uint32_t link_us = 2 * link_.round_trip_us + WireTimeUs(2 + 3 + 2);
+
+  return link_us + chip_.mass_erase_ms * 1000;
+}
+
+bool ErasePlanner::IsWorthWiping(const uint32_t& special_us, const uint32_t& pages_us) const {
+  // On a near tie keep the page list, it doesn't touch anything else
+  return (uint64_t)special_us + chip_.page_erase_ms * 1000 <= pages_us;
+}
+
+uint16_t ErasePlanner::PagesPerMessage(const uint32_t& num_pages) const {
+  // Keep every message under max_message_ms even if all its pages take tERASE max
+  uint32_t max_pages = (max_message_ms_ - TIMEOUT_MARGIN_MS) / chip_.page_erase_max_ms;
+  if (max_pages > MAX_PAGES_PER_MESSAGE) max_pages = MAX_PAGES_PER_MESSAGE;
+  if (max_pages == 0) max_pages = 1;
+
+  // Then spread the pages evenly so the last message isn't a tiny one
+  uint32_t num_messages = (num_pages + max_pages - 1) / max_pages;
+  if (num_messages == 0) {
+    return 0;
+  }
+
+  return (num_pages + num_messages - 1) / num_messages;
+}
+
+uint16_t ErasePlanner::PagesTimeoutMs(const uint16_t& pages_per_message) const {
+  uint32_t timeout_ms = TIMEOUT_MARGIN_MS + pages_per_message * chip_.page_erase_max_ms;
+
+  return timeout_ms > 0xFFFF ? 0xFFFF : timeout_ms;
+}
+
+uint16_t ErasePlanner::SpecialTimeoutMs() const {
+  return TIMEOUT_MARGIN_MS + chip_.mass_erase_max_ms;
+}
+
+uint32_t ErasePlanner::WireTimeUs(const uint32_t& num_bytes) const {
+  return (uint64_t)num_bytes * BITS_PER_BYTE * 1000000 / link_.baud_rate;
+}
+}  // namespace Schmi
@@ -0,0 +1,36 @@
+#include "Schmi/error_handler_capture.hpp"
+
+namespace Schmi {
+
+void ErrorHandlerCapture::Init(const Error& error) {
+  error_ = error;
+  num_errors_++;
+
+  return;
+}
+
+void ErrorHandlerCapture::Display() {
+  if (verbose_) {
+    std::cerr << error_.error_location << ": ";
+    std::cerr << error_.error_string << " - ";
+    std::cerr << error_.err_num << "\n";
+  }
+
+  return;
+}
+
+void ErrorHandlerCapture::DisplayAndDie() {
+  Display();
+  died_ = true;
+
+  return;
+}
+
+void ErrorHandlerCapture::Reset() {
+  error_ = {"", "", 0};
+  num_errors_ = 0;
+  died_ = false;
+
+  return;
+}
+}  // namespace Schmi
@@ -0,0 +1,49 @@
+#include "Schmi/event_pump.hpp"
+
+#include <chrono>
+
+namespace Schmi {
+
+void EventPump::Start() {
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  thread_ = std::thread(&EventPump::Run, this);
+
+  return;
+}
+
+void EventPump::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  thread_.join();
+
+  return;
+}
+
+uint32_t EventPump::Drain() {
+  uint32_t num_events = 0;
+  SessionEvent event;
+  while (ring_.Pop(event)) {
+    sink_(event);
+    num_events++;
+  }
+
+  return num_events;
+}
+
+void EventPump::Run() {
+  while (running_) {
+    if (!Drain()) {
+      std::this_thread::sleep_for(std::chrono::microseconds(poll_us_));
+    }
+  }
+  // What came in since the last poll
+  Drain();
+
+  return;
+}
+}  // namespace Schmi
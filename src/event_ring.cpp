@@ -0,0 +1,46 @@
+#include "Schmi/event_ring.hpp"
+
+#include <string.h>
+
+namespace Schmi {
+
+const uint8_t SessionEvent::TEXT_SIZE;
+const uint32_t EventRing::CAPACITY;
+
+bool EventRing::Push(const SessionEvent& event) {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  uint32_t limit = event.kind == EventKind::kError ? CAPACITY : CAPACITY - 1;
+  if (tail - head_.load(std::memory_order_acquire) >= limit) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+
+  events_[tail % CAPACITY] = event;
+  tail_.store(tail + 1, std::memory_order_release);
+
+  return 1;
+}
+
+bool EventRing::Push(const EventKind& kind, const int32_t& num, const uint64_t& value, const char* text) {
+  SessionEvent event;
+  event.kind = kind;
+  event.num = num;
+  event.value = value;
+  strncpy(event.text, text, SessionEvent::TEXT_SIZE - 1);
+  event.text[SessionEvent::TEXT_SIZE - 1] = '\0';
+
+  return Push(event);
+}
+
+bool EventRing::Pop(SessionEvent& event) {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  if (head == tail_.load(std::memory_order_acquire)) {
+    return 0;
+  }
+
+  event = events_[head % CAPACITY];
+  head_.store(head + 1, std::memory_order_release);
+
+  return 1;
+}
+}  // namespace Schmi
@@ -0,0 +1,65 @@
+#include "Schmi/event_ring_session.hpp"
+
+#include <string.h>
+
+namespace Schmi {
+
+SessionEvent MakeErrorEvent(const EventKind& kind, const Error& error) {
+  SessionEvent event;
+  event.kind = kind;
+  event.num = error.err_num;
+  event.value = 0;
+  event.text[0] = '\0';
+  strncat(event.text, error.error_location, SessionEvent::TEXT_SIZE - 1);
+  strncat(event.text, ": ", SessionEvent::TEXT_SIZE - 1 - strlen(event.text));
+  strncat(event.text, error.error_string, SessionEvent::TEXT_SIZE - 1 - strlen(event.text));
+
+  return event;
+}
+
+void RingLoadingBar::StartLoadingBar(const uint64_t& total_num_bytes) {
+  total_num_bytes_ = total_num_bytes;
+  last_percent_ = -1;
+  ring_.Push(EventKind::kWriteStart, 0, total_num_bytes);
+
+  return;
+}
+
+void RingLoadingBar::StartCheckingLoadingBar(const uint64_t& total_num_bytes) {
+  total_num_bytes_ = total_num_bytes;
+  last_percent_ = -1;
+  ring_.Push(EventKind::kVerifyStart, 0, total_num_bytes);
+
+  return;
+}
+
+void RingLoadingBar::UpdateLoadingBar(const uint64_t& bytes_left) {
+  int32_t percent = total_num_bytes_ ? 100 - bytes_left * 100 / total_num_bytes_ : 100;
+  if (percent == last_percent_) {
+    return;
+  }
+  last_percent_ = percent;
+  ring_.Push(EventKind::kProgress, percent, bytes_left);
+
+  return;
+}
+
+void RingLoadingBar::EndLoadingBar() {
+  ring_.Push(EventKind::kEnd, 100, 0);
+
+  return;
+}
+
+void RingErrorHandler::DisplayAndDie() {
+  Queue(EventKind::kError);
+  died_ = true;
+
+  return;
+}
+
+void RingErrorHandler::Queue(const EventKind& kind) {
+  ring_.Push(MakeErrorEvent(kind, error_));
+
+  return;
+}
+}  // namespace Schmi
@@ -0,0 +1,135 @@
+#include "Schmi/fault_injecting_serial.hpp"
+
+namespace Schmi {
+
+void FaultInjectingSerial::Init() {
+  ser_.Init();
+
+  return;
+}
+
+int FaultInjectingSerial::Write(uint8_t* buffer, const uint16_t& buffer_length) {
+  AddLatency();
+
+  if (Chance(config_.stall_write_rate)) {
+    stats_.stalled_writes++;
+    Delay(config_.stall_write_us);
+  }
+
+  // Forwarded in pieces of write_buffer_ size, loader stub frames are larger than AN3155 ones
+  uint16_t num_bytes = 0;
+  for (uint16_t ii = 0; ii < buffer_length; ii++) {
+    if (Chance(config_.drop_byte_rate)) {
+      stats_.dropped_bytes++;
+      continue;
+    }
+    write_buffer_[num_bytes++] = CorruptByte(buffer[ii]);
+
+    if (num_bytes == MAX_MESSAGE_SIZE) {
+      if (ser_.Write(write_buffer_, num_bytes) != 0) {
+        return -1;
+      }
+      num_bytes = 0;
+    }
+  }
+
+  // The host can't tell a byte got lost on the way, as far as it knows the write went through
+  if (num_bytes == 0) {
+    return 0;
+  }
+
+  return ser_.Write(write_buffer_, num_bytes);
+}
+
+int FaultInjectingSerial::Read(uint8_t* buffer, const uint16_t& num_bytes,
+                               const uint16_t& timeout_ms) {
+  AddLatency();
+
+  uint16_t num_bytes_to_read = num_bytes;
+  bool partial_read = num_bytes > 1 && Chance(config_.partial_read_rate);
+  if (partial_read) {
+    stats_.partial_reads++;
+    num_bytes_to_read = num_bytes / 2;
+  }
+
+  uint16_t num_bytes_read = 0;
+  while (num_bytes_read < num_bytes_to_read) {
+    if (ser_.Read(buffer + num_bytes_read, 1, timeout_ms) != 0) {
+      return -1;
+    }
+    // A dropped byte never reaches the host, the next one takes its place
+    if (Chance(config_.drop_byte_rate)) {
+      stats_.dropped_bytes++;
+      continue;
+    }
+    buffer[num_bytes_read] = CorruptByte(buffer[num_bytes_read]);
+    num_bytes_read++;
+  }
+
+  if (partial_read) {
+    Delay((uint64_t)timeout_ms * 1000);
+    return -1;
+  }
+
+  if (num_bytes == 1 && buffer[0] == CMD::ACK && Chance(config_.spurious_nack_rate)) {
+    stats_.spurious_nacks++;
+    buffer[0] = CMD::NACK;
+  }
+
+  return 0;
+}
+
+void FaultInjectingSerial::Reset() {
+  rng_.seed(config_.seed);
+  stats_ = {0, 0, 0, 0, 0, 0};
+
+  return;
+}
+
+void FaultInjectingSerial::SetConfig(const FaultConfig& config) {
+  config_ = config;
+  Reset();
+
+  return;
+}
+
+bool FaultInjectingSerial::Chance(const double& rate) {
+  if (rate <= 0.0) {
+    return 0;
+  }
+  std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+  return distribution(rng_) < rate;
+}
+
+void FaultInjectingSerial::AddLatency() {
+  uint64_t latency_us = config_.latency_us;
+  if (config_.latency_jitter_us) {
+    std::uniform_int_distribution<uint32_t> distribution(0, config_.latency_jitter_us);
+    latency_us += distribution(rng_);
+  }
+  Delay(latency_us);
+
+  return;
+}
+
+void FaultInjectingSerial::Delay(const uint64_t& duration_us) {
+  if (duration_us == 0) {
+    return;
+  }
+  stats_.injected_delay_us += duration_us;
+  clock_.SleepUs(duration_us);
+
+  return;
+}
+
+uint8_t FaultInjectingSerial::CorruptByte(const uint8_t& byte) {
+  if (!Chance(config_.corrupt_byte_rate)) {
+    return byte;
+  }
+  stats_.corrupted_bytes++;
+  std::uniform_int_distribution<int> distribution(0, 7);
+
+  return byte ^ (1 << distribution(rng_));
+}
+}  // namespace Schmi
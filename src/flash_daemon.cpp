@@ -0,0 +1,541 @@
+#include "Schmi/flash_daemon.hpp"
+
+#include "Schmi/crc32.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_interface.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace Schmi {
+
+const uint32_t FlashDaemon::MAX_OUTPUT_BYTES;
+
+// A PROGRESS event every percent, not every 256 byte write
+class FlashDaemon::JobBar : public LoadingBarInterface {
+ public:
+  JobBar(FlashDaemon& daemon, Job& job) : daemon_(daemon), job_(job){};
+
+  void StartLoadingBar(const uint64_t& total_num_bytes) override { Start("write", total_num_bytes); };
+  void StartCheckingLoadingBar(const uint64_t& total_num_bytes) override { Start("verify", total_num_bytes); };
+  void UpdateLoadingBar(const uint64_t& bytes_left) override {
+    uint32_t percent = total_num_bytes_ ? 100 - bytes_left * 100 / total_num_bytes_ : 100;
+    if (percent == last_percent_) {
+      return;
+    }
+    last_percent_ = percent;
+
+    std::stringstream event;
+    event << "PROGRESS " << job_.id << " " << phase_ << " " << percent;
+    daemon_.Send(*job_.client, event.str());
+  };
+  void EndLoadingBar() override{};
+
+ private:
+  FlashDaemon& daemon_;
+  Job& job_;
+  std::string phase_;
+  uint64_t total_num_bytes_ = 0;
+  uint32_t last_percent_ = 0;
+
+  void Start(const std::string& phase, const uint64_t& total_num_bytes) {
+    phase_ = phase;
+    total_num_bytes_ = total_num_bytes;
+    last_percent_ = 0;
+  };
+};
+
+void FlashDaemon::AddPort(const std::string& name, SerialInterface* ser, ClockInterface* clock) {
+  std::unique_ptr<Port> port(new Port());
+  port->name = name;
+  port->ser = ser;
+  port->clock = clock ? clock : &clock_;
+  port->busy = false;
+  port->boards_done = 0;
+  ports_.push_back(std::move(port));
+
+  return;
+}
+
+bool FlashDaemon::SetIoThreadOptions(const std::string& port_name, const IoThreadOptions& options) {
+  for (auto& port : ports_) {
+    if (port->name == port_name) {
+      port->io_options = options;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+bool FlashDaemon::Start() {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(address.sun_path)) {
+    return 0;
+  }
+  socket_path_.copy(address.sun_path, socket_path_.size());
+
+  // A socket left behind by a daemon that didn't stop cleanly
+  unlink(socket_path_.c_str());
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    return 0;
+  }
+  if (bind(listen_fd_, (sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd_, MAX_CLIENTS) < 0 ||
+      pipe(stop_pipe_) < 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return 0;
+  }
+  // Non-blocking, a port worker never waits to wake the server thread
+  if (pipe2(wake_pipe_, O_NONBLOCK | O_CLOEXEC) < 0) {
+    close(listen_fd_);
+    close(stop_pipe_[0]);
+    close(stop_pipe_[1]);
+    listen_fd_ = -1;
+    return 0;
+  }
+
+  stopping_ = false;
+  for (auto& port : ports_) {
+    port->trace_port = tracer_ ? tracer_->AddPort(port->name) : 0;
+    port->worker = std::thread(&FlashDaemon::PortWorker, this, std::ref(*port));
+  }
+  server_ = std::thread(&FlashDaemon::Serve, this);
+  running_ = true;
+
+  return 1;
+}
+
+void FlashDaemon::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    queue_.clear();
+  }
+  job_cv_.notify_all();
+
+  char stop = 0;
+  if (write(stop_pipe_[1], &stop, 1) < 0) {
+    perror("FlashDaemon::Stop");
+  }
+  server_.join();
+  for (auto& port : ports_) {
+    port->worker.join();
+  }
+
+  // What the sockets take now, the last DONE lines included
+  for (auto& client : clients_) {
+    FlushClient(*client);
+    CloseClient(*client);
+  }
+  clients_.clear();
+  close(listen_fd_);
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+  close(wake_pipe_[0]);
+  close(wake_pipe_[1]);
+  listen_fd_ = -1;
+  unlink(socket_path_.c_str());
+
+  return;
+}
+
+bool FlashDaemon::LoadImage(const std::string& path, std::string& image_id, std::string& error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    error = "cannot open " + path;
+    return 0;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (bytes.empty()) {
+    error = "empty image " + path;
+    return 0;
+  }
+
+  // Same content, same id, whatever the file is called: a second LOAD of an image costs nothing
+  // but the read
+  Crc32 crc;
+  crc.Update(bytes.data(), bytes.size());
+  char id[32];
+  snprintf(id, sizeof(id), "%08x-%zu", crc.Get(), bytes.size());
+  image_id = id;
+
+  if (images_.find(image_id) == images_.end()) {
+    images_[image_id] = std::make_shared<BinaryFileMemory>(bytes);
+  }
+
+  return 1;
+}
+
+void FlashDaemon::Serve() {
+  const size_t NUM_FIXED_FDS = 3;
+
+  while (true) {
+    std::vector<pollfd> fds;
+    fds.push_back({stop_pipe_[0], POLLIN, 0});
+    fds.push_back({wake_pipe_[0], POLLIN, 0});
+    fds.push_back({listen_fd_, POLLIN, 0});
+    for (auto& client : clients_) {
+      std::lock_guard<std::mutex> lock(client->mutex);
+      fds.push_back({client->fd, (short)(client->output.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+    }
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents) {
+      return;
+    }
+    if (fds[1].revents) {
+      char wake[64];
+      while (read(wake_pipe_[0], wake, sizeof(wake)) > 0) {
+      }
+    }
+    if (fds[2].revents & POLLIN) {
+      AcceptClient();
+    }
+
+    // Clients accepted just now aren't in fds yet
+    std::vector<std::shared_ptr<Client>> still_open;
+    for (size_t ii = 0; ii < clients_.size(); ii++) {
+      std::shared_ptr<Client> client = clients_[ii];
+      bool polled = ii + NUM_FIXED_FDS < fds.size();
+      if (polled && (fds[ii + NUM_FIXED_FDS].revents & (POLLIN | POLLHUP | POLLERR))) {
+        if (!ReadClient(*client)) {
+          FlushClient(*client);
+          CloseClient(*client);
+          continue;
+        }
+
+        size_t end;
+        while ((end = client->input.find('\n')) != std::string::npos) {
+          std::string line = client->input.substr(0, end);
+          client->input.erase(0, end + 1);
+          HandleRequest(client, line);
+        }
+      }
+
+      // Answers to the requests above, and whatever the workers queued
+      if (!FlushClient(*client)) {
+        CloseClient(*client);
+        continue;
+      }
+      still_open.push_back(client);
+    }
+    clients_ = still_open;
+  }
+}
+
+void FlashDaemon::AcceptClient() {
+  int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  if (clients_.size() >= MAX_CLIENTS) {
+    close(fd);
+    return;
+  }
+
+  std::shared_ptr<Client> client = std::make_shared<Client>();
+  client->fd = fd;
+  client->open = true;
+  clients_.push_back(client);
+
+  return;
+}
+
+bool FlashDaemon::ReadClient(Client& client) {
+  char buffer[512];
+  ssize_t num_bytes = read(client.fd, buffer, sizeof(buffer));
+  if (num_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return 1;
+  }
+  if (num_bytes <= 0) {
+    return 0;
+  }
+
+  client.input.append(buffer, num_bytes);
+  if (client.input.size() > MAX_LINE_LENGTH && client.input.find('\n') == std::string::npos) {
+    Send(client, "ERROR line too long");
+    return 0;
+  }
+
+  return 1;
+}
+
+void FlashDaemon::HandleRequest(const std::shared_ptr<Client>& client, const std::string& line) {
+  std::istringstream request(line);
+  std::string command;
+  request >> command;
+
+  if (command == "LOAD") {
+    std::string path, image_id, error;
+    request >> path;
+    if (!LoadImage(path, image_id, error)) {
+      Send(*client, "ERROR " + error);
+      return;
+    }
+    Send(*client, "IMAGE " + image_id + " " + std::to_string(images_[image_id]->GetBinaryFileSize()));
+  } else if (command == "FLASH") {
+    HandleFlash(client, request);
+  } else if (command == "STATUS") {
+    HandleStatus(client);
+  } else if (command == "LATENCY") {
+    HandleLatency(client);
+  } else if (command == "LINKS") {
+    HandleLinks(client);
+  } else if (!command.empty()) {
+    Send(*client, "ERROR unknown request " + command);
+  }
+
+  return;
+}
+
+void FlashDaemon::HandleFlash(const std::shared_ptr<Client>& client, std::istream& request) {
+  std::string image_id, port_name;
+  request >> image_id >> port_name;
+
+  auto image = images_.find(image_id);
+  if (image == images_.end()) {
+    Send(*client, "ERROR unknown image " + image_id);
+    return;
+  }
+
+  if (!port_name.empty()) {
+    bool found = false;
+    for (auto& port : ports_) {
+      found = found || port->name == port_name;
+    }
+    if (!found) {
+      Send(*client, "ERROR unknown port " + port_name);
+      return;
+    }
+  }
+
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->image = image->second;
+  job->port = port_name;
+  job->client = client;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->id = next_job_id_++;
+  }
+  // QUEUED is in the output before a worker can queue anything about the job
+  Send(*client, "QUEUED " + std::to_string(job->id));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(job);
+  }
+  job_cv_.notify_all();
+
+  return;
+}
+
+void FlashDaemon::HandleStatus(const std::shared_ptr<Client>& client) {
+  std::vector<std::string> lines;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& port : ports_) {
+      lines.push_back("PORT " + port->name + (port->busy ? " BUSY " : " IDLE ") + std::to_string(port->boards_done));
+    }
+    lines.push_back("QUEUE " + std::to_string(queue_.size()));
+  }
+
+  for (const std::string& line : lines) {
+    Send(*client, line);
+  }
+
+  return;
+}
+
+void FlashDaemon::HandleLatency(const std::shared_ptr<Client>& client) {
+  std::vector<std::string> lines;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& port : ports_) {
+      const LatencyHistogram& latency = port->latency;
+      std::stringstream line;
+      line << "LATENCY " << port->name << " " << latency.GetCount() << " " << latency.GetPercentileUs(50) << " "
+           << latency.GetPercentileUs(99) << " " << latency.GetPercentileUs(99.9) << " " << latency.GetMaxUs();
+      lines.push_back(line.str());
+    }
+  }
+
+  for (const std::string& line : lines) {
+    Send(*client, line);
+  }
+
+  return;
+}
+
+void FlashDaemon::HandleLinks(const std::shared_ptr<Client>& client) {
+  if (!link_scheduler_) {
+    Send(*client, "ERROR no link scheduler");
+    return;
+  }
+
+  for (const LinkStats& link : link_scheduler_->GetLinkStats()) {
+    uint64_t busy_percent = link.elapsed_us ? link.busy_us * 100 / link.elapsed_us : 0;
+    std::stringstream line;
+    line << "LINK " << link.name << " " << (link.is_hub ? "hub" : "chip") << " " << link.num_ports << " "
+         << busy_percent << " " << link.max_transfers << " " << link.wait_us / 1000;
+    Send(*client, line.str());
+  }
+
+  return;
+}
+
+void FlashDaemon::PortWorker(Port& port) {
+  IoThreadStatus io_status = ApplyIoThreadOptions(port.io_options);
+  if (!io_status.warnings.empty()) {
+    fprintf(stderr, "%s: %s", port.name.c_str(), io_status.warnings.c_str());
+  }
+
+  // Opened and configured once, Init of the port does nothing after that. A port that can't be
+  // opened yet is tried again by every job.
+  port.ser->Open();
+
+  std::shared_ptr<Job> job;
+  while ((job = NextJob(port))) {
+    LatencyHistogram latency;
+    std::string result = RunJob(port, *job, latency);
+
+    // The port is idle again by the time the client hears about it
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      port.busy = false;
+      port.boards_done++;
+      port.latency.Merge(latency);
+    }
+    Send(*job->client, result);
+  }
+
+  return;
+}
+
+std::shared_ptr<FlashDaemon::Job> FlashDaemon::NextJob(Port& port) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (stopping_) {
+      return nullptr;
+    }
+
+    // Oldest job this port can take, jobs for a busy port don't hold back the others
+    for (auto it = queue_.begin(); it != queue_.end(); it++) {
+      if ((*it)->port.empty() || (*it)->port == port.name) {
+        std::shared_ptr<Job> job = *it;
+        queue_.erase(it);
+        port.busy = true;
+        return job;
+      }
+    }
+
+    job_cv_.wait(lock);
+  }
+}
+
+std::string FlashDaemon::RunJob(Port& port, Job& job, LatencyHistogram& latency) {
+  ErrorHandlerCapture error;
+  JobBar bar(*this, job);
+  FlashLoader fl(port.ser, job.image.get(), &error, &bar);
+  fl.SetClock(port.clock);
+  fl.SetLatencyHistogram(&latency);
+  fl.SetTimeoutModel(&port.timeouts);
+  fl.SetCapabilityCache(&port.capability_cache);
+  fl.SetInlineVerify(inline_verify_);
+  fl.SetTracer(tracer_, port.trace_port);
+  fl.SetPhaseGate(link_scheduler_ ? link_scheduler_->GetGate(port.name) : nullptr);
+
+  std::stringstream result;
+  result << "DONE " << job.id << " " << port.name;
+  if (!port.ser->Open()) {
+    result << " FAIL open";
+    return result.str();
+  }
+
+  fl.Init();
+  if (fl.Flash(true, false)) {
+    result << " OK " << fl.GetTiming().total_us;
+  } else {
+    result << " FAIL " << error.GetLastError().error_location << ": " << error.GetLastError().error_string;
+    if (fl.GetTiming().reject_us) {
+      result << " REJECTED " << fl.GetTiming().reject_us;
+    }
+    // The fd may have gone stale with the adapter, the next job opens the port again
+    port.ser->Close();
+  }
+
+  return result.str();
+}
+
+void FlashDaemon::Send(Client& client, const std::string& line) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(client.mutex);
+    if (!client.open) {
+      return;
+    }
+    // A client this far behind isn't reading, it is dropped rather than holding the memory
+    if (client.output.size() + line.size() + 1 > MAX_OUTPUT_BYTES) {
+      client.open = false;
+      wake = true;
+    } else {
+      wake = client.output.empty();
+      client.output += line + "\n";
+    }
+  }
+
+  if (wake && write(wake_pipe_[1], "w", 1) < 0) {
+    // Full, the server thread has a wake up pending already
+  }
+
+  return;
+}
+
+bool FlashDaemon::FlushClient(Client& client) {
+  std::lock_guard<std::mutex> lock(client.mutex);
+  while (client.open && !client.output.empty()) {
+    ssize_t num_sent = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (num_sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno != EINTR) {
+        client.open = false;
+      }
+      continue;
+    }
+    client.output.erase(0, num_sent);
+  }
+
+  return client.open;
+}
+
+void FlashDaemon::CloseClient(Client& client) {
+  std::lock_guard<std::mutex> lock(client.mutex);
+  if (client.fd >= 0) {
+    close(client.fd);
+    client.fd = -1;
+  }
+  client.open = false;
+
+  return;
+}
+}  // namespace Schmi
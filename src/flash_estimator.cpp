@@ -0,0 +1,271 @@
+#include "Schmi/flash_estimator.hpp"
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/phase_gate_interface.hpp"
+#include "Schmi/sim_clock.hpp"
+
+#include <vector>
+
+namespace Schmi {
+
+namespace {
+const uint8_t BITS_PER_BYTE = 11;  // start + 8 data + even parity + stop
+
+uint64_t WireTimeUs(const uint64_t& num_bytes, const uint32_t& baud_rate) {
+  return num_bytes * BITS_PER_BYTE * 1000000 / baud_rate;
+}
+
+uint64_t LinkUs(const PhaseEstimate& phase, const CostModel& model) {
+  return WireTimeUs(phase.bytes_sent + phase.bytes_received, model.link.baud_rate) +
+         (uint64_t)phase.round_trips * model.link.round_trip_us;
+}
+
+// What's left of a measured phase once the link is paid for, never negative
+uint64_t Remainder(const uint64_t& measured_us, const uint64_t& link_us) {
+  return measured_us > link_us ? measured_us - link_us : 0;
+}
+
+struct Transfer {
+  uint64_t start_us;
+  uint32_t bytes_sent;
+  uint32_t bytes_received;
+  bool turnaround;  // first read after a write, the host waits for the answer
+};
+
+// Notes every transfer with the time it started, so it can be put in its phase once the
+// FlashTiming of the session is known
+class TransferLog : public SerialInterface {
+ public:
+  TransferLog(SerialInterface& ser, ClockInterface& clock) : ser_(ser), clock_(clock){};
+  ~TransferLog(){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    transfers_.push_back({clock_.NowUs() - start_us_, buffer_length, 0, false});
+    wrote_ = true;
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms = 500) override {
+    transfers_.push_back({clock_.NowUs() - start_us_, 0, num_bytes, wrote_});
+    wrote_ = false;
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+  bool SetBaudRate(const uint32_t& baud_rate) override { return ser_.SetBaudRate(baud_rate); };
+  void FlushInput() override { ser_.FlushInput(); };
+
+  // Forgets what was logged, times are from now on
+  void Restart() {
+    transfers_.clear();
+    start_us_ = clock_.NowUs();
+    wrote_ = false;
+
+    return;
+  };
+
+  const std::vector<Transfer>& GetTransfers() const { return transfers_; };
+
+ private:
+  SerialInterface& ser_;
+  ClockInterface& clock_;
+  std::vector<Transfer> transfers_;
+  uint64_t start_us_ = 0;
+  bool wrote_ = false;
+};
+
+// FlashTiming has no mark between discover and erase, the erase starts when its phase is entered
+class EraseStart : public PhaseGateInterface {
+ public:
+  EraseStart(ClockInterface& clock) : clock_(clock){};
+  ~EraseStart(){};
+
+  void Enter(const SessionPhase& phase) override {
+    if (phase == SessionPhase::kErase && !entered_) {
+      start_us_ = clock_.NowUs();
+      entered_ = true;
+    }
+  };
+  void Leave(const SessionPhase&) override{};
+
+  // The session starts at the same time as TransferLog::Restart
+  void Restart() {
+    session_start_us_ = clock_.NowUs();
+    entered_ = false;
+
+    return;
+  };
+
+  // erase_done_us when the session didn't erase at all
+  uint64_t GetStartUs(const uint64_t& erase_done_us) const {
+    return entered_ ? start_us_ - session_start_us_ : erase_done_us;
+  };
+
+ private:
+  ClockInterface& clock_;
+  uint64_t session_start_us_ = 0;
+  uint64_t start_us_ = 0;
+  bool entered_ = false;
+};
+}  // namespace
+
+CostModel MakeCostModel(const ChipTiming& chip, const LinkTiming& link) {
+  CostModel model = {link, (uint32_t)chip.page_erase_ms * 1000, (uint32_t)chip.mass_erase_ms * 1000, 10000, 10};
+
+  return model;
+}
+
+EmulatorConfig FlashEstimator::MakeEmulatorConfig(const uint64_t& image_size, const DryRunOptions& options) const {
+  EmulatorConfig config;
+  config.product_id = chip_.product_id;
+  config.flash_start = options.start_address;
+  config.page_size = chip_.page_size;
+  config.num_banks = chip_.num_banks;
+  config.flash_size = chip_.flash_size;
+  if (!config.flash_size) {
+    // Unknown part, just big enough for the image
+    uint64_t end = (uint64_t)options.starting_flash - options.start_address + image_size;
+    config.flash_size = (end / chip_.page_size + 1) * chip_.page_size;
+  }
+
+  config.baud_rate = model_.link.baud_rate;
+  config.ack_latency_us = model_.link.round_trip_us;
+  config.page_erase_us = model_.page_erase_us;
+  config.bank_erase_us = model_.special_erase_us;
+  config.mass_erase_us = model_.special_erase_us;
+  config.program_us_per_byte = model_.program_ns_per_byte / 1000;
+  config.checksum_command = options.verify == VerifyStrategy::kChecksum;
+  config.checksum_us_per_kb = model_.checksum_us_per_kb;
+
+  return config;
+}
+
+FlashEstimate FlashEstimator::Estimate(const uint64_t& image_size, const DryRunOptions& options) const {
+  FlashEstimate estimate = {};
+
+  SimClock clock;
+  Stm32Emulator emulator(clock, MakeEmulatorConfig(image_size, options));
+  TransferLog log(emulator, clock);
+  EraseStart erase_start(clock);
+  BinaryFileMemory bin(std::vector<uint8_t>(image_size, 0x00));
+  ErrorHandlerCapture error;
+  LoadingBarNull bar;
+
+  FlashLoader fl(&log, &bin, &error, &bar);
+  fl.SetClock(&clock);
+  fl.SetChipTiming(chip_);
+  fl.SetStartAddress(options.start_address);
+  fl.SetAllowEraseOutsideImage(options.allow_erase_outside_image);
+  fl.SetPhaseGate(&erase_start);
+
+  // The first board of its kind fills the capability cache of the loader, the next one is timed
+  if (options.capabilities_cached) {
+    fl.Init();
+    fl.Flash(true, options.global_erase, options.starting_flash);
+    emulator.Reset();
+  }
+
+  log.Restart();
+  erase_start.Restart();
+  fl.Init();
+  if (!options.init_usart) {
+    // Already connected, like a board handed over by another tool
+    fl.InitUsart();
+  }
+  EmulatorStats before = emulator.GetStats();
+  estimate.completed = fl.Flash(options.init_usart, options.global_erase, options.starting_flash);
+  if (!estimate.completed) {
+    estimate.error = error.GetLastError();
+    return estimate;
+  }
+
+  // Every transfer goes to the phase it started in
+  const FlashTiming& timing = fl.GetTiming();
+  PhaseEstimate* phases[] = {&estimate.connect, &estimate.discover, &estimate.erase,
+                             &estimate.write,   &estimate.verify,   &estimate.go};
+  uint64_t phase_ends_us[] = {timing.sync_done_us,  erase_start.GetStartUs(timing.erase_done_us),
+                              timing.erase_done_us, timing.write_done_us,
+                              timing.verify_done_us, UINT64_MAX};
+  for (const Transfer& transfer : log.GetTransfers()) {
+    uint8_t ii = 0;
+    while (transfer.start_us >= phase_ends_us[ii]) {
+      ii++;
+    }
+    phases[ii]->bytes_sent += transfer.bytes_sent;
+    phases[ii]->bytes_received += transfer.bytes_received;
+    phases[ii]->round_trips += transfer.turnaround;
+  }
+
+  const EmulatorStats& after = emulator.GetStats();
+  estimate.erase_plan = fl.GetErasePlan();
+  for (uint8_t ii = 0; ii < estimate.erase_plan.num_steps; ii++) {
+    if (estimate.erase_plan.steps[ii].type == EraseType::kPages) {
+      estimate.pages_erased += estimate.erase_plan.steps[ii].num_pages;
+    }
+  }
+  estimate.special_erases = after.special_erases - before.special_erases;
+  estimate.bytes_programmed = after.bytes_programmed - before.bytes_programmed;
+  estimate.bytes_checksummed = after.bytes_checksummed - before.bytes_checksummed;
+
+  Price(estimate);
+
+  return estimate;
+}
+
+void FlashEstimator::Price(FlashEstimate& estimate) const {
+  PricePhase(estimate.connect, 0);
+  PricePhase(estimate.discover, 0);
+  PricePhase(estimate.erase, (uint64_t)estimate.pages_erased * model_.page_erase_us +
+                                 (uint64_t)estimate.special_erases * model_.special_erase_us);
+  PricePhase(estimate.write, estimate.bytes_programmed * model_.program_ns_per_byte / 1000);
+  PricePhase(estimate.verify, estimate.bytes_checksummed * model_.checksum_us_per_kb / 1024);
+  PricePhase(estimate.go, 0);
+
+  estimate.total_us = estimate.connect.estimated_us + estimate.discover.estimated_us +
+                      estimate.erase.estimated_us + estimate.write.estimated_us +
+                      estimate.verify.estimated_us + estimate.go.estimated_us;
+
+  return;
+}
+
+void FlashEstimator::PricePhase(PhaseEstimate& phase, const uint64_t& chip_us) const {
+  phase.chip_us = chip_us;
+  phase.estimated_us = LinkUs(phase, model_) + chip_us;
+
+  return;
+}
+
+CostModel CalibrateCostModel(const CostModel& model, const FlashEstimate& estimate, const FlashTiming& measured) {
+  CostModel fitted = model;
+
+  // The read back verify is nothing but link, it gives the round trip. A checksum verify is
+  // mostly link too, the chip time is taken from the model.
+  const PhaseEstimate& verify = estimate.verify;
+  if (verify.round_trips) {
+    uint64_t verify_us = measured.verify_done_us - measured.write_done_us;
+    uint64_t chip_us = estimate.bytes_checksummed * model.checksum_us_per_kb / 1024;
+    uint64_t wire_us = WireTimeUs(verify.bytes_sent + verify.bytes_received, model.link.baud_rate);
+    fitted.link.round_trip_us = Remainder(verify_us, wire_us + chip_us) / verify.round_trips;
+  }
+
+  if (estimate.bytes_programmed) {
+    uint64_t write_us = measured.write_done_us - measured.erase_done_us;
+    fitted.program_ns_per_byte = Remainder(write_us, LinkUs(estimate.write, fitted)) * 1000 / estimate.bytes_programmed;
+  }
+
+  // FlashTiming counts the capability discovery as part of the erase
+  uint64_t erase_us = measured.erase_done_us - measured.sync_done_us;
+  uint64_t erase_chip_us = Remainder(erase_us, LinkUs(estimate.discover, fitted) + LinkUs(estimate.erase, fitted));
+  if (estimate.pages_erased && !estimate.special_erases) {
+    fitted.page_erase_us = erase_chip_us / estimate.pages_erased;
+  } else if (estimate.special_erases && !estimate.pages_erased) {
+    fitted.special_erase_us = erase_chip_us / estimate.special_erases;
+  } else if (estimate.erase.chip_us) {
+    // Both kinds in one session, keep their ratio
+    fitted.page_erase_us = (uint64_t)model.page_erase_us * erase_chip_us / estimate.erase.chip_us;
+    fitted.special_erase_us = (uint64_t)model.special_erase_us * erase_chip_us / estimate.erase.chip_us;
+  }
+
+  return fitted;
+}
+}  // namespace Schmi
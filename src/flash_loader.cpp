@@ -1,90 +1,409 @@
 #include "iq_flasher/include/Schmi/flash_loader.hpp"
 #include <QDebug>
 
+#include <string.h>
+
 namespace Schmi {
 
 void FlashLoader::Init() {
-  ser_->Init();
+  TraceSpan span(tracer_, trace_port_, "init", "session");
+  StartSession();
+
+  // The binary first, loaders that work in the background can then read the file while the port
+  // opens and the chip is erased. Only its size is needed before the first write.
   bin_->Init();
   total_num_bytes_ = bin_->GetBinaryFileSize();
+  if (stub_image_) {
+    stub_image_->Init();
+  }
+  ser_->Init();
+  timing_.init_done_us = SessionUs();
+
+  return;
+}
+
+bool FlashLoader::InitUsart() { return stm32_->Connect(connect_result_); }
+
+void FlashLoader::SetClock(ClockInterface* clock) {
+  clock_ = clock;
+  stm32_->SetClock(clock);
+
+  return;
+}
+
+void FlashLoader::SetTracer(Tracer* tracer, const uint32_t& port) {
+  tracer_ = tracer;
+  trace_port_ = port;
+  stm32_->SetTracer(tracer, port);
+
+  return;
+}
+
+void FlashLoader::SetRepairBudget(const uint16_t& max_pages, const uint8_t& max_passes) {
+  repair_max_pages_ = max_pages < MAX_REPAIR_PAGES ? max_pages : MAX_REPAIR_PAGES;
+  repair_max_passes_ = max_passes;
+
+  return;
+}
+
+void FlashLoader::SetChipTiming(const ChipTiming& chip_timing) {
+  chip_timing_ = chip_timing;
+  chip_timing_set_ = true;
+
+  return;
+}
+
+void FlashLoader::SetStub(BinaryFileInterface* stub_image, const uint32_t& baud_rate,
+                          const uint32_t& load_address) {
+  if (stub_ == nullptr) {
+    stub_ = new StubClient(*ser_, *err_);
+  }
+  stub_image_ = stub_image;
+  stub_baud_rate_ = baud_rate;
+  stub_load_address_ = load_address;
 
   return;
 }
 
-bool FlashLoader::InitUsart() { return stm32_->InitUsart(); }
+void FlashLoader::StartSession() {
+  timing_ = {};
+  session_start_us_ = clock_ ? clock_->NowUs() : 0;
+  session_started_ = true;
 
-uint16_t FlashLoader::CalculatePageOffset(uint16_t memoryLocation){
-    return ceil((memoryLocation - START_ADDRESS_) / PAGE_SIZE_);
+  return;
+}
+
+uint64_t FlashLoader::SessionUs() { return clock_ ? clock_->NowUs() - session_start_us_ : 0; }
+
+uint32_t FlashLoader::CalculatePageOffset(uint32_t memoryLocation) {
+  return (memoryLocation - start_address_) / chip_timing_.page_size;
 }
 
 bool FlashLoader::Flash(bool init_usart, bool global_erase, uint32_t starting_flash) {
+  TraceSpan span(tracer_, trace_port_, "flash", "session");
+  if (!session_started_) {
+    StartSession();
+  }
+  session_started_ = false;
+
   if (init_usart) {
-    if (!stm32_->InitUsart()) {
+    if (!stm32_->Connect(connect_result_)) {
+      return 0;
+    }
+  }
+  timing_.sync_done_us = SessionUs();
+
+  if (!DiscoverCapabilities()) {
+    return 0;
+  }
+
+  if (!CheckFlashRange(starting_flash)) {
+    return 0;
+  }
+
+  diff_result_ = {};
+  if (device_state_) {
+    if (!ReadUniqueId()) {
       return 0;
     }
+
+    bool can_diff = unique_id_known_ && !global_erase && !stub_image_ && bin_->IsRereadable();
+    if (can_diff && device_state_->Find(unique_id_, device_record_)) {
+      if (!CheckDeviceRecord(diff_result_.used_record)) {
+        return 0;
+      }
+    }
+
+    // From here the flash changes, a session that stops halfway leaves no record behind
+    if (unique_id_known_) {
+      device_state_->Forget(unique_id_);
+    }
+  }
+  if (diff_result_.used_record) {
+    return FlashChangedPages(starting_flash);
   }
 
+  ErasePlanner planner(chip_timing_);
   if (global_erase) {
-    if (!stm32_->SpecialExtendedErase(0xFFFF)) {
+    EraseStep mass_erase = planner.PlanMassErase();
+    erase_plan_ = {};
+    erase_plan_.steps[0] = mass_erase;
+    erase_plan_.num_steps = 1;
+    erase_plan_.estimated_us = mass_erase.estimated_us;
+    PhaseScope phase(phase_gate_, SessionPhase::kErase);
+    if (!stm32_->SpecialExtendedErase(mass_erase.special_code, mass_erase.timeout_ms)) {
+      return 0;
+    }
+  } else {
+    uint32_t page_offset = CalculatePageOffset(starting_flash);
+    uint32_t num_of_pages = GetNumPagesFromBinary(starting_flash);
+
+    erase_plan_ = planner.Plan(page_offset, num_of_pages, allow_erase_outside_image_);
+    if (!Erase(erase_plan_)) {
       return 0;
     }
+  }
+  timing_.erase_done_us = SessionUs();
+
+  if (stub_image_) {
+    // Always back to the bootloader speed, whatever happened to the session
+    bool flashed = FlashWithStub(starting_flash);
+    if (stub_baud_rate_) {
+      ser_->SetBaudRate(BOOTLOADER_BAUD_RATE);
+    }
+    if (flashed && device_state_ && unique_id_known_) {
+      RecordDeviceState(starting_flash);
+    }
+    return flashed;
+  }
+
+  if (inline_verify_) {
+    if (!FlashAndVerifyPages(starting_flash)) {
+      return 0;
+    }
+    // Write and verify are interleaved, they both end here
+    timing_.write_done_us = SessionUs();
+    timing_.verify_done_us = timing_.write_done_us;
   } else {
-    uint16_t page_offset = CalculatePageOffset(starting_flash);
-    uint16_t num_of_pages = GetPagesCodesFromBinary(page_offset);
+    if (!FlashBytes(starting_flash)) {
+      return 0;
+    }
+    timing_.write_done_us = SessionUs();
+
+    if (!CheckMemory(starting_flash)) {
+      return 0;
+    }
+    timing_.verify_done_us = SessionUs();
+  }
+
+  if (device_state_ && unique_id_known_) {
+    RecordDeviceState(starting_flash);
+  }
+
+  if (!stm32_->GoToAddress(start_address_)) {
+    return 0;
+  }
+  timing_.total_us = SessionUs();
+
+  return 1;
+}
+
+bool FlashLoader::FlashWithStub(uint32_t curAddress) {
+  if (!stub_->Upload(*stm32_, *stub_image_, stub_load_address_)) {
+    return 0;
+  }
 
-    //Let the page codes handle the offset in the erase
-    if (!stm32_->ExtendedErase(pages_codes_buffer, num_of_pages)) {
+  StubInfo info;
+  if (!stub_->Ping(info)) {
+    return 0;
+  }
+
+  if (stub_baud_rate_) {
+    if (!stub_->SetBaudRate(stub_baud_rate_)) {
       return 0;
     }
   }
 
-  if (!FlashBytes(starting_flash)) {
+  if (!StubFlashBytes(curAddress)) {
     return 0;
   }
+  timing_.write_done_us = SessionUs();
 
-  if (!CheckMemory(starting_flash)) {
+  if (!StubCheckMemory(curAddress)) {
     return 0;
   }
+  timing_.verify_done_us = SessionUs();
 
-  if (!stm32_->GoToAddress(START_ADDRESS_)) {
+  if (!stub_->Run(start_address_)) {
     return 0;
   }
+  timing_.total_us = SessionUs();
 
   return 1;
 }
 
-uint16_t FlashLoader::GetPagesCodesFromBinary(uint16_t page_offset) {
-  float binary_file_size = bin_->GetBinaryFileSize();
-  uint16_t num_of_pages = ceil(binary_file_size / PAGE_SIZE_);
+bool FlashLoader::StubFlashBytes(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "write", "session");
+  BinaryBytesData flash_data = {0, curAddress, total_num_bytes_};
+  const uint16_t block_size = stub_->GetMaxBlockSize();
+
+  bar_->StartLoadingBar(total_num_bytes_);
+  image_crc_.Reset();
+
+  while (flash_data.bytes_left) {
+    uint16_t num_bytes = flash_data.bytes_left < block_size ? flash_data.bytes_left : block_size;
+    bin_->GetBytesArray(stub_block_, {num_bytes, flash_data.current_byte_pos});
+    image_crc_.Update(stub_block_, num_bytes);
+
+    if (flash_data.current_byte_pos == 0) {
+      timing_.first_write_us = SessionUs();
+    }
+
+    PhaseScope phase(phase_gate_, SessionPhase::kTransfer);
+    if (!stub_->QueueWrite(stub_block_, num_bytes, flash_data.current_memory_address)) {
+      return 0;
+    }
+
+    UpdateBinaryBytesData(flash_data, num_bytes);
+
+    bar_->UpdateLoadingBar(flash_data.bytes_left);
+  }
+
+  if (!stub_->Flush()) {
+    return 0;
+  }
+
+  bar_->EndLoadingBar();
+
+  return 1;
+}
 
-  if (num_of_pages > MAX_NUM_PAGES_TO_ERASE) {
-    Schmi::Error err_message = {"GetPagesCodesFromBinary", ("num pages > 512"), num_of_pages};
-    err_->Init(err_message);
+bool FlashLoader::StubCheckMemory(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "verify", "session");
+  // The stub reads the flash itself, only the CRC comes back over the link
+  uint32_t timeout_ms = StubClient::RESPONSE_TIMEOUT_MS + total_num_bytes_ / 16384;
+  uint32_t memory_crc;
+  if (!stub_->Crc(curAddress, total_num_bytes_, memory_crc, timeout_ms > 0xFFFF ? 0xFFFF : timeout_ms)) {
+    return 0;
+  }
+
+  if (memory_crc != image_crc_.Get()) {
+    RejectBoard({"StubCheckMemory", "Flash CRC does not match image", (int)memory_crc});
+    return 0;
+  }
+
+  return 1;
+}
+
+bool FlashLoader::DiscoverCapabilities() {
+  TraceSpan span(tracer_, trace_port_, "discover", "session");
+  uint16_t product_id;
+  if (!stm32_->GetID(product_id)) {
+    return 0;
+  }
+
+  VersionAndReadProtectionData vrpd;
+  if (!stm32_->GetVersionAndReadProtection(vrpd)) {
+    return 0;
+  }
+
+  const BootloaderCapabilities* cached = capability_cache_->Find(product_id, vrpd.version);
+  if (cached) {
+    capabilities_ = *cached;
+  } else {
+    BootloaderCommands commands;
+    if (!stm32_->Get(commands)) {
+      return 0;
+    }
+    capabilities_ = MakeBootloaderCapabilities(product_id, commands);
+    capability_cache_->Store(capabilities_);
+  }
+
+  // Every erase, special codes included, goes through EXTEND_ERASE
+  if (!capabilities_.Supports(CMD::EXTEND_ERASE)) {
+    Schmi::Error err = {"DiscoverCapabilities", "Bootloader has no EXTEND_ERASE", capabilities_.bootloader_version};
+    err_->Init(err);
+    err_->DisplayAndDie();
+    return 0;
+  }
+
+  // Looked up for every board, the next one on the port may be another chip
+  if (!chip_timing_set_) {
+    chip_timing_ = FindChipTiming(product_id);
+    chip_timing_.product_id = product_id;
+  }
+
+  return 1;
+}
+
+bool FlashLoader::CheckFlashRange(const uint32_t& starting_flash) {
+  uint64_t end_address = (uint64_t)starting_flash + total_num_bytes_;
+  uint64_t last_page = end_address > starting_flash
+                           ? (end_address - 1 - start_address_) / chip_timing_.page_size
+                           : 0;
+
+  // Page codes of EXTEND_ERASE are 16 bits wide
+  if (starting_flash < start_address_ || end_address > 0x100000000 || last_page > 0xFFFF) {
+    Schmi::Error err = {"CheckFlashRange", "Image outside of the flash address space",
+                        (int)(starting_flash - start_address_)};
+    err_->Init(err);
     err_->DisplayAndDie();
     return 0;
   }
 
-  for (int ii = 0; ii < num_of_pages; ++ii) {
-    pages_codes_buffer[ii] = ii + page_offset;
+  return 1;
+}
+
+bool FlashLoader::Erase(const ErasePlan& plan) {
+  TraceSpan span(tracer_, trace_port_, "erase", "session");
+  PhaseScope phase(phase_gate_, SessionPhase::kErase);
+  for (uint8_t ii = 0; ii < plan.num_steps; ii++) {
+    const EraseStep& step = plan.steps[ii];
+
+    if (step.type != EraseType::kPages) {
+      if (!stm32_->SpecialExtendedErase(step.special_code, step.timeout_ms)) {
+        return 0;
+      }
+      continue;
+    }
+
+    // The page list is generated one message at a time, so it never needs more than
+    // MAX_PAGES_PER_MESSAGE codes whatever the size of the flash. One ExtendedErase per message
+    // so each gets the timeout sized for its batch.
+    uint32_t page = step.first_page;
+    uint32_t num_pages_left = step.num_pages;
+    while (num_pages_left) {
+      uint16_t num_pages = num_pages_left < step.pages_per_message ? num_pages_left : step.pages_per_message;
+      for (uint16_t jj = 0; jj < num_pages; jj++) {
+        pages_codes_buffer_[jj] = page + jj;
+      }
+      if (!stm32_->ExtendedErase(pages_codes_buffer_, num_pages, step.timeout_ms)) {
+        return 0;
+      }
+      page += num_pages;
+      num_pages_left -= num_pages;
+    }
+  }
+
+  return 1;
+}
+
+uint32_t FlashLoader::GetNumPagesFromBinary(const uint32_t& starting_flash) {
+  if (total_num_bytes_ == 0) {
+    return 0;
   }
 
-  return num_of_pages;
+  // The image doesn't have to start on a page boundary
+  uint32_t first_page = CalculatePageOffset(starting_flash);
+  uint64_t last_byte = (uint64_t)starting_flash - start_address_ + total_num_bytes_ - 1;
+  uint32_t last_page = last_byte / chip_timing_.page_size;
+
+  return last_page - first_page + 1;
 }
 
 bool FlashLoader::FlashBytes(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "write", "session");
   BinaryBytesData flash_data = {0, curAddress, total_num_bytes_};
 
   bar_->StartLoadingBar(total_num_bytes_);
+  image_crc_.Reset();
+  image_checksum_.Reset();
 
   while (flash_data.bytes_left) {
     uint32_t num_bytes = CheckNumBytesToWrite(flash_data.bytes_left);
 
-    uint8_t binary_buffer[MAX_WRITE_SIZE];
-    bin_->GetBytesArray(binary_buffer, {num_bytes, flash_data.current_byte_pos});
+    if (flash_data.current_byte_pos == 0) {
+      timing_.first_write_us = SessionUs();
+    }
 
-    if (!stm32_->WriteMemory(binary_buffer, num_bytes, flash_data.current_memory_address)) {
+    uint8_t binary_buffer[MAX_WRITE_SIZE];
+    const uint8_t* written =
+        WriteChunk(flash_data.current_byte_pos, num_bytes, flash_data.current_memory_address, binary_buffer);
+    if (!written) {
       return 0;
     }
+    image_crc_.Update(written, num_bytes);
+    image_checksum_.Update(written, num_bytes);
 
     UpdateBinaryBytesData(flash_data, num_bytes);
 
@@ -96,7 +415,152 @@ bool FlashLoader::FlashBytes(uint32_t curAddress) {
   return 1;
 }
 
+const uint8_t* FlashLoader::WriteChunk(const uint64_t& byte_pos, const uint16_t& num_bytes, const uint32_t& address,
+                                       uint8_t* buffer) {
+  PhaseScope phase(phase_gate_, SessionPhase::kTransfer);
+  // A prepared image has the frame built already, its bytes follow the length byte
+  uint16_t frame_length;
+  const uint8_t* frame = bin_->GetWriteFrame({num_bytes, byte_pos}, frame_length);
+  if (frame) {
+    return stm32_->WriteMemoryFrame(frame, frame_length, address) ? frame + 1 : nullptr;
+  }
+
+  bin_->GetBytesArray(buffer, {num_bytes, byte_pos});
+
+  return stm32_->WriteMemory(buffer, num_bytes, address) ? buffer : nullptr;
+}
+
+bool FlashLoader::ReadChunk(uint8_t* buffer, const uint16_t& num_bytes, const uint32_t& address) {
+  PhaseScope phase(phase_gate_, SessionPhase::kTransfer);
+
+  return stm32_->ReadMemory(buffer, num_bytes, address);
+}
+
+bool FlashLoader::FlashAndVerifyPages(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "write and verify", "session");
+  uint32_t first_page = CalculatePageOffset(curAddress);
+  uint32_t num_pages = GetNumPagesFromBinary(curAddress);
+  BinaryBytesData flash_data = {0, curAddress, total_num_bytes_};
+  bool use_checksum = capabilities_.Supports(CMD::GET_CHECKSUM) && curAddress % 4 == 0;
+  bool can_repair = repair_max_pages_ && bin_->IsRereadable();
+
+  repair_result_ = {};
+  bar_->StartLoadingBar(total_num_bytes_);
+  image_crc_.Reset();
+  image_checksum_.Reset();
+  timing_.first_write_us = SessionUs();
+
+  for (uint32_t page = first_page; page < first_page + num_pages; page++) {
+    uint32_t address, num_bytes;
+    GetPageSpan(curAddress, page, address, num_bytes);
+
+    Crc32 page_crc;
+    Crc32Stm32 page_checksum;
+    for (uint32_t pos = 0; pos < num_bytes; pos += MAX_WRITE_SIZE) {
+      uint16_t chunk = num_bytes - pos < MAX_WRITE_SIZE ? num_bytes - pos : MAX_WRITE_SIZE;
+
+      uint8_t binary_buffer[MAX_WRITE_SIZE];
+      const uint8_t* written =
+          WriteChunk(flash_data.current_byte_pos, chunk, flash_data.current_memory_address, binary_buffer);
+      if (!written) {
+        return 0;
+      }
+      image_crc_.Update(written, chunk);
+      image_checksum_.Update(written, chunk);
+      page_crc.Update(written, chunk);
+      page_checksum.Update(written, chunk);
+
+      UpdateBinaryBytesData(flash_data, chunk);
+    }
+
+    uint32_t expected = use_checksum ? page_checksum.Get() : page_crc.Get();
+    bool matches;
+    if (!SpanMatches(address, num_bytes, use_checksum, expected, matches)) {
+      return 0;
+    }
+
+    if (!matches) {
+      repair_result_.pages_found++;
+      if (!can_repair || repair_result_.pages_found > repair_max_pages_) {
+        RejectBoard({"FlashAndVerifyPages", "Page does not match", (int)page});
+        return 0;
+      }
+
+      // The repair of CheckAndRepairMemory, with this page as the list
+      bad_pages_[0] = page;
+      num_bad_pages_ = 1;
+      uint8_t passes = 0;
+      while (!matches && passes < repair_max_passes_) {
+        passes++;
+        if (!RewritePages(curAddress) || !PageMatches(curAddress, page, matches)) {
+          return 0;
+        }
+      }
+      num_bad_pages_ = 0;
+      repair_result_.passes = passes > repair_result_.passes ? passes : repair_result_.passes;
+
+      if (!matches) {
+        RejectBoard({"FlashAndVerifyPages", "Page still does not match after repair", (int)page});
+        return 0;
+      }
+      repair_result_.pages_repaired++;
+    }
+
+    bar_->UpdateLoadingBar(flash_data.bytes_left);
+  }
+
+  bar_->EndLoadingBar();
+
+  return 1;
+}
+
+bool FlashLoader::SpanMatches(const uint32_t& address, const uint32_t& num_bytes, const bool& use_checksum,
+                              const uint32_t& expected, bool& matches) {
+  if (use_checksum) {
+    uint32_t memory_checksum;
+    if (!GetMemoryChecksum(address, (num_bytes + 3) & ~(uint32_t)3, memory_checksum)) {
+      return 0;
+    }
+    matches = memory_checksum == expected;
+    return 1;
+  }
+
+  Crc32 memory_crc;
+  for (uint32_t pos = 0; pos < num_bytes; pos += MAX_WRITE_SIZE) {
+    uint16_t chunk = num_bytes - pos < MAX_WRITE_SIZE ? num_bytes - pos : MAX_WRITE_SIZE;
+
+    uint8_t memory_buffer[MAX_WRITE_SIZE];
+    if (!ReadChunk(memory_buffer, chunk, address + pos)) {
+      return 0;
+    }
+    memory_crc.Update(memory_buffer, chunk);
+  }
+  matches = memory_crc.Get() == expected;
+
+  return 1;
+}
+
+void FlashLoader::RejectBoard(const Error& err) {
+  timing_.reject_us = SessionUs();
+  err_->Init(err);
+  err_->DisplayAndDie();
+
+  return;
+}
+
 bool FlashLoader::CheckMemory(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "verify", "session");
+  repair_result_ = {};
+  if (repair_max_pages_ && bin_->IsRereadable()) {
+    return CheckAndRepairMemory(curAddress);
+  }
+  if (capabilities_.Supports(CMD::GET_CHECKSUM) && curAddress % 4 == 0) {
+    return CheckMemoryChecksum(curAddress);
+  }
+  if (!bin_->IsRereadable()) {
+    return CheckMemoryCrc(curAddress);
+  }
+
   BinaryBytesData memory_data = {0, curAddress, total_num_bytes_};
 
   bar_->StartCheckingLoadingBar(total_num_bytes_);
@@ -108,7 +572,7 @@ bool FlashLoader::CheckMemory(uint32_t curAddress) {
     bin_->GetBytesArray(binary_buffer, {num_bytes, memory_data.current_byte_pos});
 
     uint8_t memory_buffer[MAX_WRITE_SIZE];
-    if (!stm32_->ReadMemory(memory_buffer, num_bytes, memory_data.current_memory_address)) {
+    if (!ReadChunk(memory_buffer, num_bytes, memory_data.current_memory_address)) {
       return 0;
     }
     if (!CompareBinaryAndMemory(memory_buffer, binary_buffer, num_bytes)) {
@@ -125,6 +589,435 @@ bool FlashLoader::CheckMemory(uint32_t curAddress) {
   return 1;
 }
 
+bool FlashLoader::CheckMemoryCrc(uint32_t curAddress) {
+  BinaryBytesData memory_data = {0, curAddress, total_num_bytes_};
+  Crc32 memory_crc;
+
+  bar_->StartCheckingLoadingBar(total_num_bytes_);
+
+  while (memory_data.bytes_left) {
+    uint16_t num_bytes = CheckNumBytesToWrite(memory_data.bytes_left);
+
+    uint8_t memory_buffer[MAX_WRITE_SIZE];
+    if (!ReadChunk(memory_buffer, num_bytes, memory_data.current_memory_address)) {
+      return 0;
+    }
+    memory_crc.Update(memory_buffer, num_bytes);
+
+    UpdateBinaryBytesData(memory_data, num_bytes);
+
+    bar_->UpdateLoadingBar(memory_data.bytes_left);
+  }
+
+  bar_->EndLoadingBar();
+
+  if (memory_crc.Get() != image_crc_.Get()) {
+    RejectBoard({"CheckMemoryCrc", "Flash CRC does not match image", (int)memory_crc.Get()});
+    return 0;
+  }
+
+  return 1;
+}
+
+bool FlashLoader::CheckMemoryChecksum(uint32_t curAddress) {
+  // WRITE_MEMORY padded the last write to a multiple of 4 with 0xFF, so does the image checksum
+  uint64_t num_bytes = (total_num_bytes_ + 3) & ~(uint64_t)3;
+  uint32_t memory_checksum;
+
+  bar_->StartCheckingLoadingBar(total_num_bytes_);
+  if (!GetMemoryChecksum(curAddress, num_bytes, memory_checksum)) {
+    return 0;
+  }
+  bar_->UpdateLoadingBar(0);
+  bar_->EndLoadingBar();
+
+  if (memory_checksum != image_checksum_.Get()) {
+    RejectBoard({"CheckMemoryChecksum", "Flash checksum does not match image", (int)memory_checksum});
+    return 0;
+  }
+
+  return 1;
+}
+
+bool FlashLoader::GetMemoryChecksum(const uint32_t& address, const uint64_t& num_bytes, uint32_t& checksum) {
+  uint32_t timeout_ms = 500 + num_bytes / 16384;
+
+  return stm32_->GetChecksum(address, num_bytes, checksum, timeout_ms > 0xFFFF ? 0xFFFF : timeout_ms);
+}
+
+bool FlashLoader::CheckAndRepairMemory(uint32_t curAddress) {
+  // With GET_CHECKSUM a good board costs a single checksum, pages are only looked at one by one
+  // when it doesn't match
+  if (capabilities_.Supports(CMD::GET_CHECKSUM) && curAddress % 4 == 0) {
+    uint32_t memory_checksum;
+    if (!GetMemoryChecksum(curAddress, (total_num_bytes_ + 3) & ~(uint64_t)3, memory_checksum)) {
+      return 0;
+    }
+    if (memory_checksum == image_checksum_.Get()) {
+      return 1;
+    }
+  }
+
+  bar_->StartCheckingLoadingBar(total_num_bytes_);
+  if (!FindBadPages(curAddress, true)) {
+    return 0;
+  }
+  bar_->EndLoadingBar();
+  repair_result_.pages_found = num_bad_pages_;
+
+  uint16_t num_pages_to_repair = num_bad_pages_;
+  while (num_bad_pages_ && repair_result_.passes < repair_max_passes_) {
+    repair_result_.passes++;
+    if (!RewritePages(curAddress)) {
+      return 0;
+    }
+    if (!FindBadPages(curAddress, false)) {
+      return 0;
+    }
+  }
+  repair_result_.pages_repaired = num_pages_to_repair - num_bad_pages_;
+
+  if (num_bad_pages_) {
+    RejectBoard({"CheckAndRepairMemory", "Pages still do not match after repair", (int)bad_pages_[0]});
+    return 0;
+  }
+
+  return 1;
+}
+
+bool FlashLoader::FindBadPages(uint32_t curAddress, const bool& all_pages) {
+  uint32_t first_page = CalculatePageOffset(curAddress);
+  uint32_t num_pages = all_pages ? GetNumPagesFromBinary(curAddress) : num_bad_pages_;
+  uint64_t bytes_left = total_num_bytes_;
+  uint16_t num_bad_pages = 0;
+
+  // Rechecking the list compacts it in place, a page is never written ahead of the one being read
+  for (uint32_t ii = 0; ii < num_pages; ii++) {
+    uint32_t page = all_pages ? first_page + ii : bad_pages_[ii];
+
+    bool matches;
+    if (!PageMatches(curAddress, page, matches)) {
+      return 0;
+    }
+
+    if (!matches) {
+      if (num_bad_pages >= repair_max_pages_) {
+        RejectBoard({"FindBadPages", "More bad pages than the repair budget", (int)page});
+        return 0;
+      }
+      bad_pages_[num_bad_pages++] = page;
+    }
+
+    if (all_pages) {
+      uint32_t address, num_bytes;
+      GetPageSpan(curAddress, page, address, num_bytes);
+      bytes_left -= num_bytes;
+      bar_->UpdateLoadingBar(bytes_left);
+    }
+  }
+  num_bad_pages_ = num_bad_pages;
+
+  return 1;
+}
+
+bool FlashLoader::PageMatches(uint32_t curAddress, const uint32_t& page, bool& matches) {
+  uint32_t address, num_bytes;
+  GetPageSpan(curAddress, page, address, num_bytes);
+  uint64_t byte_pos = address - curAddress;
+
+  uint8_t binary_buffer[MAX_WRITE_SIZE];
+  if (capabilities_.Supports(CMD::GET_CHECKSUM) && address % 4 == 0) {
+    Crc32Stm32 expected;
+    for (uint32_t pos = 0; pos < num_bytes; pos += MAX_WRITE_SIZE) {
+      uint16_t chunk = num_bytes - pos < MAX_WRITE_SIZE ? num_bytes - pos : MAX_WRITE_SIZE;
+      bin_->GetBytesArray(binary_buffer, {chunk, byte_pos + pos});
+      expected.Update(binary_buffer, chunk);
+    }
+
+    uint32_t memory_checksum;
+    if (!GetMemoryChecksum(address, (num_bytes + 3) & ~(uint32_t)3, memory_checksum)) {
+      return 0;
+    }
+    matches = memory_checksum == expected.Get();
+    return 1;
+  }
+
+  matches = true;
+  for (uint32_t pos = 0; pos < num_bytes && matches; pos += MAX_WRITE_SIZE) {
+    uint16_t chunk = num_bytes - pos < MAX_WRITE_SIZE ? num_bytes - pos : MAX_WRITE_SIZE;
+    bin_->GetBytesArray(binary_buffer, {chunk, byte_pos + pos});
+
+    uint8_t memory_buffer[MAX_WRITE_SIZE];
+    if (!ReadChunk(memory_buffer, chunk, address + pos)) {
+      return 0;
+    }
+    matches = memcmp(memory_buffer, binary_buffer, chunk) == 0;
+  }
+
+  return 1;
+}
+
+bool FlashLoader::RewritePages(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "repair", "session");
+  ErasePlanner planner(chip_timing_);
+
+  // Page by page: a few bad pages cost a round trip each, and a page is never left erased
+  // longer than it takes to write it back
+  for (uint16_t ii = 0; ii < num_bad_pages_; ii++) {
+    uint32_t page = bad_pages_[ii];
+    EraseStep step = planner.Plan(page, 1, false).steps[0];
+    pages_codes_buffer_[0] = page;
+    if (!stm32_->ExtendedErase(pages_codes_buffer_, 1, step.timeout_ms)) {
+      return 0;
+    }
+
+    if (!WritePages(curAddress, page, 1)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+bool FlashLoader::WritePages(uint32_t curAddress, const uint32_t& first_page, const uint32_t& num_pages) {
+  uint32_t address, num_bytes, last_address, last_num_bytes;
+  GetPageSpan(curAddress, first_page, address, num_bytes);
+  GetPageSpan(curAddress, first_page + num_pages - 1, last_address, last_num_bytes);
+
+  BinaryBytesData flash_data = {address - curAddress, address, last_address + last_num_bytes - address};
+  while (flash_data.bytes_left) {
+    uint16_t chunk = CheckNumBytesToWrite(flash_data.bytes_left);
+
+    uint8_t binary_buffer[MAX_WRITE_SIZE];
+    if (!WriteChunk(flash_data.current_byte_pos, chunk, flash_data.current_memory_address, binary_buffer)) {
+      return 0;
+    }
+
+    UpdateBinaryBytesData(flash_data, chunk);
+  }
+
+  return 1;
+}
+
+bool FlashLoader::ReadUniqueId() {
+  uint32_t address = FindUniqueIdAddress(capabilities_.product_id);
+  unique_id_known_ = false;
+  if (address == 0) {
+    return 1;
+  }
+
+  if (!stm32_->ReadMemory(unique_id_.bytes, UNIQUE_ID_SIZE, address)) {
+    return 0;
+  }
+  unique_id_known_ = true;
+
+  return 1;
+}
+
+bool FlashLoader::CheckDeviceRecord(bool& consistent) {
+  const DeviceRecord& record = device_record_;
+  consistent = false;
+  if (record.page_size != chip_timing_.page_size || record.num_pages == 0) {
+    return 1;
+  }
+
+  if (capabilities_.Supports(CMD::GET_CHECKSUM)) {
+    uint32_t address = start_address_ + record.first_page * record.page_size;
+    uint32_t checksum;
+    if (!GetMemoryChecksum(address, (uint64_t)record.num_pages * record.page_size, checksum)) {
+      return 0;
+    }
+    consistent = checksum == record.range_checksum;
+    return 1;
+  }
+
+  // Without GET_CHECKSUM the first and last pages are read back: the vector table and the end of
+  // the image are what another firmware changes first
+  uint32_t crc;
+  if (!ReadPageCrc(record.first_page, crc)) {
+    return 0;
+  }
+  if (crc != device_state_->GetPageCrc(0)) {
+    return 1;
+  }
+  if (!ReadPageCrc(record.first_page + record.num_pages - 1, crc)) {
+    return 0;
+  }
+  consistent = crc == device_state_->GetPageCrc(record.num_pages - 1);
+
+  return 1;
+}
+
+bool FlashLoader::ReadPageCrc(const uint32_t& page, uint32_t& crc) {
+  uint32_t address = start_address_ + page * chip_timing_.page_size;
+  Crc32 memory_crc;
+
+  for (uint32_t pos = 0; pos < chip_timing_.page_size; pos += MAX_WRITE_SIZE) {
+    uint16_t chunk = CheckNumBytesToWrite(chip_timing_.page_size - pos);
+    uint8_t memory_buffer[MAX_WRITE_SIZE];
+    if (!ReadChunk(memory_buffer, chunk, address + pos)) {
+      return 0;
+    }
+    memory_crc.Update(memory_buffer, chunk);
+  }
+  crc = memory_crc.Get();
+
+  return 1;
+}
+
+bool FlashLoader::FlashChangedPages(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "diff flash", "session");
+  uint32_t first_page = CalculatePageOffset(curAddress);
+  uint32_t num_pages = GetNumPagesFromBinary(curAddress);
+  uint64_t bytes_left = total_num_bytes_;
+  diff_result_.pages_in_image = num_pages;
+
+  // Runs of changed pages are erased together, then written and verified before the next run
+  bar_->StartLoadingBar(total_num_bytes_);
+  uint32_t run_start = 0;
+  uint32_t run_length = 0;
+  for (uint32_t page = first_page; page <= first_page + num_pages; page++) {
+    if (page < first_page + num_pages) {
+      uint32_t address, num_bytes;
+      GetPageSpan(curAddress, page, address, num_bytes);
+      bytes_left -= num_bytes;
+
+      if (!IsPageUnchanged(curAddress, page)) {
+        run_start = run_length ? run_start : page;
+        run_length++;
+        continue;
+      }
+    }
+
+    if (run_length) {
+      if (!FlashPageRun(curAddress, run_start, run_length)) {
+        return 0;
+      }
+      diff_result_.pages_written += run_length;
+      run_length = 0;
+    }
+    bar_->UpdateLoadingBar(bytes_left);
+  }
+  bar_->EndLoadingBar();
+
+  // Erase, write and verify are interleaved, they all end here
+  timing_.erase_done_us = SessionUs();
+  timing_.write_done_us = timing_.erase_done_us;
+  timing_.verify_done_us = timing_.erase_done_us;
+
+  RecordDeviceState(curAddress);
+
+  if (!stm32_->GoToAddress(start_address_)) {
+    return 0;
+  }
+  timing_.total_us = SessionUs();
+
+  return 1;
+}
+
+bool FlashLoader::IsPageUnchanged(const uint32_t& curAddress, const uint32_t& page) {
+  if (page < device_record_.first_page || page >= device_record_.first_page + device_record_.num_pages) {
+    return 0;
+  }
+
+  return ComputePageCrc(curAddress, page) == device_state_->GetPageCrc(page - device_record_.first_page);
+}
+
+bool FlashLoader::FlashPageRun(uint32_t curAddress, const uint32_t& first_page, const uint32_t& num_pages) {
+  ErasePlanner planner(chip_timing_);
+  if (!Erase(planner.Plan(first_page, num_pages, false))) {
+    return 0;
+  }
+  if (!WritePages(curAddress, first_page, num_pages)) {
+    return 0;
+  }
+
+  for (uint32_t page = first_page; page < first_page + num_pages; page++) {
+    bool matches;
+    if (!PageMatches(curAddress, page, matches)) {
+      return 0;
+    }
+    if (!matches) {
+      RejectBoard({"FlashPageRun", "Bytes do not match", (int)page});
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void FlashLoader::RecordDeviceState(uint32_t curAddress) {
+  TraceSpan span(tracer_, trace_port_, "record state", "session");
+  // A stream can't be read again, the board was forgotten and gets a full flash next time
+  if (!bin_->IsRereadable()) {
+    return;
+  }
+
+  DeviceRecord record = {chip_timing_.page_size, CalculatePageOffset(curAddress), GetNumPagesFromBinary(curAddress),
+                         0, total_num_bytes_, 0};
+  Crc32Stm32 range_checksum;
+  Crc32 image_crc;
+
+  device_state_->StartRecord(unique_id_);
+  for (uint32_t ii = 0; ii < record.num_pages; ii++) {
+    device_state_->SetPageCrc(ii, ComputePageCrc(curAddress, record.first_page + ii, &range_checksum, &image_crc));
+  }
+  record.image_crc = image_crc.Get();
+  record.range_checksum = range_checksum.Get();
+  device_state_->Commit(record);
+  image_crc_ = image_crc;
+
+  return;
+}
+
+uint32_t FlashLoader::ComputePageCrc(const uint32_t& curAddress, const uint32_t& page, Crc32Stm32* range_checksum,
+                                     Crc32* image_crc) {
+  uint32_t address, num_bytes;
+  GetPageSpan(curAddress, page, address, num_bytes);
+  uint64_t page_start = (uint64_t)start_address_ + (uint64_t)page * chip_timing_.page_size;
+  uint64_t image_start = address;
+  uint64_t image_end = (uint64_t)address + num_bytes;
+  Crc32 crc;
+
+  for (uint32_t pos = 0; pos < chip_timing_.page_size; pos += MAX_WRITE_SIZE) {
+    uint16_t chunk = CheckNumBytesToWrite(chip_timing_.page_size - pos);
+    uint64_t chunk_start = page_start + pos;
+    uint64_t start = chunk_start > image_start ? chunk_start : image_start;
+    uint64_t end = chunk_start + chunk < image_end ? chunk_start + chunk : image_end;
+
+    uint8_t buffer[MAX_WRITE_SIZE];
+    memset(buffer, 0xFF, chunk);
+    if (start < end) {
+      uint8_t* image_bytes = buffer + (start - chunk_start);
+      bin_->GetBytesArray(image_bytes, {(uint32_t)(end - start), start - curAddress});
+      if (image_crc) {
+        image_crc->Update(image_bytes, end - start);
+      }
+    }
+
+    crc.Update(buffer, chunk);
+    if (range_checksum) {
+      range_checksum->Update(buffer, chunk);
+    }
+  }
+
+  return crc.Get();
+}
+
+void FlashLoader::GetPageSpan(const uint32_t& curAddress, const uint32_t& page, uint32_t& address,
+                              uint32_t& num_bytes) {
+  uint64_t page_start = (uint64_t)start_address_ + (uint64_t)page * chip_timing_.page_size;
+  uint64_t page_end = page_start + chip_timing_.page_size;
+  uint64_t image_end = (uint64_t)curAddress + total_num_bytes_;
+
+  uint64_t start = page_start > curAddress ? page_start : curAddress;
+  uint64_t end = page_end < image_end ? page_end : image_end;
+  address = start;
+  num_bytes = end - start;
+
+  return;
+}
+
 bool FlashLoader::CompareBinaryAndMemory(uint8_t* memory_buffer, uint8_t* binary_buffer,
                                          const uint16_t& num_bytes) {  
     uint8_t mem, buf;
@@ -132,16 +1025,14 @@ bool FlashLoader::CompareBinaryAndMemory(uint8_t* memory_buffer, uint8_t* binary
       mem = memory_buffer[ii];
       buf = binary_buffer[ii];
       if (mem != buf) {
-        Schmi::Error err = {"CheckBytes", "Bytes do not match", ii};
-        err_->Init(err);
-        err_->DisplayAndDie();
+        RejectBoard({"CheckBytes", "Bytes do not match", ii});
         return 0;
     }
   }
   return 1;
 }
 
-uint16_t FlashLoader::CheckNumBytesToWrite(const uint32_t& bytes_left) {
+uint16_t FlashLoader::CheckNumBytesToWrite(const uint64_t& bytes_left) {
   uint16_t num_bytes_to_write = 0;
 
   if (bytes_left < MAX_WRITE_SIZE) {
@@ -0,0 +1,347 @@
+#include "Schmi/image_store.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+namespace Schmi {
+
+const uint32_t ImageStore::SEGMENT_GRANULE;
+
+bool ImageStore::Init() {
+  mkdir(root_dir_.c_str(), 0755);
+  mkdir((root_dir_ + "/objects").c_str(), 0755);
+  struct stat st;
+  if (stat((root_dir_ + "/objects").c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return 0;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  images_.clear();
+  by_hash_.clear();
+  by_product_.clear();
+
+  // A missing index is an empty store
+  std::ifstream file(root_dir_ + "/index.txt");
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    ImageInfo info;
+    uint32_t version = 0;
+    size_t num_segments = 0;
+    fields >> info.hash >> std::hex >> info.product_id >> version >> std::dec >> info.size >> num_segments;
+    info.version = version;
+    for (size_t ii = 0; ii < num_segments && fields; ii++) {
+      ImageSegment segment;
+      char colon;
+      fields >> segment.offset >> colon >> segment.length;
+      info.segments.push_back(segment);
+    }
+    // A line cut short by a crash
+    if (!fields || info.hash.size() != 16) {
+      continue;
+    }
+    AddImage(info);
+  }
+
+  return 1;
+}
+
+size_t ImageStore::Ingest(const std::vector<std::string>& paths, std::vector<std::string>& errors,
+                          const uint32_t& num_threads) {
+  uint32_t num_workers = num_threads ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+  num_workers = std::min<size_t>(num_workers, std::max<size_t>(1, paths.size()));
+
+  // Every thread takes the next file until there are none left, a big image doesn't hold up the others
+  std::vector<ImageInfo> infos(paths.size());
+  std::vector<std::string> file_errors(paths.size());
+  std::vector<char> ingested(paths.size(), 0);
+  std::atomic<size_t> next(0);
+  auto worker = [&] {
+    for (size_t ii = next++; ii < paths.size(); ii = next++) {
+      ingested[ii] = IngestFile(paths[ii], infos[ii], file_errors[ii]);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (uint32_t ii = 1; ii < num_workers; ii++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : workers) {
+    thread.join();
+  }
+
+  // Added in the order given, the same files give the same product lookups whatever the timing
+  size_t num_new = 0;
+  bool changed = false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t ii = 0; ii < paths.size(); ii++) {
+    if (!ingested[ii]) {
+      errors.push_back(paths[ii] + ": " + file_errors[ii]);
+      continue;
+    }
+    if (by_hash_.find(infos[ii].hash) == by_hash_.end()) {
+      num_new++;
+    }
+    changed |= AddImage(infos[ii]);
+  }
+  // Known content under a product name is a change too, or FindByProduct loses it on the next Init
+  if (changed && !SaveIndex()) {
+    errors.push_back("could not write " + root_dir_ + "/index.txt");
+  }
+
+  return num_new;
+}
+
+std::vector<std::string> ImageStore::ListImages(const std::string& dir) {
+  std::vector<std::string> paths;
+  DIR* handle = opendir(dir.c_str());
+  if (!handle) {
+    return paths;
+  }
+  while (dirent* entry = readdir(handle)) {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) {
+      paths.push_back(dir + "/" + name);
+    }
+  }
+  closedir(handle);
+  std::sort(paths.begin(), paths.end());
+
+  return paths;
+}
+
+const ImageInfo* ImageStore::FindByHash(const std::string& hash) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = by_hash_.find(hash);
+
+  return found == by_hash_.end() ? nullptr : found->second;
+}
+
+const ImageInfo* ImageStore::FindByProduct(const uint32_t& product_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = by_product_.find(product_id);
+
+  return found == by_product_.end() ? nullptr : found->second;
+}
+
+std::shared_ptr<BinaryFileMapped> ImageStore::Open(const std::string& hash) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (by_hash_.find(hash) == by_hash_.end()) {
+    return nullptr;
+  }
+
+  // Still open for another session, it gets the same mapping
+  std::shared_ptr<BinaryFileMapped> image = open_[hash].lock();
+  if (image) {
+    return image;
+  }
+  image = std::make_shared<BinaryFileMapped>(GetObjectPath(hash));
+  // An object cut short or replaced behind the store's back isn't the image of the index
+  if (!image->Map() || image->GetBinaryFileSize() != by_hash_[hash]->size) {
+    return nullptr;
+  }
+  open_[hash] = image;
+
+  return image;
+}
+
+std::shared_ptr<BinaryFileMapped> ImageStore::OpenProduct(const uint32_t& product_id) {
+  const ImageInfo* info = FindByProduct(product_id);
+
+  return info ? Open(info->hash) : nullptr;
+}
+
+size_t ImageStore::GetNumImages() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return images_.size();
+}
+
+bool ImageStore::ParseImageName(const std::string& file_name, uint32_t& product_id, uint8_t& version) {
+  std::string name = file_name.substr(file_name.find_last_of('/') + 1);
+  if (name.compare(0, 2, "0x") != 0) {
+    return 0;
+  }
+
+  size_t num_digits = 0;
+  while (2 + num_digits < name.size() && isxdigit((unsigned char)name[2 + num_digits])) {
+    num_digits++;
+  }
+  if (num_digits < 3 || num_digits > 10) {
+    return 0;
+  }
+
+  uint64_t value = std::stoull(name.substr(2, num_digits), nullptr, 16);
+  product_id = value >> 8;
+  version = value & 0xFF;
+
+  return 1;
+}
+
+std::string ImageStore::HashBytes(const uint8_t* bytes, const uint64_t& num_bytes) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (uint64_t ii = 0; ii < num_bytes; ii++) {
+    hash = (hash ^ bytes[ii]) * 0x100000001b3ULL;
+  }
+
+  char text[17];
+  snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+
+  return text;
+}
+
+std::vector<ImageSegment> ImageStore::FindSegments(const uint8_t* bytes, const uint64_t& num_bytes) {
+  std::vector<ImageSegment> segments;
+  for (uint64_t pos = 0; pos < num_bytes; pos += SEGMENT_GRANULE) {
+    uint64_t end = std::min<uint64_t>(pos + SEGMENT_GRANULE, num_bytes);
+    bool blank = std::all_of(bytes + pos, bytes + end, [](const uint8_t& byte) { return byte == 0xFF; });
+    if (blank) {
+      continue;
+    }
+    if (!segments.empty() && segments.back().offset + segments.back().length == pos) {
+      segments.back().length += end - pos;
+    } else {
+      segments.push_back({pos, end - pos});
+    }
+  }
+
+  return segments;
+}
+
+bool ImageStore::IngestFile(const std::string& path, ImageInfo& info, std::string& error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    error = "cannot open";
+    return 0;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (bytes.empty()) {
+    error = "empty image";
+    return 0;
+  }
+
+  info.hash = HashBytes(bytes.data(), bytes.size());
+  info.size = bytes.size();
+  info.segments = FindSegments(bytes.data(), bytes.size());
+  if (!ParseImageName(path, info.product_id, info.version)) {
+    info.product_id = 0;
+    info.version = 0;
+  }
+
+  // Objects are never rewritten. The hash is short, so an object of the same name has to have the
+  // same bytes too.
+  std::string object_path = GetObjectPath(info.hash);
+  if (access(object_path.c_str(), F_OK) == 0) {
+    return ObjectMatches(object_path, bytes, error);
+  }
+
+  // Through a temporary file of this thread, a half written object is never seen under its name
+  std::ostringstream temp_name;
+  temp_name << object_path << ".tmp" << std::this_thread::get_id();
+  {
+    std::ofstream object(temp_name.str(), std::ios::binary | std::ios::trunc);
+    object.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    if (!object.good()) {
+      error = "could not write " + temp_name.str();
+      unlink(temp_name.str().c_str());
+      return 0;
+    }
+  }
+  // link doesn't replace an object another thread stored in the meantime
+  bool linked = link(temp_name.str().c_str(), object_path.c_str()) == 0;
+  bool exists = !linked && errno == EEXIST;
+  unlink(temp_name.str().c_str());
+  if (exists) {
+    return ObjectMatches(object_path, bytes, error);
+  }
+  if (!linked) {
+    error = "could not write " + object_path;
+    return 0;
+  }
+
+  return 1;
+}
+
+bool ImageStore::ObjectMatches(const std::string& object_path, const std::vector<uint8_t>& bytes,
+                               std::string& error) {
+  struct stat st;
+  if (stat(object_path.c_str(), &st) == 0 && (uint64_t)st.st_size == bytes.size()) {
+    std::ifstream object(object_path, std::ios::binary);
+    std::vector<uint8_t> stored(bytes.size());
+    object.read(reinterpret_cast<char*>(stored.data()), stored.size());
+    if (object && stored == bytes) {
+      return 1;
+    }
+  }
+  error = "hash collides with " + object_path + ", which has other bytes";
+
+  return 0;
+}
+
+bool ImageStore::AddImage(const ImageInfo& info) {
+  bool changed = false;
+  auto found = images_.find(info.hash);
+  if (found == images_.end()) {
+    found = images_.emplace(info.hash, std::unique_ptr<ImageInfo>(new ImageInfo(info))).first;
+    by_hash_[info.hash] = found->second.get();
+    changed = true;
+  } else if (info.product_id && !found->second->product_id) {
+    // Known content, now under a name that tells what it is for
+    found->second->product_id = info.product_id;
+    found->second->version = info.version;
+    changed = true;
+  }
+
+  const ImageInfo* image = found->second.get();
+  if (!image->product_id) {
+    return changed;
+  }
+  auto latest = by_product_.find(image->product_id);
+  if (latest == by_product_.end() || latest->second->version <= image->version) {
+    by_product_[image->product_id] = image;
+  }
+
+  return changed;
+}
+
+bool ImageStore::SaveIndex() {
+  // The old index stays whole until the new one is complete
+  std::string file_name = root_dir_ + "/index.txt";
+  std::string temp_name = file_name + ".tmp";
+  {
+    std::ofstream file(temp_name, std::ios::trunc);
+    for (auto& image : images_) {
+      const ImageInfo& info = *image.second;
+      file << info.hash << std::hex << " " << info.product_id << " " << (uint32_t)info.version << std::dec << " "
+           << info.size << " " << info.segments.size();
+      for (const ImageSegment& segment : info.segments) {
+        file << " " << segment.offset << ":" << segment.length;
+      }
+      file << "\n";
+    }
+
+    if (!file.good()) {
+      std::cerr << "ERROR: could not write " << temp_name << "\n";
+      return 0;
+    }
+  }
+
+  if (rename(temp_name.c_str(), file_name.c_str()) != 0) {
+    std::cerr << "ERROR: could not replace " << file_name << "\n";
+    return 0;
+  }
+
+  return 1;
+}
+}  // namespace Schmi
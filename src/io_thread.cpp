@@ -0,0 +1,66 @@
+#include "Schmi/io_thread.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace Schmi {
+
+IoThreadStatus ApplyIoThreadOptions(const IoThreadOptions& options) {
+  IoThreadStatus status = {false, false, false, ""};
+
+  if (options.cpu >= 0) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int result = EINVAL;
+    if (options.cpu < CPU_SETSIZE) {
+      CPU_SET(options.cpu, &cpus);
+      result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#else
+    // Thread affinity is a Linux call, elsewhere the thread runs anywhere
+    int result = ENOTSUP;
+#endif
+    status.pinned = result == 0;
+    if (!status.pinned) {
+      status.warnings += "cannot pin to cpu " + std::to_string(options.cpu) + ": " + strerror(result) + "\n";
+    }
+  }
+
+  if (options.rt_priority > 0) {
+    sched_param param = {};
+    param.sched_priority = options.rt_priority;
+    // EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO, the thread keeps its normal priority
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    status.realtime = result == 0;
+    if (!status.realtime) {
+      status.warnings +=
+          "cannot use SCHED_FIFO priority " + std::to_string(options.rt_priority) + ": " + strerror(result) + "\n";
+    }
+  }
+
+  if (options.lock_memory) {
+    status.memory_locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    if (!status.memory_locked) {
+      status.warnings += std::string("cannot lock memory: ") + strerror(errno) + "\n";
+    }
+  }
+
+  return status;
+}
+
+IoThreadStatus RunOnIoThread(const IoThreadOptions& options, const std::function<void()>& work) {
+  IoThreadStatus status;
+  std::thread io_thread([&] {
+    status = ApplyIoThreadOptions(options);
+    work();
+  });
+  io_thread.join();
+
+  return status;
+}
+}  // namespace Schmi
@@ -0,0 +1,123 @@
+#include "Schmi/latency_histogram.hpp"
+
+namespace Schmi {
+
+void LatencyHistogram::Reset() {
+  for (uint16_t ii = 0; ii < NUM_BUCKETS; ii++) {
+    buckets_[ii] = 0;
+  }
+  count_ = 0;
+  total_us_ = 0;
+  max_us_ = 0;
+
+  return;
+}
+
+void LatencyHistogram::Record(const uint64_t& duration_us) {
+  buckets_[BucketOf(duration_us)]++;
+  count_++;
+  total_us_ += duration_us;
+  if (duration_us > max_us_) {
+    max_us_ = duration_us;
+  }
+
+  return;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (uint16_t ii = 0; ii < NUM_BUCKETS; ii++) {
+    buckets_[ii] += other.buckets_[ii];
+  }
+  count_ += other.count_;
+  total_us_ += other.total_us_;
+  if (other.max_us_ > max_us_) {
+    max_us_ = other.max_us_;
+  }
+
+  return;
+}
+
+uint64_t LatencyHistogram::GetPercentileUs(const double& percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  // Rank of the sample the percentile lands on, counted from 1
+  uint64_t rank = (uint64_t)(percentile / 100 * count_ + 0.999999);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > count_) {
+    rank = count_;
+  }
+
+  uint64_t seen = 0;
+  for (uint16_t ii = 0; ii < NUM_BUCKETS; ii++) {
+    seen += buckets_[ii];
+    if (seen >= rank) {
+      uint64_t upper_us = BucketUpperUs(ii);
+      return upper_us < max_us_ ? upper_us : max_us_;
+    }
+  }
+
+  return max_us_;
+}
+
+void LatencyHistogram::Decay() {
+  count_ = 0;
+  total_us_ = 0;
+  max_us_ = 0;
+  for (uint16_t ii = 0; ii < NUM_BUCKETS; ii++) {
+    buckets_[ii] /= 2;
+    count_ += buckets_[ii];
+    total_us_ += buckets_[ii] * BucketUpperUs(ii);
+    if (buckets_[ii]) {
+      max_us_ = BucketUpperUs(ii);
+    }
+  }
+
+  return;
+}
+
+void LatencyHistogram::AddToBucket(const uint16_t& bucket, const uint64_t& count) {
+  if (bucket >= NUM_BUCKETS || count == 0) {
+    return;
+  }
+
+  buckets_[bucket] += count;
+  count_ += count;
+  total_us_ += count * BucketUpperUs(bucket);
+  if (BucketUpperUs(bucket) > max_us_) {
+    max_us_ = BucketUpperUs(bucket);
+  }
+
+  return;
+}
+
+// Below SUB_BUCKETS every us has its bucket, above it each power of two is cut in SUB_BUCKETS
+uint16_t LatencyHistogram::BucketOf(const uint64_t& duration_us) {
+  if (duration_us < SUB_BUCKETS) {
+    return duration_us;
+  }
+
+  uint8_t exponent = 63;
+  while (!(duration_us >> exponent)) {
+    exponent--;
+  }
+  uint16_t sub_bucket = (duration_us >> (exponent - 3)) & (SUB_BUCKETS - 1);
+  uint16_t bucket = (exponent - 2) * SUB_BUCKETS + sub_bucket;
+
+  return bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::BucketUpperUs(const uint16_t& bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+
+  uint8_t exponent = bucket / SUB_BUCKETS + 2;
+  uint64_t sub_bucket = bucket % SUB_BUCKETS;
+
+  return ((SUB_BUCKETS + sub_bucket + 1) << (exponent - 3)) - 1;
+}
+}  // namespace Schmi
@@ -0,0 +1,215 @@
+#include "Schmi/link_scheduler.hpp"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+namespace Schmi {
+
+namespace {
+
+const uint8_t MAX_USB_PARENTS = 8;
+
+bool IsUsbDevice(const std::string& dir) {
+  struct stat st;
+  return stat((dir + "/idVendor").c_str(), &st) == 0;
+}
+
+std::string BaseName(const std::string& dir) { return dir.substr(dir.rfind('/') + 1); }
+}  // namespace
+
+bool ReadUsbTopology(const std::string& sysfs_tty_dir, const std::string& name, UsbTopology& topology) {
+  topology = {name, name, name, name};
+
+  char resolved[PATH_MAX];
+  std::string link = sysfs_tty_dir + "/" + name + "/device";
+  if (!realpath(link.c_str(), resolved)) {
+    return 0;
+  }
+
+  // The link goes to the serial port below the interface (.../1-1.2/1-1.2:1.0/ttyUSB0). The first
+  // parent with an idVendor is the chip, the directory under it on the way up is the interface
+  // and the next one up is the hub.
+  std::string dir = resolved;
+  std::string child = dir;
+  for (uint8_t ii = 0; ii < MAX_USB_PARENTS && dir.size() > 1; ii++) {
+    if (IsUsbDevice(dir)) {
+      std::string parent = dir.substr(0, dir.rfind('/'));
+      topology.interface = BaseName(child);
+      topology.chip = BaseName(dir);
+      topology.hub = IsUsbDevice(parent) ? BaseName(parent) : topology.chip;
+      return 1;
+    }
+    child = dir;
+    dir = dir.substr(0, dir.rfind('/'));
+  }
+
+  return 0;
+}
+
+class LinkScheduler::PortGate : public PhaseGateInterface {
+ public:
+  PortGate(LinkScheduler& scheduler, Link& chip, Link& hub) : scheduler_(scheduler), chip_(chip), hub_(hub){};
+
+  void Enter(const SessionPhase& phase) override {
+    // Only the outermost phase counts, an erase never waits
+    if (depth_++ > 0 || phase == SessionPhase::kErase) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(scheduler_.mutex_);
+    uint64_t asked_us = scheduler_.clock_->NowUs();
+    scheduler_.waiting_.push_back(this);
+    scheduler_.link_cv_.wait(lock, [&] {
+      for (PortGate* gate : scheduler_.waiting_) {
+        if (scheduler_.CanStart(*gate)) {
+          return gate == this;
+        }
+      }
+      return false;
+    });
+    scheduler_.waiting_.erase(std::find(scheduler_.waiting_.begin(), scheduler_.waiting_.end(), this));
+
+    uint64_t now_us = scheduler_.clock_->NowUs();
+    chip_.stats.wait_us += now_us - asked_us;
+    hub_.stats.wait_us += now_us - asked_us;
+    scheduler_.StartTransfer(*this, now_us);
+    // Another waiter may be able to go on a different link
+    scheduler_.link_cv_.notify_all();
+
+    return;
+  };
+
+  void Leave(const SessionPhase&) override {
+    if (--depth_ > 0 || !transferring_) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(scheduler_.mutex_);
+    scheduler_.EndTransfer(*this, scheduler_.clock_->NowUs());
+    scheduler_.link_cv_.notify_all();
+
+    return;
+  };
+
+ private:
+  friend class LinkScheduler;
+
+  LinkScheduler& scheduler_;
+  Link& chip_;
+  Link& hub_;
+  uint32_t depth_ = 0;  // session thread only
+  bool transferring_ = false;
+  uint64_t transfer_start_us_ = 0;
+};
+
+LinkScheduler::LinkScheduler(const LinkLimits& limits, ClockInterface* clock)
+    : limits_(limits), clock_(clock ? clock : &default_clock_) {
+  created_us_ = clock_->NowUs();
+}
+
+LinkScheduler::~LinkScheduler() {}
+
+void LinkScheduler::AddPort(const UsbTopology& topology) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Link& chip = GetLink(chips_, topology.chip, false);
+  Link& hub = GetLink(hubs_, topology.hub, true);
+  chip.stats.num_ports++;
+  hub.stats.num_ports++;
+  gates_[topology.name].reset(new PortGate(*this, chip, hub));
+
+  return;
+}
+
+bool LinkScheduler::AddPort(const std::string& name, const std::string& sysfs_tty_dir) {
+  UsbTopology topology;
+  bool on_usb = ReadUsbTopology(sysfs_tty_dir, name.substr(name.rfind('/') + 1), topology);
+  topology.name = name;
+  AddPort(topology);
+
+  return on_usb;
+}
+
+PhaseGateInterface* LinkScheduler::GetGate(const std::string& port_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = gates_.find(port_name);
+
+  return found == gates_.end() ? nullptr : found->second.get();
+}
+
+std::vector<LinkStats> LinkScheduler::GetLinkStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t now_us = clock_->NowUs();
+
+  std::vector<LinkStats> stats;
+  for (auto* links : {&hubs_, &chips_}) {
+    for (auto& entry : *links) {
+      LinkStats link = entry.second.stats;
+      if (link.transfers) {
+        link.busy_us += now_us - entry.second.busy_since_us;
+      }
+      link.elapsed_us = now_us - created_us_;
+      stats.push_back(link);
+    }
+  }
+
+  return stats;
+}
+
+LinkScheduler::Link& LinkScheduler::GetLink(std::map<std::string, Link>& links, const std::string& name,
+                                            const bool& is_hub) {
+  auto found = links.find(name);
+  if (found != links.end()) {
+    return found->second;
+  }
+
+  Link link = {};
+  link.stats.name = name;
+  link.stats.is_hub = is_hub;
+  link.limit = is_hub ? limits_.max_transfers_per_hub : limits_.max_transfers_per_chip;
+
+  return links.emplace(name, link).first->second;
+}
+
+bool LinkScheduler::CanStart(const PortGate& gate) const {
+  for (const Link* link : {&gate.chip_, &gate.hub_}) {
+    if (link->limit && link->stats.transfers >= link->limit) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void LinkScheduler::StartTransfer(PortGate& gate, const uint64_t& now_us) {
+  for (Link* link : {&gate.chip_, &gate.hub_}) {
+    if (link->stats.transfers++ == 0) {
+      link->busy_since_us = now_us;
+    }
+    link->stats.max_transfers = std::max(link->stats.max_transfers, link->stats.transfers);
+  }
+  gate.transferring_ = true;
+  gate.transfer_start_us_ = now_us;
+
+  return;
+}
+
+void LinkScheduler::EndTransfer(PortGate& gate, const uint64_t& now_us) {
+  for (Link* link : {&gate.chip_, &gate.hub_}) {
+    link->stats.transfer_us += now_us - gate.transfer_start_us_;
+    if (--link->stats.transfers == 0) {
+      AddBusyTime(*link, now_us);
+    }
+  }
+  gate.transferring_ = false;
+
+  return;
+}
+
+void LinkScheduler::AddBusyTime(Link& link, const uint64_t& now_us) {
+  link.stats.busy_us += now_us - link.busy_since_us;
+
+  return;
+}
+}  // namespace Schmi
@@ -1,18 +1,81 @@
+#include "Schmi/auto_flasher.hpp"
 #include "Schmi/binary_file_std.hpp"
-#include "Schmi/error_handler_std.hpp"
+#include "Schmi/board_cloner.hpp"
+#include "Schmi/binary_file_stream.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/event_pump.hpp"
+#include "Schmi/event_ring_session.hpp"
+#include "Schmi/flash_daemon.hpp"
+#include "Schmi/flash_estimator.hpp"
 #include "Schmi/flash_loader.hpp"
+#include "Schmi/image_store.hpp"
+#include "Schmi/io_thread.hpp"
+#include "Schmi/latency_histogram.hpp"
+#include "Schmi/link_scheduler.hpp"
 #include "Schmi/loading_bar_std.hpp"
+#include "Schmi/parse_number.hpp"
+#include "Schmi/port_watcher.hpp"
 #include "Schmi/serial_posix.hpp"
+#include "Schmi/serial_tcp.hpp"
+#include "Schmi/timeout_model_std.hpp"
+#include "Schmi/tracer.hpp"
 
+#include <signal.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+// Options every mode takes before its own arguments, see ParseRunnerOptions
+struct RunnerOptions {
+  Schmi::IoThreadOptions io;
+  std::string timeouts_file;
+  bool inline_verify = false;
+  std::string trace_file;
+  std::string store_dir;
+  bool usb_links = false;
+  Schmi::LinkLimits link_limits;
+};
 
 void DisplayAsciiArt(const std::string& file_name);
 std::string GetTextFileContents(std::ifstream& file);
+int DryRun(int argc, char* argv[]);
+int RunDaemon(int argc, char* argv[], const RunnerOptions& options);
+int WatchPorts(int argc, char* argv[]);
+int IngestImages(int argc, char* argv[]);
+int CloneBoard(int argc, char* argv[]);
+std::unique_ptr<Schmi::SerialInterface> MakeSerial(const std::string& name, Schmi::EventRing* events);
+std::shared_ptr<Schmi::BinaryFileMapped> OpenStoreImage(const std::string& store_dir, const std::string& key);
+bool ParseRunnerOptions(int& argc, char* argv[], RunnerOptions& options);
+void PrintLatency(const Schmi::LatencyHistogram& latency);
+void PrintTiming(const Schmi::FlashTiming& timing);
+void PrintEvent(const Schmi::SessionEvent& event, Schmi::LoadingBarStd& bar);
 
 int main(int argc, char* argv[]) {
   // DisplayAsciiArt("misc/schmi_ascii_art.txt");
 
+  RunnerOptions options;
+  if (!ParseRunnerOptions(argc, argv, options)) {
+    return EXIT_FAILURE;
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "--dry-run") {
+    return DryRun(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--daemon") {
+    return RunDaemon(argc, argv, options);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--watch") {
+    return WatchPorts(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--ingest") {
+    return IngestImages(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--clone") {
+    return CloneBoard(argc, argv);
+  }
+
   std::string binary_file = "binaries/0x100016_iq2306_2200kv.bin";
   // std::string binary_file = "binaries/0x20000A_iq2306_190kv.bin";
   // std::string binary_file = "binaries/0x8000000B.bin";
@@ -20,21 +83,415 @@ int main(int argc, char* argv[]) {
   // std::string binary_file = "./1048583_V6-3.bin";
   // std::string binary_file = "./1048583_V6-3.bin";
 
+  std::string serial_port = "/dev/ttyUSB0";
+  uint64_t image_size = 0;
+
+  // usage: Schmi_runner [binary_file] [serial_port] [image_size]
+  //        Schmi_runner --dry-run binary_file [product_id] [baud_rate] [round_trip_us]
+  //        Schmi_runner --daemon socket_path serial_port [serial_port...]
+  //        Schmi_runner --watch binary_file [vid:pid[:serial] | name_pattern...]
+  //        Schmi_runner --ingest store_dir image_dir|image_file...
+  //        Schmi_runner --clone source_port num_bytes target_port [target_port...]
+  // Any mode also takes --io-cpu N, --io-priority P, --mlock, --timeouts file, --inline-verify,
+  // --trace file, --store dir and --usb-links first, see ParseRunnerOptions
+  // A binary_file of "-" streams the image from stdin, then image_size is required
+  // A serial_port of tcp:host:port or rfc2217:host:port goes through a serial server, see SerialTcp
+  if (argc > 1) binary_file = argv[1];
+  if (argc > 2) serial_port = argv[2];
+  if (argc > 3 && !Schmi::ParseNumber(argv[3], image_size)) {
+    std::cerr << "ERROR: image_size is not a number: " << argv[3] << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (binary_file == "-" && image_size == 0) {
+    std::cerr << "ERROR: streaming from stdin needs the image size\n";
+    return EXIT_FAILURE;
+  }
+
   std::cout << "Binary to flash: " << binary_file << "\n\n";
 
-  Schmi::ErrorHandlerStd error;
-  Schmi::BinaryFileStd bin(binary_file);
-  Schmi::SerialPosix ser("/dev/ttyUSB0");
-  Schmi::LoadingBarStd bar;
+  // The session only queues its progress and errors, they are printed from this thread
+  Schmi::EventRing events;
+  Schmi::RingErrorHandler error(events);
+  Schmi::RingLoadingBar bar(events);
+  Schmi::LoadingBarStd console_bar;
+  Schmi::EventPump pump(events, [&](const Schmi::SessionEvent& event) { PrintEvent(event, console_bar); });
+
+  Schmi::BinaryFileStd file_bin(binary_file);
+  Schmi::BinaryFileStream stream_bin(STDIN_FILENO, image_size);
+  Schmi::BinaryFileInterface* bin = &file_bin;
+  std::shared_ptr<Schmi::BinaryFileMapped> store_bin;
+  if (binary_file == "-") {
+    bin = &stream_bin;
+  } else if (!options.store_dir.empty()) {
+    store_bin = OpenStoreImage(options.store_dir, binary_file);
+    if (!store_bin) {
+      return EXIT_FAILURE;
+    }
+    bin = store_bin.get();
+  }
+  std::unique_ptr<Schmi::SerialInterface> ser = MakeSerial(serial_port, &events);
+
+  Schmi::ClockStd clock;
+  Schmi::LatencyHistogram latency;
+  Schmi::TimeoutModel timeouts;
+
+  Schmi::FlashLoader fl(ser.get(), bin, &error, &bar);
+  fl.SetClock(&clock);
+  fl.SetLatencyHistogram(&latency);
+  fl.SetInlineVerify(options.inline_verify);
+  Schmi::Tracer tracer(clock);
+  if (!options.trace_file.empty()) {
+    fl.SetTracer(&tracer, tracer.AddPort(serial_port));
+  }
+  if (!options.timeouts_file.empty()) {
+    Schmi::LoadTimeoutModel(options.timeouts_file, timeouts);
+    fl.SetTimeoutModel(&timeouts);
+  }
+
+  bool flashed = false;
+  pump.Start();
+  Schmi::IoThreadStatus io_status = Schmi::RunOnIoThread(options.io, [&] {
+    fl.Init();
+    flashed = fl.Flash(true, false);
+  });
+  pump.Stop();
+  std::cerr << io_status.warnings;
+  if (events.GetNumDropped()) {
+    std::cerr << "WARNING: " << events.GetNumDropped() << " events were dropped\n";
+  }
+  if (!options.trace_file.empty() && !tracer.WriteChromeTrace(options.trace_file)) {
+    std::cerr << "ERROR: could not write " << options.trace_file << "\n";
+  }
+  PrintLatency(latency);
+  PrintTiming(fl.GetTiming());
+
+  // A session that failed may have timed out on a hung board, that isn't a latency to learn
+  if (flashed && !options.timeouts_file.empty()) {
+    Schmi::SaveTimeoutModel(options.timeouts_file, timeouts);
+  }
+
+  return flashed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Takes the common options off the front of the arguments:
+//   --io-cpu N        pin the protocol loop to core N, the daemon gives port k core N + k
+//   --io-priority P   run it with SCHED_FIFO priority P
+//   --mlock           lock the process memory
+//   --timeouts file   learn the ACK deadlines, kept in the file from one run to the next
+//   --inline-verify   verify each page as soon as it is written, a bad board is given up early
+//   --trace file      write a timeline of the session, or of every daemon job, for a trace viewer
+//   --store dir       take the binary_file of a single flash from an image store, by hash or product ID
+//   --usb-links       schedule the daemon's transfers on the USB chips and hubs its ports share
+//   --chip-transfers N  with --usb-links, at most N blocks at once on one chip, no cap by default
+//   --hub-transfers N   the same for one hub
+// Without the privileges for the I/O options they are reported and flashing goes on as usual
+bool ParseRunnerOptions(int& argc, char* argv[], RunnerOptions& options) {
+  int first = 1;
+  while (first < argc) {
+    std::string option = argv[first];
+    bool takes_value =
+        option == "--io-cpu" || option == "--io-priority" || option == "--timeouts" || option == "--trace" ||
+                       option == "--store" || option == "--chip-transfers" || option == "--hub-transfers";
+    if (option == "--mlock") {
+      options.io.lock_memory = true;
+      first++;
+    } else if (option == "--inline-verify") {
+      options.inline_verify = true;
+      first++;
+    } else if (option == "--usb-links") {
+      options.usb_links = true;
+      first++;
+    } else if (takes_value && first + 1 < argc) {
+      std::string value = argv[first + 1];
+      uint64_t number = 0;
+      if (option == "--io-cpu" || option == "--io-priority" || option == "--chip-transfers" ||
+          option == "--hub-transfers") {
+        // A CPU index, checked when the thread is pinned, a SCHED_FIFO priority or a link limit
+        uint64_t max = option == "--io-cpu" ? INT32_MAX : option == "--io-priority" ? 99 : UINT8_MAX;
+        if (!Schmi::ParseNumber(value, number, max)) {
+          std::cerr << "ERROR: " << option << " takes a number, not " << value << "\n";
+          return 0;
+        }
+      }
+      if (option == "--io-cpu") {
+        options.io.cpu = number;
+      } else if (option == "--io-priority") {
+        options.io.rt_priority = number;
+      } else if (option == "--timeouts") {
+        options.timeouts_file = value;
+      } else if (option == "--trace") {
+        options.trace_file = value;
+      } else if (option == "--chip-transfers") {
+        options.link_limits.max_transfers_per_chip = number;
+      } else if (option == "--hub-transfers") {
+        options.link_limits.max_transfers_per_hub = number;
+      } else {
+        options.store_dir = value;
+      }
+      first += 2;
+    } else if (takes_value) {
+      std::cerr << "ERROR: " << option << " needs a value\n";
+      return 0;
+    } else {
+      break;
+    }
+  }
+
+  for (int ii = first; ii < argc; ii++) {
+    argv[ii - first + 1] = argv[ii];
+  }
+  argc -= first - 1;
+
+  return 1;
+}
+
+void PrintEvent(const Schmi::SessionEvent& event, Schmi::LoadingBarStd& bar) {
+  switch (event.kind) {
+    case Schmi::EventKind::kWriteStart:
+      bar.StartLoadingBar(event.value);
+      break;
+    case Schmi::EventKind::kVerifyStart:
+      bar.StartCheckingLoadingBar(event.value);
+      break;
+    case Schmi::EventKind::kProgress:
+      bar.UpdateLoadingBar(event.value);
+      break;
+    case Schmi::EventKind::kEnd:
+      bar.EndLoadingBar();
+      break;
+    case Schmi::EventKind::kWarning:
+    case Schmi::EventKind::kError:
+      std::cerr << event.text << " - " << event.num << "\n";
+      break;
+  }
+
+  return;
+}
+
+void PrintLatency(const Schmi::LatencyHistogram& latency) {
+  std::cout << "ACK round trips: " << latency.GetCount() << ", p50 " << latency.GetPercentileUs(50) << " us, p99 "
+            << latency.GetPercentileUs(99) << " us, p99.9 " << latency.GetPercentileUs(99.9) << " us, max "
+            << latency.GetMaxUs() << " us\n";
+
+  return;
+}
+
+void PrintTiming(const Schmi::FlashTiming& timing) {
+  std::cout << "Session: sync " << timing.sync_done_us / 1000 << " ms, erase " << timing.erase_done_us / 1000
+            << " ms, write " << timing.write_done_us / 1000 << " ms, verify " << timing.verify_done_us / 1000
+            << " ms, total " << timing.total_us / 1000 << " ms\n";
+  // What a bad board cost the station before it was given up
+  if (timing.reject_us) {
+    std::cout << "Board rejected after " << timing.reject_us / 1000 << " ms\n";
+  }
+
+  return;
+}
+
+void PrintPhase(const std::string& name, const Schmi::PhaseEstimate& phase) {
+  std::cout << name << phase.estimated_us / 1000 << " ms (" << phase.round_trips << " round trips, "
+            << phase.bytes_sent << " bytes sent, " << phase.bytes_received << " received)\n";
+
+  return;
+}
+
+// Prints what flashing the image would cost without touching a chip
+int DryRun(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "ERROR: --dry-run needs a binary file\n";
+    return EXIT_FAILURE;
+  }
+
+  uint16_t product_id = Schmi::DEFAULT_CHIP_TIMING.product_id;
+  Schmi::LinkTiming link = Schmi::DEFAULT_LINK_TIMING;
+  uint64_t product_id_arg = product_id;
+  uint64_t baud_rate = link.baud_rate;
+  uint64_t round_trip_us = link.round_trip_us;
+  if ((argc > 3 && !Schmi::ParseNumber(argv[3], product_id_arg, 0xFFFF, 0)) ||
+      (argc > 4 && (!Schmi::ParseNumber(argv[4], baud_rate, UINT32_MAX) || baud_rate == 0)) ||
+      (argc > 5 && !Schmi::ParseNumber(argv[5], round_trip_us, UINT32_MAX))) {
+    std::cerr << "ERROR: usage: --dry-run binary_file [product_id] [baud_rate] [round_trip_us]\n";
+    return EXIT_FAILURE;
+  }
+  product_id = product_id_arg;
+  link.baud_rate = baud_rate;
+  link.round_trip_us = round_trip_us;
 
-  Schmi::FlashLoader fl(&ser, &bin, &error, &bar);
+  Schmi::BinaryFileStd bin(argv[2], false);
+  bin.Init();
+  const Schmi::ChipTiming& chip = Schmi::FindChipTiming(product_id);
+  Schmi::FlashEstimator estimator(chip, Schmi::MakeCostModel(chip, link));
+  Schmi::FlashEstimate estimate = estimator.Estimate(bin.GetBinaryFileSize());
+  if (!estimate.completed) {
+    std::cerr << "ERROR: the session would fail, " << estimate.error.error_location << ": "
+              << estimate.error.error_string << "\n";
+    return EXIT_FAILURE;
+  }
 
-  fl.Init();
-  fl.Flash(true, false);
+  std::cout << "Dry run of " << argv[2] << " at " << link.baud_rate << " baud\n\n";
+  PrintPhase("connect:  ", estimate.connect);
+  PrintPhase("discover: ", estimate.discover);
+  PrintPhase("erase:    ", estimate.erase);
+  PrintPhase("write:    ", estimate.write);
+  PrintPhase("verify:   ", estimate.verify);
+  PrintPhase("go:       ", estimate.go);
+  std::cout << "\ntotal:    " << estimate.total_us / 1000 << " ms\n";
 
   return EXIT_SUCCESS;
 }
 
+// Serves flashing jobs on a Unix socket until SIGINT or SIGTERM, see FlashDaemon
+int RunDaemon(int argc, char* argv[], const RunnerOptions& options) {
+#ifndef __linux__
+  std::cerr << "ERROR: --daemon needs Linux\n";
+  return EXIT_FAILURE;
+#else
+  if (argc < 4) {
+    std::cerr << "ERROR: --daemon needs a socket path and at least one serial port\n";
+    return EXIT_FAILURE;
+  }
+
+  // Blocked before the daemon threads start so they inherit it, sigwait picks them up
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+  Schmi::FlashDaemon daemon(argv[2]);
+  std::vector<std::unique_ptr<Schmi::SerialInterface>> ports;
+  for (int ii = 3; ii < argc; ii++) {
+    ports.push_back(MakeSerial(argv[ii], nullptr));
+    daemon.AddPort(argv[ii], ports.back().get());
+
+    Schmi::IoThreadOptions port_options = options.io;
+    if (options.io.cpu >= 0) {
+      port_options.cpu = options.io.cpu + ii - 3;
+    }
+    daemon.SetIoThreadOptions(argv[ii], port_options);
+  }
+  daemon.SetInlineVerify(options.inline_verify);
+  Schmi::LinkScheduler link_scheduler(options.link_limits);
+  if (options.usb_links) {
+    for (int ii = 3; ii < argc; ii++) {
+      if (!link_scheduler.AddPort(argv[ii])) {
+        std::cerr << "WARNING: " << argv[ii] << " isn't on USB, it gets a link of its own\n";
+      }
+    }
+    daemon.SetLinkScheduler(&link_scheduler);
+  }
+  Schmi::ClockStd clock;
+  Schmi::Tracer tracer(clock);
+  if (!options.trace_file.empty()) {
+    daemon.SetTracer(&tracer);
+  }
+
+  if (!daemon.Start()) {
+    std::cerr << "ERROR: could not listen on " << argv[2] << "\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "Serving " << ports.size() << " ports on " << argv[2] << "\n";
+
+  int signal_number;
+  sigwait(&stop_signals, &signal_number);
+  daemon.Stop();
+  if (!options.trace_file.empty() && !tracer.WriteChromeTrace(options.trace_file)) {
+    std::cerr << "ERROR: could not write " << options.trace_file << "\n";
+  }
+
+  return EXIT_SUCCESS;
+#endif
+}
+
+// Flashes every board plugged in until SIGINT or SIGTERM, see PortWatcher and AutoFlasher
+int WatchPorts(int argc, char* argv[]) {
+#ifndef __linux__
+  std::cerr << "ERROR: --watch needs Linux, ports are found with inotify and sysfs\n";
+  return EXIT_FAILURE;
+#else
+  if (argc < 3) {
+    std::cerr << "ERROR: --watch needs a binary file\n";
+    return EXIT_FAILURE;
+  }
+
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+  Schmi::BinaryFileStd bin(argv[2], false);
+  bin.Init();
+  std::vector<uint8_t> image(bin.GetBinaryFileSize());
+  bin.GetBytesArray(image.data(), {(uint32_t)image.size(), 0});
+
+  // vid:pid[:serial] in hex, anything else is a pattern on the node name
+  Schmi::PortWatcher watcher;
+  for (int ii = 3; ii < argc; ii++) {
+    std::string arg = argv[ii];
+    Schmi::PortFilter filter = {"", 0, 0, ""};
+    size_t first_colon = arg.find(':');
+    if (first_colon == std::string::npos) {
+      filter.name_pattern = arg;
+    } else {
+      size_t second_colon = arg.find(':', first_colon + 1);
+      uint64_t vid = 0;
+      uint64_t pid = 0;
+      if (!Schmi::ParseNumber(arg.substr(0, first_colon), vid, 0xFFFF, 16) ||
+          !Schmi::ParseNumber(arg.substr(first_colon + 1, second_colon - first_colon - 1), pid, 0xFFFF, 16)) {
+        std::cerr << "ERROR: " << arg << " is not vid:pid[:serial] in hex\n";
+        return EXIT_FAILURE;
+      }
+      filter.vid = vid;
+      filter.pid = pid;
+      if (second_colon != std::string::npos) {
+        filter.serial = arg.substr(second_colon + 1);
+      }
+    }
+    watcher.AddFilter(filter);
+  }
+
+  std::mutex output_mutex;
+  Schmi::AutoFlasher flasher(
+      image,
+      [](const Schmi::SerialDeviceInfo& device) {
+        std::unique_ptr<Schmi::SerialPosix> ser(new Schmi::SerialPosix(device.path));
+        return ser->Open() ? std::unique_ptr<Schmi::SerialInterface>(std::move(ser)) : nullptr;
+      },
+      [&](const Schmi::AutoFlashResult& result) {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cout << result.device.path << ": ";
+        if (result.ok) {
+          std::cout << "OK in " << result.total_us / 1000 << " ms, started after " << result.start_delay_us / 1000
+                    << " ms\n";
+        } else {
+          std::cout << "FAILED " << result.error << "\n";
+        }
+      });
+
+  bool started = watcher.Start([&](const Schmi::SerialDeviceInfo& device) {
+    {
+      std::lock_guard<std::mutex> lock(output_mutex);
+      std::cout << device.path << ": flashing " << argv[2] << "\n";
+    }
+    flasher.Flash(device);
+  });
+  if (!started) {
+    std::cerr << "ERROR: cannot watch /dev\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "Waiting for boards, " << image.size() << " bytes to flash\n";
+
+  int signal_number;
+  sigwait(&stop_signals, &signal_number);
+  watcher.Stop();
+  flasher.Wait();
+
+  return EXIT_SUCCESS;
+#endif
+}
+
 void DisplayAsciiArt(const std::string& file_name) {
   try {
     std::ifstream reader(file_name);
@@ -68,3 +525,115 @@ std::string GetTextFileContents(std::ifstream& file) {
   file.close();
   return lines;
 }
+
+// Copies images into a store, hashing them on every core
+int IngestImages(int argc, char* argv[]) {
+  if (argc < 4) {
+    std::cerr << "ERROR: --ingest needs a store directory and images\n";
+    return EXIT_FAILURE;
+  }
+
+  Schmi::ImageStore store(argv[2]);
+  if (!store.Init()) {
+    std::cerr << "ERROR: could not open the store " << argv[2] << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> paths;
+  for (int ii = 3; ii < argc; ii++) {
+    std::vector<std::string> listed = Schmi::ImageStore::ListImages(argv[ii]);
+    if (listed.empty()) {
+      paths.push_back(argv[ii]);
+    }
+    paths.insert(paths.end(), listed.begin(), listed.end());
+  }
+
+  std::vector<std::string> errors;
+  size_t num_new = store.Ingest(paths, errors);
+  for (auto& error : errors) {
+    std::cerr << "ERROR: " << error << "\n";
+  }
+  std::cout << num_new << " new images, " << store.GetNumImages() << " in " << argv[2] << "\n";
+
+  return errors.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// A 16 digit key is a hash, anything else a product ID like 0x1000
+std::shared_ptr<Schmi::BinaryFileMapped> OpenStoreImage(const std::string& store_dir, const std::string& key) {
+  Schmi::ImageStore store(store_dir);
+  if (!store.Init()) {
+    std::cerr << "ERROR: could not open the store " << store_dir << "\n";
+    return nullptr;
+  }
+
+  std::shared_ptr<Schmi::BinaryFileMapped> image;
+  if (key.size() == 16) {
+    image = store.Open(key);
+  } else {
+    uint64_t product_id = 0;
+    if (Schmi::ParseNumber(key, product_id, UINT32_MAX, 0)) {
+      image = store.OpenProduct(product_id);
+    }
+  }
+  if (!image) {
+    std::cerr << "ERROR: no image " << key << " in " << store_dir << "\n";
+  }
+
+  return image;
+}
+
+// A device node, or a serial server for tcp:host:port and rfc2217:host:port
+std::unique_ptr<Schmi::SerialInterface> MakeSerial(const std::string& name, Schmi::EventRing* events) {
+  std::string host;
+  uint16_t port = 0;
+  Schmi::SerialTcpOptions tcp_options;
+  if (Schmi::SerialTcp::ParseAddress(name, host, port, tcp_options.rfc2217)) {
+    std::unique_ptr<Schmi::SerialTcp> ser(new Schmi::SerialTcp(host, port, tcp_options));
+    ser->SetEventRing(events);
+    return ser;
+  }
+
+  std::unique_ptr<Schmi::SerialPosix> ser(new Schmi::SerialPosix(name));
+  ser->SetEventRing(events);
+  return ser;
+}
+
+// Copies the flash of the board on the first port onto the boards on the others, see BoardCloner
+int CloneBoard(int argc, char* argv[]) {
+  if (argc < 5) {
+    std::cerr << "ERROR: --clone needs a source port, a size and at least one target port\n";
+    return EXIT_FAILURE;
+  }
+
+  uint64_t num_bytes = 0;
+  if (!Schmi::ParseNumber(argv[3], num_bytes, UINT32_MAX, 0) || num_bytes == 0) {
+    std::cerr << "ERROR: --clone needs the number of bytes to copy, not " << argv[3] << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<Schmi::SerialInterface> source = MakeSerial(argv[2], nullptr);
+  Schmi::BoardCloner cloner(source.get(), 0x08000000, num_bytes);
+  std::vector<std::unique_ptr<Schmi::SerialInterface>> targets;
+  for (int ii = 4; ii < argc; ii++) {
+    targets.push_back(MakeSerial(argv[ii], nullptr));
+    cloner.AddTarget(argv[ii], targets.back().get());
+  }
+
+  Schmi::CloneReport report = cloner.Run();
+  if (!report.source_ok) {
+    std::cerr << "ERROR: " << argv[2] << ": " << report.source_error << "\n";
+  } else {
+    std::cout << argv[2] << ": read " << report.num_bytes << " bytes in " << report.read_us / 1000 << " ms ("
+              << report.producer_wait_us / 1000 << " ms waiting for the targets), crc " << std::hex
+              << report.source_crc << std::dec << "\n";
+  }
+
+  bool all_ok = report.source_ok;
+  for (const Schmi::CloneTargetResult& target : report.targets) {
+    all_ok = all_ok && target.ok;
+    std::cout << target.name << ": " << (target.ok ? "OK " : "FAIL ") << target.total_us / 1000 << " ms"
+              << (target.ok ? "" : ", " + target.error) << "\n";
+  }
+
+  return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,214 @@
+#include "Schmi/port_watcher.hpp"
+
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fstream>
+
+namespace Schmi {
+
+namespace {
+
+const char* DEFAULT_NAME_PATTERNS[] = {"ttyUSB*", "ttyACM*"};
+
+// Levels from the tty up to its USB device: interface, device, and a hub or two on the way
+const uint8_t MAX_USB_PARENTS = 6;
+
+bool ReadAttribute(const std::string& path, std::string& value) {
+  std::ifstream file(path);
+  if (!std::getline(file, value)) {
+    return 0;
+  }
+
+  return 1;
+}
+
+bool ReadHexAttribute(const std::string& path, uint16_t& value) {
+  std::string text;
+  if (!ReadAttribute(path, text)) {
+    return 0;
+  }
+  value = strtoul(text.c_str(), nullptr, 16);
+
+  return 1;
+}
+}  // namespace
+
+bool MatchesFilter(const SerialDeviceInfo& device, const PortFilter& filter) {
+  if (!filter.name_pattern.empty() && fnmatch(filter.name_pattern.c_str(), device.name.c_str(), 0) != 0) {
+    return 0;
+  }
+  if ((filter.vid && filter.vid != device.vid) || (filter.pid && filter.pid != device.pid)) {
+    return 0;
+  }
+  if (!filter.serial.empty() && filter.serial != device.serial) {
+    return 0;
+  }
+
+  return 1;
+}
+
+bool PortWatcher::Start(const DeviceCallback& on_added, const DeviceCallback& on_removed,
+                        const bool& include_present) {
+  if (running_) {
+    return 0;
+  }
+  on_added_ = on_added;
+  on_removed_ = on_removed;
+
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    return 0;
+  }
+  // Watched before the scan, a node plugged in between is seen twice at worst, present_ drops that
+  if (inotify_add_watch(inotify_fd_, dev_dir_.c_str(), IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0 ||
+      pipe(stop_pipe_) < 0) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+    return 0;
+  }
+
+  present_.clear();
+  std::vector<std::string> names;
+  if (include_present) {
+    DIR* dir = opendir(dev_dir_.c_str());
+    if (dir) {
+      while (dirent* entry = readdir(dir)) {
+        names.push_back(entry->d_name);
+      }
+      closedir(dir);
+    }
+  }
+
+  running_ = true;
+  thread_ = std::thread([this, names] {
+    for (auto& name : names) {
+      NodeAdded(name);
+    }
+    Watch();
+  });
+
+  return 1;
+}
+
+void PortWatcher::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+
+  char stop = 0;
+  if (write(stop_pipe_[1], &stop, 1) < 0) {
+    perror("PortWatcher::Stop");
+  }
+  thread_.join();
+
+  close(inotify_fd_);
+  close(stop_pipe_[0]);
+  close(stop_pipe_[1]);
+  inotify_fd_ = -1;
+
+  return;
+}
+
+void PortWatcher::Watch() {
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    pollfd fds[2] = {{stop_pipe_[0], POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents) {
+      return;
+    }
+
+    ssize_t num_bytes = read(inotify_fd_, buffer, sizeof(buffer));
+    for (ssize_t pos = 0; pos < num_bytes;) {
+      const inotify_event* event = (const inotify_event*)(buffer + pos);
+      pos += sizeof(inotify_event) + event->len;
+      if (event->len == 0) {
+        continue;
+      }
+
+      if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        NodeAdded(event->name);
+      } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        NodeRemoved(event->name);
+      }
+    }
+  }
+}
+
+void PortWatcher::NodeAdded(const std::string& name) {
+  if (name[0] == '.' || present_.count(name)) {
+    return;
+  }
+
+  SerialDeviceInfo device = {dev_dir_ + "/" + name, name, 0, 0, ""};
+  ReadUsbInfo(name, device);
+  if (!Matches(device)) {
+    return;
+  }
+
+  present_.insert(name);
+  on_added_(device);
+
+  return;
+}
+
+void PortWatcher::NodeRemoved(const std::string& name) {
+  if (!present_.erase(name)) {
+    return;
+  }
+
+  if (on_removed_) {
+    SerialDeviceInfo device = {dev_dir_ + "/" + name, name, 0, 0, ""};
+    on_removed_(device);
+  }
+
+  return;
+}
+
+bool PortWatcher::ReadUsbInfo(const std::string& name, SerialDeviceInfo& device) const {
+  char resolved[PATH_MAX];
+  std::string link = sysfs_tty_dir_ + "/" + name + "/device";
+  if (!realpath(link.c_str(), resolved)) {
+    return 0;
+  }
+
+  std::string dir = resolved;
+  for (uint8_t ii = 0; ii < MAX_USB_PARENTS && dir.size() > 1; ii++) {
+    if (ReadHexAttribute(dir + "/idVendor", device.vid)) {
+      ReadHexAttribute(dir + "/idProduct", device.pid);
+      ReadAttribute(dir + "/serial", device.serial);
+      return 1;
+    }
+    dir = dir.substr(0, dir.rfind('/'));
+  }
+
+  return 0;
+}
+
+bool PortWatcher::Matches(const SerialDeviceInfo& device) const {
+  if (filters_.empty()) {
+    for (const char* pattern : DEFAULT_NAME_PATTERNS) {
+      if (fnmatch(pattern, device.name.c_str(), 0) == 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  for (auto& filter : filters_) {
+    if (MatchesFilter(device, filter)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+}  // namespace Schmi
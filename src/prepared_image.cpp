@@ -0,0 +1,117 @@
+#include "Schmi/prepared_image.hpp"
+
+#include <string.h>
+
+namespace Schmi {
+
+const uint16_t PreparedImage::CHUNK_SIZE;
+
+PreparedImage::PreparedImage(BinaryFileInterface& bin) {
+  bin.Init();
+  bytes_.resize(bin.GetBinaryFileSize());
+
+  // In chunks, a stream may not hand out more than that at once
+  for (uint64_t pos = 0; pos < bytes_.size(); pos += CHUNK_SIZE) {
+    uint32_t num_bytes = bytes_.size() - pos < CHUNK_SIZE ? bytes_.size() - pos : CHUNK_SIZE;
+    bin.GetBytesArray(&bytes_[pos], {num_bytes, pos});
+  }
+  BuildFrames();
+}
+
+PreparedImage::PreparedImage(const std::vector<uint8_t>& bytes) : bytes_(bytes) { BuildFrames(); }
+
+void PreparedImage::BuildFrames() {
+  uint32_t num_chunks = (bytes_.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  frames_.resize((uint64_t)num_chunks * Stm32::MAX_WRITE_FRAME_SIZE);
+  frame_lengths_.resize(num_chunks);
+
+  for (uint32_t chunk = 0; chunk < num_chunks; chunk++) {
+    uint64_t pos = (uint64_t)chunk * CHUNK_SIZE;
+    uint16_t num_bytes = bytes_.size() - pos < CHUNK_SIZE ? bytes_.size() - pos : CHUNK_SIZE;
+    frame_lengths_[chunk] =
+        Stm32::BuildWriteFrame(&bytes_[pos], num_bytes, &frames_[(uint64_t)chunk * Stm32::MAX_WRITE_FRAME_SIZE]);
+  }
+
+  return;
+}
+
+bool PatchedImage::AddPatch(const uint64_t& offset, const uint8_t* bytes, const uint32_t& num_bytes) {
+  if (offset + num_bytes > image_->GetSize()) {
+    return 0;
+  }
+
+  uint64_t end = offset + num_bytes;
+  for (uint64_t pos = offset; pos < end;) {
+    uint32_t chunk = pos / PreparedImage::CHUNK_SIZE;
+    uint64_t chunk_start = (uint64_t)chunk * PreparedImage::CHUNK_SIZE;
+    uint64_t chunk_end = chunk_start + PreparedImage::CHUNK_SIZE < end ? chunk_start + PreparedImage::CHUNK_SIZE : end;
+
+    // Chunks are copied from the prepared image the first time a patch touches them
+    auto it = chunks_.find(chunk);
+    if (it == chunks_.end()) {
+      it = chunks_.emplace(chunk, Chunk()).first;
+      memcpy(it->second.frame, image_->GetFrame(chunk), image_->GetFrameLength(chunk));
+    }
+    Chunk& patched = it->second;
+
+    memcpy(patched.frame + 1 + (pos - chunk_start), bytes + (pos - offset), chunk_end - pos);
+    uint16_t chunk_bytes = image_->GetSize() - chunk_start < PreparedImage::CHUNK_SIZE ? image_->GetSize() - chunk_start
+                                                                                        : PreparedImage::CHUNK_SIZE;
+    patched.frame_length = Stm32::BuildWriteFrame(patched.frame + 1, chunk_bytes, patched.frame);
+
+    pos = chunk_end;
+  }
+
+  return 1;
+}
+
+void PatchedImage::GetBytesArray(uint8_t* bytes, const BytesData& bytes_data) {
+  // Past the end, like CloneStreamReader: erased bytes the verify will catch
+  if (bytes_data.starting_byte > image_->GetSize() ||
+      bytes_data.num_bytes > image_->GetSize() - bytes_data.starting_byte) {
+    memset(bytes, 0xFF, bytes_data.num_bytes);
+    return;
+  }
+
+  memcpy(bytes, image_->GetBytes() + bytes_data.starting_byte, bytes_data.num_bytes);
+
+  // Then the patched chunks the range overlaps
+  uint64_t end = bytes_data.starting_byte + bytes_data.num_bytes;
+  uint32_t first_chunk = bytes_data.starting_byte / PreparedImage::CHUNK_SIZE;
+  for (auto it = chunks_.lower_bound(first_chunk); it != chunks_.end(); it++) {
+    uint64_t chunk_start = (uint64_t)it->first * PreparedImage::CHUNK_SIZE;
+    if (chunk_start >= end) {
+      break;
+    }
+
+    uint64_t from = chunk_start > bytes_data.starting_byte ? chunk_start : bytes_data.starting_byte;
+    uint64_t to = chunk_start + PreparedImage::CHUNK_SIZE < end ? chunk_start + PreparedImage::CHUNK_SIZE : end;
+    memcpy(bytes + (from - bytes_data.starting_byte), it->second.frame + 1 + (from - chunk_start), to - from);
+  }
+
+  return;
+}
+
+const uint8_t* PatchedImage::GetWriteFrame(const BytesData& bytes_data, uint16_t& frame_length) {
+  // Only whole chunks have a frame, writes cut another way are built as usual
+  if (bytes_data.starting_byte >= image_->GetSize()) {
+    return nullptr;
+  }
+  uint32_t chunk = bytes_data.starting_byte / PreparedImage::CHUNK_SIZE;
+  uint64_t chunk_start = (uint64_t)chunk * PreparedImage::CHUNK_SIZE;
+  uint64_t chunk_bytes = image_->GetSize() - chunk_start < PreparedImage::CHUNK_SIZE ? image_->GetSize() - chunk_start
+                                                                                      : PreparedImage::CHUNK_SIZE;
+  if (bytes_data.starting_byte != chunk_start || bytes_data.num_bytes != chunk_bytes) {
+    return nullptr;
+  }
+
+  auto it = chunks_.find(chunk);
+  if (it != chunks_.end()) {
+    frame_length = it->second.frame_length;
+    return it->second.frame;
+  }
+  frame_length = image_->GetFrameLength(chunk);
+
+  return image_->GetFrame(chunk);
+}
+}  // namespace Schmi
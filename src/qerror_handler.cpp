@@ -1,23 +1,44 @@
 #include "iq_flasher/include/Schmi/qerror_handler.hpp"
 
+#include "iq_flasher/include/Schmi/event_ring_session.hpp"
+
 namespace Schmi {
 void ErrorHandlerStd::Init(const Error& error) { error_ = error; }
 
 void ErrorHandlerStd::Display() {
-  std::ostringstream error;
-  error << error_.error_location << ": ";
-  error << error_.error_string << " - ";
-
-  iv.label_message->setText(QString::fromStdString(error.str()));
-  iv.pcon->AddToLog(QString::fromStdString(error.str()));
+  if (events_) {
+    events_->Push(MakeErrorEvent(EventKind::kWarning, error_));
+    return;
+  }
+  iv.label_message->setText(GetText());
+  iv.pcon->AddToLog(GetText());
 }
 
 void ErrorHandlerStd::DisplayAndDie() {
+  if (events_) {
+    events_->Push(MakeErrorEvent(EventKind::kError, error_));
+  } else {
+    iv.pcon->AddToLog(GetText());
+  }
+  throw GetText();
+}
+
+void ErrorHandlerStd::ShowEvent(const SessionEvent& event) {
+  if (event.kind == EventKind::kWarning) {
+    iv.label_message->setText(QString(event.text));
+    iv.pcon->AddToLog(QString(event.text));
+  } else if (event.kind == EventKind::kError) {
+    iv.pcon->AddToLog(QString(event.text));
+  }
+
+  return;
+}
+
+QString ErrorHandlerStd::GetText() const {
   std::ostringstream error;
   error << error_.error_location << ": ";
   error << error_.error_string << " - ";
 
-  iv.pcon->AddToLog(QString::fromStdString(error.str()));
-  throw QString::fromStdString(error.str());
+  return QString::fromStdString(error.str());
 }
 };  // namespace Schmi
@@ -3,61 +3,45 @@
 namespace Schmi {
 
 int SerialPosix::Write(uint8_t* buffer, const uint16_t& buffer_length) {
-  try {
-    int num_bytes_written = write(usb_flag_, buffer, buffer_length);
-    tcdrain(usb_flag_);
-
-    CheckNumBytesWritten(num_bytes_written, buffer_length);
+  int num_bytes_written = write(usb_flag_, buffer, buffer_length);
+  tcdrain(usb_flag_);
 
-  } catch (const StdException& e) {
-    std::cerr << e.what() << '\n';
+  if (num_bytes_written != buffer_length) {
+    Report("Error writting bytes", num_bytes_written);
     return -1;
   }
 
   return 0;
 }
 
-void SerialPosix::CheckNumBytesWritten(const int& num_bytes_written, const uint16_t& buffer_length) {
-  if (num_bytes_written != buffer_length) {
-    std::stringstream err_message;
-    err_message << "Error writting bytes: " << num_bytes_written;
-    err_message << " / wanted to write: " << (int)buffer_length;
-    throw Schmi::StdException(err_message.str());
-  }
-}
-
 int SerialPosix::Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) {
   SerialReadData read_data = {buffer, num_bytes};
-  try {
-    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    while (read_data.bytes_left) {
-      if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(timeout_ms)) {
-        std::stringstream err_message;
-        err_message << "Read Timout: " << timeout_ms;
-        throw Schmi::StdException(err_message.str());
-      }
-
-      int num_bytes_read = read(usb_flag_, read_data.buffer, read_data.bytes_left);
-
-      CheckNumBytesRead(num_bytes_read);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (read_data.bytes_left) {
+    if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(timeout_ms)) {
+      Report("Read Timout", timeout_ms);
+      return -1;
+    }
 
-      UpdateSerialReadData(read_data, num_bytes_read);
+    int num_bytes_read = read(usb_flag_, read_data.buffer, read_data.bytes_left);
+    if (num_bytes_read < 0) {
+      Report("Error reading bytes", num_bytes_read);
+      return -1;
     }
 
-  } catch (const StdException& e) {
-    std::cerr << e.what() << '\n';
-    return -1;
+    UpdateSerialReadData(read_data, num_bytes_read);
   }
 
   return 0;
 }
 
-void SerialPosix::CheckNumBytesRead(const int& num_bytes_read) {
-  if (num_bytes_read < 0) {
-    std::stringstream err_message;
-    err_message << "Error reading bytes: " << num_bytes_read;
-    throw Schmi::StdException(err_message.str());
+void SerialPosix::Report(const char* message, const int& num) {
+  // No formatting on the I/O path with a ring, whoever drains it prints
+  if (events_) {
+    events_->Push(EventKind::kWarning, num, 0, message);
+    return;
   }
+  std::cerr << message << ": " << num << '\n';
 
   return;
 }
@@ -70,14 +54,41 @@ void SerialPosix::UpdateSerialReadData(SerialReadData& read_data, const int& num
 }
 
 void SerialPosix::Init() {
+  if (!Open()) {
+    exit(EXIT_FAILURE);
+  }
+
+  return;
+}
+
+bool SerialPosix::Open() {
+  // Already open and configured, a long running owner like FlashDaemon keeps the port warm
+  // between boards instead of paying open and tcsetattr every time
+  if (usb_flag_ >= 0) {
+    return 1;
+  }
+
+  int usb_flag = -1;
   try {
-    int usb_flag = OpenPort();
+    usb_flag = OpenPort();
     SetAttributes(usb_flag);
     usb_flag_ = usb_flag;
 
   } catch (const StdException& e) {
-    std::cerr << "ERROR: " << e.what() << "\n";
-    exit(EXIT_FAILURE);
+    std::cerr << "ERROR: " << usb_handle_ << ": " << e.what() << "\n";
+    if (usb_flag >= 0) {
+      close(usb_flag);
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+void SerialPosix::Close() {
+  if (usb_flag_ >= 0) {
+    close(usb_flag_);
+    usb_flag_ = -1;
   }
 
   return;
@@ -99,7 +110,7 @@ void SerialPosix::SetAttributes(const int& usb_flag) {
   struct termios tty;
 
   GetTerminalAttributes(usb_flag, tty);
-  SetBaudRate(tty);
+  SetBaudRate(tty, SerialConst::BAUD_RATE);
   SetTerminalAttributes(usb_flag, tty);
 
   return;
@@ -115,13 +126,48 @@ void SerialPosix::GetTerminalAttributes(const int& usb_flag, struct termios& tty
   return;
 }
 
-void SerialPosix::SetBaudRate(struct termios& tty) {
-  cfsetospeed(&tty, SerialConst::BAUD_RATE);
-  cfsetispeed(&tty, SerialConst::BAUD_RATE);
+void SerialPosix::SetBaudRate(struct termios& tty, const speed_t& speed) {
+  cfsetospeed(&tty, speed);
+  cfsetispeed(&tty, speed);
 
   return;
 }
 
+bool SerialPosix::SetBaudRate(const uint32_t& baud_rate) {
+  const struct {
+    uint32_t baud_rate;
+    speed_t speed;
+  } speeds[] = {{115200, B115200},   {230400, B230400},   {460800, B460800},   {921600, B921600},
+                {1000000, B1000000}, {1500000, B1500000}, {2000000, B2000000}, {3000000, B3000000}};
+
+  speed_t speed = 0;
+  for (const auto& entry : speeds) {
+    if (entry.baud_rate == baud_rate) {
+      speed = entry.speed;
+    }
+  }
+  if (speed == 0) {
+    return 0;
+  }
+
+  try {
+    struct termios tty;
+    GetTerminalAttributes(usb_flag_, tty);
+    SetBaudRate(tty, speed);
+    if (tcsetattr(usb_flag_, TCSADRAIN, &tty) != 0) {
+      std::stringstream err_message;
+      err_message << "Error from tcsetattr: " << std::strerror(errno);
+      throw Schmi::StdException(err_message.str());
+    }
+
+  } catch (const StdException& e) {
+    std::cerr << e.what() << '\n';
+    return 0;
+  }
+
+  return 1;
+}
+
 void SerialPosix::SetTerminalAttributes(const int& usb_flag, struct termios& tty) {
   // These settings are similar to cfmakeraw(tty) with parity bit set
   // I wrote them explicitly for better understanding
@@ -0,0 +1,291 @@
+#include "Schmi/serial_tcp.hpp"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace Schmi {
+
+const uint32_t SerialTcp::RECEIVE_SIZE;
+
+SerialTcp::~SerialTcp() { Close(); }
+
+void SerialTcp::Init() {
+  if (!Open()) {
+    exit(EXIT_FAILURE);
+  }
+
+  return;
+}
+
+bool SerialTcp::Open() {
+  // Kept open from board to board like SerialPosix
+  if (fd_ >= 0) {
+    return 1;
+  }
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &addresses) != 0) {
+    std::cerr << "ERROR: " << host_ << ": unknown host\n";
+    return 0;
+  }
+  // close and freeaddrinfo may change errno, the reason is kept from where it failed
+  int error = 0;
+  for (addrinfo* address = addresses; address && fd_ < 0; address = address->ai_next) {
+    fd_ = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+    if (fd_ < 0) {
+      error = errno;
+    } else if (connect(fd_, address->ai_addr, address->ai_addrlen) != 0) {
+      error = errno;
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd_ < 0) {
+    std::cerr << "ERROR: " << host_ << ":" << port_ << ": " << std::strerror(error) << "\n";
+    return 0;
+  }
+
+  int on = options_.no_delay;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  input_.clear();
+  input_pos_ = 0;
+  decoder_.Reset();
+
+  if (options_.rfc2217) {
+    // 8 data bits, even parity, 1 stop bit: what the AN3155 bootloader talks
+    std::vector<uint8_t> setup;
+    Telnet::AppendNegotiation(Telnet::WILL, Telnet::BINARY, setup);
+    Telnet::AppendNegotiation(Telnet::DO, Telnet::BINARY, setup);
+    Telnet::AppendNegotiation(Telnet::WILL, Telnet::COM_PORT_OPTION, setup);
+    Telnet::AppendSubnegotiation(Telnet::COM_PORT_OPTION, {Telnet::SET_DATASIZE, 8}, setup);
+    Telnet::AppendSubnegotiation(Telnet::COM_PORT_OPTION, {Telnet::SET_PARITY, Telnet::PARITY_EVEN}, setup);
+    Telnet::AppendSubnegotiation(Telnet::COM_PORT_OPTION, {Telnet::SET_STOPSIZE, 1}, setup);
+    if (!Send(setup.data(), setup.size()) || !SetBaudRate(options_.baud_rate)) {
+      std::cerr << "ERROR: " << host_ << ":" << port_ << ": no RFC 2217 answer\n";
+      close(fd_);
+      fd_ = -1;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void SerialTcp::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  return;
+}
+
+int SerialTcp::Write(uint8_t* buffer, const uint16_t& buffer_length) {
+  const uint8_t* bytes = buffer;
+  size_t num_bytes = buffer_length;
+  if (options_.rfc2217) {
+    output_.clear();
+    Telnet::AppendEscaped(buffer, buffer_length, output_);
+    bytes = output_.data();
+    num_bytes = output_.size();
+  }
+
+  if (!Send(bytes, num_bytes)) {
+    Report("Error writting bytes", errno);
+    return -1;
+  }
+
+  return 0;
+}
+
+int SerialTcp::Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) {
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (input_.size() - input_pos_ < num_bytes) {
+    int64_t left_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    // A closed connection isn't waited on, the next Open connects again
+    if (fd_ < 0) {
+      Report("Connection closed", 0);
+      return -1;
+    }
+    if (left_ms < 0 || (!Receive(left_ms) && fd_ >= 0)) {
+      Report("Read Timout", timeout_ms);
+      return -1;
+    }
+  }
+
+  memcpy(buffer, input_.data() + input_pos_, num_bytes);
+  input_pos_ += num_bytes;
+  if (input_pos_ == input_.size()) {
+    input_.clear();
+    input_pos_ = 0;
+  }
+
+  return 0;
+}
+
+bool SerialTcp::SetBaudRate(const uint32_t& baud_rate) {
+  if (!options_.rfc2217 || fd_ < 0) {
+    return 0;
+  }
+
+  confirmed_baud_rate_ = 0;
+  std::vector<uint8_t> value = {uint8_t(baud_rate >> 24), uint8_t(baud_rate >> 16), uint8_t(baud_rate >> 8),
+                                uint8_t(baud_rate)};
+  if (!SendComPortOption(Telnet::SET_BAUDRATE, value)) {
+    return 0;
+  }
+
+  // The data already on its way stays in input_ for the next Read
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+  while (confirmed_baud_rate_ == 0 && std::chrono::steady_clock::now() < deadline) {
+    Receive(50);
+  }
+
+  return confirmed_baud_rate_ == baud_rate;
+}
+
+void SerialTcp::FlushInput() {
+  input_.clear();
+  input_pos_ = 0;
+  while (Receive(0)) {
+    input_.clear();
+    input_pos_ = 0;
+  }
+
+  return;
+}
+
+bool SerialTcp::ParseAddress(const std::string& name, std::string& host, uint16_t& port, bool& rfc2217) {
+  size_t scheme_end = name.find(':');
+  size_t port_start = name.rfind(':');
+  if (scheme_end == std::string::npos || scheme_end == port_start) {
+    return 0;
+  }
+  std::string scheme = name.substr(0, scheme_end);
+  if (scheme != "tcp" && scheme != "rfc2217") {
+    return 0;
+  }
+
+  host = name.substr(scheme_end + 1, port_start - scheme_end - 1);
+  char* end = nullptr;
+  unsigned long value = strtoul(name.c_str() + port_start + 1, &end, 10);
+  if (host.empty() || *end != '\0' || value == 0 || value > 65535) {
+    return 0;
+  }
+  port = value;
+  rfc2217 = scheme == "rfc2217";
+
+  return 1;
+}
+
+bool SerialTcp::Receive(const int& timeout_ms) {
+  pollfd pfd = {fd_, POLLIN, 0};
+  if (poll(&pfd, 1, timeout_ms) <= 0) {
+    return 0;
+  }
+
+  uint8_t bytes[RECEIVE_SIZE];
+  ssize_t num_bytes = recv(fd_, bytes, sizeof(bytes), 0);
+  if (num_bytes < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return 0;
+  }
+  if (num_bytes <= 0) {
+    Close();
+    return 0;
+  }
+  // The kernel drops back to delayed ACKs on its own, it has to be asked again every time
+  if (options_.quick_ack) {
+    int on = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+  }
+
+  if (!options_.rfc2217) {
+    input_.insert(input_.end(), bytes, bytes + num_bytes);
+    return 1;
+  }
+  decoder_.Decode(bytes, num_bytes, input_, commands_);
+  HandleCommands();
+
+  return 1;
+}
+
+bool SerialTcp::Send(const uint8_t* bytes, const size_t& num_bytes) {
+  size_t num_sent = 0;
+  while (num_sent < num_bytes) {
+    ssize_t sent = send(fd_, bytes + num_sent, num_bytes - num_sent, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return 0;
+    }
+    num_sent += sent;
+  }
+
+  return 1;
+}
+
+void SerialTcp::HandleCommands() {
+  std::vector<uint8_t> answers;
+  for (const Telnet::Command& command : commands_) {
+    if (command.verb == Telnet::SB) {
+      if (command.option == Telnet::COM_PORT_OPTION && command.payload.size() == 5 &&
+          command.payload[0] == Telnet::SET_BAUDRATE + Telnet::SERVER_OFFSET) {
+        confirmed_baud_rate_ = (command.payload[1] << 24) | (command.payload[2] << 16) | (command.payload[3] << 8) |
+                               command.payload[4];
+      }
+      continue;
+    }
+
+    // Only binary and the COM port option are agreed to, and only what was asked is answered
+    bool wanted = command.option == Telnet::BINARY || command.option == Telnet::COM_PORT_OPTION;
+    if (command.verb == Telnet::DO && !wanted) {
+      Telnet::AppendNegotiation(Telnet::WONT, command.option, answers);
+    } else if (command.verb == Telnet::WILL && !wanted) {
+      Telnet::AppendNegotiation(Telnet::DONT, command.option, answers);
+    }
+  }
+  commands_.clear();
+
+  if (!answers.empty()) {
+    Send(answers.data(), answers.size());
+  }
+
+  return;
+}
+
+bool SerialTcp::SendComPortOption(const uint8_t& command, const std::vector<uint8_t>& value) {
+  std::vector<uint8_t> payload = {command};
+  payload.insert(payload.end(), value.begin(), value.end());
+  std::vector<uint8_t> frame;
+  Telnet::AppendSubnegotiation(Telnet::COM_PORT_OPTION, payload, frame);
+
+  return Send(frame.data(), frame.size());
+}
+
+void SerialTcp::Report(const char* message, const int& num) {
+  if (events_) {
+    events_->Push(EventKind::kWarning, num, 0, message);
+    return;
+  }
+  std::cerr << message << ": " << num << '\n';
+
+  return;
+}
+}  // namespace Schmi
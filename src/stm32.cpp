@@ -2,6 +2,11 @@
 
 namespace Schmi {
 
+const uint8_t Stm32::CONNECT_MAX_ATTEMPTS;
+const uint16_t Stm32::CONNECT_MIN_TIMEOUT_MS;
+const uint16_t Stm32::CONNECT_MAX_TIMEOUT_MS;
+const uint16_t Stm32::MAX_WRITE_FRAME_SIZE;
+
 bool Stm32::InitUsart() {
   if (!SendCmd(CMD::USART_INIT)) {
     return 0;
@@ -10,14 +15,95 @@ bool Stm32::InitUsart() {
   return 1;
 }
 
+bool Stm32::Connect(ConnectResult& result) {
+  TraceSpan span(tracer_, trace_port_, "CONNECT", "stm32");
+  result = {0, false, 0};
+  uint64_t start_us = clock_ ? clock_->NowUs() : 0;
+  uint16_t timeout_ms = connect_timeout_ms_;
+
+  uint8_t message[2];
+  memcpy(message, CMD::USART_INIT, 2);
+
+  while (result.attempts < CONNECT_MAX_ATTEMPTS) {
+    result.attempts++;
+
+    // Leftovers of an aborted session, or a late answer to the previous attempt
+    ser_.FlushInput();
+    uint64_t attempt_us = clock_ ? clock_->NowUs() : 0;
+    if (!SendBytes(message, 2)) {
+      return 0;
+    }
+
+    // Not through ReadBytes, a miss here is expected and not worth an error
+    uint8_t answer;
+    if (ser_.Read(&answer, 1, timeout_ms) != 0) {
+      timeout_ms = timeout_ms * 2 < CONNECT_MAX_TIMEOUT_MS ? timeout_ms * 2 : CONNECT_MAX_TIMEOUT_MS;
+      continue;
+    }
+
+    // A synced bootloader takes 0x7F 0x00 for a command with a bad complement
+    if (answer != CMD::ACK && answer != CMD::NACK) {
+      continue;
+    }
+    result.was_synced = answer == CMD::NACK;
+
+    if (clock_) {
+      uint64_t now_us = clock_->NowUs();
+      result.latency_us = now_us - start_us;
+
+      uint32_t next_timeout_ms = 4 * (now_us - attempt_us) / 1000 + 1;
+      if (next_timeout_ms < CONNECT_MIN_TIMEOUT_MS) next_timeout_ms = CONNECT_MIN_TIMEOUT_MS;
+      if (next_timeout_ms > CONNECT_MAX_TIMEOUT_MS) next_timeout_ms = CONNECT_MAX_TIMEOUT_MS;
+      connect_timeout_ms_ = next_timeout_ms;
+    }
+
+    return 1;
+  }
+
+  Schmi::Error err = {"Connect", "No answer to sync", result.attempts};
+  error_handler_.Init(err);
+  error_handler_.DisplayAndDie();
+  return 0;
+}
+
+bool Stm32::Get(BootloaderCommands& commands) {
+  TraceSpan span(tracer_, trace_port_, "GET", "stm32");
+  if (!SendCmd(CMD::GET)) {
+    return 0;
+  }
+
+  // N = number of bytes to follow - 1, the version then one byte per command
+  uint8_t num_bytes;
+  if (!ReadData(&num_bytes, 1)) {
+    return 0;
+  }
+
+  uint16_t num_incoming_bytes = num_bytes + 1;
+  if (!ReadData(message_buffer, num_incoming_bytes)) {
+    return 0;
+  }
+  if (!CheckForAck()) {
+    return 0;
+  }
+
+  commands.version = message_buffer[0];
+  commands.num_commands = 0;
+  for (uint16_t ii = 1; ii < num_incoming_bytes && commands.num_commands < MAX_BOOTLOADER_COMMANDS; ii++) {
+    commands.commands[commands.num_commands++] = message_buffer[ii];
+  }
+
+  return 1;
+}
+
 bool Stm32::GetVersionAndReadProtection(VersionAndReadProtectionData& vrpd) {
+  TraceSpan span(tracer_, trace_port_, "GET_VER_PROTECT_STATUS", "stm32");
   if (!SendCmd(CMD::GET_VER_PROTECT_STATUS)) {
     return 0;
   }
 
   const uint8_t num_incoming_bytes = 4;
   uint8_t incoming_bytes[num_incoming_bytes];
-  if (!ReadBytes(incoming_bytes, num_incoming_bytes)) {
+  if (!ReadData(incoming_bytes, num_incoming_bytes)) {
     return 0;
   }
 
@@ -27,23 +113,28 @@ bool Stm32::GetVersionAndReadProtection(VersionAndReadProtectionData& vrpd) {
 }
 
 bool Stm32::GetID(uint16_t& id) {
+  TraceSpan span(tracer_, trace_port_, "GET_ID", "stm32");
   if (!SendCmd(CMD::GET_ID)) {
     return 0;
   }
 
   const uint8_t num_incoming_bytes = 4;
   uint8_t incoming_bytes[num_incoming_bytes];
-  if (!ReadBytes(incoming_bytes, num_incoming_bytes)) {
+  if (!ReadData(incoming_bytes, num_incoming_bytes)) {
     return 0;
   }
 
   id = (incoming_bytes[1] << 8) | incoming_bytes[2];
+  if (timeout_model_) {
+    timeout_model_->SetChip(id);
+  }
 
   return 1;
 }
 
 bool Stm32::ReadMemory(uint8_t* bytes_read_buffer, const uint16_t num_bytes_to_read,
                        const uint32_t& address) {
+  TraceSpan span(tracer_, trace_port_, "READ_MEMORY", "stm32");
     if (num_bytes_to_read > 256) {
     Schmi::Error err = {"ReadMemory", "num_bytes_to_read > 256", num_bytes_to_read};
     error_handler_.Init(err);
@@ -70,7 +161,7 @@ bool Stm32::ReadMemory(uint8_t* bytes_read_buffer, const uint16_t num_bytes_to_r
   }
 
   uint16_t num_incoming_bytes = num_bytes_to_read;
-  if (!ReadBytes(bytes_read_buffer, num_incoming_bytes)) {
+  if (!ReadData(bytes_read_buffer, num_incoming_bytes)) {
     return 0;
   }
 
@@ -78,6 +169,7 @@ bool Stm32::ReadMemory(uint8_t* bytes_read_buffer, const uint16_t num_bytes_to_r
 }
 
 bool Stm32::GoToAddress(const uint32_t& address) {
+  TraceSpan span(tracer_, trace_port_, "GO", "stm32");
   if (!SendCmd(Schmi::CMD::GO)) {
     return 0;
   }
@@ -90,6 +182,7 @@ bool Stm32::GoToAddress(const uint32_t& address) {
 }
 
 bool Stm32::WriteMemory(uint8_t* bytes, const uint16_t& num_bytes, const uint32_t& start_address) {
+  TraceSpan span(tracer_, trace_port_, "WRITE_MEMORY", "stm32");
   if (!SendCmd(CMD::WRITE_MEMORY)) {
     return 0;
   }
@@ -105,11 +198,26 @@ bool Stm32::WriteMemory(uint8_t* bytes, const uint16_t& num_bytes, const uint32_
   return 1;
 }
 
-bool Stm32::ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages) {
-  if (!SendCmd(CMD::EXTEND_ERASE)) {
+bool Stm32::WriteMemoryFrame(const uint8_t* frame, const uint16_t& frame_length, const uint32_t& start_address) {
+  TraceSpan span(tracer_, trace_port_, "WRITE_MEMORY", "stm32");
+  if (!SendCmd(CMD::WRITE_MEMORY)) {
     return 0;
   }
 
+  if (!SendAddressMessage(start_address)) {
+    return 0;
+  }
+
+  // Only read from, the port takes a non-const buffer
+  if (!SendMessage(const_cast<uint8_t*>(frame), frame_length, WaitKind::kWrite)) {
+    return 0;
+  }
+
+  return 1;
+}
+
+bool Stm32::ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages,
+                          const uint16_t& ack_read_timeout_ms) {
   // MAX_NUM_PAGES = 254 if MAX_MESSAGE_SIZE = 512
   const uint16_t MAX_NUM_PAGES = floor((MAX_MESSAGE_SIZE / 2) - 3);
 
@@ -123,6 +231,12 @@ bool Stm32::ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages) {
       num_pages_ready_to_erase = num_pages_left;
     }
 
+    // The bootloader goes back to waiting for a command after each erase message
+    TraceSpan span(tracer_, trace_port_, "EXTEND_ERASE", "stm32");
+    if (!SendCmd(CMD::EXTEND_ERASE)) {
+      return 0;
+    }
+
     // This is how the Extend Erase message is made, (look up AN3155)
     // it's confusing but not worth making its own function, just look at the pdf
     // 2 bytes for N+1 pages | 2 bytes per page number | checmsum
@@ -141,8 +255,8 @@ bool Stm32::ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages) {
 
     AddCheckSum(message_buffer, message_length);
 
-    const uint16_t ack_read_timeout_ms = 8000;
-    if (!SendMessage(message_buffer, message_length, ack_read_timeout_ms)) {
+    if (!SendMessage(message_buffer, message_length, WaitKind::kErase, num_pages_ready_to_erase,
+                     ack_read_timeout_ms)) {
       return 0;
     }
 
@@ -153,7 +267,9 @@ bool Stm32::ExtendedErase(uint16_t* page_codes, const uint16_t& num_of_pages) {
   return 1;
 }
 
-bool Stm32::SpecialExtendedErase(const uint16_t& special_extended_erase_code) {
+bool Stm32::SpecialExtendedErase(const uint16_t& special_extended_erase_code,
+                                 const uint16_t& ack_read_timeout_ms) {
+  TraceSpan span(tracer_, trace_port_, "EXTEND_ERASE special", "stm32");
   if (!SendCmd(CMD::EXTEND_ERASE)) {
     return 0;
   }
@@ -168,14 +284,65 @@ bool Stm32::SpecialExtendedErase(const uint16_t& special_extended_erase_code) {
     return 0;
   }
 
-  if (!SendMessage(message, message_length)) {
+  if (!SendMessage(message, message_length, WaitKind::kMassErase, 1, ack_read_timeout_ms)) {
+    return 0;
+  }
+
+  return 1;
+}
+
+bool Stm32::GetChecksum(const uint32_t& address, const uint32_t& num_bytes, uint32_t& crc,
+                        const uint16_t& ack_read_timeout_ms) {
+  TraceSpan span(tracer_, trace_port_, "GET_CHECKSUM", "stm32");
+  if (address % 4 != 0 || num_bytes % 4 != 0) {
+    Schmi::Error err = {"GetChecksum", "Range not word aligned", (int)num_bytes};
+    error_handler_.Init(err);
+    error_handler_.DisplayAndDie();
+    return 0;
+  }
+
+  if (!SendCmd(CMD::GET_CHECKSUM)) {
+    return 0;
+  }
+
+  if (!SendAddressMessage(address)) {
     return 0;
   }
 
+  // Same layout as the address: 4 bytes MSB first and their checksum, the ACK comes once the
+  // chip went through the whole range
+  const uint8_t message_length = 5;
+  uint8_t message[message_length];
+  message[0] = (num_bytes >> 24) & 0xFF;
+  message[1] = (num_bytes >> 16) & 0xFF;
+  message[2] = (num_bytes >> 8) & 0xFF;
+  message[3] = num_bytes & 0xFF;
+  AddCheckSum(message, message_length);
+
+  if (!SendMessage(message, message_length, WaitKind::kChecksum, (num_bytes + 1023) / 1024, ack_read_timeout_ms)) {
+    return 0;
+  }
+
+  const uint8_t num_incoming_bytes = 5;
+  uint8_t incoming_bytes[num_incoming_bytes];
+  if (!ReadData(incoming_bytes, num_incoming_bytes)) {
+    return 0;
+  }
+  if (CalculateCheckSum(incoming_bytes, num_incoming_bytes) != 0) {
+    Schmi::Error err = {"GetChecksum", "Checksum of the answer not valid", incoming_bytes[4]};
+    error_handler_.Init(err);
+    error_handler_.DisplayAndDie();
+    return 0;
+  }
+
+  crc = ((uint32_t)incoming_bytes[0] << 24) | (incoming_bytes[1] << 16) | (incoming_bytes[2] << 8) |
+        incoming_bytes[3];
+
   return 1;
 }
 
 bool Stm32::ReadoutUnprotect() {
+  TraceSpan span(tracer_, trace_port_, "READOUT_UNPROTECT", "stm32");
   if (!SendCmd(CMD::READOUT_UNPROTECT)) {
     return 0;
   }
@@ -206,39 +373,38 @@ bool Stm32::SendAddressMessage(const uint32_t& address) {
 }
 
 bool Stm32::SendWriteMemoryBytesMessage(uint8_t* bytes, const uint16_t& num_bytes) {
-  uint16_t message_length = num_bytes + 2;  // plus first byte and checksum
-
-  message_buffer[0] = num_bytes - 1;
-  for (uint16_t ii = 0; ii < num_bytes; ii++) {
-    message_buffer[ii + 1] = *bytes++;
+  if (num_bytes == 0 || num_bytes > 256) {
+    Schmi::Error err = {"SendWriteMemoryBytesMessage", "num_bytes is 0 or more than 256", num_bytes};
+    error_handler_.Init(err);
+    error_handler_.DisplayAndDie();
+    return 0;
   }
 
-  // Pad message array with 0xFF to garantee num_bytes is a multiple of 4 (check datasheet)
-  if (num_bytes % 4 != 0) {
-    uint8_t num_pad_bytes = (4 - num_bytes % 4);
-    uint16_t padded_num_bytes = num_bytes + num_pad_bytes;
-
-    if (padded_num_bytes > 256 || padded_num_bytes % 4 != 0) {
-      Schmi::Error err = {"SendWriteMemoryBytesMessage", "num_byte > 256 || !%4", padded_num_bytes};
-      error_handler_.Init(err);
-      error_handler_.DisplayAndDie();
-      return 0;
-    }
+  uint16_t message_length = BuildWriteFrame(bytes, num_bytes, message_buffer);
+  if (!SendMessage(message_buffer, message_length, WaitKind::kWrite)) {
+    return 0;
+  }
 
-    for (uint16_t ii = num_bytes + 1; ii <= padded_num_bytes; ii++) {
-      message_buffer[ii] = 0xFF;
-    }
+  return 1;
+}
 
-    message_length += num_pad_bytes;
-  }
+uint16_t Stm32::BuildWriteFrame(const uint8_t* bytes, const uint16_t& num_bytes, uint8_t* frame) {
+  // Pad to a multiple of 4 with 0xFF (check datasheet), N counts the padding too
+  uint16_t padded_num_bytes = (num_bytes + 3) & ~3;
+  uint16_t frame_length = padded_num_bytes + 2;  // plus first byte and checksum
 
-  AddCheckSum(message_buffer, message_length);
+  // The bytes may already be in place, like when a patched frame is built again
+  memmove(frame + 1, bytes, num_bytes);
+  frame[0] = padded_num_bytes - 1;
+  memset(frame + 1 + num_bytes, 0xFF, padded_num_bytes - num_bytes);
 
-  if (!SendMessage(message_buffer, message_length)) {
-    return 0;
+  uint8_t checksum = 0;
+  for (uint16_t ii = 0; ii < frame_length - 1; ii++) {
+    checksum ^= frame[ii];
   }
+  frame[frame_length - 1] = checksum;
 
-  return 1;
+  return frame_length;
 }
 
 bool Stm32::SendCmd(const uint8_t* cmd) {
@@ -253,12 +419,12 @@ bool Stm32::SendCmd(const uint8_t* cmd) {
   return 1;
 }
 
-bool Stm32::SendMessage(uint8_t* message, const size_t& message_length,
-                        const uint16_t& ack_read_timeout_ms) {
+bool Stm32::SendMessage(uint8_t* message, const size_t& message_length, const WaitKind& kind,
+                        const uint32_t& units, const uint16_t& ack_read_timeout_ms) {
   if (!SendBytes(message, message_length)) {
     return 0;
   }
-  if (!CheckForAck(ack_read_timeout_ms)) {
+  if (!CheckForAck(kind, units, message_length, ack_read_timeout_ms)) {
     return 0;
   }
 
@@ -266,6 +432,9 @@ bool Stm32::SendMessage(uint8_t* message, const size_t& message_length,
 }
 
 bool Stm32::SendBytes(uint8_t* buffer, const size_t& buffer_length) {
+  if ((latency_ || timeout_model_) && clock_) {
+    ack_wait_start_us_ = clock_->NowUs();
+  }
   if (ser_.Write(buffer, buffer_length) != 0) {
     Schmi::Error err = {"SendBytes", "Failed to send Bytes", -1};
     error_handler_.Init(err);
@@ -277,10 +446,13 @@ bool Stm32::SendBytes(uint8_t* buffer, const size_t& buffer_length) {
   return 1;
 }
 
-bool Stm32::CheckForAck(const uint16_t& ack_read_timeout_ms) {
+bool Stm32::CheckForAck(const WaitKind& kind, const uint32_t& units, const size_t& num_bytes,
+                        const uint16_t& ack_read_timeout_ms) {
+  TraceSpan span(tracer_, trace_port_, "ACK", "wait");
   const uint8_t num_bytes_to_read = 1;
   uint8_t buffer[num_bytes_to_read];
-  if (!ReadBytes(buffer, num_bytes_to_read, ack_read_timeout_ms)) {
+  uint16_t deadline_ms = GetDeadlineMs(kind, units, num_bytes, ack_read_timeout_ms);
+  if (!WaitForBytes(buffer, num_bytes_to_read, deadline_ms, ack_read_timeout_ms)) {
     return 0;
   }
 
@@ -291,9 +463,77 @@ bool Stm32::CheckForAck(const uint16_t& ack_read_timeout_ms) {
     return 0;
   }
 
+  // Only the first ACK after a message, the one the chip sends as soon as it has taken it
+  if (clock_ && ack_wait_start_us_) {
+    uint64_t latency_us = clock_->NowUs() - ack_wait_start_us_;
+    if (latency_) {
+      latency_->Record(latency_us);
+    }
+    if (timeout_model_) {
+      RecordWait(kind, units, num_bytes, deadline_ms, latency_us);
+    }
+    ack_wait_start_us_ = 0;
+  }
+
+  return 1;
+}
+
+bool Stm32::ReadData(uint8_t* buffer, const size_t& num_bytes) {
+  TraceSpan span(tracer_, trace_port_, "answer", "wait");
+  uint64_t start_us = timeout_model_ && clock_ ? clock_->NowUs() : 0;
+  uint16_t deadline_ms = GetDeadlineMs(WaitKind::kRead, 1, num_bytes, 500);
+  if (!WaitForBytes(buffer, num_bytes, deadline_ms, 500)) {
+    return 0;
+  }
+
+  if (timeout_model_ && clock_) {
+    RecordWait(WaitKind::kRead, 1, num_bytes, deadline_ms, clock_->NowUs() - start_us);
+  }
+
+  return 1;
+}
+
+uint16_t Stm32::GetDeadlineMs(const WaitKind& kind, const uint32_t& units, const size_t& num_bytes,
+                              const uint16_t& fixed_timeout_ms) {
+  if (!timeout_model_ || !clock_) {
+    return fixed_timeout_ms;
+  }
+
+  return timeout_model_->GetDeadlineMs(kind, units, num_bytes, fixed_timeout_ms);
+}
+
+bool Stm32::WaitForBytes(uint8_t* buffer, const size_t& num_bytes, const uint16_t& deadline_ms,
+                         const uint16_t& fixed_timeout_ms) {
+  if (deadline_ms >= fixed_timeout_ms) {
+    return ReadBytes(buffer, num_bytes, fixed_timeout_ms);
+  }
+
+  // A USB latency timer spike shouldn't fail a good board, a silent chip is still given up in ms.
+  // Only the first byte gets the extension, a read that timed out may have taken some of the rest.
+  if (ser_.Read(buffer, 1, deadline_ms) != 0 &&
+      !ReadBytes(buffer, 1, TimeoutModel::GetExtensionMs(deadline_ms, fixed_timeout_ms))) {
+    return 0;
+  }
+  if (num_bytes > 1 && !ReadBytes(buffer + 1, num_bytes - 1, deadline_ms)) {
+    return 0;
+  }
+
   return 1;
 }
 
+void Stm32::RecordWait(const WaitKind& kind, const uint32_t& units, const size_t& num_bytes,
+                       const uint16_t& deadline_ms, const uint64_t& latency_us) {
+  // A late answer is still a sample: leaving it out would keep the tail out of the model and
+  // tighten the deadline with every board
+  if (latency_us > (uint64_t)deadline_ms * 1000) {
+    timeout_model_->RecordMiss(kind, units, num_bytes, latency_us);
+  } else {
+    timeout_model_->Record(kind, units, num_bytes, latency_us);
+  }
+
+  return;
+}
+
 bool Stm32::ReadBytes(uint8_t* buffer, const size_t& num_bytes, const uint16_t& timeout_ms) {
   int result = ser_.Read(buffer, num_bytes, timeout_ms);
   if (result != 0) {
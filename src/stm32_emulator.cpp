@@ -0,0 +1,766 @@
+#include "Schmi/stm32_emulator.hpp"
+
+#include "Schmi/crc32.hpp"
+
+#include <algorithm>
+
+namespace Schmi {
+
+namespace {
+// Opcodes as the bootloader sees them (first byte of the CMD frames)
+const uint8_t OP_GET = 0x00;
+const uint8_t OP_GET_VERSION = 0x01;
+const uint8_t OP_GET_ID = 0x02;
+const uint8_t OP_READ_MEMORY = 0x11;
+const uint8_t OP_GO = 0x21;
+const uint8_t OP_WRITE_MEMORY = 0x31;
+const uint8_t OP_EXTEND_ERASE = 0x44;
+const uint8_t OP_READOUT_UNPROTECT = 0x92;
+const uint8_t OP_GET_CHECKSUM = 0xA1;
+
+// GET_CHECKSUM is last so it can be left out of the list, see EmulatorConfig::checksum_command
+const uint8_t SUPPORTED_OPS[] = {OP_GET, OP_GET_VERSION, OP_GET_ID, OP_READ_MEMORY, OP_GO,
+                                 OP_WRITE_MEMORY, OP_EXTEND_ERASE, OP_READOUT_UNPROTECT, OP_GET_CHECKSUM};
+
+const uint8_t SYNC_BYTE = 0x7F;
+const uint8_t BITS_PER_BYTE = 11;  // start + 8 data + even parity + stop
+}  // namespace
+
+Stm32Emulator::Stm32Emulator(ClockInterface& clock, const EmulatorConfig& config)
+    : clock_(clock),
+      config_(config),
+      flash_(config.flash_size, 0xFF),
+      sram_(config.sram_size, 0x00),
+      booted_at_us_(clock.NowUs() + config.boot_us),
+      host_baud_rate_(config.baud_rate),
+      device_baud_rate_(config.baud_rate) {}
+
+std::vector<uint8_t> Stm32Emulator::MakeStubImage(const uint16_t& max_block_size, const uint32_t& code_size) {
+  std::vector<uint8_t> image(StubProtocol::IMAGE_HEADER_SIZE + code_size, 0x00);
+  StubProtocol::WriteLe32(image.data(), StubProtocol::IMAGE_MAGIC);
+  image[4] = StubProtocol::VERSION;
+  image[6] = max_block_size & 0xFF;
+  image[7] = max_block_size >> 8;
+  StubProtocol::WriteLe32(image.data() + 8, StubProtocol::IMAGE_HEADER_SIZE);
+
+  return image;
+}
+
+int Stm32Emulator::Write(uint8_t* buffer, const uint16_t& buffer_length) {
+  bool booted = clock_.NowUs() >= booted_at_us_;
+  clock_.SleepUs(WireTimeUs(buffer_length));
+  stats_.bytes_received += buffer_length;
+
+  // Framing errors on the chip side, nothing it can make sense of
+  if (!booted || host_baud_rate_ != device_baud_rate_) {
+    return 0;
+  }
+
+  for (uint16_t ii = 0; ii < buffer_length; ii++) {
+    ProcessByte(buffer[ii]);
+  }
+  if (state_ == State::kStub) {
+    turnaround_pending_ = true;
+  }
+
+  return 0;
+}
+
+int Stm32Emulator::Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) {
+  // The stub answers as soon as each request is handled, however many the host sent in a row. The
+  // link latency is only paid once, when the host turns around to read.
+  if (turnaround_pending_) {
+    clock_.SleepUs(config_.ack_latency_us);
+    turnaround_pending_ = false;
+  }
+
+  uint16_t num_bytes_read = 0;
+  while (num_bytes_read < num_bytes && !output_.empty()) {
+    buffer[num_bytes_read++] = output_.front();
+    output_.pop_front();
+  }
+  clock_.SleepUs(WireTimeUs(num_bytes_read));
+  stats_.bytes_sent += num_bytes_read;
+
+  // Nothing else will ever arrive, so a short read is a timeout like it would be on a real port
+  if (num_bytes_read < num_bytes) {
+    clock_.SleepUs((uint64_t)timeout_ms * 1000);
+    return -1;
+  }
+
+  return 0;
+}
+
+void Stm32Emulator::Reset() {
+  output_.clear();
+  frame_.clear();
+  frame_length_ = 0;
+  state_ = State::kWaitSync;
+  current_cmd_ = 0;
+  go_address_ = 0;
+  device_baud_rate_ = config_.baud_rate;
+  turnaround_pending_ = false;
+  booted_at_us_ = clock_.NowUs() + config_.boot_us;
+
+  return;
+}
+
+bool Stm32Emulator::SetBaudRate(const uint32_t& baud_rate) {
+  host_baud_rate_ = baud_rate;
+
+  return 1;
+}
+
+void Stm32Emulator::FillFlash(const uint8_t& value) {
+  std::fill(flash_.begin(), flash_.end(), value);
+
+  return;
+}
+
+void Stm32Emulator::ProcessByte(const uint8_t& byte) {
+  switch (state_) {
+    case State::kWaitSync:
+      if (byte == SYNC_BYTE) {
+        SendAck();
+        state_ = State::kSyncPad;
+      }
+      return;
+
+    case State::kRunning:
+      return;
+
+    case State::kStub:
+      ProcessStubByte(byte);
+      return;
+
+    case State::kSyncPad:
+      // Stm32::InitUsart pads the sync byte with a dummy 0x00, swallow it
+      StartFrame(State::kCommand, 2);
+      if (byte == 0x00) {
+        return;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  frame_.push_back(byte);
+
+  if (state_ == State::kWriteData && frame_.size() == 1) {
+    frame_length_ = byte + 3;  // N, N + 1 data bytes, checksum
+  }
+  if (frame_.size() < frame_length_) {
+    return;
+  }
+
+  switch (state_) {
+    case State::kCommand:
+      ProcessCommand();
+      break;
+    case State::kAddress:
+      ProcessAddress();
+      break;
+    case State::kReadLength:
+      ProcessReadLength();
+      break;
+    case State::kWriteData:
+      ProcessWriteData();
+      break;
+    case State::kEraseCount:
+      ProcessEraseCount();
+      break;
+    case State::kEraseData:
+      ProcessEraseData();
+      break;
+    case State::kChecksumLength:
+      ProcessChecksumLength();
+      break;
+    default:
+      break;
+  }
+
+  return;
+}
+
+void Stm32Emulator::ProcessCommand() {
+  uint8_t cmd = frame_[0];
+  uint8_t complement = frame_[1];
+  StartFrame(State::kCommand, 2);
+
+  if ((uint8_t)(cmd ^ complement) != 0xFF || !IsCommandSupported(cmd)) {
+    SendNack();
+    return;
+  }
+
+  stats_.commands++;
+  current_cmd_ = cmd;
+  SendAck();
+
+  // Answers follow the ACK right away, the host doesn't turn around in between so there is no
+  // latency to charge for the closing ACK
+  switch (cmd) {
+    case OP_GET:
+      SendByte(NumSupportedOps());  // N = number of bytes to follow - 1
+      SendByte(config_.bootloader_version);
+      for (uint8_t ii = 0; ii < NumSupportedOps(); ii++) {
+        SendByte(SUPPORTED_OPS[ii]);
+      }
+      SendByte(CMD::ACK);
+      break;
+
+    case OP_GET_VERSION:
+      SendByte(config_.bootloader_version);
+      SendByte(0x00);
+      SendByte(0x00);
+      SendByte(CMD::ACK);
+      break;
+
+    case OP_GET_ID:
+      SendByte(0x01);
+      SendByte(config_.product_id >> 8);
+      SendByte(config_.product_id & 0xFF);
+      SendByte(CMD::ACK);
+      break;
+
+    case OP_READ_MEMORY:
+    case OP_GO:
+    case OP_WRITE_MEMORY:
+    case OP_GET_CHECKSUM:
+      StartFrame(State::kAddress, 5);
+      break;
+
+    case OP_EXTEND_ERASE:
+      StartFrame(State::kEraseCount, 2);
+      break;
+
+    case OP_READOUT_UNPROTECT:
+      SendAck();
+      break;
+
+    default:
+      break;
+  }
+
+  return;
+}
+
+void Stm32Emulator::ProcessAddress() {
+  uint32_t address = (frame_[0] << 24) | (frame_[1] << 16) | (frame_[2] << 8) | frame_[3];
+  bool checksum_ok = XorBytes(frame_.data(), 5) == 0;
+  StartFrame(State::kCommand, 2);
+
+  if (!checksum_ok || MapAddress(address, 1) == nullptr) {
+    SendNack();
+    return;
+  }
+
+  address_ = address;
+  SendAck();
+
+  switch (current_cmd_) {
+    case OP_READ_MEMORY:
+      StartFrame(State::kReadLength, 2);
+      break;
+
+    case OP_WRITE_MEMORY:
+      StartFrame(State::kWriteData, 1);
+      break;
+
+    case OP_GET_CHECKSUM:
+      StartFrame(State::kChecksumLength, 5);
+      break;
+
+    case OP_GO:
+      go_address_ = address_;
+      state_ = FindStub(address_) ? State::kStub : State::kRunning;
+      if (state_ == State::kStub) {
+        num_stub_writes_ = 0;
+        StartFrame(State::kStub, StubProtocol::REQUEST_HEADER_SIZE);
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return;
+}
+
+void Stm32Emulator::ProcessReadLength() {
+  uint8_t num_bytes_minus_one = frame_[0];
+  uint8_t complement = frame_[1];
+  StartFrame(State::kCommand, 2);
+
+  uint32_t num_bytes = num_bytes_minus_one + 1;
+  uint8_t* memory = MapAddress(address_, num_bytes);
+  if ((uint8_t)(num_bytes_minus_one ^ complement) != 0xFF || memory == nullptr) {
+    SendNack();
+    return;
+  }
+
+  SendAck();
+  for (uint32_t ii = 0; ii < num_bytes; ii++) {
+    SendByte(memory[ii]);
+  }
+
+  return;
+}
+
+void Stm32Emulator::ProcessWriteData() {
+  uint32_t num_bytes = frame_[0] + 1;
+  bool checksum_ok = XorBytes(frame_.data(), frame_.size()) == 0;
+  uint8_t* memory = MapAddress(address_, num_bytes);
+  bool is_read_only = memory >= config_.unique_id && memory < config_.unique_id + sizeof(config_.unique_id);
+
+  if (!checksum_ok || memory == nullptr || is_read_only) {
+    StartFrame(State::kCommand, 2);
+    SendNack();
+    return;
+  }
+
+  bool is_flash = memory >= flash_.data() && memory < flash_.data() + flash_.size();
+  uint32_t bad_byte = num_bytes;
+  if (is_flash) {
+    auto weak = weak_pages_.find((memory - flash_.data()) / config_.page_size);
+    if (weak != weak_pages_.end() && weak->second.bad_programs_left && !weak->second.corrupted) {
+      weak->second.corrupted = true;
+      bad_byte = 0;
+    }
+  }
+
+  for (uint32_t ii = 0; ii < num_bytes; ii++) {
+    if (ii == bad_byte) {
+      continue;
+    }
+    // NOR flash can only clear bits, writing over data that was not erased corrupts it
+    if (is_flash) {
+      memory[ii] &= frame_[ii + 1];
+    } else {
+      memory[ii] = frame_[ii + 1];
+    }
+  }
+  StartFrame(State::kCommand, 2);
+
+  stats_.bytes_programmed += num_bytes;
+  clock_.SleepUs((uint64_t)config_.program_us_per_byte * num_bytes);
+  SendAck();
+
+  return;
+}
+
+void Stm32Emulator::ProcessEraseCount() {
+  uint16_t count = (frame_[0] << 8) | frame_[1];
+
+  if (count >= 0xFFF0) {
+    frame_length_ = 3;  // special code + checksum
+  } else {
+    frame_length_ = 2 + 2 * (count + 1) + 1;
+  }
+  state_ = State::kEraseData;
+
+  return;
+}
+
+void Stm32Emulator::ProcessEraseData() {
+  std::vector<uint8_t> frame = frame_;
+  StartFrame(State::kCommand, 2);
+
+  if (XorBytes(frame.data(), frame.size()) != 0) {
+    SendNack();
+    return;
+  }
+
+  uint16_t count = (frame[0] << 8) | frame[1];
+  if (count >= 0xFFF0) {
+    if (!SpecialErase(count)) {
+      SendNack();
+      return;
+    }
+    SendAck();
+    return;
+  }
+
+  for (uint32_t ii = 0; ii <= count; ii++) {
+    uint16_t page = (frame[2 + 2 * ii] << 8) | frame[3 + 2 * ii];
+    if (!ErasePage(page)) {
+      SendNack();
+      return;
+    }
+  }
+  SendAck();
+
+  return;
+}
+
+void Stm32Emulator::ProcessChecksumLength() {
+  uint32_t num_bytes = (frame_[0] << 24) | (frame_[1] << 16) | (frame_[2] << 8) | frame_[3];
+  bool checksum_ok = XorBytes(frame_.data(), 5) == 0;
+  StartFrame(State::kCommand, 2);
+
+  uint8_t* memory = MapAddress(address_, num_bytes);
+  if (!checksum_ok || num_bytes == 0 || num_bytes % 4 != 0 || address_ % 4 != 0 || memory == nullptr) {
+    SendNack();
+    return;
+  }
+
+  Crc32Stm32 crc;
+  crc.Update(memory, num_bytes);
+  stats_.bytes_checksummed += num_bytes;
+  clock_.SleepUs((uint64_t)num_bytes * config_.checksum_us_per_kb / 1024);
+
+  uint8_t answer[5];
+  uint32_t checksum = crc.Get();
+  answer[0] = checksum >> 24;
+  answer[1] = (checksum >> 16) & 0xFF;
+  answer[2] = (checksum >> 8) & 0xFF;
+  answer[3] = checksum & 0xFF;
+  answer[4] = XorBytes(answer, 4);
+
+  SendAck();
+  for (uint8_t ii = 0; ii < 5; ii++) {
+    SendByte(answer[ii]);
+  }
+
+  return;
+}
+
+void Stm32Emulator::StartFrame(const State& state, const size_t& frame_length) {
+  state_ = state;
+  frame_.clear();
+  frame_length_ = frame_length;
+
+  return;
+}
+
+bool Stm32Emulator::FindStub(const uint32_t& go_address) {
+  // The header sits entry_offset bytes before the GO address, entry points are close to the start
+  const uint32_t max_entry_offset = 1024;
+  for (uint32_t offset = go_address & 3; offset <= max_entry_offset; offset += 4) {
+    uint8_t* header = MapAddress(go_address - offset, StubProtocol::IMAGE_HEADER_SIZE);
+    if (go_address - offset < config_.sram_start || header == nullptr) {
+      break;
+    }
+    if (StubProtocol::ReadLe32(header) == StubProtocol::IMAGE_MAGIC &&
+        StubProtocol::ReadLe32(header + 8) == offset) {
+      stub_max_block_size_ = header[6] | (header[7] << 8);
+      if (stub_max_block_size_ > StubProtocol::MAX_BLOCK_SIZE) {
+        stub_max_block_size_ = StubProtocol::MAX_BLOCK_SIZE;
+      }
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void Stm32Emulator::ProcessStubByte(const uint8_t& byte) {
+  if (frame_.empty() && byte != StubProtocol::REQUEST_SYNC) {
+    return;
+  }
+  frame_.push_back(byte);
+
+  if (frame_.size() == StubProtocol::REQUEST_HEADER_SIZE) {
+    uint16_t length = frame_[3] | (frame_[4] << 8);
+    if (length > stub_max_block_size_) {
+      // Can't be a real header, look for the next sync byte
+      std::vector<uint8_t> rest(frame_.begin() + 1, frame_.end());
+      StartFrame(State::kStub, StubProtocol::REQUEST_HEADER_SIZE);
+      for (const uint8_t& rest_byte : rest) {
+        ProcessStubByte(rest_byte);
+      }
+      return;
+    }
+    frame_length_ = StubProtocol::REQUEST_HEADER_SIZE + length + StubProtocol::CRC_SIZE;
+  }
+  if (frame_.size() < frame_length_) {
+    return;
+  }
+
+  ProcessStubRequest();
+  if (state_ == State::kStub) {
+    StartFrame(State::kStub, StubProtocol::REQUEST_HEADER_SIZE);
+  }
+
+  return;
+}
+
+void Stm32Emulator::ProcessStubRequest() {
+  const uint8_t seq = frame_[1];
+  const uint8_t command = frame_[2];
+  const uint16_t length = frame_[3] | (frame_[4] << 8);
+  const uint32_t address = StubProtocol::ReadLe32(&frame_[5]);
+  const uint8_t* payload = &frame_[StubProtocol::REQUEST_HEADER_SIZE];
+  const uint32_t value = length >= 4 ? StubProtocol::ReadLe32(payload) : 0;
+
+  Crc32 crc;
+  crc.Update(&frame_[1], frame_.size() - 1 - StubProtocol::CRC_SIZE);
+  if (crc.Get() != StubProtocol::ReadLe32(&frame_[frame_.size() - StubProtocol::CRC_SIZE])) {
+    stats_.nacks++;
+    SendStubResponse(seq, StubProtocol::kBadCrc);
+    return;
+  }
+  stats_.stub_requests++;
+
+  switch (command) {
+    case StubProtocol::kPing: {
+      uint8_t answer[4] = {StubProtocol::VERSION, 0, (uint8_t)(stub_max_block_size_ & 0xFF),
+                           (uint8_t)(stub_max_block_size_ >> 8)};
+      SendStubResponse(seq, StubProtocol::kOk, answer, 4);
+      return;
+    }
+
+    case StubProtocol::kSetBaud:
+      if (value == 0 || value > config_.stub_max_baud_rate) {
+        SendStubResponse(seq, StubProtocol::kBadBaudRate);
+        return;
+      }
+      // The answer still goes out at the old speed
+      SendStubResponse(seq, StubProtocol::kOk);
+      device_baud_rate_ = value;
+      return;
+
+    case StubProtocol::kErase:
+      SendStubResponse(seq, StubErase(address, value));
+      return;
+
+    case StubProtocol::kWrite: {
+      uint8_t status;
+      if (!FindStubWrite(seq, status)) {
+        status = StubWrite(address, payload, length);
+        stub_writes_[num_stub_writes_++ % StubProtocol::WRITE_HISTORY_SIZE] = {seq, status};
+      }
+      SendStubResponse(seq, status);
+      return;
+    }
+
+    case StubProtocol::kCrc: {
+      uint8_t* memory = MapAddress(address, value);
+      if (memory == nullptr) {
+        SendStubResponse(seq, StubProtocol::kBadAddress);
+        return;
+      }
+      Crc32 memory_crc;
+      memory_crc.Update(memory, value);
+      uint8_t answer[4];
+      StubProtocol::WriteLe32(answer, memory_crc.Get());
+      SendStubResponse(seq, StubProtocol::kOk, answer, 4);
+      return;
+    }
+
+    case StubProtocol::kRun:
+      SendStubResponse(seq, StubProtocol::kOk);
+      go_address_ = address;
+      state_ = State::kRunning;
+      return;
+
+    default:
+      SendStubResponse(seq, StubProtocol::kBadCommand);
+      return;
+  }
+}
+
+uint8_t Stm32Emulator::StubErase(const uint32_t& address, const uint32_t& num_bytes) {
+  if (num_bytes == 0 || MapAddress(address, num_bytes) == nullptr || address < config_.flash_start ||
+      address >= config_.flash_start + config_.flash_size) {
+    return StubProtocol::kBadAddress;
+  }
+
+  uint32_t first_page = (address - config_.flash_start) / config_.page_size;
+  uint32_t last_page = (address - config_.flash_start + num_bytes - 1) / config_.page_size;
+  if (first_page == 0 && (uint64_t)(last_page + 1) * config_.page_size >= config_.flash_size) {
+    SpecialErase(0xFFFF);
+    return StubProtocol::kOk;
+  }
+
+  for (uint32_t page = first_page; page <= last_page; page++) {
+    if (!ErasePage(page)) {
+      return StubProtocol::kFlashError;
+    }
+  }
+
+  return StubProtocol::kOk;
+}
+
+uint8_t Stm32Emulator::StubWrite(const uint32_t& address, const uint8_t* bytes, const uint32_t& num_bytes) {
+  uint8_t* memory = MapAddress(address, num_bytes);
+  if (memory == nullptr) {
+    return StubProtocol::kBadAddress;
+  }
+
+  bool is_flash = memory >= flash_.data() && memory < flash_.data() + flash_.size();
+  uint32_t bad_byte = num_bytes;
+  if (is_flash) {
+    auto weak = weak_pages_.find((memory - flash_.data()) / config_.page_size);
+    if (weak != weak_pages_.end() && weak->second.bad_programs_left && !weak->second.corrupted) {
+      weak->second.corrupted = true;
+      bad_byte = 0;
+    }
+  }
+
+  for (uint32_t ii = 0; ii < num_bytes; ii++) {
+    if (ii == bad_byte) {
+      continue;
+    }
+    memory[ii] = is_flash ? memory[ii] & bytes[ii] : bytes[ii];
+  }
+
+  if (is_flash) {
+    stats_.bytes_programmed += num_bytes;
+    clock_.SleepUs((uint64_t)config_.program_us_per_byte * num_bytes);
+  }
+
+  return StubProtocol::kOk;
+}
+
+bool Stm32Emulator::FindStubWrite(const uint8_t& seq, uint8_t& status) const {
+  uint32_t num_writes =
+      num_stub_writes_ < StubProtocol::WRITE_HISTORY_SIZE ? num_stub_writes_ : StubProtocol::WRITE_HISTORY_SIZE;
+  for (uint8_t ii = 0; ii < num_writes; ii++) {
+    if (stub_writes_[ii].seq == seq) {
+      status = stub_writes_[ii].status;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void Stm32Emulator::SendStubResponse(const uint8_t& seq, const uint8_t& status, const uint8_t* payload,
+                                     const uint16_t& length) {
+  uint8_t frame[StubProtocol::MAX_RESPONSE_SIZE];
+  frame[0] = StubProtocol::RESPONSE_SYNC;
+  frame[1] = seq;
+  frame[2] = status;
+  frame[3] = length & 0xFF;
+  frame[4] = length >> 8;
+  for (uint16_t ii = 0; ii < length; ii++) {
+    frame[StubProtocol::RESPONSE_HEADER_SIZE + ii] = payload[ii];
+  }
+
+  uint16_t crc_pos = StubProtocol::RESPONSE_HEADER_SIZE + length;
+  Crc32 crc;
+  crc.Update(frame + 1, crc_pos - 1);
+  StubProtocol::WriteLe32(frame + crc_pos, crc.Get());
+
+  for (uint16_t ii = 0; ii < crc_pos + StubProtocol::CRC_SIZE; ii++) {
+    SendByte(frame[ii]);
+  }
+
+  return;
+}
+
+void Stm32Emulator::SendAck() {
+  clock_.SleepUs(config_.ack_latency_us);
+  SendByte(CMD::ACK);
+
+  return;
+}
+
+void Stm32Emulator::SendNack() {
+  clock_.SleepUs(config_.ack_latency_us);
+  stats_.nacks++;
+  SendByte(CMD::NACK);
+
+  return;
+}
+
+void Stm32Emulator::SendByte(const uint8_t& byte) {
+  output_.push_back(byte);
+
+  return;
+}
+
+uint8_t Stm32Emulator::NumSupportedOps() {
+  return config_.checksum_command ? sizeof(SUPPORTED_OPS) : sizeof(SUPPORTED_OPS) - 1;
+}
+
+bool Stm32Emulator::IsCommandSupported(const uint8_t& cmd) {
+  for (uint8_t ii = 0; ii < NumSupportedOps(); ii++) {
+    if (SUPPORTED_OPS[ii] == cmd) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+uint8_t* Stm32Emulator::MapAddress(const uint32_t& address, const uint32_t& num_bytes) {
+  uint64_t end = (uint64_t)address + num_bytes;
+
+  if (address >= config_.flash_start && end <= (uint64_t)config_.flash_start + config_.flash_size) {
+    return &flash_[address - config_.flash_start];
+  }
+  if (address >= config_.sram_start && end <= (uint64_t)config_.sram_start + config_.sram_size) {
+    return &sram_[address - config_.sram_start];
+  }
+  if (address >= config_.unique_id_address &&
+      end <= (uint64_t)config_.unique_id_address + sizeof(config_.unique_id)) {
+    return &config_.unique_id[address - config_.unique_id_address];
+  }
+
+  return nullptr;
+}
+
+bool Stm32Emulator::ErasePage(const uint32_t& page) {
+  uint64_t start = (uint64_t)page * config_.page_size;
+  if (start + config_.page_size > config_.flash_size) {
+    return 0;
+  }
+
+  std::fill(flash_.begin() + start, flash_.begin() + start + config_.page_size, 0xFF);
+  stats_.pages_erased++;
+
+  auto weak = weak_pages_.find(page);
+  if (weak != weak_pages_.end() && weak->second.corrupted) {
+    weak->second.bad_programs_left--;
+    weak->second.corrupted = false;
+  }
+  clock_.SleepUs(config_.page_erase_us);
+
+  return 1;
+}
+
+bool Stm32Emulator::SpecialErase(const uint16_t& code) {
+  uint32_t bank_size = config_.flash_size / config_.num_banks;
+
+  switch (code) {
+    case 0xFFFF:  // global erase
+      std::fill(flash_.begin(), flash_.end(), 0xFF);
+      stats_.pages_erased += config_.flash_size / config_.page_size;
+      stats_.special_erases++;
+      clock_.SleepUs(config_.mass_erase_us);
+      return 1;
+
+    case 0xFFFE:  // bank 1 mass erase
+    case 0xFFFD:  // bank 2 mass erase
+    {
+      uint32_t bank = 0xFFFE - code;
+      if (config_.num_banks < 2) {
+        return 0;
+      }
+      std::fill(flash_.begin() + bank * bank_size, flash_.begin() + (bank + 1) * bank_size, 0xFF);
+      stats_.pages_erased += bank_size / config_.page_size;
+      stats_.special_erases++;
+      clock_.SleepUs(config_.bank_erase_us);
+      return 1;
+    }
+
+    default:
+      return 0;
+  }
+}
+
+uint64_t Stm32Emulator::WireTimeUs(const uint64_t& num_bytes) {
+  return num_bytes * BITS_PER_BYTE * 1000000 / host_baud_rate_;
+}
+
+uint8_t Stm32Emulator::XorBytes(const uint8_t* bytes, const size_t& num_bytes) {
+  uint8_t result = 0;
+  for (size_t ii = 0; ii < num_bytes; ii++) {
+    result ^= bytes[ii];
+  }
+
+  return result;
+}
+}  // namespace Schmi
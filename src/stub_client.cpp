@@ -0,0 +1,335 @@
+#include "Schmi/stub_client.hpp"
+
+#include "Schmi/crc32.hpp"
+
+#include <string.h>
+
+namespace Schmi {
+
+const uint8_t StubClient::WINDOW_SIZE;
+const uint8_t StubClient::MAX_RETRIES;
+const uint16_t StubClient::RESPONSE_TIMEOUT_MS;
+const uint32_t StubClient::MAX_STUB_SIZE;
+
+bool StubClient::Upload(Stm32& stm32, BinaryFileInterface& stub_image, const uint32_t& load_address) {
+  uint64_t stub_size = stub_image.GetBinaryFileSize();
+  if (stub_size < StubProtocol::IMAGE_HEADER_SIZE || stub_size > MAX_STUB_SIZE) {
+    Die({"Upload", "Stub image size not valid", (int)stub_size});
+    return 0;
+  }
+
+  uint8_t header[StubProtocol::IMAGE_HEADER_SIZE];
+  stub_image.GetBytesArray(header, {StubProtocol::IMAGE_HEADER_SIZE, 0});
+  if (StubProtocol::ReadLe32(header) != StubProtocol::IMAGE_MAGIC) {
+    Die({"Upload", "Not a stub image", (int)StubProtocol::ReadLe32(header)});
+    return 0;
+  }
+  uint16_t max_block_size = header[6] | (header[7] << 8);
+  uint32_t entry_offset = StubProtocol::ReadLe32(header + 8);
+
+  max_block_size_ = max_block_size < StubProtocol::MAX_BLOCK_SIZE ? max_block_size : StubProtocol::MAX_BLOCK_SIZE;
+  if (max_block_size_ == 0 || entry_offset >= stub_size) {
+    Die({"Upload", "Stub image header not valid", (int)entry_offset});
+    return 0;
+  }
+
+  uint8_t buffer[256];
+  for (uint64_t pos = 0; pos < stub_size; pos += sizeof(buffer)) {
+    uint16_t num_bytes = stub_size - pos < sizeof(buffer) ? stub_size - pos : sizeof(buffer);
+    stub_image.GetBytesArray(buffer, {num_bytes, pos});
+    if (!stm32.WriteMemory(buffer, num_bytes, load_address + pos)) {
+      return 0;
+    }
+  }
+
+  next_seq_ = 0;
+  for (uint8_t ii = 0; ii < WINDOW_SIZE; ii++) {
+    window_[ii].in_use = false;
+  }
+
+  return stm32.GoToAddress(load_address + entry_offset);
+}
+
+bool StubClient::Ping(StubInfo& info) {
+  if (!Transact(StubProtocol::kPing, 0, nullptr, 0, RESPONSE_TIMEOUT_MS)) {
+    return 0;
+  }
+  if (response_.length < 4) {
+    Die({"Ping", "Answer too short", response_.length});
+    return 0;
+  }
+
+  info.version = response_.payload[0];
+  info.max_block_size = response_.payload[2] | (response_.payload[3] << 8);
+  if (info.max_block_size < max_block_size_) {
+    max_block_size_ = info.max_block_size;
+  }
+
+  return 1;
+}
+
+bool StubClient::SetBaudRate(const uint32_t& baud_rate) {
+  uint8_t payload[4];
+  StubProtocol::WriteLe32(payload, baud_rate);
+  if (!Transact(StubProtocol::kSetBaud, 0, payload, 4, RESPONSE_TIMEOUT_MS)) {
+    return 0;
+  }
+
+  if (!ser_.SetBaudRate(baud_rate)) {
+    Die({"SetBaudRate", "Port can't switch to baud rate", (int)baud_rate});
+    return 0;
+  }
+
+  return 1;
+}
+
+bool StubClient::Erase(const uint32_t& address, const uint32_t& num_bytes, const uint16_t& timeout_ms) {
+  uint8_t payload[4];
+  StubProtocol::WriteLe32(payload, num_bytes);
+
+  return Transact(StubProtocol::kErase, address, payload, 4, timeout_ms);
+}
+
+bool StubClient::QueueWrite(const uint8_t* bytes, const uint16_t& num_bytes, const uint32_t& address) {
+  if (num_bytes == 0 || num_bytes > max_block_size_) {
+    Die({"QueueWrite", "Block size not valid", num_bytes});
+    return 0;
+  }
+
+  // The window slides: a block goes out only within WINDOW_SIZE seqs of the oldest one in flight,
+  // so the stub still remembers any block that has to be sent again
+  Slot* slot = nullptr;
+  while (slot == nullptr) {
+    Slot* oldest = FindOldestSlot();
+    if (oldest == nullptr || (uint8_t)(next_seq_ - oldest->seq) < WINDOW_SIZE) {
+      for (uint8_t ii = 0; ii < WINDOW_SIZE && slot == nullptr; ii++) {
+        if (!window_[ii].in_use) {
+          slot = &window_[ii];
+        }
+      }
+    }
+    if (slot == nullptr && !CollectResponse()) {
+      return 0;
+    }
+  }
+
+  BuildRequest(*slot, StubProtocol::kWrite, address, bytes, num_bytes);
+  slot->in_use = true;
+
+  return SendSlot(*slot);
+}
+
+bool StubClient::Flush() {
+  for (uint8_t ii = 0; ii < WINDOW_SIZE; ii++) {
+    while (window_[ii].in_use) {
+      if (!CollectResponse()) {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+bool StubClient::Crc(const uint32_t& address, const uint32_t& num_bytes, uint32_t& crc,
+                     const uint16_t& timeout_ms) {
+  uint8_t payload[4];
+  StubProtocol::WriteLe32(payload, num_bytes);
+  if (!Transact(StubProtocol::kCrc, address, payload, 4, timeout_ms)) {
+    return 0;
+  }
+  if (response_.length < 4) {
+    Die({"Crc", "Answer too short", response_.length});
+    return 0;
+  }
+  crc = StubProtocol::ReadLe32(response_.payload);
+
+  return 1;
+}
+
+bool StubClient::Run(const uint32_t& address) {
+  return Transact(StubProtocol::kRun, address, nullptr, 0, RESPONSE_TIMEOUT_MS);
+}
+
+bool StubClient::Transact(const uint8_t& command, const uint32_t& address, const uint8_t* payload,
+                          const uint16_t& payload_length, const uint16_t& timeout_ms) {
+  // Commands other than writes are not pipelined, they wait for the window to drain
+  if (!Flush()) {
+    return 0;
+  }
+
+  BuildRequest(request_, command, address, payload, payload_length);
+  if (!SendSlot(request_)) {
+    return 0;
+  }
+
+  while (true) {
+    if (!ReadResponse(timeout_ms)) {
+      if (!Resend(request_)) {
+        return 0;
+      }
+      continue;
+    }
+
+    // Late answers to writes that were sent twice
+    if (response_.seq != request_.seq) {
+      continue;
+    }
+
+    if (response_.status == StubProtocol::kBadCrc) {
+      if (!Resend(request_)) {
+        return 0;
+      }
+      continue;
+    }
+
+    return CheckStatus();
+  }
+}
+
+bool StubClient::CollectResponse() {
+  if (!ReadResponse(RESPONSE_TIMEOUT_MS)) {
+    // Only the oldest block is overdue, the answers to the ones sent after it can still come. If
+    // the stub did get it, it answers again without writing it twice.
+    Slot* oldest = FindOldestSlot();
+    return oldest ? Resend(*oldest) : 1;
+  }
+
+  for (uint8_t ii = 0; ii < WINDOW_SIZE; ii++) {
+    Slot& slot = window_[ii];
+    if (!slot.in_use || slot.seq != response_.seq) {
+      continue;
+    }
+
+    if (response_.status == StubProtocol::kBadCrc) {
+      return Resend(slot);
+    }
+    if (!CheckStatus()) {
+      return 0;
+    }
+    slot.in_use = false;
+    return 1;
+  }
+
+  // Answer to a request that was already answered once
+  return 1;
+}
+
+StubClient::Slot* StubClient::FindOldestSlot() {
+  Slot* oldest = nullptr;
+  uint8_t oldest_age = 0;
+  for (uint8_t ii = 0; ii < WINDOW_SIZE; ii++) {
+    // Seqs wrap around, the age is how many requests were built since
+    uint8_t age = next_seq_ - window_[ii].seq;
+    if (window_[ii].in_use && age >= oldest_age) {
+      oldest = &window_[ii];
+      oldest_age = age;
+    }
+  }
+
+  return oldest;
+}
+
+bool StubClient::SendSlot(Slot& slot) {
+  stats_.requests++;
+  if (ser_.Write(slot.frame, slot.length) != 0) {
+    Die({"SendSlot", "Failed to send Bytes", -1});
+    return 0;
+  }
+
+  return 1;
+}
+
+bool StubClient::Resend(Slot& slot) {
+  if (slot.retries >= MAX_RETRIES) {
+    Die({"Resend", "No valid answer from stub", slot.frame[2]});
+    return 0;
+  }
+  slot.retries++;
+  stats_.retransmits++;
+
+  return SendSlot(slot);
+}
+
+void StubClient::BuildRequest(Slot& slot, const uint8_t& command, const uint32_t& address,
+                              const uint8_t* payload, const uint16_t& payload_length) {
+  slot.seq = next_seq_++;
+  slot.retries = 0;
+
+  slot.frame[0] = StubProtocol::REQUEST_SYNC;
+  slot.frame[1] = slot.seq;
+  slot.frame[2] = command;
+  slot.frame[3] = payload_length & 0xFF;
+  slot.frame[4] = payload_length >> 8;
+  StubProtocol::WriteLe32(slot.frame + 5, address);
+  if (payload_length) {
+    memcpy(slot.frame + StubProtocol::REQUEST_HEADER_SIZE, payload, payload_length);
+  }
+
+  uint16_t crc_pos = StubProtocol::REQUEST_HEADER_SIZE + payload_length;
+  Crc32 crc;
+  crc.Update(slot.frame + 1, crc_pos - 1);
+  StubProtocol::WriteLe32(slot.frame + crc_pos, crc.Get());
+  slot.length = crc_pos + StubProtocol::CRC_SIZE;
+
+  return;
+}
+
+bool StubClient::ReadResponse(const uint16_t& timeout_ms) {
+  uint8_t frame[StubProtocol::MAX_RESPONSE_SIZE];
+  uint16_t length;
+
+  while (true) {
+    // Skip whatever is left of a corrupted answer until the next sync byte
+    do {
+      if (ser_.Read(frame, 1, timeout_ms) != 0) {
+        return 0;
+      }
+    } while (frame[0] != StubProtocol::RESPONSE_SYNC);
+
+    if (ser_.Read(frame + 1, StubProtocol::RESPONSE_HEADER_SIZE - 1, RESPONSE_TIMEOUT_MS) != 0) {
+      return 0;
+    }
+    length = frame[3] | (frame[4] << 8);
+    if (length > StubProtocol::MAX_RESPONSE_PAYLOAD) {
+      stats_.bad_responses++;
+      continue;
+    }
+    if (ser_.Read(frame + StubProtocol::RESPONSE_HEADER_SIZE, length + StubProtocol::CRC_SIZE,
+                  RESPONSE_TIMEOUT_MS) != 0) {
+      return 0;
+    }
+
+    uint16_t crc_pos = StubProtocol::RESPONSE_HEADER_SIZE + length;
+    Crc32 crc;
+    crc.Update(frame + 1, crc_pos - 1);
+    if (crc.Get() == StubProtocol::ReadLe32(frame + crc_pos)) {
+      break;
+    }
+    stats_.bad_responses++;
+  }
+
+  response_.seq = frame[1];
+  response_.status = frame[2];
+  response_.length = length;
+  memcpy(response_.payload, frame + StubProtocol::RESPONSE_HEADER_SIZE, length);
+
+  return 1;
+}
+
+bool StubClient::CheckStatus() {
+  if (response_.status != StubProtocol::kOk) {
+    Die({"CheckStatus", "Stub returned an error", response_.status});
+    return 0;
+  }
+
+  return 1;
+}
+
+void StubClient::Die(const Schmi::Error& err) {
+  error_handler_.Init(err);
+  error_handler_.DisplayAndDie();
+
+  return;
+}
+}  // namespace Schmi
@@ -0,0 +1,100 @@
+#include "Schmi/telnet.hpp"
+
+namespace Schmi {
+namespace Telnet {
+
+void AppendEscaped(const uint8_t* bytes, const size_t& num_bytes, std::vector<uint8_t>& out) {
+  for (size_t ii = 0; ii < num_bytes; ii++) {
+    out.push_back(bytes[ii]);
+    if (bytes[ii] == IAC) {
+      out.push_back(IAC);
+    }
+  }
+
+  return;
+}
+
+void AppendNegotiation(const uint8_t& verb, const uint8_t& option, std::vector<uint8_t>& out) {
+  out.push_back(IAC);
+  out.push_back(verb);
+  out.push_back(option);
+
+  return;
+}
+
+void AppendSubnegotiation(const uint8_t& option, const std::vector<uint8_t>& payload, std::vector<uint8_t>& out) {
+  out.push_back(IAC);
+  out.push_back(SB);
+  out.push_back(option);
+  AppendEscaped(payload.data(), payload.size(), out);
+  out.push_back(IAC);
+  out.push_back(SE);
+
+  return;
+}
+
+void Decoder::Decode(const uint8_t* bytes, const size_t& num_bytes, std::vector<uint8_t>& data,
+                     std::vector<Command>& commands) {
+  for (size_t ii = 0; ii < num_bytes; ii++) {
+    uint8_t byte = bytes[ii];
+    switch (state_) {
+      case State::kData:
+        if (byte == IAC) {
+          state_ = State::kIac;
+        } else {
+          data.push_back(byte);
+        }
+        break;
+
+      case State::kIac:
+        state_ = State::kData;
+        if (byte == IAC) {
+          data.push_back(IAC);
+        } else if (byte == SB) {
+          command_ = {SB, 0, {}};
+          state_ = State::kSubOption;
+        } else if (byte >= WILL) {
+          command_ = {byte, 0, {}};
+          state_ = State::kOption;
+        }
+        // Anything else (NOP, break, ...) means nothing to a serial link
+        break;
+
+      case State::kOption:
+        command_.option = byte;
+        commands.push_back(command_);
+        state_ = State::kData;
+        break;
+
+      case State::kSubOption:
+        command_.option = byte;
+        state_ = State::kSub;
+        break;
+
+      case State::kSub:
+        if (byte == IAC) {
+          state_ = State::kSubIac;
+        } else {
+          command_.payload.push_back(byte);
+        }
+        break;
+
+      case State::kSubIac:
+        if (byte == IAC) {
+          command_.payload.push_back(IAC);
+          state_ = State::kSub;
+        } else {
+          // SE, or a broken sub-negotiation which is dropped the same way
+          if (byte == SE) {
+            commands.push_back(command_);
+          }
+          state_ = State::kData;
+        }
+        break;
+    }
+  }
+
+  return;
+}
+}  // namespace Telnet
+}  // namespace Schmi
@@ -0,0 +1,83 @@
+#include "Schmi/timeout_model.hpp"
+
+namespace Schmi {
+
+const uint16_t TimeoutModel::MIN_SAMPLES;
+const uint32_t TimeoutModel::MAX_SAMPLES;
+const uint16_t TimeoutModel::MIN_EXTENSION_MS;
+
+void TimeoutModel::SetChip(const uint16_t& product_id) {
+  for (uint8_t ii = 0; ii < num_chips_; ii++) {
+    if (chips_[ii].product_id == product_id) {
+      current_ = ii;
+      return;
+    }
+  }
+
+  // What was learned before the chip was identified, in a fresh model, is about this chip
+  if (chips_[current_].product_id == 0) {
+    chips_[current_].product_id = product_id;
+    return;
+  }
+
+  if (num_chips_ < MAX_CHIPS) {
+    current_ = num_chips_++;
+  } else {
+    current_ = next_chip_;
+    next_chip_ = (next_chip_ + 1) % MAX_CHIPS;
+  }
+  chips_[current_].product_id = product_id;
+  for (uint8_t ii = 0; ii < NUM_KINDS; ii++) {
+    chips_[current_].latency[ii].Reset();
+  }
+
+  return;
+}
+
+void TimeoutModel::Record(const WaitKind& kind, const uint32_t& units, const uint32_t& num_bytes,
+                          const uint64_t& latency_us) {
+  uint64_t wire_us = num_bytes * byte_ns_ / 1000;
+  uint64_t residual_us = latency_us > wire_us ? latency_us - wire_us : 0;
+
+  LatencyHistogram& latency = GetLatency(kind);
+  latency.Record(residual_us / (units ? units : 1));
+  if (latency.GetCount() > MAX_SAMPLES) {
+    latency.Decay();
+  }
+
+  return;
+}
+
+uint16_t TimeoutModel::GetDeadlineMs(const WaitKind& kind, const uint32_t& units, const uint32_t& num_bytes,
+                                     const uint16_t& fixed_timeout_ms) const {
+  const LatencyHistogram& latency = GetLatency(kind);
+  if (latency.GetCount() < MIN_SAMPLES) {
+    return fixed_timeout_ms;
+  }
+
+  uint64_t wire_us = num_bytes * byte_ns_ / 1000;
+  uint64_t deadline_us = MARGIN * (latency.GetPercentileUs(99.9) * (units ? units : 1) + wire_us) + MIN_MARGIN_US;
+  uint64_t deadline_ms = (deadline_us + 999) / 1000;
+
+  if (deadline_ms < MIN_DEADLINE_MS) {
+    deadline_ms = MIN_DEADLINE_MS;
+  }
+  if (deadline_ms > fixed_timeout_ms) {
+    deadline_ms = fixed_timeout_ms;
+  }
+
+  return deadline_ms;
+}
+
+uint16_t TimeoutModel::GetExtensionMs(const uint16_t& deadline_ms, const uint16_t& fixed_timeout_ms) {
+  uint16_t extension_ms = deadline_ms > MIN_EXTENSION_MS ? deadline_ms : MIN_EXTENSION_MS;
+  if (deadline_ms >= fixed_timeout_ms) {
+    return 0;
+  }
+  if (extension_ms > fixed_timeout_ms - deadline_ms) {
+    extension_ms = fixed_timeout_ms - deadline_ms;
+  }
+
+  return extension_ms;
+}
+}  // namespace Schmi
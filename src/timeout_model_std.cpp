@@ -0,0 +1,73 @@
+#include "Schmi/timeout_model_std.hpp"
+
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace Schmi {
+
+bool LoadTimeoutModel(const std::string& file_name, TimeoutModel& model) {
+  std::ifstream file(file_name);
+  if (!file) {
+    return 1;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    uint32_t product_id, kind;
+    fields >> std::hex >> product_id >> std::dec >> kind;
+    if (fields.fail() || kind >= TimeoutModel::NUM_KINDS) {
+      continue;
+    }
+
+    model.SetChip(product_id);
+    LatencyHistogram& latency = model.GetLatency((WaitKind)kind);
+    uint32_t bucket;
+    uint64_t count;
+    char colon;
+    while (fields >> bucket >> colon >> count && colon == ':') {
+      latency.AddToBucket(bucket, count);
+    }
+  }
+
+  return 1;
+}
+
+bool SaveTimeoutModel(const std::string& file_name, const TimeoutModel& model) {
+  // The old file stays whole until the new one is complete
+  std::string temp_name = file_name + ".tmp";
+  {
+    std::ofstream file(temp_name, std::ios::trunc);
+    for (uint8_t chip = 0; chip < model.GetNumChips(); chip++) {
+      for (uint8_t kind = 0; kind < TimeoutModel::NUM_KINDS; kind++) {
+        const LatencyHistogram& latency = model.GetLatencyAt(chip, (WaitKind)kind);
+        if (latency.GetCount() == 0) {
+          continue;
+        }
+
+        file << std::hex << model.GetChipAt(chip) << std::dec << " " << (int)kind;
+        for (uint16_t bucket = 0; bucket < LatencyHistogram::NUM_BUCKETS; bucket++) {
+          if (latency.GetBucketCount(bucket)) {
+            file << " " << bucket << ":" << latency.GetBucketCount(bucket);
+          }
+        }
+        file << "\n";
+      }
+    }
+
+    if (!file.good()) {
+      std::cerr << "ERROR: could not write " << temp_name << "\n";
+      return 0;
+    }
+  }
+
+  if (rename(temp_name.c_str(), file_name.c_str()) != 0) {
+    std::cerr << "ERROR: could not replace " << file_name << "\n";
+    return 0;
+  }
+
+  return 1;
+}
+}  // namespace Schmi
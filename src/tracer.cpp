@@ -0,0 +1,155 @@
+#include "Schmi/tracer.hpp"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+namespace Schmi {
+
+const uint32_t Tracer::MAX_EVENTS;
+
+namespace {
+
+// The kernel thread ID, the one top and perf show, looked up once per thread. Elsewhere the
+// threads are numbered in the order they first record.
+uint32_t GetThreadId() {
+#ifdef __linux__
+  static thread_local uint32_t thread_id = syscall(SYS_gettid);
+#else
+  static std::atomic<uint32_t> next_thread_id(1);
+  static thread_local uint32_t thread_id = next_thread_id++;
+#endif
+  return thread_id;
+}
+
+std::string EscapeJson(const std::string& text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+
+  return escaped;
+}
+}  // namespace
+
+Tracer::Tracer(ClockInterface& clock) : clock_(clock) {
+  static std::atomic<uint64_t> next_id(1);
+  id_ = next_id++;
+}
+
+uint32_t Tracer::AddPort(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ports_.push_back(name);
+
+  // 0 is left for spans recorded without a port
+  return ports_.size();
+}
+
+Tracer::ThreadBuffer& Tracer::GetThreadBuffer() {
+  // The last tracer this thread recorded to, looked up in buffers_ only when it changes
+  static thread_local uint64_t cached_id = 0;
+  static thread_local ThreadBuffer* cached_buffer = nullptr;
+  if (cached_id == id_) {
+    return *cached_buffer;
+  }
+
+  uint32_t thread = GetThreadId();
+  std::lock_guard<std::mutex> lock(mutex_);
+  ThreadBuffer* buffer = nullptr;
+  for (auto& candidate : buffers_) {
+    if (candidate->thread == thread) {
+      buffer = candidate.get();
+    }
+  }
+  if (!buffer) {
+    buffers_.emplace_back(new ThreadBuffer());
+    buffer = buffers_.back().get();
+    buffer->thread = thread;
+  }
+  cached_id = id_;
+  cached_buffer = buffer;
+
+  return *buffer;
+}
+
+void Tracer::Record(const uint32_t& port, const char* name, const char* category, const uint64_t& start_us) {
+  uint64_t end_us = clock_.NowUs();
+
+  // Threads racing for the last slots can go a few spans over, that's fine for a memory cap
+  if (num_events_.load(std::memory_order_relaxed) >= MAX_EVENTS) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  num_events_.fetch_add(1, std::memory_order_relaxed);
+
+  ThreadBuffer& buffer = GetThreadBuffer();
+  TraceEvent event = {name, category, port, buffer.thread, start_us, end_us - start_us};
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events.push_back(event);
+
+  return;
+}
+
+size_t Tracer::GetNumEvents() { return num_events_.load(std::memory_order_relaxed); }
+
+std::vector<TraceEvent> Tracer::GetEvents() {
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_) {
+      std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+      events.insert(events.end(), buffer->events.begin(), buffer->events.end());
+    }
+  }
+
+  // Spans are recorded as they end, the inner ones first
+  std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+    return a.ts_us < b.ts_us || (a.ts_us == b.ts_us && a.duration_us > b.duration_us);
+  });
+
+  return events;
+}
+
+std::string Tracer::ToChromeTrace() {
+  std::vector<TraceEvent> events = GetEvents();
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::stringstream json;
+  json << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << GetNumDropped()
+       << "},\"traceEvents\":[\n";
+
+  // Ports are processes in the viewer, so every port gets its own group of rows
+  bool first = true;
+  for (uint32_t ii = 0; ii < ports_.size(); ii++) {
+    json << (first ? "" : ",\n") << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << ii + 1
+         << ",\"tid\":0,\"args\":{\"name\":\"" << EscapeJson(ports_[ii]) << "\"}}";
+    first = false;
+  }
+  for (const TraceEvent& event : events) {
+    json << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+         << "\",\"ph\":\"X\",\"ts\":" << event.ts_us << ",\"dur\":" << event.duration_us
+         << ",\"pid\":" << event.port << ",\"tid\":" << event.thread << "}";
+    first = false;
+  }
+  json << "\n]}\n";
+
+  return json.str();
+}
+
+bool Tracer::WriteChromeTrace(const std::string& path) {
+  std::ofstream file(path);
+  if (!file) {
+    return 0;
+  }
+  file << ToChromeTrace();
+
+  return file.good();
+}
+}  // namespace Schmi
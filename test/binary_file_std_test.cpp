@@ -32,7 +32,6 @@ TEST_F(BinaryFileStdTest, GetFileSize) {
   iq_bin_->Init();
   test_bin_->Init();
 
-  uint64_t size = test_bin_->GetBinaryFileSize();
   EXPECT_EQ(32, test_bin_->GetBinaryFileSize());
   EXPECT_EQ(53776, iq_bin_->GetBinaryFileSize());
 };
@@ -85,4 +84,25 @@ TEST_F(BinaryFileStdTest, GetBytesArray_iqbin) {
   // //Eq() instead of ContainerEq() so that it runs faster (huge .bin file)
   // //it's less failure info but runs same test
   EXPECT_THAT(bytes, Eq(test_bytes));
-}
\ No newline at end of file
+}
+TEST_F(BinaryFileStdTest, BackgroundAndUpFrontLoadingMatch) {
+  Schmi::BinaryFileStd up_front_bin("../test_files/1048583_V6-3.bin", false);
+  up_front_bin.Init();
+  iq_bin_->Init();
+
+  uint64_t size = iq_bin_->GetBinaryFileSize();
+  ASSERT_EQ(size, up_front_bin.GetBinaryFileSize());
+
+  // Last bytes first, the read has to wait for the whole file
+  std::vector<uint8_t> background_bytes(size);
+  std::vector<uint8_t> up_front_bytes(size);
+  iq_bin_->GetBytesArray(background_bytes.data() + size - 256, {256, size - 256});
+  iq_bin_->GetBytesArray(background_bytes.data(), {(uint32_t)size - 256, 0});
+  up_front_bin.GetBytesArray(up_front_bytes.data(), {(uint32_t)size, 0});
+  EXPECT_THAT(background_bytes, Eq(up_front_bytes));
+
+  Schmi::Crc32 crc;
+  crc.Update(up_front_bytes.data(), size);
+  EXPECT_EQ(crc.Get(), iq_bin_->WaitUntilLoaded());
+  EXPECT_EQ(crc.Get(), up_front_bin.WaitUntilLoaded());
+}
@@ -0,0 +1,172 @@
+#include "Schmi/binary_file_stream.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/crc32.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <unistd.h>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// The image goes through a real pipe, written by a thread like the build tool on the other end
+class BinaryFileStreamTest : public ::testing::Test {
+ protected:
+  BinaryFileStreamTest() {
+    int fds[2];
+    if (pipe(fds) == 0) {
+      read_fd_ = fds[0];
+      write_fd_ = fds[1];
+    }
+  };
+
+  ~BinaryFileStreamTest() {
+    if (writer_.joinable()) writer_.join();
+    close(read_fd_);
+    if (write_fd_ >= 0) close(write_fd_);
+  };
+
+  void SetUp() override { ASSERT_GE(read_fd_, 0); };
+
+  void TearDown() override{};
+
+  void StartWriter(const std::vector<uint8_t>& bytes) {
+    writer_ = std::thread([this, bytes]() {
+      uint64_t pos = 0;
+      while (pos < bytes.size()) {
+        ssize_t num_bytes = write(write_fd_, bytes.data() + pos, bytes.size() - pos);
+        if (num_bytes <= 0) break;
+        pos += num_bytes;
+      }
+      close(write_fd_);
+      write_fd_ = -1;
+    });
+  };
+
+  int read_fd_ = -1;
+  int write_fd_ = -1;
+  std::thread writer_;
+};
+
+TEST(Crc32Test, MatchesCheckValue) {
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+  Schmi::Crc32 crc;
+  crc.Update(check, sizeof(check));
+  EXPECT_EQ(0xCBF43926, crc.Get());
+
+  crc.Reset();
+  crc.Update(check, 4);
+  crc.Update(check + 4, 5);
+  EXPECT_EQ(0xCBF43926, crc.Get());
+}
+
+TEST_F(BinaryFileStreamTest, ReadsImageFrontToBackThroughSmallRing) {
+  std::vector<uint8_t> image = MakeImage(100000);
+  StartWriter(image);
+
+  Schmi::BinaryFileStream bin(read_fd_, image.size(), 1000);
+  bin.Init();
+  EXPECT_EQ(image.size(), bin.GetBinaryFileSize());
+  EXPECT_FALSE(bin.IsRereadable());
+
+  std::vector<uint8_t> read_back(image.size());
+  for (uint64_t pos = 0; pos < image.size(); pos += 256) {
+    uint32_t num_bytes = image.size() - pos < 256 ? image.size() - pos : 256;
+    bin.GetBytesArray(read_back.data() + pos, {num_bytes, pos});
+  }
+
+  EXPECT_TRUE(image == read_back);
+  EXPECT_EQ(image.size(), bin.GetBytesReceived());
+}
+
+TEST_F(BinaryFileStreamTest, RecentBytesCanBeReadAgain) {
+  std::vector<uint8_t> image = MakeImage(4096);
+  StartWriter(image);
+
+  Schmi::BinaryFileStream bin(read_fd_, image.size(), 1024);
+  bin.Init();
+
+  uint8_t bytes[256];
+  bin.GetBytesArray(bytes, {256, 0});
+  bin.GetBytesArray(bytes, {256, 256});
+  bin.GetBytesArray(bytes, {256, 0});
+  EXPECT_EQ(0, memcmp(bytes, image.data(), 256));
+}
+
+TEST_F(BinaryFileStreamTest, SpillFileAllowsRereadFromStart) {
+  std::vector<uint8_t> image = MakeImage(10000);
+  StartWriter(image);
+
+  std::string spill_file = "binary_file_stream_test.spill";
+  Schmi::BinaryFileStream bin(read_fd_, image.size(), 512, spill_file);
+  bin.Init();
+  EXPECT_TRUE(bin.IsRereadable());
+
+  uint8_t bytes[256];
+  for (uint64_t pos = 0; pos < image.size(); pos += 250) {
+    bin.GetBytesArray(bytes, {250, pos});
+  }
+
+  bin.GetBytesArray(bytes, {256, 100});
+  EXPECT_EQ(0, memcmp(bytes, image.data() + 100, 256));
+
+  remove(spill_file.c_str());
+}
+
+TEST_F(BinaryFileStreamTest, ReadBehindRingWithoutSpillDies) {
+  std::vector<uint8_t> image = MakeImage(4096);
+  ASSERT_EQ(4096, write(write_fd_, image.data(), image.size()));
+
+  Schmi::BinaryFileStream bin(read_fd_, image.size(), 1024);
+  bin.Init();
+
+  uint8_t bytes[256];
+  bin.GetBytesArray(bytes, {256, 2048});
+  EXPECT_EXIT(bin.GetBytesArray(bytes, {256, 0}), ::testing::ExitedWithCode(EXIT_FAILURE), "");
+}
+
+TEST_F(BinaryFileStreamTest, StreamEndingEarlyDies) {
+  std::vector<uint8_t> image = MakeImage(100);
+  ASSERT_EQ(100, write(write_fd_, image.data(), image.size()));
+  close(write_fd_);
+  write_fd_ = -1;
+
+  Schmi::BinaryFileStream bin(read_fd_, 200);
+  bin.Init();
+
+  uint8_t bytes[200];
+  EXPECT_EXIT(bin.GetBytesArray(bytes, {200, 0}), ::testing::ExitedWithCode(EXIT_FAILURE),
+              "Stream ended");
+}
+
+TEST_F(BinaryFileStreamTest, FlashLoaderVerifiesStreamAgainstCrc) {
+  std::vector<uint8_t> image = MakeImage(100000);
+  StartWriter(image);
+
+  Schmi::SimClock clock;
+  Schmi::Stm32Emulator emulator(clock);
+  Schmi::ErrorHandlerCapture error;
+  Schmi::LoadingBarNull bar;
+  Schmi::BinaryFileStream bin(read_fd_, image.size(), 1024);
+  Schmi::FlashLoader fl(&emulator, &bin, &error, &bar);
+  emulator.FillFlash(0x00);
+
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  std::vector<uint8_t> flash(emulator.GetFlash(), emulator.GetFlash() + image.size());
+  EXPECT_TRUE(image == flash);
+
+  Schmi::Crc32 crc;
+  crc.Update(image.data(), image.size());
+  EXPECT_EQ(crc.Get(), fl.GetImageCrc32());
+  EXPECT_TRUE(emulator.IsRunning());
+}
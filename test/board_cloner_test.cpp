@@ -0,0 +1,199 @@
+#include "Schmi/board_cloner.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/serial_posix.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A board that goes away after a number of writes
+class UnpluggedSerial : public Schmi::SerialInterface {
+ public:
+  UnpluggedSerial(Schmi::SerialInterface& ser, const uint32_t& num_writes) : ser_(ser), writes_left_(num_writes){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    if (writes_left_ == 0) {
+      return -1;
+    }
+    writes_left_--;
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+
+ private:
+  Schmi::SerialInterface& ser_;
+  uint32_t writes_left_;
+};
+}  // namespace
+
+class BoardClonerTest : public ::testing::Test {
+ protected:
+  static const uint8_t NUM_TARGETS = 3;
+
+  BoardClonerTest() : source_(source_clock_), image_(MakeImage(40000)) {
+    for (uint8_t ii = 0; ii < NUM_TARGETS; ii++) {
+      targets_.emplace_back(new Schmi::Stm32Emulator(target_clocks_[ii]));
+      targets_.back()->FillFlash(0x00);
+    }
+
+    // The golden board
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::ErrorHandlerCapture error;
+    Schmi::LoadingBarNull bar;
+    Schmi::FlashLoader fl(&source_, &bin, &error, &bar);
+    fl.Init();
+    EXPECT_TRUE(fl.Flash(true, false));
+    source_.Reset();
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  bool IsClone(const uint8_t& target) {
+    return std::equal(image_.begin(), image_.end(), targets_[target]->GetFlash());
+  };
+
+  Schmi::SimClock source_clock_;
+  Schmi::Stm32Emulator source_;
+  Schmi::SimClock target_clocks_[NUM_TARGETS];
+  std::vector<std::unique_ptr<Schmi::Stm32Emulator>> targets_;
+  std::vector<uint8_t> image_;
+};
+
+const uint8_t BoardClonerTest::NUM_TARGETS;
+
+TEST(CloneStreamTest, ProducerWaitsForTheSlowestReader) {
+  std::vector<uint8_t> bytes(10000);
+  for (uint32_t ii = 0; ii < bytes.size(); ii++) {
+    bytes[ii] = ii * 3;
+  }
+  Schmi::CloneStream stream(bytes.size(), 2, 1024);
+
+  bool written = false;
+  std::thread producer([&] { written = stream.Write(bytes.data(), bytes.size()); });
+
+  // The fast reader gets at most a ring ahead of the slow one
+  std::vector<uint8_t> fast(bytes.size());
+  ASSERT_TRUE(stream.Read(0, fast.data(), 0, 1024));
+  std::vector<uint8_t> slow(bytes.size());
+  for (uint32_t pos = 0; pos < 2000; pos += 100) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT_TRUE(stream.Read(1, slow.data() + pos, pos, 100));
+  }
+  ASSERT_TRUE(stream.Read(0, fast.data() + 1024, 1024, 1024));
+  EXPECT_GT(stream.GetProducerWaitUs(), 0);
+
+  // Once the slow one is gone nothing holds the producer
+  stream.Detach(1);
+  for (uint32_t pos = 2048; pos < bytes.size(); pos += 256) {
+    uint32_t num_bytes = std::min<uint32_t>(256, bytes.size() - pos);
+    ASSERT_TRUE(stream.Read(0, fast.data() + pos, pos, num_bytes));
+  }
+  producer.join();
+  EXPECT_TRUE(written);
+  EXPECT_EQ(bytes, fast);
+  EXPECT_TRUE(std::equal(bytes.begin(), bytes.begin() + 2000, slow.begin()));
+
+  // Past the end nothing ever comes
+  stream.Abort();
+  uint8_t byte;
+  EXPECT_FALSE(stream.Read(0, &byte, bytes.size(), 1));
+}
+
+TEST_F(BoardClonerTest, OneBoardIsCopiedOntoMany) {
+  Schmi::BoardCloner cloner(&source_, 0x08000000, image_.size(), nullptr, 4096);
+  for (uint8_t ii = 0; ii < NUM_TARGETS; ii++) {
+    cloner.AddTarget("target" + std::to_string(ii), targets_[ii].get(), &target_clocks_[ii]);
+  }
+
+  uint64_t bytes_sent = source_.GetStats().bytes_sent;
+  Schmi::CloneReport report = cloner.Run();
+  ASSERT_TRUE(report.source_ok);
+  EXPECT_EQ(image_.size(), report.num_bytes);
+  Schmi::Crc32 crc;
+  crc.Update(image_.data(), image_.size());
+  EXPECT_EQ(crc.Get(), report.source_crc);
+
+  ASSERT_EQ(NUM_TARGETS, report.targets.size());
+  for (uint8_t ii = 0; ii < NUM_TARGETS; ii++) {
+    EXPECT_TRUE(report.targets[ii].ok) << report.targets[ii].error;
+    EXPECT_EQ("target" + std::to_string(ii), report.targets[ii].name);
+    EXPECT_EQ(report.source_crc, report.targets[ii].crc);
+    EXPECT_TRUE(IsClone(ii));
+    EXPECT_TRUE(targets_[ii]->IsRunning());
+  }
+  // Read once for all of them
+  EXPECT_LT(source_.GetStats().bytes_sent - bytes_sent, image_.size() * 11 / 10);
+}
+
+TEST_F(BoardClonerTest, BadTargetDoesntStopTheOthers) {
+  UnpluggedSerial unplugged(*targets_[1], 100);
+  Schmi::BoardCloner cloner(&source_, 0x08000000, image_.size(), nullptr, 4096);
+  cloner.AddTarget("good", targets_[0].get(), &target_clocks_[0]);
+  cloner.AddTarget("unplugged", &unplugged, &target_clocks_[1]);
+  cloner.AddTarget("also good", targets_[2].get(), &target_clocks_[2]);
+
+  Schmi::CloneReport report = cloner.Run();
+  ASSERT_TRUE(report.source_ok);
+  EXPECT_TRUE(report.targets[0].ok);
+  EXPECT_FALSE(report.targets[1].ok);
+  EXPECT_FALSE(report.targets[1].error.empty());
+  EXPECT_TRUE(report.targets[2].ok);
+  EXPECT_TRUE(IsClone(0));
+  EXPECT_TRUE(IsClone(2));
+}
+
+TEST_F(BoardClonerTest, LostSourceFailsEveryTarget) {
+  UnpluggedSerial unplugged(source_, 150);
+  Schmi::BoardCloner cloner(&unplugged, 0x08000000, image_.size(), nullptr, 4096);
+  for (uint8_t ii = 0; ii < NUM_TARGETS; ii++) {
+    cloner.AddTarget("target" + std::to_string(ii), targets_[ii].get(), &target_clocks_[ii]);
+  }
+
+  Schmi::CloneReport report = cloner.Run();
+  EXPECT_FALSE(report.source_ok);
+  EXPECT_FALSE(report.source_error.empty());
+  for (uint8_t ii = 0; ii < NUM_TARGETS; ii++) {
+    EXPECT_FALSE(report.targets[ii].ok);
+    EXPECT_FALSE(IsClone(ii));
+  }
+}
+
+TEST_F(BoardClonerTest, PortsThatCantBeOpenedAreReported) {
+  Schmi::SerialPosix missing("/nonexistent/ttyNOPE0");
+  Schmi::BoardCloner cloner(&source_, 0x08000000, image_.size(), nullptr, 4096);
+  cloner.AddTarget("good", targets_[0].get(), &target_clocks_[0]);
+  cloner.AddTarget("missing", &missing, &target_clocks_[1]);
+
+  Schmi::CloneReport report = cloner.Run();
+  ASSERT_TRUE(report.source_ok);
+  EXPECT_TRUE(report.targets[0].ok);
+  EXPECT_TRUE(IsClone(0));
+  EXPECT_FALSE(report.targets[1].ok);
+  EXPECT_EQ("clone: could not open the port", report.targets[1].error);
+
+  Schmi::BoardCloner no_source(&missing, 0x08000000, image_.size(), nullptr, 4096);
+  no_source.AddTarget("target", targets_[2].get(), &target_clocks_[2]);
+  report = no_source.Run();
+  EXPECT_FALSE(report.source_ok);
+  EXPECT_EQ("clone: could not open the source", report.source_error);
+  EXPECT_FALSE(report.targets[0].ok);
+}
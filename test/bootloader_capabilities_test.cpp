@@ -0,0 +1,189 @@
+#include "Schmi/bootloader_capabilities.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/crc32.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <string.h>
+#include <vector>
+
+namespace {
+
+Schmi::BootloaderCapabilities MakeCapabilities(const uint16_t& product_id, const uint8_t& version) {
+  Schmi::BootloaderCommands commands = {version, 1, {Schmi::CMD::GET[0]}};
+
+  return Schmi::MakeBootloaderCapabilities(product_id, commands);
+}
+}  // namespace
+
+TEST(Crc32Stm32Test, WordsAreFedLittleEndian) {
+  // CRC-32/MPEG-2 of "12345678", each word of the input is "4321" and "8765" read little endian
+  Schmi::Crc32Stm32 crc;
+  crc.Update((const uint8_t*)"43218765", 8);
+  EXPECT_EQ(0x49E3C2FB, crc.Get());
+}
+
+TEST(Crc32Stm32Test, LastWordIsPaddedWithErasedFlash) {
+  Schmi::Crc32Stm32 crc;
+  crc.Update((const uint8_t*)"432", 3);
+  crc.Update((const uint8_t*)"15", 2);
+  EXPECT_EQ(0x96C904CA, crc.Get());
+
+  Schmi::Crc32Stm32 padded;
+  padded.Update((const uint8_t*)"43215\xFF\xFF\xFF", 8);
+  EXPECT_EQ(padded.Get(), crc.Get());
+}
+
+TEST(CapabilityCacheTest, FindsByProductAndVersion) {
+  Schmi::CapabilityCache cache;
+  cache.Store(MakeCapabilities(0x0468, 0x31));
+  cache.Store(MakeCapabilities(0x0469, 0x31));
+
+  ASSERT_NE(nullptr, cache.Find(0x0468, 0x31));
+  EXPECT_EQ(0x0468, cache.Find(0x0468, 0x31)->product_id);
+  EXPECT_EQ(nullptr, cache.Find(0x0468, 0x40));
+  EXPECT_EQ(nullptr, cache.Find(0x0415, 0x31));
+
+  // Storing the same pair again replaces it
+  cache.Store(MakeCapabilities(0x0468, 0x31));
+  EXPECT_EQ(2, cache.GetNumEntries());
+}
+
+TEST(CapabilityCacheTest, OldestEntryIsReplacedWhenFull) {
+  Schmi::CapabilityCache cache;
+  for (uint16_t ii = 0; ii <= Schmi::CapabilityCache::MAX_ENTRIES; ii++) {
+    cache.Store(MakeCapabilities(ii, 0x31));
+  }
+
+  EXPECT_EQ(Schmi::CapabilityCache::MAX_ENTRIES, cache.GetNumEntries());
+  EXPECT_EQ(nullptr, cache.Find(0, 0x31));
+  EXPECT_NE(nullptr, cache.Find(1, 0x31));
+  EXPECT_NE(nullptr, cache.Find(Schmi::CapabilityCache::MAX_ENTRIES, 0x31));
+}
+
+class BootloaderCapabilitiesTest : public ::testing::Test {
+ protected:
+  BootloaderCapabilitiesTest() : image_(MakeImage(60001)){};
+
+  ~BootloaderCapabilitiesTest(){};
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  // Time to verify the image after flashing it
+  uint64_t FlashImage(Schmi::Stm32Emulator& emulator) {
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(&emulator, &bin, &error_, &bar_);
+    fl.SetCapabilityCache(&cache_);
+    fl.SetClock(&clock_);
+
+    emulator.FillFlash(0x00);
+    fl.Init();
+    if (!fl.Flash(true, false)) {
+      return 0;
+    }
+    capabilities_ = fl.GetCapabilities();
+
+    return fl.GetTiming().verify_done_us - fl.GetTiming().write_done_us;
+  };
+
+  bool FlashMatchesImage(Schmi::Stm32Emulator& emulator) {
+    return memcmp(image_.data(), emulator.GetFlash(), image_.size()) == 0;
+  };
+
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  Schmi::CapabilityCache cache_;
+  Schmi::BootloaderCapabilities capabilities_ = {};
+  std::vector<uint8_t> image_;
+};
+
+TEST_F(BootloaderCapabilitiesTest, GetListsEmulatorCommands) {
+  Schmi::Stm32Emulator emulator(clock_);
+  Schmi::Stm32 stm32(emulator, error_);
+  ASSERT_TRUE(stm32.InitUsart());
+
+  Schmi::BootloaderCommands commands;
+  ASSERT_TRUE(stm32.Get(commands));
+  EXPECT_EQ(emulator.GetConfig().bootloader_version, commands.version);
+
+  Schmi::BootloaderCapabilities capabilities = Schmi::MakeBootloaderCapabilities(0x0468, commands);
+  EXPECT_TRUE(capabilities.Supports(Schmi::CMD::GET));
+  EXPECT_TRUE(capabilities.Supports(Schmi::CMD::EXTEND_ERASE));
+  EXPECT_FALSE(capabilities.Supports(Schmi::CMD::ERASE));
+  EXPECT_FALSE(capabilities.Supports(Schmi::CMD::GET_CHECKSUM));
+
+  // The session goes on after GET
+  uint16_t id;
+  EXPECT_TRUE(stm32.GetID(id));
+}
+
+TEST_F(BootloaderCapabilitiesTest, GetChecksumMatchesWrittenBytes) {
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  Schmi::Stm32Emulator emulator(clock_, config);
+  Schmi::Stm32 stm32(emulator, error_);
+  ASSERT_TRUE(stm32.InitUsart());
+  ASSERT_TRUE(stm32.WriteMemory(image_.data(), 256, 0x08000400));
+
+  Schmi::Crc32Stm32 expected;
+  expected.Update(image_.data(), 256);
+  uint32_t crc;
+  ASSERT_TRUE(stm32.GetChecksum(0x08000400, 256, crc));
+  EXPECT_EQ(expected.Get(), crc);
+
+  EXPECT_FALSE(stm32.GetChecksum(0x08000401, 256, crc));
+  EXPECT_TRUE(error_.HasDied());
+}
+
+TEST_F(BootloaderCapabilitiesTest, SecondBoardOfSameKindSkipsGet) {
+  Schmi::Stm32Emulator first(clock_);
+  ASSERT_GT(FlashImage(first), 0);
+  EXPECT_EQ(1, cache_.GetNumEntries());
+  uint32_t first_commands = first.GetStats().commands;
+
+  Schmi::Stm32Emulator second(clock_);
+  ASSERT_GT(FlashImage(second), 0);
+  EXPECT_EQ(1, cache_.GetNumEntries());
+  EXPECT_EQ(first_commands - 1, second.GetStats().commands);
+  EXPECT_TRUE(FlashMatchesImage(second));
+
+  // A different bootloader version is a different entry
+  Schmi::EmulatorConfig config;
+  config.bootloader_version = 0x40;
+  Schmi::Stm32Emulator newer(clock_, config);
+  ASSERT_GT(FlashImage(newer), 0);
+  EXPECT_EQ(2, cache_.GetNumEntries());
+  EXPECT_EQ(0x40, capabilities_.bootloader_version);
+}
+
+TEST_F(BootloaderCapabilitiesTest, ChecksumCommandIsUsedToVerify) {
+  Schmi::Stm32Emulator read_back(clock_);
+  uint64_t read_back_us = FlashImage(read_back);
+  ASSERT_GT(read_back_us, 0);
+  EXPECT_FALSE(capabilities_.Supports(Schmi::CMD::GET_CHECKSUM));
+
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  config.bootloader_version = 0x32;
+  Schmi::Stm32Emulator checksum(clock_, config);
+  uint64_t checksum_us = FlashImage(checksum);
+  ASSERT_GT(checksum_us, 0);
+  EXPECT_TRUE(capabilities_.Supports(Schmi::CMD::GET_CHECKSUM));
+  EXPECT_TRUE(FlashMatchesImage(checksum));
+
+  // The image isn't read back, only the ACKs and the checksum come from the chip
+  EXPECT_GT(read_back.GetStats().bytes_sent, image_.size());
+  EXPECT_LT(checksum.GetStats().bytes_sent, image_.size() / 10);
+  EXPECT_LT(checksum_us * 20, read_back_us);
+}
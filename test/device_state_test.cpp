@@ -0,0 +1,223 @@
+#include "Schmi/device_state_std.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+Schmi::UniqueId MakeUid(const uint8_t& seed) {
+  Schmi::UniqueId uid;
+  for (uint8_t ii = 0; ii < Schmi::UNIQUE_ID_SIZE; ii++) {
+    uid.bytes[ii] = seed + ii;
+  }
+
+  return uid;
+}
+}  // namespace
+
+class DeviceStateTest : public ::testing::Test {
+ protected:
+  DeviceStateTest()
+      : file_name_("/tmp/schmi_device_state_test_" + std::to_string(getpid()) + ".txt"), image_(MakeImage(50001)) {
+    unlink(file_name_.c_str());
+  };
+
+  ~DeviceStateTest() { unlink(file_name_.c_str()); };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  // Like a board put on the fixture again: the bootloader starts over, the flash is kept
+  bool FlashImage(Schmi::Stm32Emulator& emulator, Schmi::DeviceStateInterface& state) {
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(&emulator, &bin, &error_, &bar_);
+    fl.SetDeviceState(&state);
+    fl.SetClock(&clock_);
+
+    emulator.Reset();
+    fl.Init();
+    bool flashed = fl.Flash(true, false);
+    result_ = fl.GetDiffFlashResult();
+    timing_ = fl.GetTiming();
+
+    return flashed;
+  };
+
+  bool FlashMatchesImage(Schmi::Stm32Emulator& emulator) {
+    return std::equal(image_.begin(), image_.end(), emulator.GetFlash());
+  };
+
+  std::string file_name_;
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  std::vector<uint8_t> image_;
+  Schmi::DiffFlashResult result_ = {};
+  Schmi::FlashTiming timing_ = {};
+};
+
+TEST_F(DeviceStateTest, RecordsSurviveReload) {
+  Schmi::DeviceRecord record = {2048, 2, 3, 0xCAFEF00D, 5000, 0x12345678};
+  {
+    Schmi::DeviceStateStd state(file_name_);
+    state.Init();
+    state.StartRecord(MakeUid(1));
+    for (uint32_t ii = 0; ii < record.num_pages; ii++) {
+      state.SetPageCrc(ii, 0xA0000000 + ii);
+    }
+    ASSERT_TRUE(state.Commit(record));
+    state.StartRecord(MakeUid(2));
+    ASSERT_TRUE(state.Commit(record));
+  }
+
+  // A line cut short by a crash
+  std::ofstream(file_name_, std::ios::app) << "0102030405060708090a0b0c 2048 0 4 1\n";
+
+  Schmi::DeviceStateStd state(file_name_);
+  state.Init();
+  EXPECT_EQ(2, state.GetNumDevices());
+
+  Schmi::DeviceRecord found;
+  ASSERT_TRUE(state.Find(MakeUid(1), found));
+  EXPECT_EQ(2, found.first_page);
+  EXPECT_EQ(3, found.num_pages);
+  EXPECT_EQ(0xCAFEF00D, found.image_crc);
+  EXPECT_EQ(5000, found.image_size);
+  EXPECT_EQ(0x12345678, found.range_checksum);
+  EXPECT_EQ(0xA0000002, state.GetPageCrc(2));
+
+  state.Forget(MakeUid(1));
+  EXPECT_FALSE(state.Find(MakeUid(1), found));
+  Schmi::DeviceStateStd reloaded(file_name_);
+  reloaded.Init();
+  EXPECT_EQ(1, reloaded.GetNumDevices());
+}
+
+TEST_F(DeviceStateTest, SameImageAgainWritesNothing) {
+  Schmi::Stm32Emulator emulator(clock_);
+  Schmi::DeviceStateStd state(file_name_);
+  state.Init();
+
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_FALSE(result_.used_record);
+  EXPECT_EQ(1, state.GetNumDevices());
+  uint64_t full_us = timing_.total_us;
+  uint64_t bytes_programmed = emulator.GetStats().bytes_programmed;
+  uint32_t pages_erased = emulator.GetStats().pages_erased;
+
+  // Another process, same file
+  Schmi::DeviceStateStd reloaded(file_name_);
+  reloaded.Init();
+  ASSERT_TRUE(FlashImage(emulator, reloaded));
+  EXPECT_TRUE(result_.used_record);
+  EXPECT_EQ(25, result_.pages_in_image);
+  EXPECT_EQ(0, result_.pages_written);
+  EXPECT_EQ(bytes_programmed, emulator.GetStats().bytes_programmed);
+  EXPECT_EQ(pages_erased, emulator.GetStats().pages_erased);
+  EXPECT_TRUE(emulator.IsRunning());
+  EXPECT_LT(timing_.total_us * 10, full_us);
+}
+
+TEST_F(DeviceStateTest, OnlyChangedPagesAreWritten) {
+  Schmi::Stm32Emulator emulator(clock_);
+  Schmi::DeviceStateStd state(file_name_);
+  state.Init();
+  ASSERT_TRUE(FlashImage(emulator, state));
+  uint64_t bytes_programmed = emulator.GetStats().bytes_programmed;
+
+  // A build that changes a constant in page 10 and grows the image into a 26th page
+  image_[10 * 2048 + 100] ^= 0xFF;
+  image_.resize(image_.size() + 2000, 0x42);
+
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_TRUE(result_.used_record);
+  EXPECT_EQ(26, result_.pages_in_image);
+  EXPECT_EQ(3, result_.pages_written);  // 10, and 24 and 25 the image grew into
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+  EXPECT_LT(emulator.GetStats().bytes_programmed - bytes_programmed, 3 * 2048 + 1);
+
+  // The record follows the new image
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_EQ(0, result_.pages_written);
+}
+
+TEST_F(DeviceStateTest, BoardChangedBehindOurBackIsFlashedInFull) {
+  Schmi::Stm32Emulator emulator(clock_);
+  Schmi::DeviceStateStd state(file_name_);
+  state.Init();
+  ASSERT_TRUE(FlashImage(emulator, state));
+
+  // Another tool erased the last page
+  emulator.Reset();
+  Schmi::Stm32 stm32(emulator, error_);
+  ASSERT_TRUE(stm32.InitUsart());
+  uint16_t page = 24;
+  ASSERT_TRUE(stm32.ExtendedErase(&page, 1));
+
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_FALSE(result_.used_record);
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_TRUE(result_.used_record);
+}
+
+TEST_F(DeviceStateTest, ChecksumCommandChecksTheWholeRange) {
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  Schmi::Stm32Emulator emulator(clock_, config);
+  Schmi::DeviceStateStd state(file_name_);
+  state.Init();
+  ASSERT_TRUE(FlashImage(emulator, state));
+
+  // A page in the middle changed, the first and last page check wouldn't see it
+  emulator.Reset();
+  Schmi::Stm32 stm32(emulator, error_);
+  ASSERT_TRUE(stm32.InitUsart());
+  uint16_t page = 12;
+  ASSERT_TRUE(stm32.ExtendedErase(&page, 1));
+
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_FALSE(result_.used_record);
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+
+  image_[3 * 2048] ^= 0x01;
+  uint64_t bytes_sent = emulator.GetStats().bytes_sent;
+  ASSERT_TRUE(FlashImage(emulator, state));
+  EXPECT_TRUE(result_.used_record);
+  EXPECT_EQ(1, result_.pages_written);
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+  EXPECT_LT(emulator.GetStats().bytes_sent - bytes_sent, 200);
+}
+
+TEST_F(DeviceStateTest, BoardsAreTellApartByUniqueId) {
+  Schmi::Stm32Emulator first(clock_);
+  Schmi::EmulatorConfig config;
+  config.unique_id[0] ^= 0xFF;
+  Schmi::Stm32Emulator second(clock_, config);
+  Schmi::DeviceStateStd state(file_name_);
+  state.Init();
+
+  ASSERT_TRUE(FlashImage(first, state));
+  ASSERT_TRUE(FlashImage(second, state));
+  EXPECT_FALSE(result_.used_record);
+  EXPECT_EQ(2, state.GetNumDevices());
+
+  ASSERT_TRUE(FlashImage(first, state));
+  EXPECT_TRUE(result_.used_record);
+}
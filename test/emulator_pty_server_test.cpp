@@ -0,0 +1,41 @@
+#include "Schmi/emulator_pty_server.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/serial_posix.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "test_images.hpp"
+
+#include <algorithm>
+#include <vector>
+
+TEST(EmulatorPtyServerTest, BoardsAreFlashedThroughThePty) {
+  Schmi::SimClock board_clock;
+  Schmi::Stm32Emulator board(board_clock);
+  Schmi::EmulatorPtyServer server(board, true);
+  ASSERT_TRUE(server.Start());
+  EXPECT_EQ(0, server.GetPortPath().compare(0, 9, "/dev/pts/"));
+
+  // The port stays open from board to board, like on a fixture
+  Schmi::SerialPosix ser(server.GetPortPath());
+  ASSERT_TRUE(ser.Open());
+  for (uint8_t seed = 1; seed <= 2; seed++) {
+    std::vector<uint8_t> image = MakeImage(6000, seed);
+    Schmi::BinaryFileMemory bin(image);
+    Schmi::ErrorHandlerCapture error;
+    Schmi::LoadingBarNull bar;
+    Schmi::FlashLoader fl(&ser, &bin, &error, &bar);
+    fl.Init();
+    ASSERT_TRUE(fl.Flash(true, false)) << error.GetLastError().error_string;
+    EXPECT_EQ(seed, server.GetNumBoards());
+    EXPECT_TRUE(std::equal(image.begin(), image.end(), board.GetFlash()));
+  }
+
+  server.Stop();
+  EXPECT_FALSE(board.IsRunning());
+}
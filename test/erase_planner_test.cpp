@@ -0,0 +1,173 @@
+#include "Schmi/erase_planner.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_std.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_std.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+namespace {
+
+// Another board can be plugged into the port between two sessions
+class SwappableSerial : public Schmi::SerialInterface {
+ public:
+  SwappableSerial(Schmi::SerialInterface* ser) : ser_(ser){};
+
+  void Swap(Schmi::SerialInterface* ser) { ser_ = ser; };
+
+  void Init() override { ser_->Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override { return ser_->Write(buffer, buffer_length); };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_->Read(buffer, num_bytes, timeout_ms);
+  };
+
+ private:
+  Schmi::SerialInterface* ser_;
+};
+}  // namespace
+
+class ErasePlannerTest : public ::testing::Test {
+ protected:
+  ErasePlannerTest() {
+    single_bank_ = Schmi::FindChipTiming(0x0468);
+    dual_bank_ = Schmi::FindChipTiming(0x0469);
+  };
+
+  ~ErasePlannerTest(){};
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  Schmi::ChipTiming single_bank_;
+  Schmi::ChipTiming dual_bank_;
+};
+
+TEST_F(ErasePlannerTest, FindChipTiming) {
+  EXPECT_EQ(0x0468, single_bank_.product_id);
+  EXPECT_EQ(128 * 1024, single_bank_.flash_size);
+  EXPECT_EQ(2, dual_bank_.num_banks);
+
+  const Schmi::ChipTiming& unknown = Schmi::FindChipTiming(0x0123);
+  EXPECT_EQ(0, unknown.flash_size);
+}
+
+TEST_F(ErasePlannerTest, SmallImageUsesPageList) {
+  Schmi::ErasePlanner planner(single_bank_);
+  Schmi::ErasePlan plan = planner.Plan(0, 27, false);
+
+  ASSERT_EQ(1, plan.num_steps);
+  EXPECT_EQ(Schmi::EraseType::kPages, plan.steps[0].type);
+  EXPECT_EQ(27, plan.steps[0].num_pages);
+  EXPECT_EQ(27, plan.steps[0].pages_per_message);
+  // Sized for 27 pages at tERASE max, not the old fixed 8000 ms
+  EXPECT_EQ(500 + 27 * 25, plan.steps[0].timeout_ms);
+}
+
+TEST_F(ErasePlannerTest, MassEraseOnlyWhenAllowed) {
+  Schmi::ErasePlanner planner(single_bank_);
+
+  Schmi::ErasePlan plan = planner.Plan(0, 27, true);
+  ASSERT_EQ(1, plan.num_steps);
+  EXPECT_EQ(Schmi::EraseType::kMass, plan.steps[0].type);
+  EXPECT_EQ(0xFFFF, plan.steps[0].special_code);
+
+  // A single page is still cheaper page by page
+  plan = planner.Plan(3, 1, true);
+  EXPECT_EQ(Schmi::EraseType::kPages, plan.steps[0].type);
+}
+
+TEST_F(ErasePlannerTest, ImageCoveringWholeFlashUsesMassErase) {
+  Schmi::ErasePlanner planner(single_bank_);
+  Schmi::ErasePlan plan = planner.Plan(0, 64, false);
+
+  ASSERT_EQ(1, plan.num_steps);
+  EXPECT_EQ(Schmi::EraseType::kMass, plan.steps[0].type);
+}
+
+TEST_F(ErasePlannerTest, FullBankUsesBankErase) {
+  Schmi::ErasePlanner planner(dual_bank_);
+  // Bank 1 is pages 0 - 127, the image spills 10 pages into bank 2
+  Schmi::ErasePlan plan = planner.Plan(0, 138, false);
+
+  ASSERT_EQ(2, plan.num_steps);
+  EXPECT_EQ(Schmi::EraseType::kBank, plan.steps[0].type);
+  EXPECT_EQ(0xFFFE, plan.steps[0].special_code);
+  EXPECT_EQ(Schmi::EraseType::kPages, plan.steps[1].type);
+  EXPECT_EQ(128, plan.steps[1].first_page);
+  EXPECT_EQ(10, plan.steps[1].num_pages);
+}
+
+TEST_F(ErasePlannerTest, NoPagesCostNothing) {
+  Schmi::ErasePlanner planner(single_bank_);
+  EXPECT_EQ(0, planner.EstimatePagesUs(0));
+  EXPECT_EQ(0, planner.Plan(3, 0, true).num_steps);
+}
+
+TEST_F(ErasePlannerTest, BatchesAreEvenAndBounded) {
+  Schmi::ChipTiming chip = Schmi::FindChipTiming(0x0422);
+  // 40 ms max per page and 4 s per message: 87 pages max per message
+  Schmi::ErasePlanner planner(chip, Schmi::DEFAULT_LINK_TIMING, 4000);
+  Schmi::ErasePlan plan = planner.Plan(0, 100, false);
+
+  ASSERT_EQ(1, plan.num_steps);
+  EXPECT_EQ(50, plan.steps[0].pages_per_message);
+  EXPECT_EQ(500 + 50 * 40, plan.steps[0].timeout_ms);
+}
+
+TEST_F(ErasePlannerTest, FlashLoaderFollowsPlan) {
+  Schmi::SimClock clock;
+  Schmi::EmulatorConfig config;
+  config.product_id = 0x0469;
+  config.flash_size = 512 * 1024;
+  config.num_banks = 2;
+  Schmi::Stm32Emulator emulator(clock, config);
+  emulator.FillFlash(0x00);
+
+  Schmi::ErrorHandlerCapture error;
+  Schmi::BinaryFileStd bin("../test_files/1048583_V6-3.bin");
+  Schmi::LoadingBarStd bar;
+  Schmi::FlashLoader fl(&emulator, &bin, &error, &bar);
+  fl.SetAllowEraseOutsideImage(true);
+
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  // 27 pages all in bank 1, a bank erase beats 27 page erases
+  const Schmi::ErasePlan& plan = fl.GetErasePlan();
+  ASSERT_EQ(1, plan.num_steps);
+  EXPECT_EQ(Schmi::EraseType::kBank, plan.steps[0].type);
+  EXPECT_EQ(0xFF, emulator.GetFlash()[config.flash_size / 2 - 1]);
+  EXPECT_EQ(0x00, emulator.GetFlash()[config.flash_size / 2]);
+}
+
+TEST_F(ErasePlannerTest, EveryBoardIsLookedUpAgain) {
+  Schmi::SimClock clock;
+  Schmi::EmulatorConfig dual_config;
+  dual_config.product_id = 0x0469;
+  dual_config.flash_size = 512 * 1024;
+  dual_config.num_banks = 2;
+  Schmi::Stm32Emulator dual(clock, dual_config);
+  Schmi::Stm32Emulator single(clock);
+  SwappableSerial port(&dual);
+
+  Schmi::ErrorHandlerCapture error;
+  Schmi::BinaryFileStd bin("../test_files/1048583_V6-3.bin");
+  Schmi::LoadingBarStd bar;
+  Schmi::FlashLoader fl(&port, &bin, &error, &bar);
+  fl.SetAllowEraseOutsideImage(true);
+  fl.Init();
+
+  ASSERT_TRUE(fl.Flash(true, false));
+  EXPECT_EQ(Schmi::EraseType::kBank, fl.GetErasePlan().steps[0].type);
+
+  // A single bank chip has no bank erase, a mass erase is the fastest there
+  port.Swap(&single);
+  ASSERT_TRUE(fl.Flash(true, false));
+  ASSERT_EQ(1, fl.GetErasePlan().num_steps);
+  EXPECT_EQ(Schmi::EraseType::kMass, fl.GetErasePlan().steps[0].type);
+}
@@ -0,0 +1,116 @@
+#include "Schmi/event_ring.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/event_pump.hpp"
+#include "Schmi/event_ring_session.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(EventRingTest, FullRingDropsInsteadOfWaiting) {
+  Schmi::EventRing ring;
+  Schmi::SessionEvent event;
+  EXPECT_FALSE(ring.Pop(event));
+
+  // Around the end of the buffer a few times
+  for (uint32_t round = 0; round < 3; round++) {
+    for (uint32_t ii = 0; ii < Schmi::EventRing::CAPACITY - 1; ii++) {
+      ASSERT_TRUE(ring.Push(Schmi::EventKind::kProgress, ii, round));
+    }
+    EXPECT_FALSE(ring.Push(Schmi::EventKind::kProgress, -1, round));
+
+    // The last slot is kept for an error
+    ASSERT_TRUE(ring.Push(Schmi::EventKind::kError, Schmi::EventRing::CAPACITY - 1, round));
+    EXPECT_FALSE(ring.Push(Schmi::EventKind::kError, -1, round));
+
+    for (uint32_t ii = 0; ii < Schmi::EventRing::CAPACITY; ii++) {
+      ASSERT_TRUE(ring.Pop(event));
+      EXPECT_EQ(ii, event.num);
+      EXPECT_EQ(round, event.value);
+    }
+    EXPECT_EQ(Schmi::EventKind::kError, event.kind);
+    EXPECT_FALSE(ring.Pop(event));
+  }
+  EXPECT_EQ(6, ring.GetNumDropped());
+
+  // Text is cut short and stays terminated
+  std::string long_text(100, 'x');
+  ASSERT_TRUE(ring.Push(Schmi::EventKind::kWarning, 7, 0, long_text.c_str()));
+  ASSERT_TRUE(ring.Pop(event));
+  EXPECT_EQ(Schmi::SessionEvent::TEXT_SIZE - 1, strlen(event.text));
+}
+
+TEST(EventRingTest, EventsCrossThreadsInOrder) {
+  Schmi::EventRing ring;
+  const int32_t NUM_EVENTS = 200000;
+
+  std::vector<int32_t> received;
+  Schmi::EventPump pump(ring, [&](const Schmi::SessionEvent& event) { received.push_back(event.num); }, 100);
+  pump.Start();
+  std::thread producer([&] {
+    for (int32_t ii = 0; ii < NUM_EVENTS; ii++) {
+      ring.Push(Schmi::EventKind::kProgress, ii, 0);
+    }
+  });
+  producer.join();
+  pump.Stop();
+
+  // Whatever was dropped, the rest came through once and in order
+  EXPECT_EQ(NUM_EVENTS, received.size() + ring.GetNumDropped());
+  for (size_t ii = 1; ii < received.size(); ii++) {
+    ASSERT_LT(received[ii - 1], received[ii]);
+  }
+}
+
+TEST(EventRingTest, SessionOnlyQueuesItsProgressAndErrors) {
+  Schmi::SimClock clock;
+  Schmi::Stm32Emulator emulator(clock);
+  std::vector<uint8_t> image(20000, 0x5A);
+  Schmi::BinaryFileMemory bin(image);
+
+  Schmi::EventRing ring;
+  Schmi::RingErrorHandler error(ring);
+  Schmi::RingLoadingBar bar(ring);
+  std::vector<Schmi::SessionEvent> events;
+  Schmi::EventPump pump(ring, [&](const Schmi::SessionEvent& event) { events.push_back(event); });
+
+  Schmi::FlashLoader fl(&emulator, &bin, &error, &bar);
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+  pump.Drain();
+
+  // A write and a verify, each with one event per percent at most
+  ASSERT_GE(events.size(), 4);
+  EXPECT_EQ(Schmi::EventKind::kWriteStart, events[0].kind);
+  EXPECT_EQ(image.size(), events[0].value);
+  uint32_t num_starts = 0;
+  uint32_t num_progress = 0;
+  for (const auto& event : events) {
+    num_starts += event.kind == Schmi::EventKind::kWriteStart || event.kind == Schmi::EventKind::kVerifyStart;
+    num_progress += event.kind == Schmi::EventKind::kProgress;
+  }
+  EXPECT_EQ(2, num_starts);
+  EXPECT_LE(num_progress, 2 * 101);
+  EXPECT_EQ(Schmi::EventKind::kEnd, events.back().kind);
+  EXPECT_EQ(0, ring.GetNumDropped());
+
+  // A failing session comes back with false, the error is in the ring
+  events.clear();
+  emulator.Reset();
+  emulator.SetWeakPage(2, 1);
+  fl.Init();
+  EXPECT_FALSE(fl.Flash(true, false));
+  EXPECT_TRUE(error.HasDied());
+  pump.Drain();
+  ASSERT_FALSE(events.empty());
+  EXPECT_EQ(Schmi::EventKind::kError, events.back().kind);
+  EXPECT_STREQ("CheckBytes: Bytes do not match", events.back().text);
+}
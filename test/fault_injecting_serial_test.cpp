@@ -0,0 +1,115 @@
+#include "Schmi/fault_injecting_serial.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+class FaultInjectingSerialTest : public ::testing::Test {
+ protected:
+  FaultInjectingSerialTest() { emulator_ = new Schmi::Stm32Emulator(clock_); };
+
+  ~FaultInjectingSerialTest() { delete emulator_; };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::Stm32Emulator* emulator_;
+};
+
+TEST_F(FaultInjectingSerialTest, NoFaultsIsTransparent) {
+  Schmi::FaultInjectingSerial ser(*emulator_, clock_, Schmi::FaultConfig());
+  Schmi::Stm32 stm32(ser, error_);
+
+  ASSERT_TRUE(stm32.InitUsart());
+  uint16_t id;
+  ASSERT_TRUE(stm32.GetID(id));
+
+  const Schmi::FaultStats& stats = ser.GetStats();
+  EXPECT_EQ(0, stats.dropped_bytes + stats.corrupted_bytes + stats.spurious_nacks);
+  EXPECT_EQ(0, stats.injected_delay_us);
+}
+
+TEST_F(FaultInjectingSerialTest, LatencyIsChargedToClock) {
+  Schmi::FaultConfig config;
+  config.latency_us = 1000;
+  Schmi::FaultInjectingSerial ser(*emulator_, clock_, config);
+  Schmi::Stm32 stm32(ser, error_);
+
+  ASSERT_TRUE(stm32.InitUsart());
+
+  // One write and one read for the sync
+  EXPECT_EQ(2000, ser.GetStats().injected_delay_us);
+  EXPECT_GE(clock_.NowUs(), 2000);
+}
+
+TEST_F(FaultInjectingSerialTest, CorruptedCommandIsNacked) {
+  Schmi::FaultConfig config;
+  Schmi::FaultInjectingSerial ser(*emulator_, clock_, config);
+  Schmi::Stm32 stm32(ser, error_);
+  ASSERT_TRUE(stm32.InitUsart());
+
+  config.corrupt_byte_rate = 1.0;
+  ser.SetConfig(config);
+  uint16_t id;
+  EXPECT_FALSE(stm32.GetID(id));
+  EXPECT_GT(ser.GetStats().corrupted_bytes, 0);
+}
+
+TEST_F(FaultInjectingSerialTest, SpuriousNack) {
+  Schmi::FaultConfig config;
+  config.spurious_nack_rate = 1.0;
+  Schmi::FaultInjectingSerial ser(*emulator_, clock_, config);
+  Schmi::Stm32 stm32(ser, error_);
+
+  EXPECT_FALSE(stm32.InitUsart());
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_EQ(1, ser.GetStats().spurious_nacks);
+}
+
+TEST_F(FaultInjectingSerialTest, PartialReadLeavesBytesInPort) {
+  Schmi::FaultConfig config;
+  config.partial_read_rate = 1.0;
+  Schmi::FaultInjectingSerial ser(*emulator_, clock_, config);
+  Schmi::Stm32 stm32(ser, error_);
+  ASSERT_TRUE(stm32.InitUsart());
+
+  uint16_t id;
+  EXPECT_FALSE(stm32.GetID(id));
+  EXPECT_EQ(1, ser.GetStats().partial_reads);
+
+  // GET_ID answers N, PID high, PID low, ACK: only half of it was consumed
+  uint8_t stale[2];
+  EXPECT_EQ(0, emulator_->Read(stale, 2));
+  EXPECT_EQ(Schmi::CMD::ACK, stale[1]);
+}
+
+TEST_F(FaultInjectingSerialTest, SameSeedSameFaults) {
+  Schmi::FaultConfig config;
+  config.seed = 42;
+  config.latency_jitter_us = 500;
+  config.corrupt_byte_rate = 0.2;
+  Schmi::FaultInjectingSerial ser(*emulator_, clock_, config);
+
+  uint8_t bytes[64] = {0};
+  for (int ii = 0; ii < 64; ii++) {
+    ser.Write(bytes, 1);
+  }
+  Schmi::FaultStats first_stats = ser.GetStats();
+
+  ser.Reset();
+  for (int ii = 0; ii < 64; ii++) {
+    ser.Write(bytes, 1);
+  }
+  Schmi::FaultStats second_stats = ser.GetStats();
+
+  EXPECT_GT(first_stats.corrupted_bytes, 0);
+  EXPECT_EQ(first_stats.corrupted_bytes, second_stats.corrupted_bytes);
+  EXPECT_EQ(first_stats.injected_delay_us, second_stats.injected_delay_us);
+}
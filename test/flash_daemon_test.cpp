@@ -0,0 +1,467 @@
+#include "Schmi/flash_daemon.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/serial_posix.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Holds the writes of a port until Release, so a test can see jobs sitting on busy ports
+class GatedSerial : public Schmi::SerialInterface {
+ public:
+  GatedSerial(Schmi::SerialInterface& ser) : ser_(ser){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return open_; });
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+  void FlushInput() override { ser_.FlushInput(); };
+
+  void Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = true;
+    cv_.notify_all();
+  };
+
+ private:
+  Schmi::SerialInterface& ser_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool open_ = false;
+};
+
+// An adapter that can be pulled: it can't be opened while unplugged, and an open port goes dead
+class UnpluggableSerial : public Schmi::SerialInterface {
+ public:
+  UnpluggableSerial(Schmi::SerialInterface& ser) : ser_(ser){};
+
+  void Init() override{};
+  bool Open() override {
+    if (open_) {
+      return 1;
+    }
+    if (!plugged_) {
+      return 0;
+    }
+    open_ = true;
+    num_opens_++;
+    return 1;
+  };
+  void Close() override { open_ = false; };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    return plugged_ ? ser_.Write(buffer, buffer_length) : -1;
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return plugged_ ? ser_.Read(buffer, num_bytes, timeout_ms) : -1;
+  };
+  void FlushInput() override { ser_.FlushInput(); };
+
+  void SetPlugged(const bool& plugged) { plugged_ = plugged; };
+  uint32_t GetNumOpens() const { return num_opens_; };
+
+ private:
+  Schmi::SerialInterface& ser_;
+  std::atomic<bool> plugged_{false};
+  std::atomic<bool> open_{false};
+  std::atomic<uint32_t> num_opens_{0};
+};
+
+// Station side of the socket, one line per request and per answer
+class DaemonClient {
+ public:
+  DaemonClient(const std::string& socket_path) {
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    socket_path.copy(address.sun_path, socket_path.size());
+    connected_ = connect(fd_, (sockaddr*)&address, sizeof(address)) == 0;
+  };
+  ~DaemonClient() { close(fd_); };
+
+  bool IsConnected() const { return connected_; };
+
+  void Send(const std::string& line) {
+    std::string out = line + "\n";
+    EXPECT_EQ((ssize_t)out.size(), write(fd_, out.data(), out.size()));
+  };
+
+  // Next line, empty after 5 s without one
+  std::string ReadLine() {
+    size_t end;
+    while ((end = input_.find('\n')) == std::string::npos) {
+      pollfd fd = {fd_, POLLIN, 0};
+      if (poll(&fd, 1, 5000) <= 0) {
+        return "";
+      }
+      char buffer[512];
+      ssize_t num_bytes = read(fd_, buffer, sizeof(buffer));
+      if (num_bytes <= 0) {
+        return "";
+      }
+      input_.append(buffer, num_bytes);
+    }
+
+    std::string line = input_.substr(0, end);
+    input_.erase(0, end + 1);
+    return line;
+  };
+
+  // Skips PROGRESS events until a line starting with prefix
+  std::string ReadUntil(const std::string& prefix, uint32_t* num_progress = nullptr) {
+    std::string line;
+    while (!(line = ReadLine()).empty()) {
+      if (line.compare(0, prefix.size(), prefix) == 0) {
+        return line;
+      }
+      if (num_progress && line.compare(0, 9, "PROGRESS ") == 0) {
+        (*num_progress)++;
+      }
+    }
+    return line;
+  };
+
+ private:
+  int fd_;
+  bool connected_;
+  std::string input_;
+};
+}  // namespace
+
+class FlashDaemonTest : public ::testing::Test {
+ protected:
+  FlashDaemonTest() : socket_path_("/tmp/schmi_daemon_test_" + std::to_string(getpid()) + ".sock") {
+    for (uint8_t ii = 0; ii < NUM_PORTS; ii++) {
+      emulators_[ii] = new Schmi::Stm32Emulator(clocks_[ii]);
+      emulators_[ii]->FillFlash(0x00);
+    }
+    daemon_ = new Schmi::FlashDaemon(socket_path_);
+  };
+
+  ~FlashDaemonTest() {
+    delete daemon_;
+    for (uint8_t ii = 0; ii < NUM_PORTS; ii++) {
+      delete emulators_[ii];
+    }
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  std::string WriteImage(const std::string& name, const std::vector<uint8_t>& image) {
+    std::string path = "/tmp/schmi_daemon_test_" + std::to_string(getpid()) + "_" + name;
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)image.data(), image.size());
+    images_.push_back(path);
+    return path;
+  };
+
+  void StartDaemon() {
+    daemon_->AddPort("ttyUSB0", emulators_[0], &clocks_[0]);
+    daemon_->AddPort("ttyUSB1", emulators_[1], &clocks_[1]);
+    ASSERT_TRUE(daemon_->Start());
+  };
+
+  bool FlashMatches(const uint8_t& port, const std::vector<uint8_t>& image) {
+    return std::equal(image.begin(), image.end(), emulators_[port]->GetFlash());
+  };
+
+  void CleanUp() {
+    daemon_->Stop();
+    for (auto& path : images_) {
+      unlink(path.c_str());
+    }
+  };
+
+  static const uint8_t NUM_PORTS = 2;
+
+  std::string socket_path_;
+  Schmi::SimClock clocks_[NUM_PORTS];
+  Schmi::Stm32Emulator* emulators_[NUM_PORTS];
+  Schmi::FlashDaemon* daemon_;
+  std::vector<std::string> images_;
+};
+
+TEST_F(FlashDaemonTest, LoadIsKeyedByContent) {
+  std::vector<uint8_t> image = MakeImage(10000, 1);
+  std::string path = WriteImage("a.bin", image);
+  std::string copy = WriteImage("copy.bin", image);
+  StartDaemon();
+
+  DaemonClient client(socket_path_);
+  ASSERT_TRUE(client.IsConnected());
+  client.Send("LOAD " + path);
+  std::string first = client.ReadLine();
+  EXPECT_THAT(first, ::testing::MatchesRegex("IMAGE [0-9a-f]{8}-10000 10000"));
+
+  client.Send("LOAD " + copy);
+  EXPECT_EQ(first, client.ReadLine());
+
+  client.Send("LOAD /nonexistent/image.bin");
+  EXPECT_EQ("ERROR cannot open /nonexistent/image.bin", client.ReadLine());
+
+  client.Send("FLASH 00000000-1");
+  EXPECT_EQ("ERROR unknown image 00000000-1", client.ReadLine());
+
+  client.Send("REBOOT");
+  EXPECT_EQ("ERROR unknown request REBOOT", client.ReadLine());
+
+  CleanUp();
+}
+
+TEST_F(FlashDaemonTest, JobsAreSpreadOverPortsAndStreamed) {
+  std::vector<uint8_t> image = MakeImage(40000, 2);
+  std::string path = WriteImage("b.bin", image);
+  GatedSerial port_0(*emulators_[0]);
+  GatedSerial port_1(*emulators_[1]);
+  daemon_->AddPort("ttyUSB0", &port_0, &clocks_[0]);
+  daemon_->AddPort("ttyUSB1", &port_1, &clocks_[1]);
+  ASSERT_TRUE(daemon_->Start());
+
+  DaemonClient client(socket_path_);
+  client.Send("LOAD " + path);
+  std::string image_id = client.ReadLine().substr(6, 14);
+
+  client.Send("FLASH " + image_id);
+  EXPECT_EQ("QUEUED 1", client.ReadLine());
+  client.Send("FLASH " + image_id);
+  EXPECT_EQ("QUEUED 2", client.ReadLine());
+
+  // One job on each port, both waiting for their board
+  std::string status;
+  for (uint32_t ii = 0; ii < 100 && status != "PORT ttyUSB1 BUSY 0"; ii++) {
+    usleep(1000);
+    client.Send("STATUS");
+    client.ReadLine();
+    status = client.ReadLine();
+    client.ReadLine();
+  }
+  client.Send("STATUS");
+  EXPECT_EQ("PORT ttyUSB0 BUSY 0", client.ReadLine());
+  EXPECT_EQ("PORT ttyUSB1 BUSY 0", client.ReadLine());
+  EXPECT_EQ("QUEUE 0", client.ReadLine());
+  port_0.Release();
+  port_1.Release();
+
+  uint32_t num_progress = 0;
+  std::string done_1 = client.ReadUntil("DONE ", &num_progress);
+  std::string done_2 = client.ReadUntil("DONE ", &num_progress);
+  EXPECT_THAT(done_1, ::testing::MatchesRegex("DONE [12] ttyUSB[01] OK [0-9]+"));
+  EXPECT_THAT(done_2, ::testing::MatchesRegex("DONE [12] ttyUSB[01] OK [0-9]+"));
+  EXPECT_NE(done_1.substr(7, 7), done_2.substr(7, 7));
+  EXPECT_GT(num_progress, 2 * 100);
+
+  client.Send("STATUS");
+  EXPECT_EQ("PORT ttyUSB0 IDLE 1", client.ReadLine());
+  EXPECT_EQ("PORT ttyUSB1 IDLE 1", client.ReadLine());
+  EXPECT_EQ("QUEUE 0", client.ReadLine());
+
+  CleanUp();
+  EXPECT_TRUE(FlashMatches(0, image));
+  EXPECT_TRUE(FlashMatches(1, image));
+}
+
+TEST_F(FlashDaemonTest, PortCanBeChosenAndReused) {
+  std::vector<uint8_t> first = MakeImage(20000, 3);
+  std::vector<uint8_t> second = MakeImage(30000, 4);
+  std::string first_path = WriteImage("c.bin", first);
+  std::string second_path = WriteImage("d.bin", second);
+  StartDaemon();
+
+  DaemonClient client(socket_path_);
+  client.Send("LOAD " + first_path);
+  std::string first_id = client.ReadLine().substr(6, 14);
+  client.Send("LOAD " + second_path);
+  std::string second_id = client.ReadLine().substr(6, 14);
+
+  client.Send("FLASH " + first_id + " ttyUSB1");
+  EXPECT_EQ("QUEUED 1", client.ReadLine());
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 1 ttyUSB1 OK"));
+
+  // The emulator is reset like a new board on the fixture, the port stays open
+  emulators_[1]->Reset();
+  client.Send("FLASH " + second_id + " ttyUSB1");
+  EXPECT_EQ("QUEUED 2", client.ReadLine());
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 2 ttyUSB1 OK"));
+
+  client.Send("FLASH " + first_id + " ttyUSB7");
+  EXPECT_EQ("ERROR unknown port ttyUSB7", client.ReadLine());
+
+  // ACK round trips of both jobs, none on the port that stayed unused
+  client.Send("LATENCY");
+  EXPECT_EQ("LATENCY ttyUSB0 0 0 0 0 0", client.ReadLine());
+  EXPECT_THAT(client.ReadLine(), ::testing::MatchesRegex("LATENCY ttyUSB1 [1-9][0-9]+ [0-9]+ [0-9]+ [0-9]+ [0-9]+"));
+
+  CleanUp();
+  EXPECT_TRUE(FlashMatches(1, second));
+  EXPECT_EQ(0, emulators_[0]->GetStats().commands);
+}
+
+TEST_F(FlashDaemonTest, FailureIsReportedAndDaemonGoesOn) {
+  std::vector<uint8_t> image = MakeImage(20000, 5);
+  std::string path = WriteImage("e.bin", image);
+  StartDaemon();
+
+  DaemonClient client(socket_path_);
+  client.Send("LOAD " + path);
+  std::string image_id = client.ReadLine().substr(6, 14);
+
+  // Image past the end of the flash of the emulator, it NACKs the write
+  std::vector<uint8_t> too_big = MakeImage(200 * 1024, 6);
+  client.Send("LOAD " + WriteImage("f.bin", too_big));
+  std::string too_big_id = client.ReadLine().substr(6, 15);
+
+  client.Send("FLASH " + too_big_id + " ttyUSB0");
+  EXPECT_EQ("QUEUED 1", client.ReadLine());
+  std::string done = client.ReadUntil("DONE ");
+  EXPECT_THAT(done, ::testing::StartsWith("DONE 1 ttyUSB0 FAIL "));
+  EXPECT_EQ(std::string::npos, done.find("REJECTED"));
+
+  emulators_[0]->Reset();
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  EXPECT_EQ("QUEUED 2", client.ReadLine());
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 2 ttyUSB0 OK"));
+
+  CleanUp();
+  EXPECT_TRUE(FlashMatches(0, image));
+}
+
+TEST_F(FlashDaemonTest, RejectedBoardReportsWhen) {
+  std::vector<uint8_t> image = MakeImage(20000, 10);
+  std::string path = WriteImage("i.bin", image);
+  emulators_[0]->SetWeakPage(2, 1);
+  daemon_->SetInlineVerify(true);
+  StartDaemon();
+
+  DaemonClient client(socket_path_);
+  client.Send("LOAD " + path);
+  std::string image_id = client.ReadLine().substr(6, 14);
+
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  EXPECT_THAT(client.ReadUntil("DONE "),
+              ::testing::MatchesRegex("DONE 1 ttyUSB0 FAIL FlashAndVerifyPages: .* REJECTED [1-9][0-9]*"));
+
+  CleanUp();
+}
+
+TEST_F(FlashDaemonTest, PortThatCantBeOpenedOnlyFailsItsJobs) {
+  std::vector<uint8_t> image = MakeImage(20000, 8);
+  std::string path = WriteImage("g.bin", image);
+  UnpluggableSerial port_0(*emulators_[0]);
+  Schmi::SerialPosix missing("/nonexistent/ttyNOPE0");
+  daemon_->AddPort("ttyUSB0", &port_0, &clocks_[0]);
+  daemon_->AddPort("ttyUSB1", emulators_[1], &clocks_[1]);
+  daemon_->AddPort("ttyNOPE0", &missing);
+  ASSERT_TRUE(daemon_->Start());
+
+  DaemonClient client(socket_path_);
+  client.Send("LOAD " + path);
+  std::string image_id = client.ReadLine().substr(6, 14);
+
+  client.Send("FLASH " + image_id + " ttyNOPE0");
+  EXPECT_EQ("DONE 1 ttyNOPE0 FAIL open", client.ReadUntil("DONE "));
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  EXPECT_EQ("DONE 2 ttyUSB0 FAIL open", client.ReadUntil("DONE "));
+  client.Send("FLASH " + image_id + " ttyUSB1");
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 3 ttyUSB1 OK"));
+
+  // Plugged in later
+  port_0.SetPlugged(true);
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 4 ttyUSB0 OK"));
+  EXPECT_EQ(1, port_0.GetNumOpens());
+
+  // Pulled mid-session and put back, the port is opened again instead of keeping the dead one
+  port_0.SetPlugged(false);
+  emulators_[0]->Reset();
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 5 ttyUSB0 FAIL "));
+  port_0.SetPlugged(true);
+  emulators_[0]->Reset();
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::StartsWith("DONE 6 ttyUSB0 OK"));
+  EXPECT_EQ(2, port_0.GetNumOpens());
+
+  CleanUp();
+  EXPECT_TRUE(FlashMatches(0, image));
+}
+
+TEST_F(FlashDaemonTest, StationThatStopsReadingDoesntHoldUpThePorts) {
+  std::vector<uint8_t> image = MakeImage(20000, 9);
+  std::string path = WriteImage("h.bin", image);
+  StartDaemon();
+
+  DaemonClient stuck(socket_path_);
+  DaemonClient station(socket_path_);
+  station.Send("LOAD " + path);
+  std::string image_id = station.ReadLine().substr(6, 14);
+
+  // More answers than the socket holds, never read, then a job whose events have nowhere to go
+  std::string requests;
+  for (uint32_t ii = 0; ii < 10000; ii++) {
+    requests += "STATUS\n";
+  }
+  stuck.Send(requests + "FLASH " + image_id + " ttyUSB0");
+
+  std::string status;
+  for (uint32_t ii = 0; ii < 500 && status != "PORT ttyUSB0 IDLE 1"; ii++) {
+    usleep(1000);
+    station.Send("STATUS");
+    status = station.ReadLine();
+    station.ReadLine();
+    station.ReadLine();
+  }
+  EXPECT_EQ("PORT ttyUSB0 IDLE 1", status);
+
+  CleanUp();
+  EXPECT_TRUE(FlashMatches(0, image));
+}
+
+TEST_F(FlashDaemonTest, JobsOnOneChipTakeTurns) {
+  std::vector<uint8_t> image = MakeImage(20000, 7);
+  std::string path = WriteImage("f.bin", image);
+  // Two channels of one chip, one block at a time
+  Schmi::LinkLimits limits;
+  limits.max_transfers_per_chip = 1;
+  Schmi::LinkScheduler links(limits);
+  links.AddPort({"ttyUSB0", "1-1.2:1.0", "1-1.2", "1-1"});
+  links.AddPort({"ttyUSB1", "1-1.2:1.1", "1-1.2", "1-1"});
+  daemon_->SetLinkScheduler(&links);
+  StartDaemon();
+
+  DaemonClient client(socket_path_);
+  client.Send("LOAD " + path);
+  std::string image_id = client.ReadLine().substr(6, 14);
+  client.Send("FLASH " + image_id + " ttyUSB0");
+  client.Send("FLASH " + image_id + " ttyUSB1");
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::MatchesRegex("DONE [12] ttyUSB[01] OK [0-9]+"));
+  EXPECT_THAT(client.ReadUntil("DONE "), ::testing::MatchesRegex("DONE [12] ttyUSB[01] OK [0-9]+"));
+
+  client.Send("LINKS");
+  EXPECT_THAT(client.ReadLine(), ::testing::MatchesRegex("LINK 1-1 hub 2 [0-9]+ [12] [0-9]+"));
+  EXPECT_THAT(client.ReadLine(), ::testing::MatchesRegex("LINK 1-1.2 chip 2 [0-9]+ 1 [0-9]+"));
+
+  CleanUp();
+  EXPECT_TRUE(FlashMatches(0, image));
+  EXPECT_TRUE(FlashMatches(1, image));
+}
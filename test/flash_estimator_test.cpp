@@ -0,0 +1,148 @@
+#include "Schmi/flash_estimator.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <cmath>
+#include <vector>
+
+// The emulator charges the same costs as the model, a dry run has to land within a few percent
+// of what FlashLoader takes against it
+class FlashEstimatorTest : public ::testing::Test {
+ protected:
+  FlashEstimatorTest() : image_(100003, 0x5A), chip_(Schmi::FindChipTiming(0x0468)){};
+
+  ~FlashEstimatorTest(){};
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  Schmi::FlashTiming FlashImage(const Schmi::EmulatorConfig& config) {
+    Schmi::SimClock clock;
+    Schmi::Stm32Emulator emulator(clock, config);
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(&emulator, &bin, &error_, &bar_);
+    fl.SetClock(&clock);
+
+    fl.Init();
+    EXPECT_TRUE(fl.Flash(true, false));
+
+    return fl.GetTiming();
+  };
+
+  Schmi::CostModel ModelOf(const Schmi::EmulatorConfig& config) {
+    Schmi::CostModel model = {{config.baud_rate, config.ack_latency_us},
+                              config.page_erase_us,
+                              config.mass_erase_us,
+                              config.program_us_per_byte * 1000,
+                              config.checksum_us_per_kb};
+    return model;
+  };
+
+  void ExpectNear(const uint64_t& expected_us, const uint64_t& actual_us) {
+    EXPECT_NEAR((double)expected_us, (double)actual_us, 0.02 * expected_us + 2000);
+  };
+
+  std::vector<uint8_t> image_;
+  Schmi::ChipTiming chip_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+};
+
+TEST_F(FlashEstimatorTest, CountsFramesOfEveryPhase) {
+  Schmi::FlashEstimator estimator(chip_, Schmi::MakeCostModel(chip_));
+  Schmi::FlashEstimate estimate = estimator.Estimate(image_.size());
+
+  // 391 writes, the last one of 163 bytes padded to 164
+  uint32_t num_writes = (image_.size() + 255) / 256;
+  EXPECT_EQ(3 * num_writes, estimate.write.round_trips);
+  EXPECT_EQ(390 * 256 + 164, estimate.bytes_programmed);
+  EXPECT_EQ(num_writes * (2 + 5 + 2) + estimate.bytes_programmed, estimate.write.bytes_sent);
+  EXPECT_EQ(3 * num_writes + image_.size(), estimate.verify.bytes_received);
+
+  EXPECT_EQ(49, estimate.pages_erased);
+  EXPECT_EQ(2, estimate.go.round_trips);
+  EXPECT_EQ(estimate.connect.estimated_us + estimate.discover.estimated_us + estimate.erase.estimated_us +
+                estimate.write.estimated_us + estimate.verify.estimated_us + estimate.go.estimated_us,
+            estimate.total_us);
+}
+
+TEST_F(FlashEstimatorTest, MatchesEmulatorPhaseByPhase) {
+  Schmi::EmulatorConfig config;
+  Schmi::FlashTiming measured = FlashImage(config);
+
+  Schmi::FlashEstimator estimator(chip_, ModelOf(config));
+  Schmi::FlashEstimate estimate = estimator.Estimate(image_.size());
+
+  ExpectNear(measured.sync_done_us, estimate.connect.estimated_us);
+  ExpectNear(measured.erase_done_us - measured.sync_done_us,
+             estimate.discover.estimated_us + estimate.erase.estimated_us);
+  ExpectNear(measured.write_done_us - measured.erase_done_us, estimate.write.estimated_us);
+  ExpectNear(measured.verify_done_us - measured.write_done_us, estimate.verify.estimated_us);
+  ExpectNear(measured.total_us, estimate.total_us);
+}
+
+TEST_F(FlashEstimatorTest, ChecksumVerifyAndFasterLink) {
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  config.baud_rate = 460800;
+  Schmi::FlashTiming measured = FlashImage(config);
+
+  Schmi::DryRunOptions options;
+  options.verify = Schmi::VerifyStrategy::kChecksum;
+  Schmi::FlashEstimator estimator(chip_, ModelOf(config));
+  Schmi::FlashEstimate estimate = estimator.Estimate(image_.size(), options);
+
+  EXPECT_EQ(3, estimate.verify.round_trips);
+  ExpectNear(measured.verify_done_us - measured.write_done_us, estimate.verify.estimated_us);
+  ExpectNear(measured.total_us, estimate.total_us);
+}
+
+TEST_F(FlashEstimatorTest, CalibrationRecoversTheLink) {
+  // A slow adapter and a slow part, the default model is way off
+  Schmi::EmulatorConfig config;
+  config.ack_latency_us = 4000;
+  config.program_us_per_byte = 25;
+  config.page_erase_us = 30000;
+  Schmi::FlashTiming measured = FlashImage(config);
+
+  Schmi::CostModel model = Schmi::MakeCostModel(chip_);
+  Schmi::FlashEstimate estimate = Schmi::FlashEstimator(chip_, model).Estimate(image_.size());
+  EXPECT_GT(std::abs((double)measured.total_us - (double)estimate.total_us), 0.2 * measured.total_us);
+
+  Schmi::CostModel fitted = Schmi::CalibrateCostModel(model, estimate, measured);
+  EXPECT_NEAR(4000, fitted.link.round_trip_us, 100);
+  EXPECT_NEAR(25000, fitted.program_ns_per_byte, 1000);
+  EXPECT_NEAR(30000, fitted.page_erase_us, 1000);
+
+  Schmi::FlashEstimator calibrated(chip_, fitted);
+  calibrated.Price(estimate);
+  ExpectNear(measured.total_us, estimate.total_us);
+}
+
+TEST_F(FlashEstimatorTest, FollowsTheOptionsOfTheLoader) {
+  Schmi::FlashEstimator estimator(chip_, Schmi::MakeCostModel(chip_));
+  Schmi::FlashEstimate estimate = estimator.Estimate(image_.size());
+
+  Schmi::DryRunOptions options;
+  options.capabilities_cached = true;
+  options.global_erase = true;
+  Schmi::FlashEstimate cached = estimator.Estimate(image_.size(), options);
+  EXPECT_TRUE(cached.completed);
+  EXPECT_EQ(estimate.discover.round_trips - 1, cached.discover.round_trips);
+  EXPECT_EQ(0, cached.pages_erased);
+  EXPECT_EQ(1, cached.special_erases);
+  EXPECT_EQ(Schmi::EraseType::kMass, cached.erase_plan.steps[0].type);
+
+  // Past the end of the 128 KB of the G431
+  Schmi::FlashEstimate too_big = estimator.Estimate(200 * 1024);
+  EXPECT_FALSE(too_big.completed);
+  EXPECT_EQ(0, too_big.total_us);
+}
@@ -0,0 +1,138 @@
+#include "Schmi/flash_loader_static.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <string.h>
+
+namespace {
+
+// Backends for the static loader don't derive from the Schmi interfaces
+struct ArrayImage {
+  const uint8_t* bytes;
+  uint32_t size;
+
+  void Init(){};
+  uint64_t GetBinaryFileSize() { return size; };
+  void GetBytesArray(uint8_t* buffer, const Schmi::BytesData& bytes_data) {
+    memcpy(buffer, bytes + bytes_data.starting_byte, bytes_data.num_bytes);
+  };
+};
+
+struct ChangingImage {
+  const uint8_t* bytes;
+  uint32_t size;
+  uint32_t reads;
+  uint32_t reads_before_change;
+
+  void Init(){};
+  uint64_t GetBinaryFileSize() { return size; };
+  void GetBytesArray(uint8_t* buffer, const Schmi::BytesData& bytes_data) {
+    memcpy(buffer, bytes + bytes_data.starting_byte, bytes_data.num_bytes);
+    if (++reads > reads_before_change) buffer[0] ^= 0xFF;
+  };
+};
+
+typedef Schmi::FlashLoaderStatic<Schmi::Stm32Emulator, ArrayImage, Schmi::ErrorHandlerCapture, Schmi::LoadingBarNull>
+    EmulatorFlashLoader;
+}  // namespace
+
+class FlashLoaderStaticTest : public ::testing::Test {
+ protected:
+  FlashLoaderStaticTest() {
+    emulator_ = new Schmi::Stm32Emulator(clock_);
+    for (uint32_t ii = 0; ii < sizeof(image_bytes_); ii++) {
+      image_bytes_[ii] = (ii * 7) & 0xFF;
+    }
+    image_ = {image_bytes_, sizeof(image_bytes_)};
+  };
+
+  ~FlashLoaderStaticTest() { delete emulator_; };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  Schmi::SimClock clock_;
+  Schmi::Stm32Emulator* emulator_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  // Not a multiple of the write size or the page size
+  uint8_t image_bytes_[5 * 2048 + 123];
+  ArrayImage image_;
+};
+
+TEST_F(FlashLoaderStaticTest, FlashesImage) {
+  EmulatorFlashLoader fl(emulator_, &image_, &error_, &bar_);
+  emulator_->FillFlash(0x00);
+
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  EXPECT_EQ(0, memcmp(image_bytes_, emulator_->GetFlash(), sizeof(image_bytes_)));
+  EXPECT_EQ(6, emulator_->GetStats().pages_erased);
+  EXPECT_TRUE(emulator_->IsRunning());
+  EXPECT_EQ(0, error_.GetNumErrors());
+}
+
+TEST_F(FlashLoaderStaticTest, UnalignedStartErasesThePageItSpillsInto) {
+  EmulatorFlashLoader fl(emulator_, &image_, &error_, &bar_);
+  emulator_->FillFlash(0x00);
+
+  // 2000 bytes into page 1, the last 36 bytes land in page 7
+  const uint32_t offset = 2048 + 2000;
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false, 0x08000000 + offset));
+
+  EXPECT_EQ(0, memcmp(image_bytes_, emulator_->GetFlash() + offset, sizeof(image_bytes_)));
+  EXPECT_EQ(7, emulator_->GetStats().pages_erased);
+  EXPECT_EQ(0, error_.GetNumErrors());
+}
+
+TEST_F(FlashLoaderStaticTest, GlobalErase) {
+  EmulatorFlashLoader fl(emulator_, &image_, &error_, &bar_);
+  emulator_->FillFlash(0x00);
+
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, true));
+
+  const Schmi::EmulatorConfig& config = emulator_->GetConfig();
+  EXPECT_EQ(0, memcmp(image_bytes_, emulator_->GetFlash(), sizeof(image_bytes_)));
+  EXPECT_EQ(0xFF, emulator_->GetFlash()[config.flash_size - 1]);
+}
+
+TEST_F(FlashLoaderStaticTest, EraseSplitsLongPageLists) {
+  // 300 pages do not fit in one EXTEND_ERASE message of 512 bytes
+  Schmi::EmulatorConfig config;
+  config.flash_size = 1024 * 1024;
+  Schmi::Stm32Emulator big_emulator(clock_, config);
+  Schmi::Stm32Static<Schmi::Stm32Emulator, Schmi::ErrorHandlerCapture> stm32(big_emulator, error_);
+
+  ASSERT_TRUE(stm32.InitUsart());
+  ASSERT_TRUE(stm32.ExtendedErase(10, 300));
+  EXPECT_EQ(300, big_emulator.GetStats().pages_erased);
+  EXPECT_EQ(2, big_emulator.GetStats().commands);  // one EXTEND_ERASE per batch
+
+  // A range past the 16 bit page codes
+  EXPECT_FALSE(stm32.ExtendedErase(0xFF00, 0x200));
+  EXPECT_STREQ("ExtendedErase", error_.GetLastError().error_location);
+  EXPECT_EQ(2, big_emulator.GetStats().commands);
+}
+
+TEST_F(FlashLoaderStaticTest, MismatchIsReported) {
+  // The image changes between the write and the verify pass
+  ChangingImage image = {image_bytes_, sizeof(image_bytes_), 0, (sizeof(image_bytes_) + 255) / 256};
+  Schmi::FlashLoaderStatic<Schmi::Stm32Emulator, ChangingImage, Schmi::ErrorHandlerCapture, Schmi::LoadingBarNull> fl(
+      emulator_, &image, &error_, &bar_);
+
+  fl.Init();
+  EXPECT_FALSE(fl.Flash(true, false));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_STREQ("CheckBytes", error_.GetLastError().error_location);
+  EXPECT_FALSE(emulator_->IsRunning());
+}
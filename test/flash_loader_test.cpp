@@ -0,0 +1,307 @@
+#include "Schmi/flash_loader.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// 4 MB of flash in 2 KB pages, 2048 pages in total
+class FlashLoaderLargeFlashTest : public ::testing::Test {
+ protected:
+  FlashLoaderLargeFlashTest() {
+    Schmi::EmulatorConfig config;
+    config.flash_size = FLASH_SIZE;
+    emulator_ = new Schmi::Stm32Emulator(clock_, config);
+    emulator_->FillFlash(0x00);
+  };
+
+  ~FlashLoaderLargeFlashTest() { delete emulator_; };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  bool FlashImage(const std::vector<uint8_t>& image, const uint32_t& address) {
+    Schmi::BinaryFileMemory bin(image);
+    Schmi::FlashLoader fl(emulator_, &bin, &error_, &bar_);
+    fl.SetChipTiming(CHIP);
+    fl.Init();
+
+    return fl.Flash(true, false, address);
+  };
+
+  static const uint32_t FLASH_SIZE = 4 * 1024 * 1024;
+  const Schmi::ChipTiming CHIP = {0x0000, 2048, FLASH_SIZE, 1, 22, 25, 22, 25};
+
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  Schmi::Stm32Emulator* emulator_;
+};
+
+const uint32_t FlashLoaderLargeFlashTest::FLASH_SIZE;
+
+TEST_F(FlashLoaderLargeFlashTest, FlashesImageLargerThan512Pages) {
+  std::vector<uint8_t> image = MakeImage(FLASH_SIZE - 4096 - 100);
+
+  ASSERT_TRUE(FlashImage(image, 0x08000000));
+
+  std::vector<uint8_t> flash(emulator_->GetFlash(), emulator_->GetFlash() + image.size());
+  EXPECT_TRUE(image == flash);
+  EXPECT_EQ(2046, emulator_->GetStats().pages_erased);
+  EXPECT_EQ(0x00, emulator_->GetFlash()[FLASH_SIZE - 1]);
+  EXPECT_TRUE(emulator_->IsRunning());
+}
+
+TEST_F(FlashLoaderLargeFlashTest, FlashesUnalignedImagePastFirstMegabyte) {
+  const uint32_t offset = 0x00100000 + 0x400;
+  std::vector<uint8_t> image = MakeImage(2 * 1024 * 1024 + 2000);
+
+  ASSERT_TRUE(FlashImage(image, 0x08000000 + offset));
+
+  std::vector<uint8_t> flash(emulator_->GetFlash() + offset, emulator_->GetFlash() + offset + image.size());
+  EXPECT_TRUE(image == flash);
+
+  // Pages 512 to 1537, partly covered at both ends
+  EXPECT_EQ(1026, emulator_->GetStats().pages_erased);
+  EXPECT_EQ(0x00, emulator_->GetFlash()[512 * 2048 - 1]);
+  EXPECT_EQ(0xFF, emulator_->GetFlash()[512 * 2048]);
+  EXPECT_EQ(0xFF, emulator_->GetFlash()[1538 * 2048 - 1]);
+  EXPECT_EQ(0x00, emulator_->GetFlash()[1538 * 2048]);
+
+  // Execution still starts at the beginning of the flash
+  EXPECT_EQ(0x08000000, emulator_->GetGoAddress());
+}
+
+TEST_F(FlashLoaderLargeFlashTest, RejectsImageBeforeStartAddress) {
+  std::vector<uint8_t> image = MakeImage(1024);
+
+  EXPECT_FALSE(FlashImage(image, 0x07FFFC00));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_EQ(0, emulator_->GetStats().pages_erased);
+}
+
+TEST_F(FlashLoaderLargeFlashTest, RejectsPagesPastLastPageCode) {
+  std::vector<uint8_t> image = MakeImage(1024);
+
+  // Page 0x10000 doesn't fit in a 16 bit EXTEND_ERASE page code
+  EXPECT_FALSE(FlashImage(image, 0x08000000 + 0x10000 * 2048));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_EQ(0, emulator_->GetStats().pages_erased);
+}
+
+TEST_F(FlashLoaderLargeFlashTest, RejectsImagePastEndOfAddressSpace) {
+  std::vector<uint8_t> image = MakeImage(1024);
+  Schmi::BinaryFileMemory bin(image);
+  Schmi::FlashLoader fl(emulator_, &bin, &error_, &bar_);
+  Schmi::ChipTiming chip = CHIP;
+  chip.page_size = 128 * 1024;
+  fl.SetChipTiming(chip);
+  fl.Init();
+
+  EXPECT_FALSE(fl.Flash(true, false, 0xFFFFFE00));
+  EXPECT_TRUE(error_.HasDied());
+}
+
+TEST_F(FlashLoaderLargeFlashTest, TimingFollowsSessionPhases) {
+  std::vector<uint8_t> image = MakeImage(64 * 1024);
+  Schmi::BinaryFileMemory bin(image);
+  Schmi::FlashLoader fl(emulator_, &bin, &error_, &bar_);
+  fl.SetChipTiming(CHIP);
+  fl.SetClock(&clock_);
+
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  const Schmi::FlashTiming& timing = fl.GetTiming();
+  EXPECT_LE(timing.init_done_us, timing.sync_done_us);
+  EXPECT_LT(timing.sync_done_us, timing.erase_done_us);
+  EXPECT_EQ(timing.erase_done_us, timing.first_write_us);
+  EXPECT_LT(timing.first_write_us, timing.write_done_us);
+  EXPECT_LT(timing.write_done_us, timing.verify_done_us);
+  EXPECT_LT(timing.verify_done_us, timing.total_us);
+  EXPECT_EQ(clock_.NowUs(), timing.total_us);
+
+  // 32 pages erased one by one
+  EXPECT_GE(timing.erase_done_us - timing.sync_done_us, 32 * emulator_->GetConfig().page_erase_us);
+}
+
+// Verify-and-repair against weak pages of the emulator, 64 KB images so 32 pages of 2 KB
+class FlashLoaderRepairTest : public ::testing::Test {
+ protected:
+  FlashLoaderRepairTest() : image_(MakeImage(64 * 1024)){};
+
+  ~FlashLoaderRepairTest(){};
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  bool FlashImage(Schmi::Stm32Emulator& emulator, const uint16_t& max_pages, const uint32_t& address = 0x08000000) {
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(&emulator, &bin, &error_, &bar_);
+    fl.SetClock(&clock_);
+    fl.SetRepairBudget(max_pages);
+    fl.SetInlineVerify(inline_verify_);
+    fl.Init();
+    bool flashed = fl.Flash(true, false, address);
+    repair_ = fl.GetRepairResult();
+    timing_ = fl.GetTiming();
+
+    return flashed;
+  };
+
+  bool FlashMatchesImage(Schmi::Stm32Emulator& emulator, const uint32_t& offset = 0) {
+    return std::equal(image_.begin(), image_.end(), emulator.GetFlash() + offset);
+  };
+
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  std::vector<uint8_t> image_;
+  bool inline_verify_ = false;
+  Schmi::RepairResult repair_ = {};
+  Schmi::FlashTiming timing_ = {};
+};
+
+TEST_F(FlashLoaderRepairTest, MismatchStopsWithoutBudget) {
+  Schmi::Stm32Emulator emulator(clock_);
+  emulator.SetWeakPage(3, 1);
+
+  EXPECT_FALSE(FlashImage(emulator, 0));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_FALSE(emulator.IsRunning());
+}
+
+TEST_F(FlashLoaderRepairTest, OnlyBadPagesAreRewritten) {
+  Schmi::Stm32Emulator emulator(clock_);
+  emulator.SetWeakPage(3, 1);
+  emulator.SetWeakPage(20, 1);
+
+  ASSERT_TRUE(FlashImage(emulator, 8));
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+  EXPECT_TRUE(emulator.IsRunning());
+  EXPECT_EQ(2, repair_.pages_found);
+  EXPECT_EQ(2, repair_.pages_repaired);
+  EXPECT_EQ(1, repair_.passes);
+
+  EXPECT_EQ(32 + 2, emulator.GetStats().pages_erased);
+  EXPECT_EQ(image_.size() + 2 * 2048, emulator.GetStats().bytes_programmed);
+}
+
+TEST_F(FlashLoaderRepairTest, PartialPagesKeepTheirOffset) {
+  // Starts 256 bytes into page 0 and ends 256 bytes into page 32
+  Schmi::Stm32Emulator emulator(clock_);
+  emulator.SetWeakPage(0, 1);
+  emulator.SetWeakPage(32, 1);
+
+  ASSERT_TRUE(FlashImage(emulator, 8, 0x08000100));
+  EXPECT_TRUE(FlashMatchesImage(emulator, 0x100));
+  EXPECT_EQ(2, repair_.pages_repaired);
+  EXPECT_EQ(image_.size() + 1792 + 256, emulator.GetStats().bytes_programmed);
+}
+
+TEST_F(FlashLoaderRepairTest, RepairWithChecksumCommand) {
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  Schmi::Stm32Emulator emulator(clock_, config);
+  emulator.SetWeakPage(7, 1);
+
+  ASSERT_TRUE(FlashImage(emulator, 8));
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+  EXPECT_EQ(1, repair_.pages_repaired);
+
+  // Checksums all the way, nothing of the image is read back
+  EXPECT_LT(emulator.GetStats().bytes_sent, image_.size() / 10);
+}
+
+TEST_F(FlashLoaderRepairTest, PageThatStaysBadGivesUp) {
+  Schmi::Stm32Emulator emulator(clock_);
+  emulator.SetWeakPage(5, 3);
+  emulator.SetWeakPage(6, 1);
+
+  EXPECT_FALSE(FlashImage(emulator, 8));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_EQ(2, repair_.pages_found);
+  EXPECT_EQ(1, repair_.pages_repaired);
+  EXPECT_EQ(2, repair_.passes);
+  EXPECT_FALSE(emulator.IsRunning());
+}
+
+TEST_F(FlashLoaderRepairTest, MoreBadPagesThanBudgetGivesUp) {
+  Schmi::Stm32Emulator emulator(clock_);
+  for (uint32_t page = 10; page < 14; page++) {
+    emulator.SetWeakPage(page, 1);
+  }
+
+  EXPECT_FALSE(FlashImage(emulator, 3));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_EQ(32, emulator.GetStats().pages_erased);
+}
+
+TEST_F(FlashLoaderRepairTest, InlineVerifyRejectsAtTheFirstBadPage) {
+  Schmi::Stm32Emulator after_write(clock_);
+  after_write.SetWeakPage(3, 1);
+  EXPECT_FALSE(FlashImage(after_write, 0));
+  EXPECT_GT(timing_.reject_us, timing_.first_write_us);
+  uint64_t after_write_us = timing_.reject_us - timing_.first_write_us;
+
+  inline_verify_ = true;
+  Schmi::Stm32Emulator emulator(clock_);
+  emulator.SetWeakPage(3, 1);
+  EXPECT_FALSE(FlashImage(emulator, 0));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_STREQ("FlashAndVerifyPages", error_.GetLastError().error_location);
+  EXPECT_EQ(3, error_.GetLastError().err_num);
+  EXPECT_FALSE(emulator.IsRunning());
+
+  // Pages 0 to 3 written and read back, nothing after
+  EXPECT_EQ(4 * 2048, emulator.GetStats().bytes_programmed);
+  // The erase is the same, writing and checking 4 pages instead of writing 32 and checking 4
+  EXPECT_GT(timing_.reject_us, timing_.first_write_us);
+  EXPECT_LT((timing_.reject_us - timing_.first_write_us) * 3, after_write_us);
+}
+
+TEST_F(FlashLoaderRepairTest, InlineVerifyRepairsWithinBudget) {
+  inline_verify_ = true;
+  Schmi::Stm32Emulator emulator(clock_);
+  emulator.SetWeakPage(3, 1);
+  emulator.SetWeakPage(20, 1);
+
+  ASSERT_TRUE(FlashImage(emulator, 8));
+  EXPECT_TRUE(FlashMatchesImage(emulator));
+  EXPECT_TRUE(emulator.IsRunning());
+  EXPECT_EQ(2, repair_.pages_found);
+  EXPECT_EQ(2, repair_.pages_repaired);
+  EXPECT_EQ(1, repair_.passes);
+  EXPECT_EQ(0, timing_.reject_us);
+  EXPECT_EQ(timing_.write_done_us, timing_.verify_done_us);
+
+  EXPECT_EQ(32 + 2, emulator.GetStats().pages_erased);
+  EXPECT_EQ(image_.size() + 2 * 2048, emulator.GetStats().bytes_programmed);
+}
+
+TEST_F(FlashLoaderRepairTest, InlineVerifyWithChecksumCommand) {
+  inline_verify_ = true;
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  Schmi::Stm32Emulator emulator(clock_, config);
+
+  // Starts 256 bytes into page 0, the partial first and last pages are checked too
+  ASSERT_TRUE(FlashImage(emulator, 0, 0x08000100));
+  EXPECT_TRUE(FlashMatchesImage(emulator, 0x100));
+  EXPECT_LT(emulator.GetStats().bytes_sent, image_.size() / 10);
+
+  emulator.Reset();
+  emulator.SetWeakPage(32, 1);
+  EXPECT_FALSE(FlashImage(emulator, 0, 0x08000100));
+  EXPECT_EQ(32, error_.GetLastError().err_num);
+}
@@ -0,0 +1,187 @@
+#include "Schmi/image_store.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ImageStoreTest : public ::testing::Test {
+ protected:
+  ImageStoreTest() {
+    char scratch[] = "/tmp/schmi_image_store_test_XXXXXX";
+    scratch_ = mkdtemp(scratch);
+    images_ = scratch_ + "/binaries";
+    store_ = scratch_ + "/store";
+    mkdir(images_.c_str(), 0755);
+  };
+
+  ~ImageStoreTest() {
+    std::string command = "rm -rf " + scratch_;
+    EXPECT_EQ(0, system(command.c_str()));
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  std::string WriteImage(const std::string& name, const std::vector<uint8_t>& bytes) {
+    std::string path = images_ + "/" + name;
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return path;
+  };
+
+  std::string scratch_;
+  std::string images_;
+  std::string store_;
+};
+
+TEST(ImageStoreNameTest, ProductAndVersionComeFromTheHexPrefix) {
+  uint32_t product_id = 0;
+  uint8_t version = 0;
+  ASSERT_TRUE(Schmi::ImageStore::ParseImageName("binaries/0x100016_iq2306_2200kv.bin", product_id, version));
+  EXPECT_EQ(0x1000, product_id);
+  EXPECT_EQ(0x16, version);
+  ASSERT_TRUE(Schmi::ImageStore::ParseImageName("0x8000000B.bin", product_id, version));
+  EXPECT_EQ(0x800000, product_id);
+  EXPECT_EQ(0x0B, version);
+  EXPECT_FALSE(Schmi::ImageStore::ParseImageName("./1048583_V6-3.bin", product_id, version));
+  EXPECT_FALSE(Schmi::ImageStore::ParseImageName("0xZZ.bin", product_id, version));
+}
+
+TEST_F(ImageStoreTest, IngestsByContentAndFindsTheLatestVersion) {
+  std::vector<uint8_t> blank_middle = MakeImage(3000, 1);
+  std::fill(blank_middle.begin() + 512, blank_middle.begin() + 2048, 0xFF);
+
+  std::vector<std::string> paths;
+  paths.push_back(WriteImage("0x100016_iq2306_2200kv.bin", blank_middle));
+  paths.push_back(WriteImage("0x100017_iq2306_2200kv.bin", MakeImage(5000, 2)));
+  paths.push_back(WriteImage("0x20000A_iq2306_190kv.bin", MakeImage(4000, 3)));
+  paths.push_back(WriteImage("copy_of_0x20000A.bin", MakeImage(4000, 3)));
+  paths.push_back(WriteImage("empty.bin", {}));
+  for (uint32_t ii = 0; ii < 20; ii++) {
+    char name[32];
+    snprintf(name, sizeof(name), "0x3000%02x_bulk.bin", ii);
+    paths.push_back(WriteImage(name, MakeImage(1000 + ii, 10 + ii)));
+  }
+  std::vector<std::string> listed = Schmi::ImageStore::ListImages(images_);
+  EXPECT_EQ(paths.size(), listed.size());
+
+  Schmi::ImageStore store(store_);
+  ASSERT_TRUE(store.Init());
+  std::vector<std::string> errors;
+  EXPECT_EQ(23, store.Ingest(listed, errors, 4));
+  EXPECT_THAT(errors, ::testing::ElementsAre(images_ + "/empty.bin: empty image"));
+  EXPECT_EQ(23, store.GetNumImages());
+
+  const Schmi::ImageInfo* latest = store.FindByProduct(0x1000);
+  ASSERT_NE(nullptr, latest);
+  EXPECT_EQ(0x17, latest->version);
+  EXPECT_EQ(5000, latest->size);
+  const Schmi::ImageInfo* older = store.FindByHash(Schmi::ImageStore::HashBytes(blank_middle.data(), 3000));
+  ASSERT_NE(nullptr, older);
+  EXPECT_EQ(0x16, older->version);
+  ASSERT_EQ(2, older->segments.size());
+  EXPECT_EQ(0, older->segments[0].offset);
+  EXPECT_EQ(512, older->segments[0].length);
+  EXPECT_EQ(2048, older->segments[1].offset);
+  EXPECT_EQ(952, older->segments[1].length);
+  EXPECT_EQ(0x300013, (store.FindByProduct(0x3000)->product_id << 8) + store.FindByProduct(0x3000)->version);
+  EXPECT_EQ(nullptr, store.FindByProduct(0x4000));
+
+  // Again: nothing new, and another process sees the same store
+  errors.clear();
+  EXPECT_EQ(0, store.Ingest({paths[0], paths[1]}, errors));
+  EXPECT_TRUE(errors.empty());
+  Schmi::ImageStore reloaded(store_);
+  ASSERT_TRUE(reloaded.Init());
+  EXPECT_EQ(23, reloaded.GetNumImages());
+  ASSERT_NE(nullptr, reloaded.FindByProduct(0x1000));
+  EXPECT_EQ(latest->hash, reloaded.FindByProduct(0x1000)->hash);
+  ASSERT_NE(nullptr, reloaded.FindByHash(older->hash));
+  EXPECT_EQ(2, reloaded.FindByHash(older->hash)->segments.size());
+}
+
+TEST_F(ImageStoreTest, ProductNamedLaterSurvivesARestart) {
+  std::vector<uint8_t> image = MakeImage(3000, 4);
+  std::vector<std::string> errors;
+  Schmi::ImageStore store(store_);
+  ASSERT_TRUE(store.Init());
+  ASSERT_EQ(1, store.Ingest({WriteImage("unnamed.bin", image)}, errors));
+  EXPECT_EQ(nullptr, store.FindByProduct(0x1000));
+
+  // The same bytes again, under a name that tells the product
+  EXPECT_EQ(0, store.Ingest({WriteImage("0x100016_iq2306_2200kv.bin", image)}, errors));
+  EXPECT_TRUE(errors.empty());
+  ASSERT_NE(nullptr, store.FindByProduct(0x1000));
+
+  Schmi::ImageStore reloaded(store_);
+  ASSERT_TRUE(reloaded.Init());
+  ASSERT_NE(nullptr, reloaded.FindByProduct(0x1000));
+  EXPECT_EQ(0x16, reloaded.FindByProduct(0x1000)->version);
+}
+
+TEST_F(ImageStoreTest, ObjectsWithOtherBytesAreRefused) {
+  std::vector<uint8_t> image = MakeImage(3000, 2);
+  std::string path = WriteImage("0x100016_iq2306_2200kv.bin", image);
+  std::vector<std::string> errors;
+  Schmi::ImageStore store(store_);
+  ASSERT_TRUE(store.Init());
+  ASSERT_EQ(1, store.Ingest({path}, errors));
+  std::string object = store_ + "/objects/" + store.FindByProduct(0x1000)->hash;
+
+  // Another image under the same hash, as a collision would leave it
+  std::vector<uint8_t> other = MakeImage(3000, 9);
+  std::ofstream(object, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(other.data()),
+                                                                   other.size());
+  EXPECT_EQ(0, store.Ingest({path}, errors));
+  ASSERT_EQ(1, errors.size());
+  EXPECT_THAT(errors[0], ::testing::HasSubstr("hash collides with"));
+
+  // Cut short, it doesn't match the index
+  std::ofstream(object, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(image.data()), 1000);
+  EXPECT_EQ(nullptr, store.OpenProduct(0x1000));
+}
+
+TEST_F(ImageStoreTest, BoardsShareTheMappedImage) {
+  std::vector<uint8_t> image = MakeImage(30000, 5);
+  std::vector<std::string> errors;
+  Schmi::ImageStore store(store_);
+  ASSERT_TRUE(store.Init());
+  ASSERT_EQ(1, store.Ingest({WriteImage("0x100016_iq2306_2200kv.bin", image)}, errors));
+
+  std::shared_ptr<Schmi::BinaryFileMapped> first = store.OpenProduct(0x1000);
+  ASSERT_NE(nullptr, first);
+  EXPECT_EQ(first, store.Open(store.FindByProduct(0x1000)->hash));
+  EXPECT_EQ(nullptr, store.Open("0000000000000000"));
+  EXPECT_TRUE(std::equal(image.begin(), image.end(), first->GetBytes()));
+
+  Schmi::SimClock clock;
+  Schmi::ErrorHandlerCapture error;
+  Schmi::LoadingBarNull bar;
+  for (uint8_t ii = 0; ii < 2; ii++) {
+    Schmi::Stm32Emulator emulator(clock);
+    Schmi::FlashLoader fl(&emulator, first.get(), &error, &bar);
+    fl.SetClock(&clock);
+    fl.Init();
+    ASSERT_TRUE(fl.Flash(true, false));
+    EXPECT_TRUE(std::equal(image.begin(), image.end(), emulator.GetFlash()));
+  }
+
+  // Mapped again once every session let it go
+  first.reset();
+  std::shared_ptr<Schmi::BinaryFileMapped> again = store.OpenProduct(0x1000);
+  ASSERT_NE(nullptr, again);
+  EXPECT_TRUE(std::equal(image.begin(), image.end(), again->GetBytes()));
+}
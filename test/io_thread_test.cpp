@@ -0,0 +1,46 @@
+#include "Schmi/io_thread.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+// Pinning is only done on Linux
+#ifdef __linux__
+TEST(IoThreadTest, PinsTheThreadItRuns) {
+  Schmi::IoThreadOptions options;
+  options.cpu = 0;
+
+  int cpu = -1;
+  Schmi::IoThreadStatus status = Schmi::RunOnIoThread(options, [&] { cpu = sched_getcpu(); });
+  EXPECT_TRUE(status.pinned);
+  EXPECT_EQ(0, cpu);
+  EXPECT_EQ("", status.warnings);
+}
+#endif
+
+TEST(IoThreadTest, MissingPrivilegesAreOnlyReported) {
+  Schmi::IoThreadOptions options;
+  options.cpu = 100000;  // no such CPU
+  options.rt_priority = 10;
+
+  bool ran = false;
+  int policy = -1;
+  Schmi::IoThreadStatus status = Schmi::RunOnIoThread(options, [&] {
+    ran = true;
+    sched_param param;
+    pthread_getschedparam(pthread_self(), &policy, &param);
+  });
+
+  EXPECT_TRUE(ran);
+  EXPECT_FALSE(status.pinned);
+  EXPECT_THAT(status.warnings, ::testing::HasSubstr("cannot pin to cpu"));
+  // Depends on who runs the tests, either way the thread ran and says what it got
+  if (status.realtime) {
+    EXPECT_EQ(SCHED_FIFO, policy);
+  } else {
+    EXPECT_EQ(SCHED_OTHER, policy);
+    EXPECT_THAT(status.warnings, ::testing::HasSubstr("SCHED_FIFO"));
+  }
+}
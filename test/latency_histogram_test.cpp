@@ -0,0 +1,70 @@
+#include "Schmi/latency_histogram.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <vector>
+
+TEST(LatencyHistogramTest, PercentilesWithinABucket) {
+  Schmi::LatencyHistogram latency;
+  EXPECT_EQ(0, latency.GetPercentileUs(50));
+
+  // 990 round trips of about 1 ms and a tail of 10 stalled ones
+  for (uint32_t ii = 0; ii < 990; ii++) {
+    latency.Record(1000 + ii % 50);
+  }
+  for (uint32_t ii = 0; ii < 10; ii++) {
+    latency.Record(20000 + ii * 1000);
+  }
+
+  EXPECT_EQ(1000, latency.GetCount());
+  EXPECT_EQ(29000, latency.GetMaxUs());
+  EXPECT_NEAR(1025, latency.GetPercentileUs(50), 1025 / 8);
+  EXPECT_NEAR(1049, latency.GetPercentileUs(99), 1049 / 8);
+  EXPECT_NEAR(29000, latency.GetPercentileUs(99.9), 29000 / 8);
+  EXPECT_EQ(29000, latency.GetPercentileUs(100));
+
+  // Small values have a bucket each
+  Schmi::LatencyHistogram small;
+  small.Record(3);
+  small.Record(5);
+  EXPECT_EQ(3, small.GetPercentileUs(50));
+  EXPECT_EQ(5, small.GetPercentileUs(100));
+
+  small.Merge(latency);
+  EXPECT_EQ(1002, small.GetCount());
+  EXPECT_EQ(29000, small.GetMaxUs());
+
+  small.Reset();
+  EXPECT_EQ(0, small.GetCount());
+}
+
+TEST(LatencyHistogramTest, EveryAckOfAFlashIsRecorded) {
+  Schmi::SimClock clock;
+  Schmi::EmulatorConfig config;
+  Schmi::Stm32Emulator emulator(clock, config);
+  std::vector<uint8_t> image(10000, 0x3C);
+  Schmi::BinaryFileMemory bin(image);
+  Schmi::ErrorHandlerCapture error;
+  Schmi::LoadingBarNull bar;
+  Schmi::LatencyHistogram latency;
+
+  Schmi::FlashLoader fl(&emulator, &bin, &error, &bar);
+  fl.SetClock(&clock);
+  fl.SetLatencyHistogram(&latency);
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  // Command, address and data of each of the 40 writes, plus the reads, erase and GO
+  EXPECT_GT(latency.GetCount(), 3 * 40 + 2 * 40);
+  EXPECT_GE(latency.GetPercentileUs(50), config.ack_latency_us);
+  // The erase waits for the flash and the data frames for programming, the commands don't
+  EXPECT_GT(latency.GetMaxUs(), latency.GetPercentileUs(50) * 10);
+}
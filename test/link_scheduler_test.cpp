@@ -0,0 +1,254 @@
+#include "Schmi/link_scheduler.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Every frame takes some real time on the wire, so sessions on different threads overlap
+class SlowSerial : public Schmi::SerialInterface {
+ public:
+  SlowSerial(Schmi::SerialInterface& ser) : ser_(ser){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    std::this_thread::sleep_for(std::chrono::microseconds(30));
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+
+ private:
+  Schmi::SerialInterface& ser_;
+};
+}  // namespace
+
+class LinkSchedulerTest : public ::testing::Test {
+ protected:
+  // A quad channel chip (ttyUSB0-3) and a single one (ttyUSB4) behind hub 1-1, a chip on a root
+  // port (ttyUSB5), and a port that isn't on USB (ttyS0)
+  LinkSchedulerTest() {
+    char scratch[] = "/tmp/schmi_links_test_XXXXXX";
+    scratch_ = mkdtemp(scratch);
+    tty_ = scratch_ + "/class/tty";
+    MakeDir("/class");
+    MakeDir("/class/tty");
+    MakeDir("/devices");
+    AddUsbDevice("/devices/usb1");
+    AddUsbDevice("/devices/usb1/1-1");
+    AddUsbDevice("/devices/usb1/1-1/1-1.2");
+    for (uint8_t ii = 0; ii < 4; ii++) {
+      AddTty("ttyUSB" + std::to_string(ii), "/devices/usb1/1-1/1-1.2/1-1.2:1." + std::to_string(ii));
+    }
+    AddUsbDevice("/devices/usb1/1-1/1-1.3");
+    AddTty("ttyUSB4", "/devices/usb1/1-1/1-1.3/1-1.3:1.0");
+    AddUsbDevice("/devices/usb1/1-2");
+    AddTty("ttyUSB5", "/devices/usb1/1-2/1-2:1.0");
+  };
+
+  ~LinkSchedulerTest() {
+    std::string command = "rm -rf " + scratch_;
+    EXPECT_EQ(0, system(command.c_str()));
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  void MakeDir(const std::string& dir) { mkdir((scratch_ + dir).c_str(), 0755); };
+
+  void AddUsbDevice(const std::string& dir) {
+    MakeDir(dir);
+    std::ofstream(scratch_ + dir + "/idVendor") << "0403\n";
+  };
+
+  // Like ftdi_sio, the device link goes to the port below the interface
+  void AddTty(const std::string& name, const std::string& interface) {
+    MakeDir(interface);
+    MakeDir(interface + "/" + name);
+    MakeDir("/class/tty/" + name);
+    EXPECT_EQ(0, symlink((scratch_ + interface + "/" + name).c_str(), (tty_ + "/" + name + "/device").c_str()));
+  };
+
+  const Schmi::LinkStats* FindLink(const std::vector<Schmi::LinkStats>& links, const std::string& name,
+                                   const bool& is_hub) {
+    for (auto& link : links) {
+      if (link.name == name && link.is_hub == is_hub) {
+        return &link;
+      }
+    }
+    return nullptr;
+  };
+
+  std::string scratch_;
+  std::string tty_;
+};
+
+TEST_F(LinkSchedulerTest, TopologyComesFromSysfs) {
+  Schmi::UsbTopology topology;
+  ASSERT_TRUE(Schmi::ReadUsbTopology(tty_, "ttyUSB2", topology));
+  EXPECT_EQ("ttyUSB2", topology.name);
+  EXPECT_EQ("1-1.2:1.2", topology.interface);
+  EXPECT_EQ("1-1.2", topology.chip);
+  EXPECT_EQ("1-1", topology.hub);
+
+  ASSERT_TRUE(Schmi::ReadUsbTopology(tty_, "ttyUSB5", topology));
+  EXPECT_EQ("1-2:1.0", topology.interface);
+  EXPECT_EQ("1-2", topology.chip);
+  EXPECT_EQ("usb1", topology.hub);
+
+  EXPECT_FALSE(Schmi::ReadUsbTopology(tty_, "ttyS0", topology));
+  EXPECT_EQ("ttyS0", topology.chip);
+  EXPECT_EQ("ttyS0", topology.hub);
+
+  Schmi::LinkScheduler scheduler;
+  EXPECT_TRUE(scheduler.AddPort("/dev/ttyUSB0", tty_));
+  EXPECT_TRUE(scheduler.AddPort("/dev/ttyUSB1", tty_));
+  EXPECT_TRUE(scheduler.AddPort("/dev/ttyUSB4", tty_));
+  EXPECT_FALSE(scheduler.AddPort("/dev/ttyS0", tty_));
+  EXPECT_NE(nullptr, scheduler.GetGate("/dev/ttyUSB0"));
+  EXPECT_EQ(nullptr, scheduler.GetGate("/dev/ttyUSB5"));
+
+  std::vector<Schmi::LinkStats> links = scheduler.GetLinkStats();
+  ASSERT_EQ(5, links.size());
+  EXPECT_TRUE(links[0].is_hub);
+  ASSERT_NE(nullptr, FindLink(links, "1-1", true));
+  EXPECT_EQ(3, FindLink(links, "1-1", true)->num_ports);
+  ASSERT_NE(nullptr, FindLink(links, "1-1.2", false));
+  EXPECT_EQ(2, FindLink(links, "1-1.2", false)->num_ports);
+}
+
+TEST_F(LinkSchedulerTest, SiblingsEraseWhileOneTransfers) {
+  Schmi::LinkLimits limits;
+  limits.max_transfers_per_chip = 1;
+  limits.max_transfers_per_hub = 3;
+  Schmi::LinkScheduler scheduler(limits);
+  for (const char* name : {"ttyUSB0", "ttyUSB1", "ttyUSB2", "ttyUSB4"}) {
+    scheduler.AddPort(name, tty_);
+  }
+  Schmi::PhaseGateInterface* first = scheduler.GetGate("ttyUSB0");
+  Schmi::PhaseGateInterface* sibling = scheduler.GetGate("ttyUSB1");
+  Schmi::PhaseGateInterface* other_chip = scheduler.GetGate("ttyUSB4");
+
+  first->Enter(Schmi::SessionPhase::kTransfer);
+  // A repair erase inside the transfer keeps the link
+  first->Enter(Schmi::SessionPhase::kErase);
+  first->Leave(Schmi::SessionPhase::kErase);
+
+  std::atomic<bool> sibling_started(false);
+  std::thread sibling_session([&] {
+    sibling->Enter(Schmi::SessionPhase::kErase);
+    sibling->Leave(Schmi::SessionPhase::kErase);
+    sibling->Enter(Schmi::SessionPhase::kTransfer);
+    sibling_started = true;
+    sibling->Leave(Schmi::SessionPhase::kTransfer);
+  });
+
+  // Another chip behind the same hub isn't held up
+  other_chip->Enter(Schmi::SessionPhase::kTransfer);
+  other_chip->Leave(Schmi::SessionPhase::kTransfer);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(sibling_started);
+  first->Leave(Schmi::SessionPhase::kTransfer);
+  sibling_session.join();
+  EXPECT_TRUE(sibling_started);
+
+  const Schmi::LinkStats* chip = FindLink(scheduler.GetLinkStats(), "1-1.2", false);
+  ASSERT_NE(nullptr, chip);
+  EXPECT_EQ(1, chip->max_transfers);
+  EXPECT_EQ(0, chip->transfers);
+  EXPECT_GE(chip->wait_us, 15000);
+  EXPECT_GE(chip->busy_us, 15000);
+  EXPECT_LE(chip->busy_us, chip->elapsed_us);
+  const Schmi::LinkStats* hub = FindLink(scheduler.GetLinkStats(), "1-1", true);
+  ASSERT_NE(nullptr, hub);
+  EXPECT_EQ(2, hub->max_transfers);
+}
+
+TEST_F(LinkSchedulerTest, WithoutLimitsTransfersOnlyGetMeasured) {
+  Schmi::LinkScheduler scheduler;
+  scheduler.AddPort("ttyUSB0", tty_);
+  scheduler.AddPort("ttyUSB1", tty_);
+  Schmi::PhaseGateInterface* first = scheduler.GetGate("ttyUSB0");
+  Schmi::PhaseGateInterface* sibling = scheduler.GetGate("ttyUSB1");
+
+  first->Enter(Schmi::SessionPhase::kTransfer);
+  sibling->Enter(Schmi::SessionPhase::kTransfer);
+  sibling->Leave(Schmi::SessionPhase::kTransfer);
+  first->Leave(Schmi::SessionPhase::kTransfer);
+
+  const Schmi::LinkStats* chip = FindLink(scheduler.GetLinkStats(), "1-1.2", false);
+  ASSERT_NE(nullptr, chip);
+  EXPECT_EQ(2, chip->max_transfers);
+  EXPECT_EQ(0, chip->transfers);
+}
+
+TEST_F(LinkSchedulerTest, SessionsShareTheLinksWithinTheLimits) {
+  Schmi::LinkLimits limits;
+  limits.max_transfers_per_chip = 2;
+  limits.max_transfers_per_hub = 2;
+  Schmi::LinkScheduler scheduler(limits);
+  const std::vector<std::string> names = {"ttyUSB0", "ttyUSB1", "ttyUSB2", "ttyUSB3", "ttyUSB4", "ttyUSB5"};
+  for (auto& name : names) {
+    scheduler.AddPort(name, tty_);
+  }
+
+  std::vector<uint8_t> image = MakeImage(20000);
+  std::vector<std::thread> sessions;
+  std::vector<char> flashed(names.size(), 0);
+  for (size_t ii = 0; ii < names.size(); ii++) {
+    sessions.emplace_back([&, ii] {
+      Schmi::SimClock clock;
+      Schmi::Stm32Emulator emulator(clock);
+      SlowSerial ser(emulator);
+      Schmi::BinaryFileMemory bin(image);
+      Schmi::ErrorHandlerCapture error;
+      Schmi::LoadingBarNull bar;
+      Schmi::FlashLoader fl(&ser, &bin, &error, &bar);
+      fl.SetClock(&clock);
+      fl.SetPhaseGate(scheduler.GetGate(names[ii]));
+      fl.Init();
+      flashed[ii] = fl.Flash(true, false) && std::equal(image.begin(), image.end(), emulator.GetFlash());
+    });
+  }
+  for (auto& session : sessions) {
+    session.join();
+  }
+  EXPECT_THAT(flashed, ::testing::Each(1));
+
+  std::vector<Schmi::LinkStats> links = scheduler.GetLinkStats();
+  const Schmi::LinkStats* hub = FindLink(links, "1-1", true);
+  ASSERT_NE(nullptr, hub);
+  EXPECT_EQ(5, hub->num_ports);
+  EXPECT_LE(hub->max_transfers, 2);
+  EXPECT_GT(hub->transfer_us, 0);
+  // The quad chip's four sessions had to queue behind each other
+  const Schmi::LinkStats* quad = FindLink(links, "1-1.2", false);
+  ASSERT_NE(nullptr, quad);
+  EXPECT_LE(quad->max_transfers, 2);
+  EXPECT_GT(quad->wait_us, 0);
+  for (auto& link : links) {
+    EXPECT_EQ(0, link.transfers);
+  }
+}
@@ -0,0 +1,22 @@
+#include "Schmi/parse_number.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(ParseNumberTest, TakesWholeNumbersOnly) {
+  uint64_t value = 7;
+  EXPECT_TRUE(Schmi::ParseNumber("115200", value));
+  EXPECT_EQ(115200, value);
+  EXPECT_TRUE(Schmi::ParseNumber("0x468", value, 0xFFFF, 0));
+  EXPECT_EQ(0x468, value);
+  EXPECT_TRUE(Schmi::ParseNumber("0403", value, 0xFFFF, 16));
+  EXPECT_EQ(0x403, value);
+
+  value = 7;
+  EXPECT_FALSE(Schmi::ParseNumber("", value));
+  EXPECT_FALSE(Schmi::ParseNumber("12k", value));
+  EXPECT_FALSE(Schmi::ParseNumber("-1", value));
+  EXPECT_FALSE(Schmi::ParseNumber(" 1", value));
+  EXPECT_FALSE(Schmi::ParseNumber("0x10000", value, 0xFFFF, 0));
+  EXPECT_FALSE(Schmi::ParseNumber("99999999999999999999999", value));
+  EXPECT_EQ(7, value);
+}
@@ -0,0 +1,228 @@
+#include "Schmi/port_watcher.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/auto_flasher.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Events of a watcher, waited for from the test thread
+class DeviceLog {
+ public:
+  void Add(const std::string& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(event);
+    cv_.notify_all();
+  };
+
+  // The events once there are num_events of them, or after 5 s
+  std::vector<std::string> WaitFor(const size_t& num_events) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, std::chrono::seconds(5), [&] { return events_.size() >= num_events; });
+    return events_;
+  };
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::string> events_;
+};
+
+// Both sessions have to be on the wire at once before either gets an answer: run one after the
+// other, the first would wait forever
+class MeetingSerial : public Schmi::SerialInterface {
+ public:
+  MeetingSerial(Schmi::SerialInterface& ser, std::mutex& mutex, std::condition_variable& cv, uint32_t& num_met)
+      : ser_(ser), mutex_(mutex), cv_(cv), num_met_(num_met){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    if (!met_) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      num_met_++;
+      cv_.notify_all();
+      if (!cv_.wait_for(lock, std::chrono::seconds(5), [&] { return num_met_ >= 2; })) {
+        return -1;
+      }
+      met_ = true;
+    }
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+  void FlushInput() override { ser_.FlushInput(); };
+
+ private:
+  Schmi::SerialInterface& ser_;
+  std::mutex& mutex_;
+  std::condition_variable& cv_;
+  uint32_t& num_met_;
+  bool met_ = false;
+};
+}  // namespace
+
+class PortWatcherTest : public ::testing::Test {
+ protected:
+  PortWatcherTest() {
+    char scratch[] = "/tmp/schmi_watcher_test_XXXXXX";
+    scratch_ = mkdtemp(scratch);
+    dev_ = scratch_ + "/dev";
+    sys_ = scratch_ + "/sys";
+    mkdir(dev_.c_str(), 0755);
+    mkdir(sys_.c_str(), 0755);
+    mkdir((sys_ + "/class").c_str(), 0755);
+    mkdir((sys_ + "/devices").c_str(), 0755);
+  };
+
+  ~PortWatcherTest() {
+    std::string command = "rm -rf " + scratch_;
+    EXPECT_EQ(0, system(command.c_str()));
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  // The sysfs side of a USB-serial adapter: the USB device with its IDs, its interface, and the
+  // tty entry linking to the interface
+  void AddUsbDevice(const std::string& tty, const std::string& vid, const std::string& pid, const std::string& serial) {
+    std::string usb = sys_ + "/devices/1-" + tty;
+    mkdir(usb.c_str(), 0755);
+    mkdir((usb + "/1-1:1.0").c_str(), 0755);
+    std::ofstream(usb + "/idVendor") << vid << "\n";
+    std::ofstream(usb + "/idProduct") << pid << "\n";
+    std::ofstream(usb + "/serial") << serial << "\n";
+    mkdir((sys_ + "/class/" + tty).c_str(), 0755);
+    EXPECT_EQ(0, symlink((usb + "/1-1:1.0").c_str(), (sys_ + "/class/" + tty + "/device").c_str()));
+  };
+
+  // The node itself, a symlink like the ones udev makes
+  void Plug(const std::string& tty) { EXPECT_EQ(0, symlink("/dev/null", (dev_ + "/" + tty).c_str())); };
+  void Unplug(const std::string& tty) { EXPECT_EQ(0, unlink((dev_ + "/" + tty).c_str())); };
+
+  std::string scratch_;
+  std::string dev_;
+  std::string sys_;
+};
+
+TEST(PortFilterTest, EmptyFieldsMatchAnything) {
+  Schmi::SerialDeviceInfo device = {"/dev/ttyACM3", "ttyACM3", 0x0483, 0x5740, "IQ0042"};
+
+  EXPECT_TRUE(Schmi::MatchesFilter(device, {"", 0, 0, ""}));
+  EXPECT_TRUE(Schmi::MatchesFilter(device, {"ttyACM*", 0x0483, 0, ""}));
+  EXPECT_TRUE(Schmi::MatchesFilter(device, {"", 0x0483, 0x5740, "IQ0042"}));
+  EXPECT_FALSE(Schmi::MatchesFilter(device, {"ttyUSB*", 0, 0, ""}));
+  EXPECT_FALSE(Schmi::MatchesFilter(device, {"", 0x0403, 0, ""}));
+  EXPECT_FALSE(Schmi::MatchesFilter(device, {"", 0x0483, 0x5740, "IQ0043"}));
+}
+
+TEST_F(PortWatcherTest, ReportsMatchingNodesAsTheyComeAndGo) {
+  AddUsbDevice("ttyACM0", "0483", "5740", "IQ0001");
+  AddUsbDevice("ttyACM1", "0483", "5740", "IQ0002");
+  AddUsbDevice("ttyUSB0", "0403", "6001", "FT1234");
+  Plug("ttyACM0");
+
+  Schmi::PortWatcher watcher(dev_, sys_ + "/class");
+  watcher.AddFilter({"", 0x0483, 0x5740, ""});
+  DeviceLog log;
+  ASSERT_TRUE(watcher.Start(
+      [&](const Schmi::SerialDeviceInfo& device) {
+        log.Add("+" + device.path + " " + std::to_string(device.vid) + " " + device.serial);
+      },
+      [&](const Schmi::SerialDeviceInfo& device) { log.Add("-" + device.name); }));
+
+  // Another vendor, and a node sysfs knows nothing about
+  Plug("ttyUSB0");
+  Plug("ttyS0");
+  Plug("ttyACM1");
+  Unplug("ttyACM0");
+  Unplug("ttyUSB0");
+  Plug("ttyACM0");
+
+  std::vector<std::string> events = log.WaitFor(4);
+  watcher.Stop();
+  ASSERT_EQ(4, events.size());
+  EXPECT_EQ("+" + dev_ + "/ttyACM0 1155 IQ0001", events[0]);
+  EXPECT_EQ("+" + dev_ + "/ttyACM1 1155 IQ0002", events[1]);
+  EXPECT_EQ("-ttyACM0", events[2]);
+  EXPECT_EQ("+" + dev_ + "/ttyACM0 1155 IQ0001", events[3]);
+}
+
+TEST_F(PortWatcherTest, DefaultFilterTakesUsbSerialNames) {
+  Plug("ttyS0");
+  Plug("ttyUSB4");
+
+  Schmi::PortWatcher watcher(dev_, sys_ + "/class");
+  DeviceLog log;
+  ASSERT_TRUE(watcher.Start([&](const Schmi::SerialDeviceInfo& device) { log.Add(device.name); }, nullptr, false));
+  Plug("ttyACM2");
+
+  std::vector<std::string> events = log.WaitFor(1);
+  watcher.Stop();
+  EXPECT_THAT(events, ::testing::ElementsAre("ttyACM2"));
+}
+
+TEST_F(PortWatcherTest, BoardsAreFlashedInParallelAsTheyArePlugged) {
+  std::vector<uint8_t> image = MakeImage(30000);
+
+  Schmi::SimClock clocks[2];
+  Schmi::Stm32Emulator first(clocks[0]);
+  Schmi::Stm32Emulator second(clocks[1]);
+  std::map<std::string, Schmi::Stm32Emulator*> boards = {{"ttyUSB0", &first}, {"ttyUSB1", &second}};
+  std::mutex meet_mutex;
+  std::condition_variable meet_cv;
+  uint32_t num_met = 0;
+
+  DeviceLog log;
+  std::atomic<uint32_t> opens_refused(0);
+  Schmi::AutoFlasher flasher(
+      image,
+      [&](const Schmi::SerialDeviceInfo& device) {
+        auto board = boards.find(device.name);
+        // The node of the second board is there before udev lets us open it
+        if (board == boards.end() || (device.name == "ttyUSB1" && opens_refused++ < 2)) {
+          return std::unique_ptr<Schmi::SerialInterface>();
+        }
+        return std::unique_ptr<Schmi::SerialInterface>(
+            new MeetingSerial(*board->second, meet_mutex, meet_cv, num_met));
+      },
+      [&](const Schmi::AutoFlashResult& result) {
+        bool timed = result.timing.total_us > 0;
+        log.Add(result.device.name + (result.ok && timed ? " OK" : " FAIL " + result.error));
+      });
+  flasher.SetOpenWindow(300);
+
+  Schmi::PortWatcher watcher(dev_, sys_ + "/class");
+  ASSERT_TRUE(watcher.Start([&](const Schmi::SerialDeviceInfo& device) { flasher.Flash(device); }));
+  Plug("ttyUSB0");
+  Plug("ttyUSB1");
+  Plug("ttyUSB2");  // no board behind it
+
+  std::vector<std::string> events = log.WaitFor(3);
+  watcher.Stop();
+  flasher.Wait();
+  std::sort(events.begin(), events.end());
+  EXPECT_THAT(events, ::testing::ElementsAre("ttyUSB0 OK", "ttyUSB1 OK", "ttyUSB2 FAIL open: cannot open " + dev_ +
+                                                                                "/ttyUSB2"));
+  EXPECT_EQ(0, flasher.GetNumRunning());
+  EXPECT_EQ(3, opens_refused);
+  EXPECT_TRUE(std::equal(image.begin(), image.end(), first.GetFlash()));
+  EXPECT_TRUE(std::equal(image.begin(), image.end(), second.GetFlash()));
+}
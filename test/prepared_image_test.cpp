@@ -0,0 +1,133 @@
+#include "Schmi/prepared_image.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+class PreparedImageTest : public ::testing::Test {
+ protected:
+  // 40 chunks, the last one 233 bytes so its frame is padded
+  PreparedImageTest() : image_(MakeImage(39 * 256 + 233)), prepared_(new Schmi::PreparedImage(image_)){};
+
+  ~PreparedImageTest(){};
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  bool FlashImage(Schmi::Stm32Emulator& emulator, Schmi::BinaryFileInterface& bin) {
+    Schmi::FlashLoader fl(&emulator, &bin, &error_, &bar_);
+    emulator.Reset();
+    fl.Init();
+    return fl.Flash(true, false);
+  };
+
+  std::vector<uint8_t> image_;
+  std::shared_ptr<const Schmi::PreparedImage> prepared_;
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+};
+
+TEST_F(PreparedImageTest, FramesAreTheOnesWriteMemorySends) {
+  ASSERT_EQ(40, prepared_->GetNumChunks());
+
+  uint8_t frame[Schmi::Stm32::MAX_WRITE_FRAME_SIZE];
+  for (uint32_t chunk = 0; chunk < prepared_->GetNumChunks(); chunk++) {
+    uint16_t num_bytes = chunk == 39 ? 233 : 256;
+    uint16_t frame_length = Schmi::Stm32::BuildWriteFrame(&image_[chunk * 256], num_bytes, frame);
+    ASSERT_EQ(frame_length, prepared_->GetFrameLength(chunk));
+    EXPECT_TRUE(std::equal(frame, frame + frame_length, prepared_->GetFrame(chunk)));
+  }
+
+  // 233 bytes go out as 236, N is 235
+  EXPECT_EQ(238, prepared_->GetFrameLength(39));
+  EXPECT_EQ(235, prepared_->GetFrame(39)[0]);
+  EXPECT_EQ(0xFF, prepared_->GetFrame(39)[1 + 233]);
+
+  // Read from a source that can't be read twice, same frames
+  Schmi::BinaryFileMemory bin(image_);
+  Schmi::PreparedImage from_bin(bin);
+  EXPECT_EQ(image_.size(), from_bin.GetSize());
+  EXPECT_TRUE(std::equal(prepared_->GetFrame(39), prepared_->GetFrame(39) + 238, from_bin.GetFrame(39)));
+}
+
+TEST_F(PreparedImageTest, PatchesOnlyRebuildTheChunksTheyTouch) {
+  Schmi::PatchedImage board(prepared_);
+  uint8_t serial[8] = {'I', 'Q', '0', '0', '4', '2', 0, 0};
+  // Across the boundary of chunks 3 and 4
+  ASSERT_TRUE(board.AddPatch(4 * 256 - 3, serial, sizeof(serial)));
+  uint8_t calibration[2] = {0x12, 0x34};
+  ASSERT_TRUE(board.AddPatch(4 * 256 + 10, calibration, sizeof(calibration)));
+  EXPECT_FALSE(board.AddPatch(image_.size() - 1, calibration, sizeof(calibration)));
+  EXPECT_EQ(2, board.GetNumPatchedChunks());
+
+  std::vector<uint8_t> expected = image_;
+  std::copy(serial, serial + sizeof(serial), expected.begin() + 4 * 256 - 3);
+  std::copy(calibration, calibration + sizeof(calibration), expected.begin() + 4 * 256 + 10);
+
+  std::vector<uint8_t> bytes(image_.size());
+  board.GetBytesArray(bytes.data(), {(uint32_t)bytes.size(), 0});
+  EXPECT_EQ(expected, bytes);
+  board.GetBytesArray(bytes.data(), {100, 4 * 256 - 50});
+  EXPECT_TRUE(std::equal(bytes.begin(), bytes.begin() + 100, expected.begin() + 4 * 256 - 50));
+
+  // Nothing is read past the end of the image
+  board.GetBytesArray(bytes.data(), {100, (uint32_t)image_.size() - 50});
+  EXPECT_TRUE(std::all_of(bytes.begin(), bytes.begin() + 100, [](uint8_t byte) { return byte == 0xFF; }));
+  board.GetBytesArray(bytes.data(), {100, UINT32_MAX});
+  EXPECT_TRUE(std::all_of(bytes.begin(), bytes.begin() + 100, [](uint8_t byte) { return byte == 0xFF; }));
+
+  // Untouched chunks hand out the shared frames, patched ones their own
+  uint16_t frame_length;
+  EXPECT_EQ(prepared_->GetFrame(2), board.GetWriteFrame({256, 2 * 256}, frame_length));
+  const uint8_t* patched = board.GetWriteFrame({256, 4 * 256}, frame_length);
+  EXPECT_NE(prepared_->GetFrame(4), patched);
+  uint8_t frame[Schmi::Stm32::MAX_WRITE_FRAME_SIZE];
+  Schmi::Stm32::BuildWriteFrame(&expected[4 * 256], 256, frame);
+  EXPECT_TRUE(std::equal(frame, frame + frame_length, patched));
+
+  // Only whole chunks
+  EXPECT_EQ(nullptr, board.GetWriteFrame({128, 2 * 256}, frame_length));
+  EXPECT_EQ(nullptr, board.GetWriteFrame({256, 2 * 256 + 128}, frame_length));
+
+  board.ClearPatches();
+  EXPECT_EQ(prepared_->GetFrame(4), board.GetWriteFrame({256, 4 * 256}, frame_length));
+}
+
+TEST_F(PreparedImageTest, BoardsGetTheirOwnSerialFromOneImage) {
+  Schmi::EmulatorConfig config;
+  config.checksum_command = true;
+  Schmi::Stm32Emulator first(clock_);
+  Schmi::Stm32Emulator second(clock_, config);
+
+  // The serial sits in the last, partial chunk, where the padding has to follow it
+  uint8_t serial[4] = {0xA1, 0xA2, 0xA3, 0xA4};
+  Schmi::PatchedImage first_board(prepared_);
+  ASSERT_TRUE(first_board.AddPatch(image_.size() - 5, serial, sizeof(serial)));
+  serial[3] = 0xB4;
+  Schmi::PatchedImage second_board(prepared_);
+  ASSERT_TRUE(second_board.AddPatch(image_.size() - 5, serial, sizeof(serial)));
+
+  // Read-back verify on the first, GET_CHECKSUM on the second
+  ASSERT_TRUE(FlashImage(first, first_board));
+  ASSERT_TRUE(FlashImage(second, second_board));
+  EXPECT_EQ(0xA4, first.GetFlash()[image_.size() - 2]);
+  EXPECT_EQ(0xB4, second.GetFlash()[image_.size() - 2]);
+  EXPECT_TRUE(std::equal(image_.begin(), image_.end() - 5, second.GetFlash()));
+  EXPECT_EQ(image_.back(), second.GetFlash()[image_.size() - 1]);
+  EXPECT_TRUE(second.IsRunning());
+
+  EXPECT_EQ(1, second_board.GetNumPatchedChunks());
+}
@@ -0,0 +1,157 @@
+#include "Schmi/serial_tcp.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/emulator_tcp_server.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/event_ring.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/latency_histogram.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+class SerialTcpTest : public ::testing::Test {
+ protected:
+  // Every fourth byte is 0xFF, the telnet escape
+  SerialTcpTest() : board_(board_clock_), image_(20000) {
+    for (uint32_t ii = 0; ii < image_.size(); ii++) {
+      image_[ii] = ii % 4 ? ii * 7 : 0xFF;
+    }
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  bool FlashImage(Schmi::SerialInterface& ser) {
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(&ser, &bin, &error_, &bar_);
+    fl.SetClock(&clock_);
+    fl.SetLatencyHistogram(&latency_);
+    fl.Init();
+    bool flashed = fl.Flash(true, false);
+
+    return flashed && std::equal(image_.begin(), image_.end(), board_.GetFlash());
+  };
+
+  // The emulator only runs on the server thread, its clock isn't the one the round trips are timed on
+  Schmi::SimClock board_clock_;
+  Schmi::Stm32Emulator board_;
+  Schmi::ClockStd clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  Schmi::LatencyHistogram latency_;
+  std::vector<uint8_t> image_;
+};
+
+TEST(TelnetTest, DecodesAcrossSegments) {
+  std::vector<uint8_t> stream = {0x79, 0x42};
+  Schmi::Telnet::AppendEscaped(std::vector<uint8_t>{0xFF, 0x01, 0xFF}.data(), 3, stream);
+  Schmi::Telnet::AppendNegotiation(Schmi::Telnet::DO, Schmi::Telnet::COM_PORT_OPTION, stream);
+  Schmi::Telnet::AppendSubnegotiation(Schmi::Telnet::COM_PORT_OPTION, {101, 0x00, 0x01, 0xC2, 0xFF}, stream);
+  stream.push_back(0x1F);
+
+  // Byte by byte, every command is cut somewhere
+  Schmi::Telnet::Decoder decoder;
+  std::vector<uint8_t> data;
+  std::vector<Schmi::Telnet::Command> commands;
+  for (uint8_t byte : stream) {
+    decoder.Decode(&byte, 1, data, commands);
+  }
+
+  EXPECT_THAT(data, ::testing::ElementsAre(0x79, 0x42, 0xFF, 0x01, 0xFF, 0x1F));
+  ASSERT_EQ(2, commands.size());
+  EXPECT_EQ(Schmi::Telnet::DO, commands[0].verb);
+  EXPECT_EQ(Schmi::Telnet::COM_PORT_OPTION, commands[0].option);
+  EXPECT_EQ(Schmi::Telnet::SB, commands[1].verb);
+  EXPECT_THAT(commands[1].payload, ::testing::ElementsAre(101, 0x00, 0x01, 0xC2, 0xFF));
+}
+
+TEST(SerialTcpAddressTest, TakesTcpAndRfc2217Names) {
+  std::string host;
+  uint16_t port = 0;
+  bool rfc2217 = true;
+  ASSERT_TRUE(Schmi::SerialTcp::ParseAddress("tcp:bench-3.local:2001", host, port, rfc2217));
+  EXPECT_EQ("bench-3.local", host);
+  EXPECT_EQ(2001, port);
+  EXPECT_FALSE(rfc2217);
+  ASSERT_TRUE(Schmi::SerialTcp::ParseAddress("rfc2217:10.0.0.7:7000", host, port, rfc2217));
+  EXPECT_EQ("10.0.0.7", host);
+  EXPECT_TRUE(rfc2217);
+
+  EXPECT_FALSE(Schmi::SerialTcp::ParseAddress("/dev/ttyUSB0", host, port, rfc2217));
+  EXPECT_FALSE(Schmi::SerialTcp::ParseAddress("tcp:host", host, port, rfc2217));
+  EXPECT_FALSE(Schmi::SerialTcp::ParseAddress("tcp:host:70000", host, port, rfc2217));
+  EXPECT_FALSE(Schmi::SerialTcp::ParseAddress("udp:host:2001", host, port, rfc2217));
+}
+
+TEST_F(SerialTcpTest, FlashesThroughARawServer) {
+  Schmi::EmulatorTcpServer server(board_);
+  ASSERT_TRUE(server.Start());
+  Schmi::SerialTcp ser("127.0.0.1", server.GetPort());
+  ASSERT_TRUE(ser.Open());
+
+  EXPECT_FALSE(ser.SetBaudRate(921600));
+  ASSERT_TRUE(FlashImage(ser));
+
+  // Loopback and no Nagle: an ACK comes back in well under a millisecond, this leaves room for a
+  // loaded machine
+  EXPECT_GT(latency_.GetCount(), 80);
+  EXPECT_LT(latency_.GetPercentileUs(50), 20000);
+}
+
+TEST_F(SerialTcpTest, Rfc2217SetsTheLineUpAndEscapesData) {
+  Schmi::EmulatorTcpServer server(board_, true);
+  ASSERT_TRUE(server.Start());
+  Schmi::SerialTcpOptions options;
+  options.rfc2217 = true;
+  Schmi::SerialTcp ser("127.0.0.1", server.GetPort(), options);
+  ASSERT_TRUE(ser.Open());
+  EXPECT_EQ(115200, server.GetBaudRate());
+
+  ASSERT_TRUE(ser.SetBaudRate(921600));
+  EXPECT_EQ(921600, server.GetBaudRate());
+  ASSERT_TRUE(ser.SetBaudRate(115200));
+
+  ASSERT_TRUE(FlashImage(ser));
+  EXPECT_GT(latency_.GetCount(), 80);
+}
+
+TEST_F(SerialTcpTest, ClosedConnectionIsToldApartAndReopened) {
+  Schmi::EmulatorTcpServer server(board_);
+  ASSERT_TRUE(server.Start());
+  uint16_t port = server.GetPort();
+  Schmi::SerialTcp ser("127.0.0.1", port);
+  Schmi::EventRing ring;
+  ser.SetEventRing(&ring);
+  ASSERT_TRUE(ser.Open());
+
+  // Nothing is sent: a timeout, the connection stays
+  uint8_t byte;
+  EXPECT_EQ(-1, ser.Read(&byte, 1, 20));
+  Schmi::SessionEvent event;
+  ASSERT_TRUE(ring.Pop(event));
+  EXPECT_STREQ("Read Timout", event.text);
+
+  // The server goes away: told at once rather than after the whole timeout
+  server.Stop();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  EXPECT_EQ(-1, ser.Read(&byte, 1, 5000));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+  ASSERT_TRUE(ring.Pop(event));
+  EXPECT_STREQ("Connection closed", event.text);
+  EXPECT_FALSE(ring.Pop(event));
+
+  // Back on the same port, the next Open connects again
+  ASSERT_TRUE(server.Start(port));
+  ASSERT_TRUE(ser.Open());
+  ASSERT_TRUE(FlashImage(ser));
+}
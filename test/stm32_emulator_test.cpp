@@ -0,0 +1,201 @@
+#include "Schmi/stm32_emulator.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_std.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_std.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32.hpp"
+
+#include <vector>
+
+using ::testing::ElementsAreArray;
+
+class Stm32EmulatorTest : public ::testing::Test {
+ protected:
+  Stm32EmulatorTest() {
+    emulator_ = new Schmi::Stm32Emulator(clock_);
+    stm32_ = new Schmi::Stm32(*emulator_, error_);
+  };
+
+  ~Stm32EmulatorTest() {
+    delete stm32_;
+    delete emulator_;
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::Stm32Emulator* emulator_;
+  Schmi::Stm32* stm32_;
+};
+
+TEST_F(Stm32EmulatorTest, InitUsartAndGetID) {
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  uint16_t id;
+  ASSERT_TRUE(stm32_->GetID(id));
+  EXPECT_EQ(emulator_->GetConfig().product_id, id);
+}
+
+TEST_F(Stm32EmulatorTest, NoAnswerBeforeSync) {
+  uint16_t id;
+  EXPECT_FALSE(stm32_->GetID(id));
+  EXPECT_FALSE(error_.HasDied());
+}
+
+TEST_F(Stm32EmulatorTest, WriteThenReadMemory) {
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  uint8_t bytes[16];
+  for (int ii = 0; ii < 16; ii++) bytes[ii] = ii;
+  ASSERT_TRUE(stm32_->WriteMemory(bytes, 16, 0x08000100));
+
+  uint8_t read_back[16];
+  ASSERT_TRUE(stm32_->ReadMemory(read_back, 16, 0x08000100));
+  EXPECT_THAT(read_back, ElementsAreArray(bytes));
+}
+
+TEST_F(Stm32EmulatorTest, WriteWithoutEraseOnlyClearsBits) {
+  ASSERT_TRUE(stm32_->InitUsart());
+  emulator_->FillFlash(0x0F);
+
+  uint8_t bytes[4] = {0xF0, 0xFF, 0x03, 0x00};
+  ASSERT_TRUE(stm32_->WriteMemory(bytes, 4, 0x08000000));
+
+  const uint8_t* flash = emulator_->GetFlash();
+  EXPECT_EQ(0x00, flash[0]);
+  EXPECT_EQ(0x0F, flash[1]);
+  EXPECT_EQ(0x03, flash[2]);
+  EXPECT_EQ(0x00, flash[3]);
+}
+
+TEST_F(Stm32EmulatorTest, WriteOfUnalignedLengthIsPadded) {
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  uint8_t bytes[5] = {1, 2, 3, 4, 5};
+  ASSERT_TRUE(stm32_->WriteMemory(bytes, 5, 0x08000000));
+
+  const uint8_t* flash = emulator_->GetFlash();
+  EXPECT_EQ(5, flash[4]);
+  EXPECT_EQ(0xFF, flash[5]);
+  EXPECT_EQ(8, emulator_->GetStats().bytes_programmed);
+}
+
+TEST_F(Stm32EmulatorTest, ExtendedEraseErasesListedPages) {
+  ASSERT_TRUE(stm32_->InitUsart());
+  emulator_->FillFlash(0x00);
+
+  uint16_t page_codes[2] = {1, 3};
+  ASSERT_TRUE(stm32_->ExtendedErase(page_codes, 2));
+
+  uint32_t page_size = emulator_->GetConfig().page_size;
+  const uint8_t* flash = emulator_->GetFlash();
+  EXPECT_EQ(0x00, flash[0]);
+  EXPECT_EQ(0xFF, flash[page_size]);
+  EXPECT_EQ(0x00, flash[2 * page_size]);
+  EXPECT_EQ(0xFF, flash[4 * page_size - 1]);
+  EXPECT_EQ(2, emulator_->GetStats().pages_erased);
+}
+
+TEST_F(Stm32EmulatorTest, BadChecksumIsNacked) {
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  uint8_t address_message[5] = {0x08, 0x00, 0x00, 0x00, 0x00};  // checksum should be 0x08
+  uint8_t read_cmd[2] = {Schmi::CMD::READ_MEMORY[0], Schmi::CMD::READ_MEMORY[1]};
+  uint8_t answer[1];
+  emulator_->Write(read_cmd, 2);
+  ASSERT_EQ(0, emulator_->Read(answer, 1));
+  emulator_->Write(address_message, 5);
+  ASSERT_EQ(0, emulator_->Read(answer, 1));
+
+  EXPECT_EQ(Schmi::CMD::NACK, answer[0]);
+  EXPECT_EQ(1, emulator_->GetStats().nacks);
+}
+
+TEST_F(Stm32EmulatorTest, ConnectFindsSyncedBootloader) {
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  Schmi::ConnectResult result;
+  ASSERT_TRUE(stm32_->Connect(result));
+  EXPECT_EQ(1, result.attempts);
+  EXPECT_TRUE(result.was_synced);
+
+  uint16_t id;
+  EXPECT_TRUE(stm32_->GetID(id));
+}
+
+TEST_F(Stm32EmulatorTest, ConnectDropsStaleInput) {
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  // Answer to a GET_ID nobody read, like after an aborted session
+  uint8_t get_id[2] = {Schmi::CMD::GET_ID[0], Schmi::CMD::GET_ID[1]};
+  emulator_->Write(get_id, 2);
+
+  Schmi::ConnectResult result;
+  ASSERT_TRUE(stm32_->Connect(result));
+  EXPECT_TRUE(result.was_synced);
+
+  uint16_t id;
+  ASSERT_TRUE(stm32_->GetID(id));
+  EXPECT_EQ(emulator_->GetConfig().product_id, id);
+}
+
+TEST_F(Stm32EmulatorTest, ConnectRetriesWhileChipBoots) {
+  Schmi::EmulatorConfig config;
+  config.boot_us = 120000;
+  Schmi::Stm32Emulator booting(clock_, config);
+  Schmi::Stm32 stm32(booting, error_);
+  stm32.SetClock(&clock_);
+
+  Schmi::ConnectResult result;
+  ASSERT_TRUE(stm32.Connect(result));
+  EXPECT_GT(result.attempts, 1);
+  EXPECT_FALSE(result.was_synced);
+  EXPECT_GE(result.latency_us, config.boot_us);
+  EXPECT_LT(result.latency_us, 2 * config.boot_us);
+
+  // The round trip was a couple of ms, the next Connect starts with a short timeout
+  EXPECT_EQ(Schmi::Stm32::CONNECT_MIN_TIMEOUT_MS, stm32.GetConnectTimeoutMs());
+
+  // A single InitUsart would have waited its whole timeout and failed
+  booting.Reset();
+  EXPECT_FALSE(stm32.InitUsart());
+}
+
+TEST_F(Stm32EmulatorTest, ConnectGivesUpWithoutAnswer) {
+  Schmi::EmulatorConfig config;
+  config.boot_us = 60000000;
+  Schmi::Stm32Emulator dead(clock_, config);
+  Schmi::Stm32 stm32(dead, error_);
+
+  Schmi::ConnectResult result;
+  EXPECT_FALSE(stm32.Connect(result));
+  EXPECT_EQ(Schmi::Stm32::CONNECT_MAX_ATTEMPTS, result.attempts);
+  EXPECT_TRUE(error_.HasDied());
+}
+
+TEST_F(Stm32EmulatorTest, FlashLoaderFlashesImage) {
+  Schmi::BinaryFileStd bin("../test_files/1048583_V6-3.bin");
+  Schmi::LoadingBarStd bar;
+  Schmi::FlashLoader fl(emulator_, &bin, &error_, &bar);
+  emulator_->FillFlash(0x00);
+
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  uint64_t size = bin.GetBinaryFileSize();
+  std::vector<uint8_t> image(size);
+  bin.GetBytesArray(image.data(), {(uint32_t)size, 0});
+  std::vector<uint8_t> flash(emulator_->GetFlash(), emulator_->GetFlash() + size);
+  EXPECT_EQ(image, flash);
+  EXPECT_TRUE(emulator_->IsRunning());
+  EXPECT_EQ(0x08000000, emulator_->GetGoAddress());
+  EXPECT_GT(clock_.NowUs(), 0);
+}
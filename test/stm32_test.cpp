@@ -284,7 +284,7 @@ TEST_F(Stm32Test, ExtendedErase_SerialCalls) {
         .WillOnce(Return(0));
 
     // ACK check
-    EXPECT_CALL(mock_ser_, Read(_, 1, 1000))
+    EXPECT_CALL(mock_ser_, Read(_, 1, 8000))
         .Times(1)
         .WillOnce(DoAll(SetArrayArgument<0>(incoming_ACK, incoming_ACK + 1), Return(0)));
 
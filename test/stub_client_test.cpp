@@ -0,0 +1,225 @@
+#include "Schmi/stub_client.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/crc32.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/fault_injecting_serial.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "test_images.hpp"
+
+#include <vector>
+
+namespace {
+
+// Every few requests, the answers the stub has sent so far are lost on the way back
+class LosingSerial : public Schmi::SerialInterface {
+ public:
+  LosingSerial(Schmi::SerialInterface& ser, const uint32_t& every) : ser_(ser), every_(every){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    int result = ser_.Write(buffer, buffer_length);
+    if (++num_writes_ % every_ == 0) {
+      ser_.FlushInput();
+    }
+    return result;
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+
+ private:
+  Schmi::SerialInterface& ser_;
+  uint32_t every_;
+  uint32_t num_writes_ = 0;
+};
+}  // namespace
+
+class StubClientTest : public ::testing::Test {
+ protected:
+  StubClientTest() : stub_image_(Schmi::Stm32Emulator::MakeStubImage()), image_(MakeImage(100000)) {
+    emulator_ = new Schmi::Stm32Emulator(clock_);
+    stm32_ = new Schmi::Stm32(*emulator_, error_);
+    emulator_->FillFlash(0x00);
+  };
+
+  ~StubClientTest() {
+    delete stm32_;
+    delete emulator_;
+  };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  // Flash time of the image, with or without the stub
+  uint64_t FlashImage(const bool& use_stub, const uint32_t& baud_rate = 0) {
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(emulator_, &bin, &error_, &bar_);
+    if (use_stub) {
+      fl.SetStub(&stub_image_, baud_rate);
+    }
+
+    emulator_->Reset();
+    emulator_->FillFlash(0x00);
+    uint64_t start_us = clock_.NowUs();
+    fl.Init();
+    if (!fl.Flash(true, false)) {
+      return 0;
+    }
+
+    return clock_.NowUs() - start_us;
+  };
+
+  bool FlashMatchesImage() {
+    return std::equal(image_.begin(), image_.end(), emulator_->GetFlash());
+  };
+
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+  Schmi::BinaryFileMemory stub_image_;
+  std::vector<uint8_t> image_;
+  Schmi::Stm32Emulator* emulator_;
+  Schmi::Stm32* stm32_;
+};
+
+TEST_F(StubClientTest, UploadStartsStub) {
+  Schmi::StubClient stub(*emulator_, error_);
+  ASSERT_TRUE(stm32_->InitUsart());
+  ASSERT_TRUE(stub.Upload(*stm32_, stub_image_, Schmi::StubProtocol::DEFAULT_LOAD_ADDRESS));
+  EXPECT_TRUE(emulator_->IsStubRunning());
+
+  Schmi::StubInfo info;
+  ASSERT_TRUE(stub.Ping(info));
+  EXPECT_EQ(Schmi::StubProtocol::VERSION, info.version);
+  EXPECT_EQ(Schmi::StubProtocol::MAX_BLOCK_SIZE, info.max_block_size);
+}
+
+TEST_F(StubClientTest, ImageWithoutHeaderIsRejected) {
+  Schmi::BinaryFileMemory not_a_stub(std::vector<uint8_t>(256, 0xAB));
+  Schmi::StubClient stub(*emulator_, error_);
+  ASSERT_TRUE(stm32_->InitUsart());
+
+  EXPECT_FALSE(stub.Upload(*stm32_, not_a_stub, Schmi::StubProtocol::DEFAULT_LOAD_ADDRESS));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_FALSE(emulator_->IsStubRunning());
+}
+
+TEST_F(StubClientTest, EraseWriteAndCrc) {
+  Schmi::StubClient stub(*emulator_, error_);
+  ASSERT_TRUE(stm32_->InitUsart());
+  ASSERT_TRUE(stub.Upload(*stm32_, stub_image_, Schmi::StubProtocol::DEFAULT_LOAD_ADDRESS));
+
+  ASSERT_TRUE(stub.Erase(0x08000800, 4096, 1000));
+  EXPECT_EQ(2, emulator_->GetStats().pages_erased);
+  EXPECT_EQ(0x00, emulator_->GetFlash()[0x7FF]);
+  EXPECT_EQ(0xFF, emulator_->GetFlash()[0x800]);
+
+  for (uint32_t pos = 0; pos < 4096; pos += 1000) {
+    uint16_t num_bytes = 4096 - pos < 1000 ? 4096 - pos : 1000;
+    ASSERT_TRUE(stub.QueueWrite(image_.data() + pos, num_bytes, 0x08000800 + pos));
+  }
+  ASSERT_TRUE(stub.Flush());
+  EXPECT_TRUE(std::equal(image_.begin(), image_.begin() + 4096, emulator_->GetFlash() + 0x800));
+
+  Schmi::Crc32 expected;
+  expected.Update(image_.data(), 4096);
+  uint32_t crc;
+  ASSERT_TRUE(stub.Crc(0x08000800, 4096, crc, 1000));
+  EXPECT_EQ(expected.Get(), crc);
+  EXPECT_EQ(0, stub.GetStats().retransmits);
+}
+
+TEST_F(StubClientTest, BadAddressIsAnError) {
+  Schmi::StubClient stub(*emulator_, error_);
+  ASSERT_TRUE(stm32_->InitUsart());
+  ASSERT_TRUE(stub.Upload(*stm32_, stub_image_, Schmi::StubProtocol::DEFAULT_LOAD_ADDRESS));
+
+  EXPECT_FALSE(stub.Erase(0x09000000, 2048, 1000));
+  EXPECT_TRUE(error_.HasDied());
+}
+
+TEST_F(StubClientTest, FlashLoaderFlashesThroughStubFasterThanBootloader) {
+  uint64_t bootloader_us = FlashImage(false);
+  ASSERT_GT(bootloader_us, 0);
+  ASSERT_TRUE(FlashMatchesImage());
+
+  uint64_t stub_us = FlashImage(true);
+  ASSERT_GT(stub_us, 0);
+  EXPECT_TRUE(FlashMatchesImage());
+  EXPECT_TRUE(emulator_->IsRunning());
+  EXPECT_EQ(0x08000000, emulator_->GetGoAddress());
+
+  EXPECT_LT(stub_us, bootloader_us);
+}
+
+TEST_F(StubClientTest, HigherBaudRateIsFasterStill) {
+  uint64_t stub_us = FlashImage(true);
+  ASSERT_GT(stub_us, 0);
+
+  uint64_t fast_stub_us = FlashImage(true, 2000000);
+  ASSERT_GT(fast_stub_us, 0);
+  EXPECT_TRUE(FlashMatchesImage());
+  EXPECT_EQ(2000000, emulator_->GetDeviceBaudRate());
+  EXPECT_LT(fast_stub_us * 2, stub_us);
+
+  // The port is back at the bootloader speed for the next board
+  emulator_->Reset();
+  EXPECT_TRUE(stm32_->InitUsart());
+}
+
+TEST_F(StubClientTest, BaudRateTooHighForStubFails) {
+  EXPECT_EQ(0, FlashImage(true, 4000000));
+  EXPECT_TRUE(error_.HasDied());
+  EXPECT_EQ(115200, emulator_->GetDeviceBaudRate());
+}
+
+TEST_F(StubClientTest, CorruptedBlocksAreSentAgain) {
+  Schmi::FaultConfig faults;
+  faults.seed = 3;
+  faults.corrupt_byte_rate = 2e-5;
+  Schmi::FaultInjectingSerial noisy(*emulator_, clock_, faults);
+
+  // Upload on a clean line, the noise only hits the stub framing
+  Schmi::StubClient stub(noisy, error_);
+  ASSERT_TRUE(stm32_->InitUsart());
+  ASSERT_TRUE(stub.Upload(*stm32_, stub_image_, Schmi::StubProtocol::DEFAULT_LOAD_ADDRESS));
+  ASSERT_TRUE(stub.Erase(0x08000000, image_.size(), 5000));
+
+  for (uint32_t pos = 0; pos < image_.size(); pos += 4096) {
+    uint16_t num_bytes = image_.size() - pos < 4096 ? image_.size() - pos : 4096;
+    ASSERT_TRUE(stub.QueueWrite(image_.data() + pos, num_bytes, 0x08000000 + pos));
+  }
+  ASSERT_TRUE(stub.Flush());
+
+  EXPECT_TRUE(FlashMatchesImage());
+  EXPECT_GT(noisy.GetStats().corrupted_bytes, 0);
+  EXPECT_GT(stub.GetStats().retransmits, 0);
+}
+
+TEST_F(StubClientTest, BlocksWhoseAnswerWasLostAreWrittenOnce) {
+  ASSERT_TRUE(stm32_->InitUsart());
+  Schmi::StubClient uploader(*emulator_, error_);
+  ASSERT_TRUE(uploader.Upload(*stm32_, stub_image_, Schmi::StubProtocol::DEFAULT_LOAD_ADDRESS));
+
+  LosingSerial lossy(*emulator_, 5);
+  Schmi::StubClient stub(lossy, error_);
+  ASSERT_TRUE(stub.Erase(0x08000000, image_.size(), 5000));
+  uint64_t programmed = emulator_->GetStats().bytes_programmed;
+  for (uint32_t pos = 0; pos < image_.size(); pos += 4096) {
+    uint16_t num_bytes = image_.size() - pos < 4096 ? image_.size() - pos : 4096;
+    ASSERT_TRUE(stub.QueueWrite(image_.data() + pos, num_bytes, 0x08000000 + pos));
+  }
+  ASSERT_TRUE(stub.Flush());
+
+  EXPECT_TRUE(FlashMatchesImage());
+  EXPECT_GT(stub.GetStats().retransmits, 0);
+  EXPECT_EQ(image_.size(), emulator_->GetStats().bytes_programmed - programmed);
+}
@@ -0,0 +1,20 @@
+#ifndef SCHMI_TEST_TEST_IMAGES_HPP
+#define SCHMI_TEST_TEST_IMAGES_HPP
+
+#include <stdint.h>
+#include <vector>
+
+// An image of size bytes with no pattern a page, a chunk or a write could line up with. Images
+// of other seeds have other bytes, the same seed always gives the same ones.
+inline std::vector<uint8_t> MakeImage(const uint32_t& size, const uint32_t& seed = 0) {
+  std::vector<uint8_t> image(size);
+  uint32_t state = 0x12345678 + seed * 0x9E3779B9;
+  for (uint32_t ii = 0; ii < size; ii++) {
+    state = state * 1103515245 + 12345;
+    image[ii] = state >> 24;
+  }
+
+  return image;
+}
+
+#endif  // SCHMI_TEST_TEST_IMAGES_HPP
@@ -0,0 +1,217 @@
+#include "Schmi/timeout_model.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+#include "Schmi/timeout_model_std.hpp"
+
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A board that stops answering after some writes, like one whose supply browned out, or that
+// answers one of them late, like behind a USB latency timer spike
+class HangingSerial : public Schmi::SerialInterface {
+ public:
+  HangingSerial(Schmi::SerialInterface& ser, Schmi::ClockInterface& clock) : ser_(ser), clock_(clock){};
+
+  void Init() override { ser_.Init(); };
+  int Write(uint8_t* buffer, const uint16_t& buffer_length) override {
+    if (writes_left_ == 0) {
+      hung_at_us_ = hung_at_us_ ? hung_at_us_ : clock_.NowUs();
+      return 0;
+    }
+    if (writes_left_ > 0) {
+      writes_left_--;
+    }
+    if (writes_to_late_ > 0) {
+      writes_to_late_--;
+    }
+    return ser_.Write(buffer, buffer_length);
+  };
+  int Read(uint8_t* buffer, const uint16_t& num_bytes, const uint16_t& timeout_ms) override {
+    // A read that gives up before the late answer comes times out, the answer is still on its way
+    if (writes_to_late_ == 0) {
+      if (late_us_ > (uint64_t)timeout_ms * 1000) {
+        clock_.SleepUs((uint64_t)timeout_ms * 1000);
+        late_us_ -= (uint64_t)timeout_ms * 1000;
+        return -1;
+      }
+      clock_.SleepUs(late_us_);
+      writes_to_late_ = -1;
+    }
+    return ser_.Read(buffer, num_bytes, timeout_ms);
+  };
+  void FlushInput() override { ser_.FlushInput(); };
+
+  void HangAfter(const int32_t& num_writes) { writes_left_ = num_writes; };
+  void AnswerLateAfter(const int32_t& num_writes, const uint64_t& late_us) {
+    writes_to_late_ = num_writes;
+    late_us_ = late_us;
+  };
+  uint64_t GetHungAtUs() const { return hung_at_us_; };
+
+ private:
+  Schmi::SerialInterface& ser_;
+  Schmi::ClockInterface& clock_;
+  int32_t writes_left_ = -1;
+  int32_t writes_to_late_ = -1;
+  uint64_t late_us_ = 0;
+  uint64_t hung_at_us_ = 0;
+};
+}  // namespace
+
+class TimeoutModelTest : public ::testing::Test {
+ protected:
+  TimeoutModelTest() : image_(20000, 0xA5), file_name_("/tmp/schmi_timeouts_test_" + std::to_string(getpid())){};
+
+  ~TimeoutModelTest() { unlink(file_name_.c_str()); };
+
+  void SetUp() override{};
+
+  void TearDown() override{};
+
+  // Flashes a board and tells how long it took to be given up after its first lost write, 0 if it didn't hang
+  uint64_t FlashBoard(Schmi::TimeoutModel* model, const int32_t& hang_after_writes = -1,
+                      const int32_t& late_after_writes = -1, const uint64_t& late_us = 0) {
+    Schmi::Stm32Emulator emulator(clock_);
+    HangingSerial ser(emulator, clock_);
+    ser.HangAfter(hang_after_writes);
+    ser.AnswerLateAfter(late_after_writes, late_us);
+    Schmi::BinaryFileMemory bin(image_);
+    Schmi::FlashLoader fl(&ser, &bin, &error_, &bar_);
+    fl.SetClock(&clock_);
+    fl.SetTimeoutModel(model);
+
+    fl.Init();
+    bool flashed = fl.Flash(true, false);
+    EXPECT_EQ(hang_after_writes < 0, flashed);
+
+    return flashed ? 0 : clock_.NowUs() - ser.GetHungAtUs();
+  };
+
+  std::vector<uint8_t> image_;
+  std::string file_name_;
+  Schmi::SimClock clock_;
+  Schmi::ErrorHandlerCapture error_;
+  Schmi::LoadingBarNull bar_;
+};
+
+TEST_F(TimeoutModelTest, DeadlinesFollowTheSamples) {
+  Schmi::TimeoutModel model(115200);
+  model.SetChip(0x468);
+
+  // Not enough samples yet
+  for (uint16_t ii = 0; ii < Schmi::TimeoutModel::MIN_SAMPLES - 1; ii++) {
+    model.Record(Schmi::WaitKind::kAck, 1, 2, 1000 + 191);
+  }
+  EXPECT_EQ(500, model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 2, 500));
+
+  // 2 * (1 ms + wire time of the 2 bytes) + 2 ms, then the floor
+  model.Record(Schmi::WaitKind::kAck, 1, 2, 1000 + 191);
+  EXPECT_EQ(5, model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 2, 500));
+  // 256 bytes take 24.4 ms on the wire
+  EXPECT_EQ(53, model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 256, 500));
+  // Never more than the fixed timeout
+  EXPECT_EQ(40, model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 256, 40));
+
+  // Erase is learned per page and scaled by the pages of the next one
+  for (uint16_t ii = 0; ii < Schmi::TimeoutModel::MIN_SAMPLES; ii++) {
+    model.Record(Schmi::WaitKind::kErase, 4, 0, 4 * 20000);
+  }
+  EXPECT_NEAR(2 * 100 * 20 + 2, model.GetDeadlineMs(Schmi::WaitKind::kErase, 100, 0, 60000), 2 * 100 * 20 / 8);
+
+  // Another chip starts over, the first one is kept
+  model.SetChip(0x415);
+  EXPECT_EQ(500, model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 2, 500));
+  model.SetChip(0x468);
+  EXPECT_EQ(5, model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 2, 500));
+  EXPECT_EQ(2, model.GetNumChips());
+}
+
+TEST_F(TimeoutModelTest, HungBoardIsGivenUpInMilliseconds) {
+  // Without a model the board gets the full fixed timeout
+  uint64_t fixed_us = FlashBoard(nullptr, 200);
+  EXPECT_GE(fixed_us, 500000);
+
+  Schmi::TimeoutModel model;
+  FlashBoard(&model);
+  FlashBoard(&model);
+  EXPECT_EQ(0x468, model.GetChip());
+  EXPECT_GE(model.GetLatency(Schmi::WaitKind::kAck).GetCount(), Schmi::TimeoutModel::MIN_SAMPLES);
+  EXPECT_GE(model.GetLatency(Schmi::WaitKind::kWrite).GetCount(), Schmi::TimeoutModel::MIN_SAMPLES);
+  EXPECT_EQ(0, model.GetNumMisses());
+
+  // Hangs at each of the three frames of a WRITE_MEMORY: the ACK of a command or an address is
+  // given up after its deadline and the extension, a data frame gets its wire time and
+  // programming on top
+  std::vector<uint64_t> learned_us;
+  for (int32_t hang_after_writes = 200; hang_after_writes < 203; hang_after_writes++) {
+    learned_us.push_back(FlashBoard(&model, hang_after_writes));
+  }
+  std::sort(learned_us.begin(), learned_us.end());
+  EXPECT_LT(learned_us[0], 30000);
+  EXPECT_LT(learned_us[1], 30000);
+  EXPECT_LT(learned_us[2], 160000);
+
+  // Healthy boards still flash with the learned deadlines
+  FlashBoard(&model);
+}
+
+TEST_F(TimeoutModelTest, LateAnswerIsWaitedForAndWidensTheDeadline) {
+  Schmi::TimeoutModel model;
+  FlashBoard(&model);
+  FlashBoard(&model);
+  uint16_t learned_ms = model.GetDeadlineMs(Schmi::WaitKind::kAck, 1, 2, 500);
+  EXPECT_LT(learned_ms, 10);
+  EXPECT_EQ(20, Schmi::TimeoutModel::GetExtensionMs(learned_ms, 500));
+  EXPECT_EQ(40, Schmi::TimeoutModel::GetExtensionMs(40, 500));
+  EXPECT_EQ(200, Schmi::TimeoutModel::GetExtensionMs(300, 500));
+  EXPECT_EQ(0, Schmi::TimeoutModel::GetExtensionMs(500, 500));
+
+  // One ACK 15 ms late, past the learned deadline but within the extension: the board is still
+  // flashed, and the late answer is a sample like the others
+  FlashBoard(&model, -1, 200, 15000);
+  EXPECT_EQ(1, model.GetNumMisses());
+  EXPECT_GE(model.GetLatency(Schmi::WaitKind::kAck).GetMaxUs() + model.GetLatency(Schmi::WaitKind::kWrite).GetMaxUs(),
+            15000);
+
+  // Healthy boards still flash
+  FlashBoard(&model);
+}
+
+TEST_F(TimeoutModelTest, LearnedValuesSurviveARestart) {
+  Schmi::TimeoutModel model;
+  FlashBoard(&model);
+  FlashBoard(&model);
+  ASSERT_TRUE(Schmi::SaveTimeoutModel(file_name_, model));
+
+  Schmi::TimeoutModel loaded;
+  ASSERT_TRUE(Schmi::LoadTimeoutModel(file_name_, loaded));
+  loaded.SetChip(0x468);
+  for (uint8_t kind = 0; kind < Schmi::TimeoutModel::NUM_KINDS; kind++) {
+    Schmi::WaitKind wait = (Schmi::WaitKind)kind;
+    EXPECT_EQ(model.GetLatency(wait).GetCount(), loaded.GetLatency(wait).GetCount());
+    EXPECT_EQ(model.GetDeadlineMs(wait, 1, 256, 500), loaded.GetDeadlineMs(wait, 1, 256, 500));
+  }
+
+  // Nothing to load is an empty model
+  Schmi::TimeoutModel empty;
+  EXPECT_TRUE(Schmi::LoadTimeoutModel(file_name_ + ".missing", empty));
+  EXPECT_EQ(0, empty.GetLatency(Schmi::WaitKind::kAck).GetCount());
+
+  // The first board on the loaded model already meets the learned deadlines, and a hung one is
+  // given up as quickly
+  FlashBoard(&loaded);
+  EXPECT_EQ(0, loaded.GetNumMisses());
+  EXPECT_LT(FlashBoard(&loaded, 200), 160000);
+}
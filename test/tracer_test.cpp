@@ -0,0 +1,155 @@
+#include "Schmi/tracer.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Schmi/binary_file_memory.hpp"
+#include "Schmi/clock_std.hpp"
+#include "Schmi/error_handler_capture.hpp"
+#include "Schmi/flash_loader.hpp"
+#include "Schmi/loading_bar_null.hpp"
+#include "Schmi/sim_clock.hpp"
+#include "Schmi/stm32_emulator.hpp"
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Spans by name, each one inside the span of that name below it, if any
+std::map<std::string, uint32_t> CountSpans(const std::vector<Schmi::TraceEvent>& events,
+                                           const std::map<std::string, std::string>& parents = {}) {
+  std::map<std::string, uint32_t> counts;
+  std::map<std::string, Schmi::TraceEvent> last;
+  for (const auto& event : events) {
+    counts[event.name]++;
+    last[event.name] = event;
+
+    auto parent = parents.find(event.name);
+    if (parent != parents.end()) {
+      EXPECT_EQ(1, last.count(parent->second)) << event.name;
+      const Schmi::TraceEvent& outer = last[parent->second];
+      EXPECT_LE(outer.ts_us, event.ts_us) << event.name;
+      EXPECT_LE(event.ts_us + event.duration_us, outer.ts_us + outer.duration_us) << event.name;
+    }
+  }
+
+  return counts;
+}
+
+size_t CountOf(const std::string& text, const std::string& pattern) {
+  size_t count = 0;
+  for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+    count++;
+  }
+
+  return count;
+}
+}  // namespace
+
+TEST(TracerTest, SessionPhasesAndCommandsAreSpans) {
+  Schmi::SimClock clock;
+  Schmi::Stm32Emulator emulator(clock);
+  std::vector<uint8_t> image(10000, 0x3C);
+  Schmi::BinaryFileMemory bin(image);
+  Schmi::ErrorHandlerCapture error;
+  Schmi::LoadingBarNull bar;
+
+  Schmi::Tracer tracer(clock);
+  Schmi::FlashLoader fl(&emulator, &bin, &error, &bar);
+  fl.SetClock(&clock);
+  fl.SetTracer(&tracer, tracer.AddPort("/dev/ttyUSB0"));
+  fl.Init();
+  ASSERT_TRUE(fl.Flash(true, false));
+
+  std::vector<Schmi::TraceEvent> events = tracer.GetEvents();
+  std::map<std::string, uint32_t> spans =
+      CountSpans(events, {{"write", "flash"}, {"WRITE_MEMORY", "write"}, {"READ_MEMORY", "verify"}});
+  EXPECT_EQ(1, spans["init"]);
+  EXPECT_EQ(1, spans["flash"]);
+  EXPECT_EQ(1, spans["erase"]);
+  EXPECT_EQ(1, spans["write"]);
+  EXPECT_EQ(1, spans["verify"]);
+  EXPECT_EQ(1, spans["CONNECT"]);
+  EXPECT_EQ(1, spans["GO"]);
+  EXPECT_EQ(40, spans["WRITE_MEMORY"]);
+  EXPECT_EQ(40, spans["READ_MEMORY"]);
+  EXPECT_GE(spans["EXTEND_ERASE"], 1);
+  EXPECT_GE(spans["ACK"], 3 * 40);
+
+  // On the sim clock, so the timestamps follow the emulated wire time
+  for (size_t ii = 1; ii < events.size(); ii++) {
+    ASSERT_LE(events[ii - 1].ts_us, events[ii].ts_us);
+  }
+  for (const auto& event : events) {
+    if (std::string(event.name) == "flash") {
+      EXPECT_EQ(clock.NowUs(), event.ts_us + event.duration_us);
+    }
+  }
+  EXPECT_EQ(1, events.front().port);
+  EXPECT_EQ(0, tracer.GetNumDropped());
+}
+
+TEST(TracerTest, PortsInParallelGetTheirOwnRows) {
+  Schmi::SimClock clocks[2];
+  Schmi::Stm32Emulator first(clocks[0]);
+  Schmi::Stm32Emulator second(clocks[1]);
+  Schmi::Stm32Emulator* boards[2] = {&first, &second};
+  std::vector<uint8_t> image(5000, 0xC3);
+
+  // One tracer for both, on the steady clock, the sim clocks are one per thread
+  Schmi::ClockStd steady;
+  Schmi::Tracer tracer(steady);
+  uint32_t ports[2] = {tracer.AddPort("/dev/ttyUSB0"), tracer.AddPort("/dev/\"odd\"")};
+  std::vector<std::thread> sessions;
+  bool flashed[2] = {false, false};
+  for (uint32_t ii = 0; ii < 2; ii++) {
+    sessions.emplace_back([&, ii] {
+      Schmi::BinaryFileMemory bin(image);
+      Schmi::ErrorHandlerCapture error;
+      Schmi::LoadingBarNull bar;
+      Schmi::FlashLoader fl(boards[ii], &bin, &error, &bar);
+      fl.SetTracer(&tracer, ports[ii]);
+      fl.Init();
+      flashed[ii] = fl.Flash(true, false);
+    });
+  }
+  for (auto& session : sessions) {
+    session.join();
+  }
+  ASSERT_TRUE(flashed[0] && flashed[1]);
+
+  std::vector<Schmi::TraceEvent> events = tracer.GetEvents();
+  std::map<uint32_t, uint32_t> threads;
+  for (const auto& event : events) {
+    threads[event.port] = event.thread;
+  }
+  ASSERT_EQ(2, threads.size());
+  EXPECT_NE(threads[1], threads[2]);
+  std::map<std::string, uint32_t> spans = CountSpans(events);
+  EXPECT_EQ(2, spans["flash"]);
+
+  std::string json = tracer.ToChromeTrace();
+  EXPECT_THAT(json, ::testing::StartsWith(
+                        "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":0},\"traceEvents\":["));
+  EXPECT_THAT(json, ::testing::HasSubstr(
+                        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"/dev/\\\"odd\\\"\"}}"));
+  EXPECT_THAT(json, ::testing::HasSubstr("{\"name\":\"write\",\"cat\":\"session\",\"ph\":\"X\",\"ts\":"));
+  EXPECT_EQ(events.size(), CountOf(json, "\"ph\":\"X\""));
+}
+
+TEST(TracerTest, SpansPastTheCapAreCounted) {
+  Schmi::SimClock clock;
+  Schmi::Tracer tracer(clock);
+  uint32_t port = tracer.AddPort("/dev/ttyUSB0");
+  for (uint32_t ii = 0; ii < Schmi::Tracer::MAX_EVENTS + 5; ii++) {
+    Schmi::TraceSpan span(&tracer, port, "ACK", "stm32");
+    clock.SleepUs(1);
+  }
+
+  EXPECT_EQ(Schmi::Tracer::MAX_EVENTS, tracer.GetNumEvents());
+  EXPECT_EQ(5, tracer.GetNumDropped());
+  EXPECT_EQ(1, tracer.GetEvents().back().duration_us);
+}